@@ -0,0 +1,716 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Synthetic MVC stream generator.
+ *
+ * Writes a stream that looks like a 3D Blu-ray's to the extractor: random
+ * base view and dependent view slices, with an OFMD in an MVC nesting SEI
+ * at the start of every GOP. The depths drift slowly like real ones, and
+ * every third plane is left undefined. The same seed always gives the same
+ * stream, so it can be used for benchmarks and to catch regressions.
+ *
+ * Usage: mvcgen [options] <output or '-' for stdout>
+ *   -format <annexb|ts|m2ts|mkv> : Defaults to m2ts.
+ *   -planes # : 3D-Planes in each OFMD. (1-32, defaults to 8)
+ *   -fps #    : The OFMD frame_rate value. (1-4, 6, or 7, defaults to 1)
+ *   -gop #    : Frames in each GOP. (1-127, defaults to 24)
+ *   -size #   : Stops after this many MB. (Defaults to 64)
+ *   -zeros #  : Percentage of slice bytes that are 0. (Defaults to 30)
+ *   -epb #    : Percentage of depth values that are 0, which need emulation
+ *               prevention bytes once two are in a row. (Defaults to 0)
+ *   -seed #
+ */
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+typedef unsigned char BYTE;
+
+#define MAX_PLANES (32)
+#define MAX_GOP_FRAMES (127)
+#define TS_PACKET_SIZE (188)
+#define PID_PMT (0x0100)
+#define PID_BASE (0x1011)
+#define PID_MVC (0x1012)
+#define PSI_INTERVAL (4096) // Packets between each PAT and PMT.
+#define MIN_SLICE_SIZE (2000)
+#define MAX_SLICE_SIZE (20000)
+
+enum streamFormat { FORMAT_ANNEXB, FORMAT_TS, FORMAT_M2TS, FORMAT_MKV };
+
+struct genOptions {
+  enum streamFormat format;
+  int numOfPlanes;
+  int frameRate;
+  int GOPFrames;
+  int64_t size;
+  int zeros;
+  int epb;
+  uint32_t seed;
+  const char *output;
+};
+
+// A growing buffer for one access unit of a view or an MKV Cluster.
+struct byteBuffer {
+  BYTE *data;
+  size_t length;
+  size_t capacity;
+};
+
+struct generator {
+  struct genOptions options;
+  FILE *out;
+  uint32_t random;
+  int depths[MAX_PLANES]; // The current depth of each plane.
+  struct byteBuffer base;
+  struct byteBuffer mvc;
+  BYTE *rbsp; // Unescaped NAL.
+  int64_t written;
+  uint64_t numPackets;
+  int counters[4]; // Continuity counters of the PAT, PMT, and the two views.
+  struct byteBuffer cluster;
+  int64_t clusterFrame; // The first frame in 'cluster'.
+  int64_t frame;
+};
+
+// xorshift, so every run gets the same stream.
+static uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+static int reserve(struct byteBuffer *buffer, size_t extra) {
+  size_t capacity = buffer->capacity > 0 ? buffer->capacity : 65536;
+  BYTE *data;
+
+  if (buffer->length + extra <= buffer->capacity) {
+    return 0;
+  }
+  while (capacity < buffer->length + extra) {
+    capacity *= 2;
+  }
+  data = (BYTE *)realloc(buffer->data, capacity);
+  if (data == NULL) {
+    return -1;
+  }
+  buffer->data = data;
+  buffer->capacity = capacity;
+
+  return 0;
+}
+
+static void writeBE32(BYTE *data, uint32_t value) {
+  data[0] = (BYTE)(value >> 24);
+  data[1] = (BYTE)(value >> 16);
+  data[2] = (BYTE)(value >> 8);
+  data[3] = (BYTE)value;
+}
+
+/*
+ * Appends the NAL in 'rbsp' with emulation prevention bytes added, after a
+ * start code or a 4 byte length for MKV.
+ */
+static int appendNAL(struct generator *gen, struct byteBuffer *buffer,
+                     const BYTE *rbsp, size_t length) {
+  int zeros = 0;
+  BYTE *start;
+  BYTE *out;
+
+  // At worst every third byte is escaped.
+  if (reserve(buffer, 4 + length + length / 2 + 1) == -1) {
+    return -1;
+  }
+  start = buffer->data + buffer->length;
+  out = start + 4;
+  for (size_t x = 0; x < length; x++) {
+    if (zeros >= 2 && rbsp[x] <= 3) {
+      *out++ = 0x03;
+      zeros = 0;
+    }
+    *out++ = rbsp[x];
+    zeros = rbsp[x] == 0 ? zeros + 1 : 0;
+  }
+
+  if (gen->options.format == FORMAT_MKV) {
+    writeBE32(start, (uint32_t)(out - start - 4));
+  } else {
+    memcpy(start, "\x00\x00\x00\x01", 4);
+  }
+  buffer->length = out - buffer->data;
+
+  return 0;
+}
+
+// A slice header byte, then random data, with 'zeros' percent of it 0.
+static int appendSlice(struct generator *gen, struct byteBuffer *buffer,
+                       BYTE header) {
+  size_t length = MIN_SLICE_SIZE +
+                  nextRandom(&gen->random) % (MAX_SLICE_SIZE - MIN_SLICE_SIZE);
+
+  gen->rbsp[0] = header;
+  for (size_t x = 1; x < length; x++) {
+    uint32_t value = nextRandom(&gen->random);
+
+    if ((int)(value % 100) < gen->options.zeros) {
+      gen->rbsp[x] = 0;
+    } else {
+      gen->rbsp[x] = (BYTE)((value >> 8) % 255 + 1);
+    }
+  }
+  gen->rbsp[length - 1] = 0x80; // rbsp_trailing_bits
+
+  return appendNAL(gen, buffer, gen->rbsp, length);
+}
+
+static size_t writeSEISize(BYTE *data, size_t size) {
+  size_t length = 0;
+
+  while (size >= 255) {
+    data[length++] = 0xFF;
+    size -= 255;
+  }
+  data[length++] = (BYTE)size;
+
+  return length;
+}
+
+/*
+ * The next GOP's depths. A plane is either undefined or moves by a step
+ * now and then. Planes 1, 4, 7... are behind the screen (negative).
+ */
+static void makeOFMD(struct generator *gen, BYTE *OFMD) {
+  const struct genOptions *options = &gen->options;
+  BYTE *depths = OFMD + 14;
+
+  memcpy(OFMD, "OFMD", 4);
+  OFMD[4] = (BYTE)(0x10 | options->frameRate);
+  memcpy(OFMD + 5, "\x21\x00\x01\x00\x01", 5);
+  OFMD[10] = (BYTE)options->numOfPlanes;
+  OFMD[11] = (BYTE)options->GOPFrames;
+  OFMD[12] = 0xFF;
+  OFMD[13] = 0xFF;
+
+  for (int plane = 0; plane < options->numOfPlanes; plane++) {
+    for (int frame = 0; frame < options->GOPFrames; frame++) {
+      int *depth = &gen->depths[plane];
+      uint32_t value = nextRandom(&gen->random);
+
+      if (plane % 3 == 2) {
+        *depths++ = 0x80;
+        continue;
+      }
+      if (value % 8 == 0) {
+        *depth += (int)((value >> 3) % 7) - 3;
+        *depth = *depth < 1 ? 1 : (*depth > 60 ? 60 : *depth);
+      }
+      if ((int)((value >> 8) % 100) < options->epb) {
+        *depths++ = 0;
+      } else {
+        *depths++ = (BYTE)(*depth | (plane % 3 == 1 ? 0x80 : 0));
+      }
+    }
+  }
+}
+
+// The OFMD in a user_data_unregistered SEI, in an MVC nesting SEI.
+static int appendOFMDSEI(struct generator *gen, struct byteBuffer *buffer) {
+  BYTE OFMD[14 + MAX_PLANES * MAX_GOP_FRAMES];
+  size_t OFMDLength = 14 + gen->options.numOfPlanes * gen->options.GOPFrames;
+  // payload_type, payload_size (a byte for every 255), uuid, and the OFMD.
+  size_t nestedSize = 1 + ((16 + OFMDLength) / 255 + 1) + 16 + OFMDLength;
+  size_t payloadSize = 2 + nestedSize;
+  BYTE *rbsp = gen->rbsp;
+  size_t length = 0;
+
+  makeOFMD(gen, OFMD);
+  rbsp[length++] = 0x06; // nal_unit_type 6
+  rbsp[length++] = 0x25; // MVC scalable nesting
+  length += writeSEISize(rbsp + length, payloadSize);
+  rbsp[length++] = 0x20; // all_view_components_in_au_flag and a view_id.
+  rbsp[length++] = 0x08;
+  rbsp[length++] = 0x05; // user_data_unregistered
+  length += writeSEISize(rbsp + length, 16 + OFMDLength);
+  for (int x = 0; x < 16; x++) {
+    rbsp[length++] = (BYTE)x; // uuid_iso_iec_11578
+  }
+  memcpy(rbsp + length, OFMD, OFMDLength);
+  length += OFMDLength;
+  rbsp[length++] = 0x80; // rbsp_trailing_bits
+
+  return appendNAL(gen, buffer, rbsp, length);
+}
+
+static int writeBytes(struct generator *gen, const BYTE *data, size_t length) {
+  if (fwrite(data, 1, length, gen->out) != length) {
+    perror("fwrite()");
+    return -1;
+  }
+  gen->written += length;
+
+  return 0;
+}
+
+// MPEG-2 CRC32 of a PSI section.
+static uint32_t crc32MPEG(const BYTE *data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (size_t x = 0; x < length; x++) {
+    crc ^= (uint32_t)data[x] << 24;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+    }
+  }
+
+  return crc;
+}
+
+/*
+ * Writes one packet of 'pid' with up to 184 bytes of 'payload'. Anything
+ * shorter is padded with adaptation field stuffing.
+ * Returns how much of 'payload' was used.
+ */
+static int writePacket(struct generator *gen, int pid, bool unitStart,
+                       int *counter, const BYTE *payload, size_t length) {
+  BYTE packet[4 + TS_PACKET_SIZE];
+  BYTE *ts = packet + 4;
+  size_t take = length < 184 ? length : 184;
+  size_t header = 4;
+
+  // TP_extra_header: A 27MHz arrival time stamp, as if it was 48Mbps.
+  writeBE32(packet, (uint32_t)(gen->numPackets * 192 * 8 * 27 / 48) &
+                        0x3FFFFFFF);
+  ts[0] = 0x47;
+  ts[1] = (BYTE)((unitStart ? 0x40 : 0) | (pid >> 8));
+  ts[2] = (BYTE)(pid & 0xFF);
+  ts[3] = (BYTE)(0x10 | *counter);
+  *counter = (*counter + 1) & 15;
+
+  if (take < 184) {
+    size_t stuffing = 184 - take;
+
+    ts[3] |= 0x20;
+    ts[4] = (BYTE)(stuffing - 1);
+    if (stuffing > 1) {
+      ts[5] = 0x00;
+      memset(ts + 6, 0xFF, stuffing - 2);
+    }
+    header += stuffing;
+  }
+  memcpy(ts + header, payload, take);
+  gen->numPackets++;
+
+  if (gen->options.format == FORMAT_M2TS) {
+    return writeBytes(gen, packet, sizeof(packet)) == -1 ? -1 : (int)take;
+  }
+  return writeBytes(gen, ts, TS_PACKET_SIZE) == -1 ? -1 : (int)take;
+}
+
+// A PAT pointing to PID_PMT and a PMT with an AVC and an MVC stream.
+static int writePSI(struct generator *gen) {
+  static const BYTE pat[] = {0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                             0x00, 0x01, 0xE0 | (PID_PMT >> 8),
+                             PID_PMT & 0xFF};
+  static const BYTE pmt[] = {
+      0x02, 0xB0, 0x17, 0x00, 0x01, 0xC1, 0x00, 0x00,
+      0xE0 | (PID_BASE >> 8), PID_BASE & 0xFF, 0xF0, 0x00, // PCR PID
+      0x1B, 0xE0 | (PID_BASE >> 8), PID_BASE & 0xFF, 0xF0, 0x00,
+      0x20, 0xE0 | (PID_MVC >> 8), PID_MVC & 0xFF, 0xF0, 0x00};
+  BYTE section[1 + sizeof(pmt) + 4];
+
+  section[0] = 0x00; // pointer_field
+  memcpy(section + 1, pat, sizeof(pat));
+  writeBE32(section + 1 + sizeof(pat), crc32MPEG(pat, sizeof(pat)));
+  if (writePacket(gen, 0x0000, true, &gen->counters[0], section,
+                  1 + sizeof(pat) + 4) == -1) {
+    return -1;
+  }
+
+  memcpy(section + 1, pmt, sizeof(pmt));
+  writeBE32(section + 1 + sizeof(pmt), crc32MPEG(pmt, sizeof(pmt)));
+  return writePacket(gen, PID_PMT, true, &gen->counters[1], section,
+                     sizeof(section));
+}
+
+// Puts one access unit of a view in a PES packet and splits it into packets.
+static int writePES(struct generator *gen, int pid, int *counter,
+                    const struct byteBuffer *buffer) {
+  // PTS in 90kHz ticks, as if it was 23.976fps.
+  uint64_t pts = 90000 + (uint64_t)gen->frame * 3754;
+  BYTE pes[14] = {0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 0x05};
+  const BYTE *data = buffer->data;
+  size_t length = buffer->length;
+  BYTE first[184];
+  size_t firstLength;
+  int taken;
+
+  pes[9] = (BYTE)(0x21 | ((pts >> 29) & 0x0E));
+  pes[10] = (BYTE)(pts >> 22);
+  pes[11] = (BYTE)(0x01 | ((pts >> 14) & 0xFE));
+  pes[12] = (BYTE)(pts >> 7);
+  pes[13] = (BYTE)(0x01 | ((pts << 1) & 0xFE));
+
+  firstLength = length < 184 - sizeof(pes) ? length : 184 - sizeof(pes);
+  memcpy(first, pes, sizeof(pes));
+  memcpy(first + sizeof(pes), data, firstLength);
+  data += firstLength;
+  length -= firstLength;
+  if (writePacket(gen, pid, true, counter, first,
+                  sizeof(pes) + firstLength) == -1) {
+    return -1;
+  }
+
+  while (length > 0) {
+    if (gen->numPackets % PSI_INTERVAL == 0 && writePSI(gen) == -1) {
+      return -1;
+    }
+    taken = writePacket(gen, pid, false, counter, data, length);
+    if (taken == -1) {
+      return -1;
+    }
+    data += taken;
+    length -= taken;
+  }
+
+  return 0;
+}
+
+// An EBML ID and the element's size as an 8 byte vint.
+static int appendElement(struct byteBuffer *buffer, uint32_t id,
+                         uint64_t size) {
+  int idLength = id > 0xFFFFFF ? 4 : (id > 0xFFFF ? 3 : (id > 0xFF ? 2 : 1));
+  BYTE *out;
+
+  if (reserve(buffer, 12) == -1) {
+    return -1;
+  }
+  out = buffer->data + buffer->length;
+  for (int x = 0; x < idLength; x++) {
+    *out++ = (BYTE)(id >> (8 * (idLength - 1 - x)));
+  }
+  *out++ = 0x01;
+  for (int x = 6; x >= 0; x--) {
+    *out++ = (BYTE)(size >> (8 * x));
+  }
+  buffer->length = out - buffer->data;
+
+  return 0;
+}
+
+static int appendBytes(struct byteBuffer *buffer, const void *data,
+                       size_t length) {
+  if (reserve(buffer, length) == -1) {
+    return -1;
+  }
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+
+  return 0;
+}
+
+/*
+ * The EBML header and the start of a Segment of unknown size with one
+ * track. Both views are in it, like MakeMKV does.
+ */
+static int writeMKVHeader(struct generator *gen) {
+  static const char codecID[] = "V_MPEG4/ISO/AVC";
+  // lengthSizeMinusOne is 3, and there's no SPS or PPS.
+  static const BYTE avcC[] = {0x01, 0x64, 0x00, 0x29, 0xFF, 0xE0, 0x00};
+  static const BYTE segment[] = {0x18, 0x53, 0x80, 0x67, 0x01, 0xFF, 0xFF,
+                                 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  struct byteBuffer *header = &gen->cluster;
+  // Each element's ID, its 8 byte size, and what's in it.
+  size_t entrySize = 10 + 10 + (9 + sizeof(codecID) - 1) +
+                     (10 + sizeof(avcC));
+
+  header->length = 0;
+  if (appendElement(header, 0x1A45DFA3, 10 + 8) == -1 ||
+      appendElement(header, 0x4282, 8) == -1 ||
+      appendBytes(header, "matroska", 8) == -1 ||
+      appendBytes(header, segment, sizeof(segment)) == -1 ||
+      appendElement(header, 0x1654AE6B, 9 + entrySize) == -1 ||
+      appendElement(header, 0xAE, entrySize) == -1 ||
+      appendElement(header, 0xD7, 1) == -1 ||
+      appendBytes(header, "\x01", 1) == -1 || // TrackNumber
+      appendElement(header, 0x83, 1) == -1 ||
+      appendBytes(header, "\x01", 1) == -1 || // TrackType (video)
+      appendElement(header, 0x86, sizeof(codecID) - 1) == -1 ||
+      appendBytes(header, codecID, sizeof(codecID) - 1) == -1 ||
+      appendElement(header, 0x63A2, sizeof(avcC)) == -1 ||
+      appendBytes(header, avcC, sizeof(avcC)) == -1) {
+    return -1;
+  }
+
+  return writeBytes(gen, header->data, header->length);
+}
+
+// Writes the Cluster that's been built up, if there is one.
+static int flushCluster(struct generator *gen) {
+  struct byteBuffer header = {NULL, 0, 0};
+  int result;
+
+  if (gen->cluster.length == 0) {
+    return 0;
+  }
+  result = appendElement(&header, 0x1F43B675, gen->cluster.length);
+  if (result == 0) {
+    result = writeBytes(gen, header.data, header.length) == -1 ||
+                     writeBytes(gen, gen->cluster.data,
+                                gen->cluster.length) == -1
+                 ? -1
+                 : 0;
+  }
+  free(header.data);
+  gen->cluster.length = 0;
+
+  return result;
+}
+
+/*
+ * Puts the frame in a SimpleBlock of the current Cluster. Each GOP gets a
+ * Cluster of its own.
+ */
+static int appendBlock(struct generator *gen, bool GOPStart) {
+  struct byteBuffer *cluster = &gen->cluster;
+  // Milliseconds, as if it was 24fps.
+  int64_t timestamp = gen->frame * 1000 / 24;
+  BYTE blockHeader[4];
+  BYTE clusterTime[4];
+
+  if (GOPStart) {
+    if (flushCluster(gen) == -1) {
+      return -1;
+    }
+    gen->clusterFrame = gen->frame;
+    writeBE32(clusterTime, (uint32_t)timestamp);
+    if (appendElement(cluster, 0xE7, 4) == -1 ||
+        appendBytes(cluster, clusterTime, 4) == -1) {
+      return -1;
+    }
+  }
+
+  // Track 1, the time from the Cluster's, and the keyframe flag.
+  timestamp -= gen->clusterFrame * 1000 / 24;
+  blockHeader[0] = 0x81;
+  blockHeader[1] = (BYTE)(timestamp >> 8);
+  blockHeader[2] = (BYTE)timestamp;
+  blockHeader[3] = GOPStart ? 0x80 : 0x00;
+  if (appendElement(cluster, 0xA3, 4 + gen->base.length + gen->mvc.length) ==
+          -1 ||
+      appendBytes(cluster, blockHeader, 4) == -1 ||
+      appendBytes(cluster, gen->base.data, gen->base.length) == -1 ||
+      appendBytes(cluster, gen->mvc.data, gen->mvc.length) == -1) {
+    fprintf(stderr, "Out of memory.\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+// One frame of both views. The first frame of a GOP gets the OFMD.
+static int writeFrame(struct generator *gen, bool GOPStart) {
+  gen->base.length = 0;
+  gen->mvc.length = 0;
+
+  // An IDR slice or a non-IDR slice and a coded slice extension (MVC).
+  if (appendSlice(gen, &gen->base, GOPStart ? 0x65 : 0x41) == -1 ||
+      (GOPStart && appendOFMDSEI(gen, &gen->mvc) == -1) ||
+      appendSlice(gen, &gen->mvc, 0x74) == -1) {
+    fprintf(stderr, "Out of memory.\n");
+    return -1;
+  }
+
+  if (gen->options.format == FORMAT_MKV) {
+    return appendBlock(gen, GOPStart);
+  }
+  if (gen->options.format == FORMAT_ANNEXB) {
+    return writeBytes(gen, gen->base.data, gen->base.length) == -1 ||
+                   writeBytes(gen, gen->mvc.data, gen->mvc.length) == -1
+               ? -1
+               : 0;
+  }
+
+  if (gen->numPackets % PSI_INTERVAL == 0 && writePSI(gen) == -1) {
+    return -1;
+  }
+  if (writePES(gen, PID_BASE, &gen->counters[2], &gen->base) == -1 ||
+      writePES(gen, PID_MVC, &gen->counters[3], &gen->mvc) == -1) {
+    return -1;
+  }
+
+  return 0;
+}
+
+static bool parseNumber(const char *text, int min, int max, int *value) {
+  char *end;
+  long number = strtol(text, &end, 10);
+
+  if (*text == '\0' || *end != '\0' || number < min || number > max) {
+    return false;
+  }
+  *value = (int)number;
+
+  return true;
+}
+
+static void printUsage(const char *program) {
+  printf("Usage: %s [-format annexb|ts|m2ts|mkv] [-planes #] [-fps #] [-gop #] "
+         "[-size #] [-zeros #] [-epb #] [-seed #] <output or '-'>\n",
+         program);
+}
+
+static int parseArgs(int argc, char *argv[], struct genOptions *options) {
+  for (int x = 1; x < argc; x++) {
+    const char *arg = argv[x];
+    int value = 0;
+    bool valid = true;
+
+    // '-' is stdout, but anything else with a '-' is an option.
+    if (x == argc - 1 && (arg[0] != '-' || strcmp(arg, "-") == 0)) {
+      options->output = arg;
+      return 0;
+    }
+
+    if (strcmp(arg, "-format") == 0) {
+      const char *format = argv[++x];
+
+      if (strcmp(format, "annexb") == 0) {
+        options->format = FORMAT_ANNEXB;
+      } else if (strcmp(format, "ts") == 0) {
+        options->format = FORMAT_TS;
+      } else if (strcmp(format, "m2ts") == 0) {
+        options->format = FORMAT_M2TS;
+      } else if (strcmp(format, "mkv") == 0) {
+        options->format = FORMAT_MKV;
+      } else {
+        valid = false;
+      }
+    } else if (strcmp(arg, "-planes") == 0) {
+      valid = parseNumber(argv[++x], 1, MAX_PLANES, &options->numOfPlanes);
+    } else if (strcmp(arg, "-fps") == 0) {
+      valid = parseNumber(argv[++x], 1, 7, &options->frameRate) &&
+              options->frameRate != 5;
+    } else if (strcmp(arg, "-gop") == 0) {
+      valid = parseNumber(argv[++x], 1, MAX_GOP_FRAMES, &options->GOPFrames);
+    } else if (strcmp(arg, "-size") == 0) {
+      valid = parseNumber(argv[++x], 1, 1024 * 64, &value);
+      options->size = (int64_t)value * 1024 * 1024;
+    } else if (strcmp(arg, "-zeros") == 0) {
+      valid = parseNumber(argv[++x], 0, 100, &options->zeros);
+    } else if (strcmp(arg, "-epb") == 0) {
+      valid = parseNumber(argv[++x], 0, 100, &options->epb);
+    } else if (strcmp(arg, "-seed") == 0) {
+      valid = parseNumber(argv[++x], 1, 0x7FFFFFFF, &value);
+      options->seed = (uint32_t)value;
+    } else {
+      printf("Unknown option '%s'\n", arg);
+      return -1;
+    }
+
+    // The option's value can't be the output.
+    if (!valid || x >= argc - 1) {
+      printf("'%s %s' is invalid.\n", arg, x < argc ? argv[x] : "");
+      return -1;
+    }
+  }
+
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  struct genOptions options = {FORMAT_M2TS, 8, 1, 24, 64 * 1024 * 1024,
+                               30, 0, 0x3D3D3D3D, NULL};
+  struct generator gen;
+  int64_t numGOPs = 0;
+  int result = 0;
+
+  if (parseArgs(argc, argv, &options) == -1) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  memset(&gen, 0, sizeof(gen));
+  gen.options = options;
+  gen.random = options.seed;
+  for (int plane = 0; plane < MAX_PLANES; plane++) {
+    gen.depths[plane] = 10 + plane * 3;
+  }
+  gen.rbsp = (BYTE *)malloc(MAX_SLICE_SIZE);
+
+  if (strcmp(options.output, "-") == 0) {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    gen.out = stdout;
+  } else {
+    gen.out = fopen(options.output, "wb");
+  }
+  if (gen.out == NULL || gen.rbsp == NULL) {
+    perror(gen.out == NULL ? "fopen()" : "malloc()");
+    free(gen.rbsp);
+    return 1;
+  }
+
+  if (options.format == FORMAT_MKV) {
+    result = writeMKVHeader(&gen);
+  }
+  while (gen.written < options.size && result == 0) {
+    for (int frame = 0; frame < options.GOPFrames && result == 0; frame++) {
+      result = writeFrame(&gen, frame == 0);
+      gen.frame++;
+    }
+    numGOPs++;
+  }
+  if (result == 0) {
+    result = flushCluster(&gen);
+  }
+
+  if (gen.out != stdout) {
+    result |= fclose(gen.out);
+  } else {
+    result |= fflush(gen.out);
+  }
+  free(gen.base.data);
+  free(gen.mvc.data);
+  free(gen.cluster.data);
+  free(gen.rbsp);
+
+  // stdout can be the stream, so this goes to stderr.
+  fprintf(stderr,
+          "%lld bytes, %lld GOPs, %lld frames, %d 3D-Planes (%d empty)\n",
+          (long long)gen.written, (long long)numGOPs, (long long)gen.frame,
+          options.numOfPlanes, options.numOfPlanes / 3);
+
+  return result == 0 ? 0 : 1;
+}
@@ -0,0 +1,747 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Performance regression check.
+ *
+ * Extracts a stream end to end (scan, planes, analytics and the OFS files)
+ * a few times and keeps the best wall time, instruction count and cache
+ * misses of each stage and the peak RSS after it. The counters come from
+ * perf_event_open and are left out if the kernel or the CPU doesn't have
+ * them. Each stage's time is also divided by the time of a fixed reference
+ * loop, which cancels out most of how fast the machine is. Any stage that
+ * got worse than its baseline by more than its tolerance fails.
+ *
+ * The counters and the reference ratios are kept in the '-baseline' file,
+ * which is checked in. Each stream has its own lines for optimized and
+ * debug builds. The counters only mean something for the same compiler as
+ * well, so they're only compared if the baseline's build matches. The times
+ * and RSS depend on the machine, so they're kept in the '-local' file
+ * instead, and are only checked if it's given.
+ *
+ * Exits with 77 (a skipped test for meson) if nothing could be compared.
+ *
+ * Usage: perfcheck -baseline <file> [-local <file>] [-record] [-rounds #]
+ *                  [-threads #] [-time %] [-instructions %] [-misses %]
+ *                  [-ratio %] [-rss %] <stream>
+ */
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "3dplanes.h"
+#include "analytics.h"
+#include "input.h"
+#include "ofmd.h"
+#include "ofs.h"
+#include "util.h"
+
+#define PERF_FOLDER "perfcheck-ofs"
+#define TIME_SLACK (1.0)   // ms a stage can always be slower by.
+#define RATIO_SLACK (0.05) // The same, as a part of the reference loop.
+#define REFERENCE_SIZE (1024 * 1024 * 32)
+#define SKIPPED_EXIT_CODE (77)
+#define MAX_BASELINE_LINES (1024)
+#define BASELINE_LINE_SIZE (512)
+
+#define STRINGIFY(x) #x
+#define VERSION_NAME(major, minor, patch)                                      \
+  STRINGIFY(major) "." STRINGIFY(minor) "." STRINGIFY(patch)
+
+// Clang defines '__GNUC__' too, so it has to be checked first.
+#if defined(__clang__)
+#define COMPILER_NAME                                                          \
+  "clang-" VERSION_NAME(__clang_major__, __clang_minor__, __clang_patchlevel__)
+#elif defined(__GNUC__)
+#define COMPILER_NAME                                                          \
+  "gcc-" VERSION_NAME(__GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__)
+#else
+#define COMPILER_NAME "unknown"
+#endif
+
+#ifdef __OPTIMIZE__
+#define BUILD_NAME COMPILER_NAME "-optimized"
+#else
+#define BUILD_NAME COMPILER_NAME "-debug"
+#endif
+
+enum stage { STAGE_SCAN, STAGE_PLANES, STAGE_ANALYTICS, STAGE_WRITE,
+             STAGE_TOTAL, NUM_STAGES };
+
+static const char *stageNames[NUM_STAGES] = {"scan", "planes", "analytics",
+                                             "write", "total"};
+
+// The ones in the '-baseline' file come first.
+enum metric { METRIC_INSTRUCTIONS, METRIC_MISSES, METRIC_RATIO, METRIC_TIME,
+              METRIC_RSS, NUM_METRICS };
+
+static const char *metricNames[NUM_METRICS] = {
+    "instructions", "cache-misses", "x-reference", "ms", "peak-rss-kb"};
+
+// -1 if a metric wasn't measured.
+struct stageResult {
+  double values[NUM_METRICS];
+};
+
+struct perfCounters {
+  int fds[2]; // Instructions and cache misses. -1 if not available.
+  uint64_t start[2];
+};
+
+struct perfOptions {
+  const char *baseline;
+  const char *local; // NULL if the times and RSS aren't checked.
+  const char *stream;
+  bool record;
+  int rounds;
+  int numThreads;
+  double tolerances[NUM_METRICS]; // In percent.
+};
+
+static int openCounter(uint64_t config) {
+#ifdef __linux__
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.inherit = 1; // Count the worker threads too.
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  (void)config;
+  return -1;
+#endif
+}
+
+static void openCounters(struct perfCounters *counters) {
+#ifdef __linux__
+  counters->fds[0] = openCounter(PERF_COUNT_HW_INSTRUCTIONS);
+  counters->fds[1] = openCounter(PERF_COUNT_HW_CACHE_MISSES);
+#else
+  counters->fds[0] = -1;
+  counters->fds[1] = -1;
+#endif
+}
+
+static void closeCounters(struct perfCounters *counters) {
+#ifdef __linux__
+  for (int x = 0; x < 2; x++) {
+    if (counters->fds[x] != -1) {
+      close(counters->fds[x]);
+    }
+  }
+#else
+  (void)counters;
+#endif
+}
+
+// Returns false if it's not available.
+static bool readCounter(int fd, uint64_t *count) {
+#ifdef __linux__
+  return fd != -1 && read(fd, count, sizeof(*count)) == sizeof(*count);
+#else
+  (void)fd;
+  (void)count;
+  return false;
+#endif
+}
+
+/*
+ * The counters run the whole time and each stage gets the difference.
+ * A reset wouldn't clear what the threads that already ended counted.
+ */
+static void startCounters(struct perfCounters *counters) {
+  for (int x = 0; x < 2; x++) {
+    if (!readCounter(counters->fds[x], &counters->start[x])) {
+      counters->start[x] = 0;
+    }
+  }
+}
+
+// Puts the counts in 'result' or -1 for the ones that aren't available.
+static void stopCounters(struct perfCounters *counters,
+                         struct stageResult *result) {
+  for (int x = 0; x < 2; x++) {
+    uint64_t count;
+
+    result->values[METRIC_INSTRUCTIONS + x] =
+        readCounter(counters->fds[x], &count)
+            ? (double)(count - counters->start[x])
+            : -1;
+  }
+}
+
+static double peakRSS() {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == -1) {
+    return -1;
+  }
+#ifdef __APPLE__
+  return (double)usage.ru_maxrss / 1024; // Bytes on macOS.
+#else
+  return (double)usage.ru_maxrss;
+#endif
+}
+
+/*
+ * Runs one stage of an extraction. The stages have to be run in order, since
+ * each one needs what the last one made.
+ */
+static int runStage(enum stage stage, const struct perfOptions *options,
+                    struct OFMDstore *OFMDs, struct OFMDdata *OFMDdata,
+                    struct planeAnalytics *analytics) {
+  switch (stage) {
+  case STAGE_SCAN:
+    freeOFMDStore(OFMDs);
+    initOFMDStore(OFMDs);
+    return getOFMDsInFile(INPUT_BLOCK_SIZE, INPUT_AUTO, options->numThreads,
+                          options->stream, false, NULL, NULL, OFMDs) > 0
+               ? 0
+               : -1;
+  case STAGE_PLANES:
+    freePlanes(OFMDdata);
+    return getPlanesFromOFMDs(OFMDs, options->numThreads, OFMDdata);
+  case STAGE_ANALYTICS:
+    analyzePlanes(OFMDdata->planes, OFMDdata->numOfPlanes,
+                  OFMDdata->totalFrames, analytics);
+    for (int plane = 0; plane < OFMDdata->numOfPlanes; plane++) {
+      OFMDdata->validPlanes[plane] =
+          hasDefinedStats(&analytics->stats[plane]) ? 1 : 0;
+    }
+    return 0;
+  case STAGE_WRITE:
+    return createOFSFiles(*OFMDdata, PERF_FOLDER, 0);
+  default:
+    return -1;
+  }
+}
+
+/*
+ * Times a loop that doesn't depend on anything being measured: copying and
+ * hashing REFERENCE_SIZE bytes. Returns the ms it took.
+ */
+static double timeReference(BYTE *buffer) {
+  static volatile uint64_t sink;
+  double start = currentSeconds();
+
+  memcpy(buffer + REFERENCE_SIZE, buffer, REFERENCE_SIZE);
+  sink = hashBytes(HASH_SEED, buffer + REFERENCE_SIZE, REFERENCE_SIZE);
+  (void)sink;
+
+  return (currentSeconds() - start) * 1000;
+}
+
+static void keepBest(struct stageResult *best, const struct stageResult *round,
+                     bool first) {
+  for (int metric = 0; metric < NUM_METRICS; metric++) {
+    if (first || round->values[metric] < best->values[metric]) {
+      best->values[metric] = round->values[metric];
+    }
+  }
+}
+
+/*
+ * Extracts the stream 'options->rounds' times and keeps the best of each
+ * metric. Returns -1 if a stage failed.
+ */
+static int measureStream(const struct perfOptions *options,
+                         struct stageResult *results) {
+  struct OFMDstore OFMDs;
+  struct OFMDdata OFMDdata;
+  struct planeAnalytics analytics;
+  struct perfCounters counters;
+  int validPlanes[MAXPLANES] = {0};
+  BYTE *reference = (BYTE *)malloc((size_t)REFERENCE_SIZE * 2);
+  int result = 0;
+
+  if (reference == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+  for (size_t x = 0; x < REFERENCE_SIZE; x++) {
+    reference[x] = (BYTE)(x * 7 + (x >> 12));
+  }
+
+  memset(&OFMDdata, 0, sizeof(OFMDdata));
+  OFMDdata.validPlanes = validPlanes;
+  initOFMDStore(&OFMDs);
+  openCounters(&counters);
+
+  for (int round = 0; round < options->rounds && result == 0; round++) {
+    struct stageResult total = {{0, 0, 0, 0, 0}};
+    double referenceMs = timeReference(reference);
+
+    for (int stage = 0; stage < STAGE_TOTAL && result == 0; stage++) {
+      struct stageResult current;
+      double start;
+
+      startCounters(&counters);
+      start = currentSeconds();
+      result = runStage((enum stage)stage, options, &OFMDs, &OFMDdata,
+                        &analytics);
+      current.values[METRIC_TIME] = (currentSeconds() - start) * 1000;
+      current.values[METRIC_RATIO] = current.values[METRIC_TIME] / referenceMs;
+      stopCounters(&counters, &current);
+      current.values[METRIC_RSS] = peakRSS();
+
+      for (int metric = 0; metric < NUM_METRICS; metric++) {
+        if (current.values[metric] < 0 || total.values[metric] < 0) {
+          total.values[metric] = -1;
+        } else if (metric == METRIC_RSS) {
+          total.values[metric] = current.values[metric];
+        } else {
+          total.values[metric] += current.values[metric];
+        }
+      }
+      keepBest(&results[stage], &current, round == 0);
+    }
+    keepBest(&results[STAGE_TOTAL], &total, round == 0);
+  }
+
+  for (int plane = 0; plane < OFMDdata.numOfPlanes; plane++) {
+    char *path = makeOFSPath(PERF_FOLDER, plane);
+
+    if (path != NULL && validPlanes[plane] == 1) {
+      remove(path);
+    }
+    free(path);
+  }
+  closeCounters(&counters);
+  freePlanes(&OFMDdata);
+  freeOFMDStore(&OFMDs);
+  free(reference);
+
+  return result;
+}
+
+// The compiler and whether it optimized, without any spaces.
+static void getBuildName(char *name, size_t size) {
+  snprintf(name, size, "%s", BUILD_NAME);
+  for (char *c = name; *c != '\0'; c++) {
+    if (*c == ' ') {
+      *c = '_';
+    }
+  }
+}
+
+// True if both builds were (or weren't) optimized.
+static bool sameOptimization(const char *build, const char *otherBuild) {
+  const char *suffix = strrchr(build, '-');
+  const char *otherSuffix = strrchr(otherBuild, '-');
+
+  return suffix != NULL && otherSuffix != NULL &&
+         strcmp(suffix, otherSuffix) == 0;
+}
+
+static int metricDecimals(int metric) {
+  if (metric == METRIC_RATIO) {
+    return 4;
+  }
+  return metric == METRIC_TIME ? 3 : 0;
+}
+
+static const char *streamName(const char *path) {
+  const char *name = path;
+
+  for (const char *c = path; *c != '\0'; c++) {
+    if (*c == '/' || *c == '\\') {
+      name = c + 1;
+    }
+  }
+
+  return name;
+}
+
+// Reads every line of the baseline. Returns the number of lines or -1.
+static int readBaseline(const char *path, char (*lines)[BASELINE_LINE_SIZE]) {
+  FILE *filePtr = fopen(path, "r");
+  int numLines = 0;
+
+  if (filePtr == NULL) {
+    return -1;
+  }
+  while (numLines < MAX_BASELINE_LINES &&
+         fgets(lines[numLines], BASELINE_LINE_SIZE, filePtr) != NULL) {
+    numLines++;
+  }
+  fclose(filePtr);
+
+  return numLines;
+}
+
+/*
+ * Replaces the stream's lines for this kind of build in the baseline at
+ * 'path' with the metrics from 'first' up to 'last' in 'results' and keeps
+ * every other line.
+ */
+static int recordBaseline(const char *path, const char *stream,
+                          int64_t streamSize,
+                          const struct stageResult *results,
+                          int first, int last) {
+  static char lines[MAX_BASELINE_LINES][BASELINE_LINE_SIZE];
+  const char *name = streamName(stream);
+  int numLines = readBaseline(path, lines);
+  char build[256];
+  FILE *filePtr;
+
+  getBuildName(build, sizeof(build));
+  filePtr = fopen(path, "w");
+  if (filePtr == NULL) {
+    perror("fopen()");
+    printf("Failed to open '%s'\n", path);
+    return -1;
+  }
+
+  fprintf(filePtr, "# Made by 'perfcheck -record'. Counters that weren't "
+                   "available are -1.\n");
+  fprintf(filePtr, "# stream bytes build stage");
+  for (int metric = first; metric < last; metric++) {
+    fprintf(filePtr, " %s", metricNames[metric]);
+  }
+  fprintf(filePtr, "\n");
+
+  for (int x = 0; x < numLines; x++) {
+    char lineName[256];
+    char lineBuild[256];
+
+    if (lines[x][0] != '#' &&
+        sscanf(lines[x], "%255s %*s %255s", lineName, lineBuild) == 2 &&
+        (strcmp(lineName, name) != 0 ||
+         !sameOptimization(lineBuild, build))) {
+      fputs(lines[x], filePtr);
+    }
+  }
+  for (int stage = 0; stage < NUM_STAGES; stage++) {
+    fprintf(filePtr, "%s %lld %s %s", name, (long long)streamSize, build,
+            stageNames[stage]);
+    for (int metric = first; metric < last; metric++) {
+      fprintf(filePtr, " %.*f", metricDecimals(metric),
+              results[stage].values[metric]);
+    }
+    fprintf(filePtr, "\n");
+  }
+
+  return fclose(filePtr) == 0 ? 0 : -1;
+}
+
+static void printRow(const char *stage, const char *metric, double baseline,
+                     double current, int decimals, bool failed) {
+  double change = (current - baseline) / (baseline > 0 ? baseline : 1) * 100;
+
+  printf("  %-10s %-14s %14.*f %14.*f %+8.1f%%%s\n", stage, metric, decimals,
+         baseline, decimals, current, change, failed ? "  <-- FAIL" : "");
+}
+
+// Reads the metrics from 'first' up to 'last' after the line's first fields.
+static bool parseMetrics(const char *text, double *values, int first,
+                         int last) {
+  for (int metric = first; metric < last; metric++) {
+    char *end;
+
+    values[metric] = strtod(text, &end);
+    if (end == text) {
+      return false;
+    }
+    text = end;
+  }
+
+  return true;
+}
+
+/*
+ * Prints the metrics from 'first' up to 'last' of every stage next to the
+ * baseline's at 'path'. 'compared' gets the number of metrics checked.
+ * Returns the number of metrics over their tolerance or -1 if the baseline
+ * doesn't have the stream.
+ */
+static int compareBaseline(const struct perfOptions *options,
+                           const char *path, int64_t streamSize,
+                           const struct stageResult *results, int first,
+                           int last, int *compared) {
+  static char lines[MAX_BASELINE_LINES][BASELINE_LINE_SIZE];
+  const char *name = streamName(options->stream);
+  int numLines = readBaseline(path, lines);
+  char build[256];
+  bool sameBuild = true;
+  bool found = false;
+  int checked = 0;
+  int failed = 0;
+
+  // The local baseline isn't there until it's recorded on this machine.
+  if (numLines == -1 && first != METRIC_INSTRUCTIONS) {
+    printf("\nWARNING: '%s' hasn't been recorded, so the times and RSS "
+           "weren't compared.\nRecord them with 'ninja perf-baseline-<format>'"
+           ".\n",
+           path);
+    return 0;
+  } else if (numLines == -1) {
+    perror("fopen()");
+    printf("Failed to open '%s'\n", path);
+    return -1;
+  }
+
+  getBuildName(build, sizeof(build));
+  for (int stage = 0; stage < NUM_STAGES; stage++) {
+    struct stageResult baseline;
+    const struct stageResult *current = &results[stage];
+
+    for (int x = 0; x < numLines; x++) {
+      char lineName[256];
+      char lineBuild[256];
+      char lineStage[32];
+      long long lineSize;
+      double *values = baseline.values;
+      int length;
+
+      if (lines[x][0] == '#' ||
+          sscanf(lines[x], "%255s %lld %255s %31s%n", lineName, &lineSize,
+                 lineBuild, lineStage, &length) != 4 ||
+          !parseMetrics(lines[x] + length, values, first, last) ||
+          strcmp(lineName, name) != 0 ||
+          strcmp(lineStage, stageNames[stage]) != 0 ||
+          !sameOptimization(lineBuild, build)) {
+        continue;
+      }
+
+      if (lineSize != streamSize) {
+        printf("The baseline's '%s' was %lld bytes, not %lld.\n", name,
+               lineSize, (long long)streamSize);
+        return -1;
+      }
+      if (!found) {
+        printf("\n%s:\n", path);
+        printf("  %-10s %-14s %14s %14s %9s\n", "stage", "metric", "baseline",
+               "current", "change");
+      }
+      sameBuild = strcmp(lineBuild, build) == 0;
+      found = true;
+
+      for (int metric = first; metric < last; metric++) {
+        bool counter = metric == METRIC_INSTRUCTIONS || metric == METRIC_MISSES;
+        double allowed = values[metric] * options->tolerances[metric] / 100;
+        bool slower;
+
+        if (values[metric] < 0 || current->values[metric] < 0 ||
+            (counter && !sameBuild)) {
+          continue;
+        }
+
+        // The smallest stages take microseconds, so they'd fail on noise.
+        if (metric == METRIC_TIME && allowed < TIME_SLACK) {
+          allowed = TIME_SLACK;
+        } else if (metric == METRIC_RATIO && allowed < RATIO_SLACK) {
+          allowed = RATIO_SLACK;
+        }
+        slower = current->values[metric] - values[metric] > allowed;
+        failed += slower ? 1 : 0;
+        checked++;
+        printRow(stageNames[stage], metricNames[metric], values[metric],
+                 current->values[metric], metricDecimals(metric), slower);
+
+        // The throughput is the same check as the time, so it's not counted.
+        if (metric == METRIC_TIME &&
+            (stage == STAGE_SCAN || stage == STAGE_TOTAL)) {
+          double MB = (double)streamSize / (1024 * 1024);
+
+          printRow(stageNames[stage], "MB/s", MB / (values[metric] / 1000),
+                   MB / (current->values[metric] / 1000), 1, false);
+        }
+      }
+      break;
+    }
+  }
+
+  if (!found) {
+    printf("'%s' doesn't have '%s' for a %s build. Record it with "
+           "'-record'.\n",
+           path, name, strrchr(build, '-') + 1);
+    return -1;
+  }
+  if (!sameBuild && first == METRIC_INSTRUCTIONS) {
+    printf("\nThe baseline is from another build, so the counters weren't "
+           "compared.\n");
+  }
+  if (checked == 0) {
+    printf("\nWARNING: '%s' has nothing this build can be compared with.\n",
+           path);
+  }
+  *compared += checked;
+
+  return failed;
+}
+
+static int64_t getFileSize(const char *filename) {
+  FILE *filePtr = fopen(filename, "rb");
+  int64_t size;
+
+  if (filePtr == NULL) {
+    perror("fopen()");
+    printf("Failed to open '%s'\n", filename);
+    return -1;
+  }
+  fseeko(filePtr, 0, SEEK_END);
+  size = ftello(filePtr);
+  fclose(filePtr);
+
+  return size;
+}
+
+static bool parsePercent(const char *text, double *value) {
+  char *end;
+
+  *value = strtod(text, &end);
+  return *text != '\0' && *end == '\0' && *value >= 0;
+}
+
+static int parseArgs(int argc, char *argv[], struct perfOptions *options) {
+  for (int x = 1; x < argc; x++) {
+    const char *arg = argv[x];
+    bool hasValue = x + 2 < argc; // The stream has to come after it.
+    bool valid = true;
+
+    if (x == argc - 1) {
+      options->stream = arg;
+    } else if (strcmp(arg, "-record") == 0) {
+      options->record = true;
+    } else if (!hasValue) {
+      valid = false;
+    } else if (strcmp(arg, "-baseline") == 0) {
+      options->baseline = argv[++x];
+    } else if (strcmp(arg, "-local") == 0) {
+      options->local = argv[++x];
+    } else if (strcmp(arg, "-rounds") == 0) {
+      options->rounds = atoi(argv[++x]);
+      valid = options->rounds > 0;
+    } else if (strcmp(arg, "-threads") == 0) {
+      options->numThreads = atoi(argv[++x]);
+      valid = options->numThreads > 0;
+    } else if (strcmp(arg, "-time") == 0) {
+      valid = parsePercent(argv[++x], &options->tolerances[METRIC_TIME]);
+    } else if (strcmp(arg, "-instructions") == 0) {
+      valid = parsePercent(argv[++x],
+                           &options->tolerances[METRIC_INSTRUCTIONS]);
+    } else if (strcmp(arg, "-misses") == 0) {
+      valid = parsePercent(argv[++x], &options->tolerances[METRIC_MISSES]);
+    } else if (strcmp(arg, "-ratio") == 0) {
+      valid = parsePercent(argv[++x], &options->tolerances[METRIC_RATIO]);
+    } else if (strcmp(arg, "-rss") == 0) {
+      valid = parsePercent(argv[++x], &options->tolerances[METRIC_RSS]);
+    } else {
+      valid = false;
+    }
+
+    if (!valid) {
+      printf("'%s' is invalid.\n", arg);
+      return -1;
+    }
+  }
+
+  return options->baseline != NULL && options->stream != NULL ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+  // Instructions hardly move. Times are noisy and cache misses more so.
+  // The ratios also move with the CPU the baseline was recorded on.
+  struct perfOptions options = {NULL, NULL, NULL, false, 5,
+                                1,    {10, 100, 50, 50, 25}};
+  struct stageResult results[NUM_STAGES];
+  int64_t streamSize;
+  int compared = 0;
+  int failed;
+
+  if (parseArgs(argc, argv, &options) == -1) {
+    printf("Usage: %s -baseline <file> [-local <file>] [-record] [-rounds #] "
+           "[-threads #] [-time %%] [-instructions %%] [-misses %%] "
+           "[-ratio %%] [-rss %%] <stream>\n",
+           argv[0]);
+    return 1;
+  }
+
+  streamSize = getFileSize(options.stream);
+  if (streamSize == -1 || makeDirectory(PERF_FOLDER) == -1) {
+    return 1;
+  }
+  setQuietReports(true);
+
+  failed = measureStream(&options, results);
+  delDirectory(PERF_FOLDER);
+  if (failed == -1) {
+    printf("Failed to extract '%s'\n", options.stream);
+    return 1;
+  }
+
+  printf("%s: %.1f MB, %d threads, best of %d rounds\n", options.stream,
+         (double)streamSize / (1024 * 1024), options.numThreads,
+         options.rounds);
+  if (results[STAGE_TOTAL].values[METRIC_INSTRUCTIONS] < 0) {
+    printf("The CPU counters aren't available.\n");
+  }
+
+  if (options.record) {
+    failed = recordBaseline(options.baseline, options.stream, streamSize,
+                            results, METRIC_INSTRUCTIONS, METRIC_TIME);
+    if (failed == 0 && options.local != NULL) {
+      failed = recordBaseline(options.local, options.stream, streamSize,
+                              results, METRIC_TIME, NUM_METRICS);
+    }
+    return failed == 0 ? 0 : 1;
+  }
+
+  failed = compareBaseline(&options, options.baseline, streamSize, results,
+                           METRIC_INSTRUCTIONS, METRIC_TIME, &compared);
+  if (failed != -1 && options.local != NULL) {
+    int localFailed =
+        compareBaseline(&options, options.local, streamSize, results,
+                        METRIC_TIME, NUM_METRICS, &compared);
+
+    failed = localFailed == -1 ? -1 : failed + localFailed;
+  }
+
+  // Passing without checking anything would hide a regression.
+  if (failed == 0 && compared == 0) {
+    printf("\nSKIPPED: Nothing could be compared with the baselines.\n");
+    return SKIPPED_EXIT_CODE;
+  }
+  if (failed != 0) {
+    printf("\n%s\n", failed == -1 ? "Nothing to compare."
+                                   : "Slower than the baseline.");
+  }
+
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Microbenchmark for the SEI scanner.
+ *
+ * Compares 'searchNative' (memchr + memcmp for '00 01 06 25') against
+ * 'findStartCode' at every instruction set the CPU supports, on a synthetic
+ * H264-like buffer, an all-zero buffer, and optionally the start of a real
+ * file given as the first argument.
+ *
+ * Usage: scanbench [file]
+ */
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scanner.h"
+#include "util.h"
+
+#define BENCH_SIZE (1024 * 1024 * 64) // 64MB
+#define BENCH_ROUNDS 5
+
+static double now() {
+  struct timespec ts;
+
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// xorshift, so every run gets the same buffer.
+static uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// Slice data, with long zero runs like M2TS stuffing and an SEI every ~64KB.
+static void fillStream(BYTE *buffer, size_t size) {
+  const BYTE sei[5] = {0x00, 0x00, 0x01, 0x06, 0x25};
+  uint32_t state = 0x3D3D3D3D;
+  size_t x = 0;
+
+  while (x < size) {
+    size_t run = nextRandom(&state) % 4096;
+    bool zeros = nextRandom(&state) % 2;
+
+    for (size_t y = 0; y < run && x < size; y++, x++) {
+      BYTE byte = zeros ? 0 : (BYTE)nextRandom(&state);
+      // Zero runs stay zeros. Only the payload gets emulation prevention, so
+      // it never makes a start code with the zeros in front of it.
+      if (!zeros && byte <= 3 && x >= 2 && buffer[x - 1] == 0 &&
+          buffer[x - 2] == 0) {
+        byte = 0x03;
+      }
+      buffer[x] = byte;
+    }
+
+    if (nextRandom(&state) % 16 == 0 && x + sizeof(sei) < size) {
+      memcpy(buffer + x, sei, sizeof(sei));
+      x += sizeof(sei);
+    }
+  }
+}
+
+static size_t countNative(const BYTE *buffer, size_t size) {
+  const BYTE seiString[4] = {0x00, 0x01, 0x06, 0x25};
+  const BYTE *match = buffer;
+  size_t count = 0;
+
+  while ((match = searchNative(match, size - (match - buffer), seiString,
+                               4)) != NULL) {
+    count++;
+    match++;
+  }
+
+  return count;
+}
+
+static size_t countStartCodes(enum scannerLevel level, const BYTE *buffer,
+                              size_t size) {
+  const BYTE *match = buffer;
+  size_t count = 0;
+
+  while ((match = findStartCodeWith(level, match, size - (match - buffer),
+                                    NAL_HEADER_SEI, NAL_HEADER_MASK,
+                                    SEI_MVC_NESTING, 0xFF)) != NULL) {
+    count++;
+    match++;
+  }
+
+  return count;
+}
+
+// Returns the number of matches and prints the best of 'BENCH_ROUNDS'.
+static size_t runBench(const char *name, int level, const BYTE *buffer,
+                       size_t size) {
+  double best = 0;
+  size_t count = 0;
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    double start = now();
+
+    if (level < 0) {
+      count = countNative(buffer, size);
+    } else {
+      count = countStartCodes((enum scannerLevel)level, buffer, size);
+    }
+
+    double elapsed = now() - start;
+    if (round == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  printf("  %-14s %10.1f MB/s  (%zu matches)\n", name,
+         (double)size / (1024 * 1024) / (best > 0 ? best : 1e-9), count);
+
+  return count;
+}
+
+static bool benchBuffer(const char *name, const BYTE *buffer, size_t size) {
+  enum scannerLevel best = scannerLevel();
+  size_t expected;
+  bool sameCount = true;
+
+  printf("%s (%zu MB):\n", name, size / (1024 * 1024));
+  expected = runBench("searchNative", -1, buffer, size);
+
+  for (int level = SCANNER_SCALAR; level <= (int)best; level++) {
+    size_t count = runBench(scannerLevelName((enum scannerLevel)level), level,
+                            buffer, size);
+    if (count != expected) {
+      printf("  ** %s found %zu matches, searchNative found %zu **\n",
+             scannerLevelName((enum scannerLevel)level), count, expected);
+      sameCount = false;
+    }
+  }
+  printf("\n");
+
+  return sameCount;
+}
+
+int main(int argc, char *argv[]) {
+  BYTE *buffer = (BYTE *)malloc(BENCH_SIZE);
+  bool passed = true;
+
+  if (buffer == NULL) {
+    perror("malloc()");
+    return 1;
+  }
+
+  printf("Best scanner on this CPU: %s\n\n", scannerLevelName(scannerLevel()));
+
+  fillStream(buffer, BENCH_SIZE);
+  passed &= benchBuffer("Synthetic stream", buffer, BENCH_SIZE);
+
+  memset(buffer, 0, BENCH_SIZE);
+  passed &= benchBuffer("All zeros", buffer, BENCH_SIZE);
+
+  if (argc >= 2) {
+    FILE *filePtr = fopen(argv[1], "rb");
+    size_t size;
+
+    if (filePtr == NULL) {
+      perror("fopen()");
+      printf("Failed to open '%s'\n", argv[1]);
+      free(buffer);
+      return 1;
+    }
+    size = fread(buffer, 1, BENCH_SIZE, filePtr);
+    fclose(filePtr);
+
+    // Real streams can have '00 01 06 25' without a leading zero, so only
+    // report the speed.
+    benchBuffer(argv[1], buffer, size);
+  }
+
+  free(buffer);
+  return passed ? 0 : 1;
+}
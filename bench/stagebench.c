@@ -0,0 +1,198 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Times each stage of an extraction on its own: scanning the stream for
+ * OFMDs, turning them into planes, the plane analytics, and writing the OFS
+ * files. Each stage is run until it has had BENCH_ROUNDS rounds and at
+ * least BENCH_MIN_TIME seconds, and the best round is reported.
+ *
+ * Usage: stagebench <stream> [threads]
+ */
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "3dplanes.h"
+#include "analytics.h"
+#include "input.h"
+#include "ofmd.h"
+#include "ofs.h"
+#include "parallel.h"
+#include "util.h"
+
+#define BENCH_ROUNDS 3
+#define BENCH_MIN_TIME (0.5)
+#define BENCH_FOLDER "stagebench-ofs"
+
+struct stageBench {
+  const char *filename;
+  int numThreads;
+  struct OFMDstore OFMDs;
+  struct OFMDdata OFMDdata;
+  struct planeAnalytics analytics;
+  int validPlanes[MAXPLANES];
+};
+
+typedef int (*stageRound)(struct stageBench *bench);
+
+static int scanStage(struct stageBench *bench) {
+  freeOFMDStore(&bench->OFMDs);
+  initOFMDStore(&bench->OFMDs);
+  return getOFMDsInFile(INPUT_BLOCK_SIZE, INPUT_AUTO, bench->numThreads,
+                        bench->filename, false, NULL, NULL, &bench->OFMDs);
+}
+
+static int planesStage(struct stageBench *bench) {
+  freePlanes(&bench->OFMDdata);
+  return getPlanesFromOFMDs(&bench->OFMDs, bench->numThreads,
+                            &bench->OFMDdata);
+}
+
+static int analyticsStage(struct stageBench *bench) {
+  analyzePlanes(bench->OFMDdata.planes, bench->OFMDdata.numOfPlanes,
+                bench->OFMDdata.totalFrames, &bench->analytics);
+  return 0;
+}
+
+static int writeStage(struct stageBench *bench) {
+  return createOFSFiles(bench->OFMDdata, BENCH_FOLDER, 0);
+}
+
+/*
+ * Runs 'stage' and prints how many MB of 'size' it gets through a second.
+ * Returns -1 if the stage failed.
+ */
+static int runStage(const char *name, stageRound stage,
+                    struct stageBench *bench, int64_t size) {
+  double best = 0;
+  double total = 0;
+  int rounds = 0;
+
+  while (rounds < BENCH_ROUNDS || total < BENCH_MIN_TIME) {
+    double start = currentSeconds();
+    double elapsed;
+
+    if (stage(bench) == -1) {
+      printf("  %s failed.\n", name);
+      return -1;
+    }
+    elapsed = currentSeconds() - start;
+    if (rounds == 0 || elapsed < best) {
+      best = elapsed;
+    }
+    total += elapsed;
+    rounds++;
+  }
+
+  printf("  %-20s %10.1f MB/s  %10.3f ms  (%d rounds)\n", name,
+         (double)size / (1024 * 1024) / (best > 0 ? best : 1e-9),
+         best * 1000, rounds);
+
+  return 0;
+}
+
+static int64_t getFileSize(const char *filename) {
+  FILE *filePtr = fopen(filename, "rb");
+  int64_t size;
+
+  if (filePtr == NULL) {
+    perror("fopen()");
+    printf("Failed to open '%s'\n", filename);
+    return -1;
+  }
+  fseeko(filePtr, 0, SEEK_END);
+  size = ftello(filePtr);
+  fclose(filePtr);
+
+  return size;
+}
+
+int main(int argc, char *argv[]) {
+  struct stageBench bench;
+  int64_t fileSize;
+  int64_t depthSize;
+  int result = 0;
+
+  if (argc < 2) {
+    printf("Usage: %s <stream> [threads]\n", argv[0]);
+    return 1;
+  }
+
+  memset(&bench, 0, sizeof(bench));
+  bench.filename = argv[1];
+  bench.numThreads = argc >= 3 ? atoi(argv[2]) : 0;
+  if (bench.numThreads < 1) {
+    bench.numThreads = cpuCount();
+  }
+  initOFMDStore(&bench.OFMDs);
+  setQuietReports(true);
+
+  fileSize = getFileSize(bench.filename);
+  if (fileSize == -1 || makeDirectory(BENCH_FOLDER) == -1) {
+    return 1;
+  }
+
+  // Every stage needs the one before it, so the first round is the setup.
+  if (scanStage(&bench) <= 0 || planesStage(&bench) == -1) {
+    printf("No OFMDs were found in '%s'\n", bench.filename);
+    freeOFMDStore(&bench.OFMDs);
+    delDirectory(BENCH_FOLDER);
+    return 1;
+  }
+  analyticsStage(&bench);
+  for (int plane = 0; plane < bench.OFMDdata.numOfPlanes; plane++) {
+    bench.validPlanes[plane] = hasDefinedStats(&bench.analytics.stats[plane]);
+  }
+  bench.OFMDdata.validPlanes = bench.validPlanes;
+  depthSize = (int64_t)bench.OFMDdata.numOfPlanes * bench.OFMDdata.totalFrames;
+
+  printf("\n%s: %.1f MB, %d OFMDs, %d 3D-Planes, %d frames, %d threads\n",
+         bench.filename, (double)fileSize / (1024 * 1024),
+         bench.OFMDs.numOFMDs, bench.OFMDdata.numOfPlanes,
+         bench.OFMDdata.totalFrames, bench.numThreads);
+
+  // The stream's size for the scan and the size of the depths after that.
+  result |= runStage("getOFMDsInFile", scanStage, &bench, fileSize);
+  result |= runStage("getPlanesFromOFMDs", planesStage, &bench, depthSize);
+  result |= runStage("analyzePlanes", analyticsStage, &bench, depthSize);
+  result |= runStage("createOFSFiles", writeStage, &bench, depthSize);
+
+  for (int plane = 0; plane < bench.OFMDdata.numOfPlanes; plane++) {
+    char *path = makeOFSPath(BENCH_FOLDER, plane);
+
+    if (path != NULL && bench.validPlanes[plane] == 1) {
+      remove(path);
+    }
+    free(path);
+  }
+  delDirectory(BENCH_FOLDER);
+  freePlanes(&bench.OFMDdata);
+  freeOFMDStore(&bench.OFMDs);
+
+  return result == 0 ? 0 : 1;
+}
@@ -22,29 +22,92 @@
  * SOFTWARE.
  */
 #pragma once
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "analytics.h"
+#include "checkpoint.h"
+#include "input.h"
+#include "ofmd.h"
+#include "rle.h"
 #include "util.h"
 
-#define MAXPLANES 32 // Most 3D Blurays have 32 planes.
+#define PROBE_OFMDS (32) // '-probe' stops after this many OFMDs by default,
+#define PROBE_SIZE (64)   // or this many MB.
+
+#define PLANE_ALIGNMENT (64) // Of each plane in 'OFMDdata.depths'.
 
 struct OFMDdata {
   int frameRate;
   int totalFrames;
   int numOfPlanes;
   int *validPlanes;
-  BYTE **planes;
+  BYTE *planes[MAXPLANES]; // Point into 'depths'.
+  BYTE *depths;            // Every plane in one block or NULL.
 };
 
-int getOFMDsInFile(size_t storeSize, size_t bufferSize, const char *filename,
-                   bool prettyPrint, BYTE ***OFMDs);
+int getOFMDsInFile(size_t bufferSize, enum inputBackend backend,
+                   int numThreads, const char *filename, bool prettyPrint,
+                   const char *indexPath, struct checkpoint *checkpoint,
+                   struct OFMDstore *OFMDs);
+
+int getOFMDsInFiles(size_t bufferSize, enum inputBackend backend,
+                    int numThreads, const char **filenames, int numFiles,
+                    bool prettyPrint, const char *indexPath,
+                    struct checkpoint *checkpoint, struct OFMDstore *OFMDs);
+
+int getPlanesInFiles(size_t bufferSize, enum inputBackend backend,
+                     int numThreads, const char **filenames, int numFiles,
+                     bool prettyPrint, struct checkpoint *checkpoint,
+                     struct OFMDdata *OFMDdata);
+
+int streamOFSFiles(size_t bufferSize, enum inputBackend backend,
+                   const char **filenames, int numFiles, bool prettyPrint,
+                   const char *outFolder, int frameRate, BYTE dropFrame,
+                   struct checkpoint *checkpoint, struct rlePlanes *rle,
+                   struct OFMDdata *OFMDdata);
+
+// What 'probeFiles' found out from the first OFMDs.
+struct probeResult {
+  int numOFMDs;
+  int numOfPlanes;
+  int frameRate;
+  int minGOPFrames;
+  int maxGOPFrames;
+  int framesRead;
+  int framesBeforeLast; // Frames of every GOP but the last one read.
+  int64_t firstOffset;  // File offsets of the first and last OFMD.
+  int64_t lastOffset;
+  int64_t bytesScanned;
+  int64_t totalSize;       // -1 if unknown (stdin, pipes).
+  int64_t estimatedFrames; // -1 if unknown.
+};
+
+int probeFiles(size_t bufferSize, enum inputBackend backend,
+               const char **filenames, int numFiles, int maxOFMDs,
+               int64_t maxBytes, struct probeResult *probe);
+
+int allocPlanes(struct OFMDdata *OFMDdata, int numOfPlanes, int totalFrames);
+
+void freePlanes(struct OFMDdata *OFMDdata);
+
+int getPlanesFromOFMDs(const struct OFMDstore *OFMDs, int numThreads,
+                       struct OFMDdata *OFMDdata);
+
+void setQuietReports(bool quiet);
+
+void setMinRangeSize(int64_t size);
+
+// Gets the percentage of the input that's been scanned.
+typedef void (*progressCallback)(void *context, int percent);
 
-void getPlanesFromOFMDs(BYTE ***OFMDs, int numOFMDs, struct OFMDdata *OFMDdata);
+void setProgressCallback(progressCallback callback, void *context);
 
-int verifyPlanes(struct OFMDdata OFMDdata, char *inFile);
+bool hasDefinedDepth(const BYTE *depths, int numFrames);
 
-void parseDepths(int planeNum, int numOfPlanes, BYTE **planes, int numFrames);
+int verifyPlanes(struct OFMDdata OFMDdata);
 
-void createOFSFiles(struct OFMDdata OFMDdata, const char *outFolder,
-                    BYTE dropFrame);
+int createOFSFiles(struct OFMDdata OFMDdata, const char *outFolder,
+                   BYTE dropFrame);
@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util.h"
+
+#define MAXPLANES 32 // Most 3D Blurays have 32 planes.
+
+struct rlePlanes;
+
+/*
+ * What the depth report says about a 3D-Plane. Can be built a GOP at a time.
+ * Depths above 0x80 are negative, and 0x80 is undefined.
+ */
+struct depthStats {
+  int numFrames;
+  int minval; // Of the defined depths. 128 and -128 if there aren't any.
+  int maxval;
+  int64_t total;
+  int undefined;
+  int firstframe; // -1 if every depth is undefined.
+  int lastframe;
+  int lastval;
+  int cuts; // Changes of depth value.
+  uint64_t hash; // Only comparable between planes added in the same pieces.
+};
+
+// Everything about the 3D-Planes of a title, with one pass over each.
+struct planeAnalytics {
+  int numOfPlanes;
+  int numDefined; // Planes with at least one defined depth.
+  int numClasses; // Sets of planes with the same depths.
+  struct depthStats stats[MAXPLANES];
+  int classOf[MAXPLANES];        // The first plane with the same depths.
+  uint32_t identical[MAXPLANES]; // Bit x is set if plane x is the same.
+};
+
+void initDepthStats(struct depthStats *stats);
+
+void addDepths(struct depthStats *stats, const BYTE *depths, int count);
+
+bool hasDefinedStats(const struct depthStats *stats);
+
+void groupIdenticalPlanes(struct planeAnalytics *analytics,
+                          BYTE *const *planes);
+
+void analyzePlanes(BYTE *const *planes, int numOfPlanes, int numFrames,
+                   struct planeAnalytics *analytics);
+
+void analyzeRLEPlanes(const struct rlePlanes *rle,
+                      struct planeAnalytics *analytics);
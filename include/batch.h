@@ -0,0 +1,92 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+#define BATCH_IO_LIMIT (2) // Default jobs reading from the same device.
+
+// One title and where its OFS files go.
+struct batchJob {
+  char *input;
+  char *outFolder;
+  int playlist;   // -1 unless 'input' is a BDMV folder.
+  int64_t device; // What 'input' is stored on. -1 if unknown.
+
+  // Filled in by the 'batchTask'.
+  int result;   // The exit code.
+  int numOFMDs; // 0 if there weren't any 3D-Planes, -1 if the scan failed.
+  int numOfPlanes;
+  int planesWritten;
+  int totalFrames;
+  int frameRate;
+  bool keepOutFolder; // It has a checkpoint for '-resume'.
+  double seconds;     // Filled in by 'runBatch'.
+};
+
+struct batch {
+  int numJobs;
+  struct batchJob *jobs;
+};
+
+// Runs one job and returns its exit code.
+typedef int (*batchTask)(void *context, struct batchJob *job);
+
+/*
+ * Adds a job for each line of 'path':
+ *
+ *   <input>[<TAB><output folder>[<TAB><playlist>]]
+ *
+ * Empty lines and lines starting with '#' are skipped. A relative output
+ * folder goes in 'outFolder', and without one the input's name (minus the
+ * extension) is used. A BDMV folder needs a playlist.
+ * Returns -1 if the manifest is broken.
+ */
+int readBatchManifest(const char *path, const char *outFolder,
+                      struct batch *batch);
+
+/*
+ * Adds a job for every input file under 'folder'. The OFS files go in the
+ * same sub-folders of 'outFolder', in a folder named after the input.
+ * BDMV folders are skipped, since those need a playlist.
+ */
+int findBatchInputs(const char *folder, const char *outFolder,
+                    struct batch *batch);
+
+/*
+ * Runs every job with up to 'numWorkers' at the same time, but no more than
+ * 'ioLimit' of them reading from the same device. Each worker keeps its
+ * input buffer from one job to the next.
+ * Prints a line as each job finishes. Returns -1 if none could be run.
+ */
+int runBatch(struct batch *batch, int numWorkers, int ioLimit,
+             batchTask task, void *context);
+
+// Prints how every job went. Returns the number of jobs that failed.
+int printBatchSummary(const struct batch *batch, double seconds);
+
+void freeBatch(struct batch *batch);
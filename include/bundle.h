@@ -0,0 +1,49 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "3dplanes.h"
+#include "util.h"
+
+#define BUNDLE_INDEX_NAME "3D-Planes.json"
+#define TAR_BLOCK_SIZE (512)
+
+/*
+ * A bundle is a tar archive of the OFS files, so any tar can unpack it. The
+ * first member is an index (BUNDLE_INDEX_NAME) with the GUID, depth stats,
+ * and the offset of every OFS file in the archive, so one plane can be
+ * fetched with a single ranged read.
+ */
+
+// Makes '-' write the bundle to stdout. (Everything else goes to stderr.)
+int bundleToStdout();
+
+/*
+ * Writes the valid planes of 'OFMDdata' to the bundle at 'path' or to
+ * stdout if it's '-'.
+ */
+int writeOFSBundle(struct OFMDdata OFMDdata, const char *path,
+                   BYTE dropFrame);
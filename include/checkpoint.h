@@ -0,0 +1,82 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "util.h"
+
+#define CHECKPOINT_NAME "3D-Planes.ofsckpt"
+#define CHECKPOINT_MAGIC "OFSCKPT\x01" // Name and version.
+#define CHECKPOINT_SECONDS (30)        // Default time between checkpoints.
+#define CHECKPOINT_OFMDS (256)         // Most GOPs between checkpoints.
+
+// Gets each OFMD of the checkpoint back, in the order they were found.
+typedef int (*checkpointReplay)(void *context, int file, const BYTE *OFMD,
+                                size_t length, int64_t offset);
+
+/*
+ * A log of the OFMDs found so far, kept in the output folder.
+ *
+ * Every OFMD is saved with the offset a scan has to start from to find it
+ * again. (The SEI itself, its TS packet, or its MKV Cluster) So a scan that
+ * gets killed can go on from the last saved OFMD with a fresh parser,
+ * instead of from byte 0. Records that were cut off are thrown away.
+ */
+struct checkpoint {
+  char *path;
+  FILE *filePtr; // NULL once writing failed.
+  int seconds;
+  bool resume; // Pick up the old checkpoint if it matches the input.
+  time_t lastFlush;
+  int pending; // OFMDs since the last flush.
+
+  // Where the old scan got to. 'file' is -1 if there's nothing to resume.
+  int file;
+  int64_t resumeOffset;
+  int64_t lastOffset; // Of the last saved OFMD.
+  int numOFMDs;
+};
+
+void initCheckpoint(struct checkpoint *checkpoint, const char *outFolder,
+                    int seconds, bool resume);
+
+/*
+ * Starts a new checkpoint for 'filenames'. With 'resume' set, an old one
+ * that matches the input is kept, and its OFMDs go to 'replay' first.
+ * Returns -1 if the checkpoint can't be written.
+ */
+int startCheckpoint(struct checkpoint *checkpoint, const char **filenames,
+                    int numFiles, checkpointReplay replay, void *context);
+
+// 'resumeOffset': Where a scan of 'file' has to start to find the OFMD again.
+int addCheckpointOFMD(struct checkpoint *checkpoint, int file,
+                      const BYTE *OFMD, size_t length, int64_t offset,
+                      int64_t resumeOffset);
+
+// Closes the checkpoint and deletes it unless 'keep' is set.
+void finishCheckpoint(struct checkpoint *checkpoint, bool keep);
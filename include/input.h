@@ -0,0 +1,98 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "util.h"
+
+#define INPUT_BLOCK_SIZE (1024 * 1024 * 4) // 4MB
+#define INPUT_ALIGNMENT (4096)
+#define TEE_PIPE_SIZE (1024 * 1024) // Asked for when stdin is teed pipe to pipe.
+
+enum inputBackend {
+  INPUT_AUTO, // mmap for regular files, stdio for stdin and pipes.
+  INPUT_MMAP,
+  INPUT_PREAD,
+  INPUT_STDIO,
+  INPUT_URING // Falls back to pread if io_uring isn't available.
+};
+
+struct uringReader;
+
+/*
+ * A read-only view of the input file.
+ *
+ * 'data' always points at the byte found at file offset 'position', and
+ * 'length' bytes are available from there. The mmap backend maps the whole
+ * file so 'data' points straight into the mapping, while the pread and stdio
+ * backends read fixed size blocks into an aligned buffer. Those keep a small
+ * 'headroom' in front of the block so only the unconsumed tail of the previous
+ * block has to be carried over. The uring backend does the same with a ring
+ * of blocks and keeps reading ahead while the current one is scanned.
+ */
+struct inputSource {
+  enum inputBackend backend;
+  FILE *filePtr;
+  int fd;
+  bool useStdin;
+  bool tee;      // stdin is copied to the tee as it's read.
+  bool teePipes; // With tee(), since both ends are pipes.
+  bool eof;
+  int64_t fileSize; // -1 if unknown (stdin, pipes).
+  int64_t position;
+  int64_t readOffset; // File offset of the next block read.
+  size_t skipHead;    // Bytes to drop from the next block after a seek.
+  BYTE *map;
+  struct uringReader *uring;
+  BYTE *buffer;
+  size_t headroom;
+  size_t blockSize;
+  BYTE *data;
+  size_t length;
+};
+
+int openInput(struct inputSource *input, const char *filename,
+              enum inputBackend backend, size_t blockSize, size_t lookahead);
+
+size_t fillInput(struct inputSource *input, size_t wanted);
+
+void skipInput(struct inputSource *input, int64_t count);
+
+void closeInput(struct inputSource *input);
+
+void keepInputBuffers(bool keep);
+
+/*
+ * Passes stdin through to stdout. Every byte of stdin is copied to the real
+ * stdout unchanged, even the ones skipped or left when it's closed. The
+ * 'stdout' everything else prints to becomes stderr, so only the stream ends
+ * up in the copy. Returns -1 if stdout couldn't be moved.
+ */
+int teeStdin();
+
+const char *inputBackendName(enum inputBackend backend);
+
+int parseInputBackend(const char *name, enum inputBackend *backend);
@@ -0,0 +1,110 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "nal.h"
+#include "util.h"
+
+#define EBML_MAGIC "\x1A\x45\xDF\xA3"
+
+#define MKV_ID_SEGMENT (0x18538067)
+#define MKV_ID_TRACKS (0x1654AE6B)
+#define MKV_ID_TRACK_ENTRY (0xAE)
+#define MKV_ID_TRACK_NUMBER (0xD7)
+#define MKV_ID_TRACK_TYPE (0x83)
+#define MKV_ID_CODEC_ID (0x86)
+#define MKV_ID_CODEC_PRIVATE (0x63A2)
+#define MKV_ID_CLUSTER (0x1F43B675)
+#define MKV_ID_TIMESTAMP (0xE7)
+#define MKV_ID_BLOCK_GROUP (0xA0)
+#define MKV_ID_BLOCK (0xA1)
+#define MKV_ID_SIMPLE_BLOCK (0xA3)
+
+#define MKV_MAX_TRACK_ENTRY (1024 * 64) // Bigger TrackEntries are skipped.
+#define MKV_CLUSTER_HEADER_SIZE (13)    // ID, longest size, and Timestamp ID.
+
+enum mkvState {
+  MKV_ELEMENT,      // Reading an element's ID and size.
+  MKV_SKIP,         // Skipping an element.
+  MKV_TRACK_ENTRY,  // Copying a TrackEntry.
+  MKV_BLOCK_HEADER, // Reading a block's track number, timestamp, and flags.
+  MKV_NAL_LENGTH,   // Reading the length in front of a NAL.
+  MKV_NAL,          // Deciding what to do with a NAL.
+  MKV_SKIP_NAL,     // Skipping a NAL that isn't an SEI.
+  MKV_SEI           // Copying an SEI NAL.
+};
+
+/*
+ * Push demuxer for Matroska files.
+ *
+ * Walks the Clusters and only looks inside the blocks of the H264/MVC track.
+ * Their NALs are length-prefixed, so each SEI is handed to 'parseNAL' whole,
+ * and everything else is skipped without being looked at.
+ */
+struct mkvDemuxer {
+  struct nalParser *parser; // Can be NULL to only read the Tracks.
+  enum mkvState state;
+  BYTE header[16];
+  size_t headerLength;
+  int64_t headerOffset;
+  uint64_t remaining;      // Bytes left in the current state.
+  uint64_t blockRemaining; // Bytes left in the current block.
+  int64_t skip; // Bytes to skip past the end of the last chunk.
+  BYTE *buffer; // TrackEntry or SEI.
+  size_t bufferLength;
+  int64_t nalOffset;
+  int videoTrack; // -1 until a H264/MVC track shows up.
+  int nalLengthSize;
+  bool mvcTrack;
+  bool fixedTrack;   // Set by 'setMKVTrack'. TrackEntries won't change it.
+  bool clusterFound; // All the TrackEntries come before the first Cluster.
+  int64_t clusterOffset; // Of the Cluster being read. -1 before the first.
+  uint64_t numBlocks;
+};
+
+int initMKVDemuxer(struct mkvDemuxer *demux, struct nalParser *parser);
+
+void freeMKVDemuxer(struct mkvDemuxer *demux);
+
+// Uses 'track' no matter what the TrackEntries say.
+void setMKVTrack(struct mkvDemuxer *demux, int track, int nalLengthSize);
+
+int feedMKVDemuxer(struct mkvDemuxer *demux, const BYTE *data, size_t length,
+                   int64_t offset);
+
+/*
+ * Returns how many bytes after the last chunk should be skipped, instead of
+ * being fed to the demuxer. (The rest of a big element or NAL)
+ */
+int64_t takeMKVSkip(struct mkvDemuxer *demux);
+
+/*
+ * Finds the first Cluster header in 'data' which is followed by its
+ * Timestamp, so it's very unlikely to be part of a frame. Returns NULL if
+ * there isn't one that fits in 'data'.
+ */
+const BYTE *findMKVCluster(const BYTE *data, size_t length);
@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+#define MAX_SEI_SIZE (1024 * 64) // Bigger SEIs are skipped.
+
+#define SEI_USER_DATA_UNREGISTERED (5)
+#define OFMD_HEADER_SIZE (14) // 'OFMD' + 10 bytes before the depth values.
+
+/*
+ * Called for every valid OFMD with exactly the payload of its
+ * user_data_unregistered SEI (after the 16 byte UUID).
+ * 'offset' is the file offset of the SEI's start code.
+ * Return non-zero to stop the parser.
+ */
+typedef int (*OFMDCallback)(void *context, const BYTE *OFMD, size_t length,
+                            int64_t offset);
+
+enum nalState { NAL_SCAN, NAL_HEADER, NAL_SEI };
+
+/*
+ * Push parser for Annex-B streams.
+ *
+ * Data can be fed in chunks of any size. Only SEI NALs are copied out of
+ * the chunks, everything else is skipped with 'findStartCode'.
+ */
+struct nalParser {
+  OFMDCallback callback;
+  void *context;
+  enum nalState state;
+  int zeroRun; // Zero bytes at the end of the last chunk. (Max 2)
+  int64_t zeroOffsets[2];
+  int64_t startCodeOffset;
+  int64_t stopOffset; // Stop at the first SEI starting here or later.
+  bool stopped;
+  bool overflow;
+  BYTE *nal;
+  size_t nalLength;
+  BYTE *rbsp;
+  uint64_t numSEIs;
+  uint64_t numOFMDs;
+};
+
+int initNALParser(struct nalParser *parser, OFMDCallback callback,
+                  void *context);
+
+int feedNALParser(struct nalParser *parser, const BYTE *data, size_t length,
+                  int64_t offset);
+
+int flushNALParser(struct nalParser *parser);
+
+bool nalParserIdle(struct nalParser *parser);
+
+void resetNALParser(struct nalParser *parser);
+
+void freeNALParser(struct nalParser *parser);
+
+int parseNAL(struct nalParser *parser, const BYTE *nal, size_t length,
+             int64_t offset);
+
+bool isValidOFMD(const BYTE *OFMD, size_t length);
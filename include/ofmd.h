@@ -0,0 +1,72 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+#define OFMD_CHUNK_SIZE (1024 * 256) // Room for a few hundred OFMDs.
+
+// Bump allocated memory for the OFMDs. Chunks are never moved or resized.
+struct OFMDchunk {
+  struct OFMDchunk *next; // The chunk before this one.
+  size_t used;
+  size_t size;
+  BYTE data[];
+};
+
+struct OFMDentry {
+  const BYTE *OFMD; // Points into one of the store's chunks.
+  uint32_t length;
+  int64_t offset; // File offset of the OFMD's SEI.
+};
+
+/*
+ * Every OFMD of a scan, in file order.
+ *
+ * Each OFMD only takes up its own length in a chunk, and 'entries' is the
+ * only array that grows (by doubling). Everything is freed with one
+ * 'freeOFMDStore'.
+ */
+struct OFMDstore {
+  struct OFMDchunk *chunks; // The newest chunk first.
+  struct OFMDentry *entries;
+  int numOFMDs;
+  int capacity;
+};
+
+void initOFMDStore(struct OFMDstore *store);
+
+// Copies 'OFMD' to the end of the store. Returns -1 if it's out of memory.
+int addOFMDToStore(struct OFMDstore *store, const BYTE *OFMD, size_t length,
+                   int64_t offset);
+
+/*
+ * Moves everything in 'src' to the end of 'dest' without copying the OFMDs.
+ * 'src' is left empty.
+ */
+int moveOFMDStore(struct OFMDstore *dest, struct OFMDstore *src);
+
+void freeOFMDStore(struct OFMDstore *store);
@@ -0,0 +1,79 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "3dplanes.h"
+#include "util.h"
+
+#define OFS_HEADER_SIZE (41)
+#define OFS_FRAMES_OFFSET (37) // number_of_frames is the last header field.
+
+/*
+ * Fills the 41 byte header of an OFS file.
+ * 'frameRate': The frame_rate value with the drop_frame_flag already added.
+ */
+void makeOFSHeader(BYTE *header, const BYTE *GUID, BYTE frameRate,
+                   int totalFrames);
+
+void makeOFSGUID(BYTE *GUID);
+
+// Returns '<outFolder>/3D-Plane-##.ofs', which has to be freed, or NULL.
+char *makeOFSPath(const char *outFolder, int plane);
+
+int writeOFSFile(const char *path, const BYTE *header, const BYTE *depths,
+                 size_t count);
+
+/*
+ * Writes the OFS files while the depth values are still coming in.
+ *
+ * The header is written first with 0 frames, and 'number_of_frames' is
+ * patched once the stream is closed. Outputs that can't seek (like a FIFO
+ * named '3D-Plane-##.ofs') get their depth values in a temp file instead,
+ * and the header is written in front of them at the end.
+ */
+struct ofsStream {
+  int numOfPlanes;
+  BYTE frameRate;
+  BYTE GUID[16];
+  int numFrames[MAXPLANES];
+  char *paths[MAXPLANES];
+  FILE *files[MAXPLANES];
+  FILE *temps[MAXPLANES]; // NULL unless the output can't seek.
+  bool canSeek[MAXPLANES];
+};
+
+int openOFSStream(struct ofsStream *stream, const char *outFolder,
+                  int numOfPlanes, BYTE frameRate);
+
+int writeOFSDepths(struct ofsStream *stream, int plane, const BYTE *depths,
+                   size_t count);
+
+/*
+ * Finishes the planes marked in 'validPlanes' and removes the others.
+ * 'validPlanes' can be NULL to remove every plane.
+ */
+int closeOFSStream(struct ofsStream *stream, const int *validPlanes);
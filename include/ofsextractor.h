@@ -0,0 +1,152 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * libofsextractor
+ *
+ * Pulls the 3D-Planes out of an MVC stream that's already in memory. The
+ * stream is pushed in with 'ofsFeed' in chunks of any size, and nothing is
+ * read from or written to disk. Each thread can have its own 'ofsExtractor'.
+ * The only state they share is the start code scanner's level, which is
+ * picked once with pthread_once and the counter 'ofsMakeFiles' falls back
+ * on for GUIDs, which is atomic.
+ *
+ *   struct ofsConfig config = {OFS_FORMAT_AUTO, true, NULL, NULL, NULL};
+ *   struct ofsExtractor *ofs = ofsCreate(&config);
+ *
+ *   while (<more data>) {
+ *     ofsFeed(ofs, data, length);
+ *   }
+ *   ofsFinish(ofs);
+ *   numFiles = ofsMakeFiles(ofs, 0, false, NULL, &files);
+ *   ...
+ *   ofsFreeFiles(files, numFiles);
+ *   ofsDestroy(ofs);
+ */
+
+#if defined(_WIN32) && defined(OFS_BUILDING_LIBRARY)
+#define OFS_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define OFS_API __attribute__((visibility("default")))
+#else
+#define OFS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OFS_MAX_PLANES (32)
+
+enum ofsFormat {
+  OFS_FORMAT_AUTO, // Worked out from the first bytes.
+  OFS_FORMAT_ANNEXB,
+  OFS_FORMAT_TS, // 188 byte TS or 192 byte M2TS.
+  OFS_FORMAT_MKV
+};
+
+/*
+ * Gets each OFMD (the payload of its SEI after the UUID) and the offset of
+ * the SEI's start code in the stream. Return non-zero to stop.
+ */
+typedef int (*ofsOFMDCallback)(void *user, const uint8_t *OFMD,
+                               size_t length, int64_t offset);
+
+/*
+ * Gets the depth values of one GOP. 'depths[plane]' has 'numFrames' values,
+ * and the first one belongs to frame 'firstFrame'. Planes the OFMD doesn't
+ * have are 0x80 (undefined). Return non-zero to stop.
+ */
+typedef int (*ofsDepthsCallback)(void *user, const uint8_t *const *depths,
+                                 int numOfPlanes, int numFrames,
+                                 int firstFrame);
+
+struct ofsConfig {
+  enum ofsFormat format;
+  bool keepPlanes; // Needed by 'ofsMakeFiles'. Off to only get callbacks.
+  ofsOFMDCallback onOFMD;     // Both can be NULL.
+  ofsDepthsCallback onDepths;
+  void *user;
+};
+
+// What has been found so far.
+struct ofsInfo {
+  enum ofsFormat format; // OFS_FORMAT_AUTO until it's been worked out.
+  int numOFMDs;
+  int numOfPlanes; // Of the first OFMD.
+  int frameRate;   // The OFS frame_rate value. (See the README's table)
+  int totalFrames;
+  int64_t bytesFed;
+};
+
+// One finished OFS file.
+struct ofsFile {
+  int plane;
+  uint8_t *data;
+  size_t size;
+};
+
+struct ofsExtractor;
+
+// Returns NULL if 'config' is NULL or it's out of memory.
+OFS_API struct ofsExtractor *ofsCreate(const struct ofsConfig *config);
+
+/*
+ * Pushes the next 'length' bytes of the stream.
+ * Returns 0, 1 once a callback stopped the extractor, or -1 if it's out of
+ * memory. Anything fed after that is ignored.
+ */
+OFS_API int ofsFeed(struct ofsExtractor *ofs, const void *data,
+                    size_t length);
+
+// Ends the stream and parses what's left. Returns the same as 'ofsFeed'.
+OFS_API int ofsFinish(struct ofsExtractor *ofs);
+
+OFS_API void ofsGetInfo(const struct ofsExtractor *ofs, struct ofsInfo *info);
+
+/*
+ * Builds an OFS file in memory for every plane that has a defined depth.
+ * Needs 'keepPlanes' and should be called after 'ofsFinish'.
+ *
+ * 'frameRate': Overrides the stream's frame_rate value if it's not 0.
+ * 'dropFrame': Sets drop_frame_flag. (Only for frame_rate 4)
+ * 'GUID': The first 15 bytes of the GUID or NULL for a random one. The
+ *         last byte is always the plane number.
+ * Returns the number of files or -1.
+ */
+OFS_API int ofsMakeFiles(const struct ofsExtractor *ofs, int frameRate,
+                         bool dropFrame, const uint8_t *GUID,
+                         struct ofsFile **files);
+
+OFS_API void ofsFreeFiles(struct ofsFile *files, int numFiles);
+
+OFS_API void ofsDestroy(struct ofsExtractor *ofs);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,78 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+#define OFSIDX_NAME "3D-Planes.ofsidx"
+#define OFSIDX_MAGIC "OFSIDX\x00\x01" // Name and version.
+#define OFSIDX_SAMPLES (16)           // Blocks hashed to spot a changed file.
+#define OFSIDX_SAMPLE_SIZE (4096)
+
+// What an input file looked like when it was indexed.
+struct indexKey {
+  int64_t size;
+  int64_t mtime;
+  uint64_t hash; // Of OFSIDX_SAMPLES blocks spread over the file.
+};
+
+// Where to find one OFMD again.
+struct indexEntry {
+  int64_t offset; // Of the SEI's start code, like the 'OFMDCallback' gets.
+  uint32_t length;
+  int frameCount;
+};
+
+/*
+ * The OFMDs of every input file, in file order.
+ * 'fileEntries' has the number of entries that belong to each file.
+ */
+struct ofsIndex {
+  int numFiles;
+  struct indexKey *keys;
+  int *fileEntries;
+  int numEntries;
+  struct indexEntry *entries;
+};
+
+/*
+ * Fills 'key' from the size and mtime of 'filename' and a hash of a few
+ * blocks spread over it. Returns -1 if it isn't a regular file.
+ */
+int makeIndexKey(const char *filename, struct indexKey *key);
+
+// Returns -1 if 'path' is missing or isn't a whole index.
+int readIndex(const char *path, struct ofsIndex *index);
+
+// Writes a temp file and renames it over 'path'.
+int writeIndex(const char *path, const struct ofsIndex *index);
+
+// True if 'index' was made from these exact files.
+bool indexMatches(const struct ofsIndex *index, const char **filenames,
+                  int numFiles);
+
+void freeIndex(struct ofsIndex *index);
@@ -0,0 +1,78 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "analytics.h"
+#include "util.h"
+
+#define RLE_NAME "3D-Planes.ofsrle"
+#define RLE_MAGIC "OFSRLE\x00\x01" // Name and version.
+
+/*
+ * A 3D-Plane as runs of the same depth value. Depths hardly ever change, so
+ * a title with hundreds of thousands of frames only has a few thousand runs.
+ */
+struct depthRun {
+  int end; // The frame after the last one of the run.
+  BYTE depth;
+};
+
+struct rlePlane {
+  int numRuns; // Next to each other they never have the same depth.
+  int capacity;
+  struct depthRun *runs;
+};
+
+struct rlePlanes {
+  int numOfPlanes;
+  int numFrames;
+  struct rlePlane planes[MAXPLANES];
+};
+
+void initRLEPlanes(struct rlePlanes *rle, int numOfPlanes);
+
+void freeRLEPlanes(struct rlePlanes *rle);
+
+int addRLEDepths(struct rlePlane *plane, int first, const BYTE *depths,
+                 int count);
+
+int addRLEOFMD(struct rlePlanes *rle, const BYTE *OFMD);
+
+int encodeRLEPlanes(BYTE *const *planes, int numOfPlanes, int numFrames,
+                    struct rlePlanes *rle);
+
+int findRun(const struct rlePlane *plane, int frame);
+
+void getRLEDepths(const struct rlePlane *plane, int first, int count,
+                  BYTE *depths);
+
+bool sameRLEPlanes(const struct rlePlane *a, const struct rlePlane *b);
+
+int writeRLEFile(const char *outFolder, const struct rlePlanes *rle,
+                 BYTE frameRate, const int *validPlanes);
+
+int readRLEFile(const char *outFolder, struct rlePlanes *rle, BYTE *frameRate,
+                int *validPlanes);
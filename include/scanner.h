@@ -0,0 +1,56 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdlib.h>
+
+#include "util.h"
+
+// NAL header for SEIs (nal_unit_type 6) and the payloadType of the
+// MVC scalable nesting SEI which carries the OFMD on 3D Blu-rays.
+#define NAL_HEADER_SEI (0x06)
+#define NAL_HEADER_MASK (0x9F) // forbidden_zero_bit and nal_unit_type.
+#define SEI_MVC_NESTING (0x25)
+
+enum scannerLevel { SCANNER_SCALAR, SCANNER_SSE2, SCANNER_AVX2 };
+
+/*
+ * Finds the next Annex-B start code ('00 00 01') where the NAL header byte
+ * matches 'header' under 'headerMask', and the byte after that matches
+ * 'payload' under 'payloadMask'. A mask of 0 matches anything.
+ *
+ * Returns a pointer to the first '00' of the start code or NULL.
+ * Never looks at a byte twice, so zero filled input is as fast as any other.
+ */
+const BYTE *findStartCode(const BYTE *data, size_t length, BYTE header,
+                          BYTE headerMask, BYTE payload, BYTE payloadMask);
+
+// Same as 'findStartCode', but only uses the given instruction set.
+const BYTE *findStartCodeWith(enum scannerLevel level, const BYTE *data,
+                              size_t length, BYTE header, BYTE headerMask,
+                              BYTE payload, BYTE payloadMask);
+
+// The best instruction set this CPU supports.
+enum scannerLevel scannerLevel();
+
+const char *scannerLevelName(enum scannerLevel level);
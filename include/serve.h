@@ -0,0 +1,90 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SERVE_MAX_REQUEST (64 * 1024) // Longest request line.
+#define SERVE_MAX_FIELDS (32)
+#define SERVE_QUEUE (64)  // Connections waiting for a worker.
+#define SERVE_TIMEOUT (10) // Seconds a client has to send its request.
+
+// One member of a request's JSON object.
+struct serveField {
+  const char *name;
+  const char *value; // Numbers and booleans as text. NULL for null.
+  bool isString;
+};
+
+// A job that came in over the socket.
+struct serveRequest {
+  int job;     // Numbered from 1 in the order they came in.
+  FILE *reply; // Lines of JSON back to the client.
+  int numFields;
+  struct serveField fields[SERVE_MAX_FIELDS];
+};
+
+// Runs one request and sends its "result" line.
+typedef void (*serveHandler)(void *context, struct serveRequest *request);
+
+/*
+ * Reads a flat JSON object of strings, numbers, booleans, and nulls in place.
+ * The fields point into 'text'. Returns -1 if it's broken or nested.
+ */
+int parseRequest(char *text, struct serveRequest *request);
+
+bool fieldInt(const struct serveField *field, int *value);
+
+bool fieldBool(const struct serveField *field, bool *value);
+
+/*
+ * Listens on the Unix domain socket 'path' and hands each request to one of
+ * 'numWorkers' workers. A connection is one request (a JSON object on one
+ * line) and gets back a line of JSON for each event:
+ *
+ *   {"event": "accepted", "job": 1}
+ *   {"event": "progress", "job": 1, "percent": 42}
+ *   {"event": "result", "job": 1, "ok": true, ...}
+ *
+ * Each worker keeps its input buffer from one job to the next.
+ * Only returns if the server couldn't be started.
+ */
+int runServer(const char *path, int numWorkers, serveHandler handler,
+              void *context);
+
+// Removes the socket. Safe to call from a signal handler.
+void stopServer();
+
+// Sends a "result" line that isn't ok.
+void sendServeError(struct serveRequest *request, const char *error);
+
+// 'progressCallback' which sends a "progress" line for a 'serveRequest'.
+void sendServeProgress(void *request, int percent);
+
+/*
+ * Sends 'request' to the server at 'path' and prints every line it sends
+ * back. Returns the exit code, which is 0 if the job's result was ok.
+ */
+int runClient(const char *path, const struct serveRequest *request);
@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "nal.h"
+#include "util.h"
+
+#define TS_PACKET_SIZE (188)
+#define M2TS_PACKET_SIZE (192) // 4 byte TP_extra_header + TS packet.
+#define TS_SYNC_BYTE (0x47)
+
+// Packets in a row that need a sync byte before the packet size is trusted.
+#define TS_PROBE_PACKETS (5)
+#define TS_PROBE_SIZE (M2TS_PACKET_SIZE * (TS_PROBE_PACKETS + 1))
+
+#define TS_PID_PAT (0x0000)
+#define TS_PID_MVC (0x1012) // The dependent view on 3D Blu-rays.
+#define TS_STREAM_TYPE_AVC (0x1B)
+#define TS_STREAM_TYPE_MVC (0x20)
+
+/*
+ * Push demuxer for 188 byte TS and 192 byte M2TS packets.
+ *
+ * Only the payload of the video PID is passed on to the NAL parser (without
+ * its PES headers). Every other packet is dropped after its 4 byte header.
+ */
+struct tsDemuxer {
+  struct nalParser *parser; // Can be NULL to only look for the PAT and PMT.
+  int packetSize;
+  int pmtPID;   // -1 until the PAT has been seen.
+  int videoPID; // TS_PID_MVC until the PMT says otherwise.
+  bool pmtFound;
+  bool mvcFound; // SSIFs have a PMT without MVC for the base view too.
+  bool fixedPID; // Set by 'setTSVideoPID'. The PMT won't change it.
+  size_t pesSkip; // PES header bytes still to skip in the next packet.
+  BYTE packet[M2TS_PACKET_SIZE]; // A packet split between two chunks.
+  size_t packetLength;
+  int64_t packetOffset;
+  uint64_t numPackets;
+  uint64_t numVideoPackets;
+};
+
+/*
+ * Checks if 'data' starts like a transport stream.
+ * Returns the packet size (188 or 192) or 0 if it isn't one.
+ * 'firstPacket' is set to the offset of the first whole packet.
+ */
+int probeTS(const BYTE *data, size_t length, size_t *firstPacket);
+
+void initTSDemuxer(struct tsDemuxer *demux, struct nalParser *parser,
+                   int packetSize);
+
+// Uses 'pid' for the video, no matter what the PMT says.
+void setTSVideoPID(struct tsDemuxer *demux, int pid);
+
+int feedTSDemuxer(struct tsDemuxer *demux, const BYTE *data, size_t length,
+                  int64_t offset);
+
+bool tsDemuxerIdle(struct tsDemuxer *demux);
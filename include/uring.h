@@ -0,0 +1,69 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+#define URING_QUEUE_DEPTH (4) // Reads kept in flight while scanning.
+#define URING_MAX_DEPTH (64)
+
+/*
+ * Read-ahead over io_uring for regular files.
+ *
+ * The reader owns a ring of 'depth' slots. Each slot is 'headroom' bytes
+ * followed by a 'blockSize' byte block, so the unconsumed tail of one block
+ * can be put in front of the next without moving the block itself. While the
+ * caller scans one block, the reads for the following blocks are already
+ * queued. The slots are registered with the kernel when RLIMIT_MEMLOCK
+ * allows it.
+ *
+ * Only available on Linux builds with the 'io_uring' meson feature. Elsewhere
+ * 'openUringReader' always fails so the caller can fall back to pread.
+ */
+struct uringReader;
+
+// Returns NULL if io_uring isn't available.
+struct uringReader *openUringReader(int fd, int64_t fileSize, size_t headroom,
+                                    size_t blockSize, int depth);
+
+/*
+ * Waits for the next block and copies 'carry' in front of it.
+ * The block from the previous call is given back to the ring.
+ * Returns the start of the block or NULL once there's nothing left to read.
+ * 'length' is set to the number of bytes read into the block.
+ */
+BYTE *nextUringBlock(struct uringReader *reader, const BYTE *carry,
+                     size_t carryLength, size_t *length);
+
+/*
+ * Moves the reader to 'offset'. Blocks which are already queued are kept if
+ * 'offset' is inside them. Returns the file offset of the block the next
+ * 'nextUringBlock' will return, which can be in front of 'offset'.
+ */
+int64_t seekUringReader(struct uringReader *reader, int64_t offset);
+
+void closeUringReader(struct uringReader *reader);
@@ -23,14 +23,20 @@
  */
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#define BUFFER_SIZE (1024 * 128) // 128KB
-#define OFMD_SIZE (4096)         // 4KB
-
 typedef unsigned char BYTE;
 
+#define HASH_SEED (0xcbf29ce484222325ULL)
+
+#ifdef _WIN32 // Windows uses backslashes in it's path.
+#define PATH_SEPARATOR "\\"
+#else
+#define PATH_SEPARATOR "/"
+#endif
+
 #if _WIN32
 char *basename(char *path);
 #else
@@ -51,4 +57,26 @@ int delDirectory(const char *path);
 
 void free2DArray(void ***array, int array2DSize);
 
+void *alignedAlloc(size_t alignment, size_t size);
+
+void alignedFree(void *memory);
+
 const char *getFileExt(const char *fileName);
+
+bool hasInputExt(const char *fileName);
+
+double currentSeconds();
+
+void writeJSONString(FILE *out, const char *text);
+
+char *absolutePath(const char *path);
+
+uint64_t hashBytes(uint64_t hash, const BYTE *data, size_t length);
+
+void writeLE(BYTE *data, uint64_t value, int size);
+
+uint64_t readLE(const BYTE *data, int size);
+
+int replaceFile(const char *path, const BYTE *data, size_t size);
+
+int takeStdout();
@@ -23,334 +23,1390 @@
  */
 #define _FILE_OFFSET_BITS 64
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "3dplanes.h"
+#include "checkpoint.h"
+#include "input.h"
+#include "mkv.h"
+#include "nal.h"
+#include "ofmd.h"
+#include "ofs.h"
+#include "ofsidx.h"
+#include "parallel.h"
+#include "rle.h"
+#include "ts.h"
 #include "util.h"
 
-#ifdef _WIN32
-#include <fcntl.h>
-#include <io.h>
-#endif
+#define MIN_RANGE_SIZE (1024 * 1024 * 32) // 32MB
+#define PID_PROBE_SIZE (1024 * 1024 * 16)  // How far to look for the PMT
+                                           // or the MKV Tracks.
+
+// An index only needs the few KB around each OFMD, but MKV SEIs are read
+// whole.
+#define INDEX_BLOCK_SIZE (1024 * 16)
+#define INDEX_LOOKAHEAD (MAX_SEI_SIZE + 8)
+
+// OFMDs copied into the planes by each task of 'getPlanesFromOFMDs'.
+#define TRANSPOSE_BLOCK (256)
+
+// The input only has to hold on to enough bytes to work out the format, or
+// find a Cluster. The NAL parser copies SEIs split between reads by itself.
+#define SCAN_LOOKAHEAD (TS_PROBE_SIZE)
+
+// Set by 'setQuietReports'.
+static bool quietReports;
+
+// Set by 'setMinRangeSize'.
+static int64_t minRangeSize = MIN_RANGE_SIZE;
+
+// Set by 'setProgressCallback' for the scans started on each thread.
+static _Thread_local progressCallback threadProgress;
+static _Thread_local void *threadProgressContext;
+
+enum streamType { STREAM_ANNEXB, STREAM_TS, STREAM_MKV };
+
+// What the input file is and where its video is.
+struct streamFormat {
+  enum streamType type;
+  int packetSize;     // TS only.
+  size_t firstPacket; // Offset of the first whole TS packet.
+  int videoPID;       // -1 to let the demuxer read it from the PMT.
+  int videoTrack;     // MKV only. -1 to let the demuxer read the Tracks.
+  int nalLengthSize;
+};
+
+// Shared by every thread scanning the same file.
+struct scanProgress {
+  pthread_mutex_t lock;
+  int64_t scanned;
+  int64_t total; // -1 if unknown (stdin).
+  int prevProgress;
+  bool prettyPrint;
+  progressCallback callback; // Gets the percentage instead of printing it.
+  void *callbackContext;
+};
 
 /*
- * Searches for all "valid" OFMDs within a 3D H264/MVC stream.
- * Which will be later used to create OFS '3D-Planes' files.
- *
- * 'storeSize': Size of resulting OFMD buffers.
- * 'bufferSize': Size of buffer that will be used when reading file in memory.
- * 'filename': The path to the 3D H264/MVC file.
- * 'OFMDs': Pointer to a 2D array which will contain the resulting OFMD buffers.
+ * Depth values decoded straight out of the OFMDs, one growing array for each
+ * plane. Planes are added when an OFMD has more of them than the ones before,
+ * but only the first OFMD's 'numOfPlanes' end up in the OFMDdata.
  */
-int getOFMDsInFile(size_t storeSize, size_t bufferSize, const char *filename,
-                   bool prettyPrint, BYTE ***OFMDs) {
-  const size_t sizeByte = sizeof(unsigned char);
-  const size_t sizeBypePtr = sizeof(unsigned char *);
-  const size_t OFMDSearchSize = 200;
-  int frameRate = 0;
-  int OFMDCounter = 0;
-
-  const unsigned char seiString[4] = {0x00, 0x01, 0x06, 0x25};
-  const size_t seiSize = 4;
-
-  FILE *filePtr;
-  off_t fileSize = 0;
-  size_t fileRead = 0;
-  bool useStdin = false;
-  unsigned char *buffer = (unsigned char *)malloc(sizeByte * bufferSize);
-  unsigned char *bufferPtr = buffer;
-  size_t origBufferSize = bufferSize;
-  unsigned char *match = NULL;
-
-  int progress = 0;
-  int prevProgress = 0;
-  int whileTimerStart = time(NULL);
-  int OFMDTimerStart = time(NULL);
-  const int timeout = 10;
+struct planeArrays {
+  int numOfPlanes; // Of the first OFMD.
+  int numArrays;
+  int frameRate;
+  int numFrames;
+  int capacity;
+  int numOFMDs;
+  BYTE *planes[MAXPLANES];
+};
+
+// The OFMDs found in one byte range of the input file.
+struct OFMDrange {
+  int file; // Index into 'scanContext.filenames'.
+  int64_t start;
+  int64_t end;
+  struct OFMDstore OFMDs;    // Filled by 'addOFMD'.
+  struct planeArrays planes; // Filled by 'decodeOFMD'.
+  int64_t resumeAfter; // OFMDs up to here came from the checkpoint.
+  int result;
+};
+
+struct scanContext {
+  const char **filenames;
+  size_t bufferSize;
+  struct streamFormat *formats; // One for each file.
+  enum inputBackend backend;
+  struct OFMDrange *ranges;
+  int numRanges;
+  struct scanProgress progress;
+  OFMDCallback callback;
+  void *callbackContext; // Gets every OFMD if set. (Only with 1 thread.)
+                         // Otherwise each range gets its own.
+  int64_t limit;         // Don't scan past this offset if it's not 0.
+  bool quiet;            // Don't print the progress.
+  struct checkpoint *checkpoint; // NULL unless the scan is checkpointed.
+                                 // (Only with 1 thread.)
+};
+
+// Reports the overall progress, but only if the percentage changed.
+static void addProgress(struct scanProgress *progress, int64_t bytes) {
+  int percent;
+
+  if (bytes <= 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&progress->lock);
+  progress->scanned += bytes;
+  if (progress->total <= 0) {
+    pthread_mutex_unlock(&progress->lock);
+    return;
+  }
+  percent = (float)progress->scanned / (float)progress->total * 100;
+  if (percent != progress->prevProgress) {
+    if (progress->callback != NULL) {
+      progress->callback(progress->callbackContext, percent);
+    } else if (progress->prettyPrint) {
+      printf("\rProgress: %d%s", percent, "%");
+      fflush(stdout);
+    } else {
+      printf("Progress: %d%s\n", percent, "%");
+      fflush(stdout);
+    }
+    progress->prevProgress = percent;
+  }
+  pthread_mutex_unlock(&progress->lock);
+}
+
+// The start of the TS packet 'offset' is in.
+static int64_t packetStart(const struct streamFormat *format, int64_t offset) {
+  int64_t packet = (offset - (int64_t)format->firstPacket) / format->packetSize;
+
+  return format->firstPacket + packet * format->packetSize;
+}
+
+// 'OFMDCallback' which stores an exact copy of the OFMD into the range.
+static int addOFMD(void *context, const BYTE *OFMD, size_t length,
+                   int64_t offset) {
+  struct OFMDrange *range = (struct OFMDrange *)context;
+
+  if (addOFMDToStore(&range->OFMDs, OFMD, length, offset) == -1) {
+    range->result = -1;
+    return 1;
+  }
+
+  return 0;
+}
 
-  if ((strlen(filename) == 1) && (strncmp(filename, "-", 1) == 0)) {
-    useStdin = true;
+static void freePlaneArrays(struct planeArrays *arrays) {
+  for (int plane = 0; plane < arrays->numArrays; plane++) {
+    free(arrays->planes[plane]);
   }
+  memset(arrays, 0, sizeof(struct planeArrays));
+}
 
-  // Set stdin to binary mode.
-  if (useStdin) {
-#ifdef _WIN32
-    // Windows doesn't except 'NULL' as parameter for freopen.
-    int result = _setmode(_fileno(stdin), _O_BINARY);
+// Makes room for 'numFrames' in every plane. Returns -1 if out of memory.
+static int growPlaneArrays(struct planeArrays *arrays, int numFrames) {
+  int capacity = arrays->capacity > 0 ? arrays->capacity : 1024 * 16;
+
+  while (capacity < numFrames) {
+    capacity *= 2;
+  }
+  if (capacity == arrays->capacity) {
+    return 0;
+  }
 
-    if (result == -1) {
-      perror("_setmode()");
+  for (int plane = 0; plane < arrays->numArrays; plane++) {
+    BYTE *grown = (BYTE *)realloc(arrays->planes[plane], capacity);
+    if (grown == NULL) {
+      perror("realloc()");
       return -1;
     }
-#else
-    filePtr = freopen(NULL, "rb", stdin);
+    arrays->planes[plane] = grown;
+  }
+  arrays->capacity = capacity;
+
+  return 0;
+}
 
-    if (filePtr == NULL) {
-      perror("freopen()");
+// Adds planes up to 'numArrays'. They're undefined (0x80) until now.
+static int addPlaneArrays(struct planeArrays *arrays, int numArrays) {
+  while (arrays->numArrays < numArrays) {
+    BYTE *plane = (BYTE *)malloc(arrays->capacity);
+    if (plane == NULL) {
+      perror("malloc()");
       return -1;
     }
-#endif
+    memset(plane, 0x80, arrays->numFrames);
+    arrays->planes[arrays->numArrays++] = plane;
   }
 
-  if (useStdin) {
-    filePtr = stdin;
-  } else {
-    filePtr = fopen(filename, "rb");
+  return 0;
+}
+
+// 'OFMDCallback' which decodes the depth values of the OFMD into the range.
+static int decodeOFMD(void *context, const BYTE *OFMD, size_t length,
+                      int64_t offset) {
+  struct OFMDrange *range = (struct OFMDrange *)context;
+  struct planeArrays *arrays = &range->planes;
+  int frameCount = OFMD[11] & 127;
+  int planesInOFMD = OFMD[10] & 0x7F;
+  (void)length;
+  (void)offset;
+
+  if (planesInOFMD > MAXPLANES) {
+    planesInOFMD = MAXPLANES;
+  }
+  if (arrays->numOFMDs == 0) {
+    arrays->numOfPlanes = planesInOFMD;
+    arrays->frameRate = OFMD[4] & 15;
   }
 
-  if (!useStdin) {
-    // Get File Size
-    fseeko(filePtr, 0, SEEK_END);
-    fileSize = ftello(filePtr);
-    fseeko(filePtr, 0, SEEK_SET);
+  if (growPlaneArrays(arrays, arrays->numFrames + frameCount) == -1 ||
+      addPlaneArrays(arrays, planesInOFMD) == -1) {
+    range->result = -1;
+    return 1;
   }
 
-  // Initilize buffer.
-  fileRead = fread(buffer, sizeByte, bufferSize, filePtr);
+  // Depths are stored like this: (14 + (plane * frameCount)) to
+  // (14 + (plane * frameCount) + frameCount).
+  for (int plane = 0; plane < arrays->numArrays; plane++) {
+    BYTE *dest = arrays->planes[plane] + arrays->numFrames;
 
-  // Find first seiString
-  while ((match = searchNative(bufferPtr, bufferSize, seiString, seiSize)) ==
-         NULL) {
-    // Shift buffer by (bufferSize - (seiSize - 1))
-    memmove(buffer, buffer + (bufferSize - (seiSize - 1)), (seiSize - 1));
-    fileRead = fread(buffer + (seiSize - 1), sizeByte,
-                     bufferSize - (seiSize - 1), filePtr);
-    // Stop if timeout reached.
-    if ((time(NULL) - whileTimerStart) > timeout) {
-      fprintf(stderr, "SEI couldn't be found within %d seconds.\n", timeout);
-      return -1;
+    // The OFMD is only as long as its own planes.
+    if (plane >= planesInOFMD) {
+      memset(dest, 0x80, frameCount);
+    } else {
+      memcpy(dest, OFMD + 14 + (plane * frameCount), frameCount);
     }
   }
-  bufferSize -= (match - bufferPtr);
-  bufferPtr = match;
-
-  memmove(buffer, bufferPtr, bufferSize);
-  fileRead = fread(buffer + bufferSize, sizeByte, origBufferSize - bufferSize,
-                   filePtr);
-  bufferSize += fileRead;
-  bufferPtr = buffer;
-
-  while ((match = searchNative(bufferPtr, bufferSize, seiString, seiSize)) !=
-         NULL) {
-    // Make match the start of buffer
-    bufferSize -= (match - bufferPtr);
-    bufferPtr = match;
-
-    if (!feof(filePtr)) {
-      // if bufferSize is too small read more data
-      if ((storeSize * 2) > bufferSize) {
-        memmove(buffer, bufferPtr, bufferSize);
-        fileRead = fread(buffer + bufferSize, sizeByte,
-                         origBufferSize - bufferSize, filePtr);
-        bufferSize += fileRead;
-        bufferPtr = buffer;
-      }
+  arrays->numFrames += frameCount;
+  arrays->numOFMDs++;
+
+  return 0;
+}
+
+// Where each range's depths go in 'getPlanesInFiles'.
+struct mergeJob {
+  struct OFMDrange *ranges;
+  const int *firstFrames; // Of each range.
+  struct OFMDdata *OFMDdata;
+};
+
+// Copies the depth values of one range into the planes.
+static void mergeRangeTask(void *context, int index) {
+  struct mergeJob *job = (struct mergeJob *)context;
+  const struct planeArrays *arrays = &job->ranges[index].planes;
+
+  for (int plane = 0; plane < job->OFMDdata->numOfPlanes; plane++) {
+    BYTE *dest = job->OFMDdata->planes[plane] + job->firstFrames[index];
+
+    if (plane < arrays->numArrays) {
+      memcpy(dest, arrays->planes[plane], arrays->numFrames);
+    } else {
+      memset(dest, 0x80, arrays->numFrames);
     }
+  }
+}
+
+// Moves 'input' to the first Cluster after 'range->start'. False if none.
+static bool findFirstCluster(struct inputSource *input,
+                             struct OFMDrange *range) {
+  const BYTE *match;
 
-    // Search for OFMD within the next 200 bytes from the seiString.
-    match = searchNative(bufferPtr, OFMDSearchSize, "OFMD", 4);
+  while (input->position < range->end &&
+         fillInput(input, MKV_CLUSTER_HEADER_SIZE) >= MKV_CLUSTER_HEADER_SIZE) {
+    match = findMKVCluster(input->data, input->length);
     if (match != NULL) {
-      // Move OFMD to start of buffer.
-      bufferSize -= (match - bufferPtr);
-      bufferPtr = match;
-
-      // Make sure the OFMD is valid before loading it into the OFMDs.
-      frameRate = bufferPtr[4] & 15;
-      if (frameRate >= 1 && frameRate <= 7 && frameRate != 5) {
-        // Make room to store data into 2D array.
-        *OFMDs =
-            (unsigned char **)realloc(*OFMDs, sizeBypePtr * (OFMDCounter + 1));
-        (*OFMDs)[OFMDCounter] = (unsigned char *)malloc(sizeByte * storeSize);
-        // Copy the data to OFMDs.
-        memcpy((*OFMDs)[OFMDCounter++], bufferPtr, storeSize);
-      }
+      skipInput(input, match - input->data);
+      return true;
+    }
+    // Keep the last few bytes in case the Cluster header is split.
+    skipInput(input, input->length - (MKV_CLUSTER_HEADER_SIZE - 1));
+  }
+
+  return false;
+}
+
+// What 'checkpointOFMD' needs to know about the range being scanned.
+struct checkpointScan {
+  struct scanContext *context;
+  struct OFMDrange *range;
+  void *callbackContext;
+  struct mkvDemuxer *mkv;
+};
+
+// 'OFMDCallback' which saves the OFMD to the checkpoint and passes it on.
+static int checkpointOFMD(void *context, const BYTE *OFMD, size_t length,
+                          int64_t offset) {
+  struct checkpointScan *scan = (struct checkpointScan *)context;
+  struct OFMDrange *range = scan->range;
+  const struct streamFormat *format = &scan->context->formats[range->file];
+  int64_t resumeOffset = offset;
+
+  // It came from the checkpoint already.
+  if (offset <= range->resumeAfter) {
+    return 0;
+  }
+
+  // Where a new scan has to start to find this OFMD again.
+  if (format->type == STREAM_TS) {
+    resumeOffset = packetStart(format, offset);
+  } else if (format->type == STREAM_MKV) {
+    resumeOffset = scan->mkv->clusterOffset > 0 ? scan->mkv->clusterOffset : 0;
+  }
+  addCheckpointOFMD(scan->context->checkpoint, range->file, OFMD, length,
+                    offset, resumeOffset);
+
+  return scan->context->callback(scan->callbackContext, OFMD, length, offset);
+}
+
+/*
+ * Parses every SEI whose start code begins within 'range'.
+ *
+ * The parser stops at the first start code past 'range->end', so the ranges
+ * never share an SEI. That's what lets the file be split between threads.
+ * Bytes past 'range->end' are still read if an SEI crosses it.
+ * Transport streams and MKVs go through their demuxer first, so only the
+ * video PID or track reaches the parser. MKV ranges own the Clusters that
+ * start inside them instead.
+ *
+ * 'useTimeout': Give up if no SEI or OFMD shows up within 10 seconds.
+ */
+static int scanRange(struct inputSource *input, struct scanContext *context,
+                     struct OFMDrange *range, bool useTimeout) {
+  // Feed mapped files in slices too, so the progress and timeouts still work.
+  const size_t sliceSize = INPUT_BLOCK_SIZE;
+  const struct streamFormat *format = &context->formats[range->file];
+  struct scanProgress *progress = &context->progress;
+  struct nalParser parser;
+  struct tsDemuxer demux;
+  struct mkvDemuxer mkv;
+  struct checkpointScan scan = {context, range, context->callbackContext, &mkv};
+  bool idle;
+  bool eof = false;
+  size_t size;
+  uint64_t numSEIs = 0;
+  int64_t reported = range->start;
+  int64_t done;
+  int result = 0;
+
+  time_t whileTimerStart = time(NULL);
+  time_t OFMDTimerStart = time(NULL);
+  const int timeout = 10;
+
+  if (scan.callbackContext == NULL) {
+    scan.callbackContext = range;
+  }
+  if (context->checkpoint != NULL) {
+    result = initNALParser(&parser, checkpointOFMD, &scan);
+  } else {
+    result = initNALParser(&parser, context->callback, scan.callbackContext);
+  }
+  if (result == -1) {
+    return -1;
+  }
+  parser.stopOffset = range->end;
+
+  if (format->type == STREAM_TS) {
+    initTSDemuxer(&demux, &parser, format->packetSize);
+    if (format->videoPID != -1) {
+      setTSVideoPID(&demux, format->videoPID);
+    }
+  }
+
+  if (format->type == STREAM_MKV) {
+    if (initMKVDemuxer(&mkv, &parser) == -1) {
+      freeNALParser(&parser);
+      return -1;
+    }
+    if (format->videoTrack != -1) {
+      setMKVTrack(&mkv, format->videoTrack, format->nalLengthSize);
+    }
+  }
+
+  skipInput(input, range->start - input->position);
+  if (format->type == STREAM_MKV && range->start > 0 &&
+      !findFirstCluster(input, range)) {
+    parser.stopped = true; // Nothing starts in this range.
+  }
+
+  while (!parser.stopped) {
+    if (format->type == STREAM_TS) {
+      idle = tsDemuxerIdle(&demux);
+    } else if (format->type == STREAM_MKV) {
+      idle = false; // Only the next Cluster ends the last one.
     } else {
-      // If our bufferSize gets this small we're probably done.
-      if (feof(filePtr) && bufferSize <= OFMDSearchSize) {
-        break;
-      }
-      // Skip if the OFMD is not valid.
-      bufferSize -= OFMDSearchSize;
-      bufferPtr += OFMDSearchSize;
+      idle = nalParserIdle(&parser);
+    }
+    if (input->position >= range->end && idle) {
+      break;
+    }
+
+    if (fillInput(input, 1) == 0) {
+      flushNALParser(&parser);
+      eof = true;
+      break;
+    }
+
+    size = input->length < sliceSize ? input->length : sliceSize;
+    if (format->type == STREAM_TS) {
+      feedTSDemuxer(&demux, input->data, size, input->position);
+    } else if (format->type == STREAM_MKV) {
+      feedMKVDemuxer(&mkv, input->data, size, input->position);
+    } else {
+      feedNALParser(&parser, input->data, size, input->position);
+    }
+    skipInput(input, size);
+    if (format->type == STREAM_MKV) {
+      skipInput(input, takeMKVSkip(&mkv));
+    }
+
+    if (parser.numSEIs != numSEIs) {
+      numSEIs = parser.numSEIs;
+      whileTimerStart = time(NULL);
+    }
+
+    // Stop if timeout reached.
+    if (useTimeout && (time(NULL) - whileTimerStart) > timeout) {
+      fprintf(stderr, "SEI couldn't be found within %d seconds.\n", timeout);
+      result = -1;
+      break;
     }
 
-    // Check if OFMDCounter has increased before the timeout.
-    if (OFMDCounter == 0) {
+    // Check if an OFMD has been found before the timeout.
+    if (useTimeout && parser.numOFMDs == 0) {
       if ((time(NULL) - OFMDTimerStart) > timeout) {
         fprintf(stderr, "No 3D-Planes found after %d seconds.\n", timeout);
-        return -1;
+        result = -1;
+        break;
       }
     }
 
-    if (!feof(filePtr)) {
-      // If the next seiString can't be found.
-      // Fill buffer, and search for the next seiString.
-      if ((match = searchNative(bufferPtr, bufferSize, seiString, seiSize)) ==
-          NULL) {
-        memmove(buffer, bufferPtr, bufferSize);
-        fileRead = fread(buffer + bufferSize, sizeByte,
-                         origBufferSize - bufferSize, filePtr);
-        bufferSize += fileRead;
-        bufferPtr = buffer;
-      }
+    done = input->position < range->end ? input->position : range->end;
+    if (done > reported) {
+      addProgress(progress, done - reported);
+      reported = done;
+    }
+  }
+  freeNALParser(&parser);
+  if (format->type == STREAM_MKV) {
+    freeMKVDemuxer(&mkv);
+  }
 
-      whileTimerStart = time(NULL);
-      while ((match = searchNative(bufferPtr, bufferSize, seiString,
-                                   seiSize)) == NULL) {
-        // Shift buffer by (bufferSize - (seiSize - 1))
-        memmove(buffer, buffer + (bufferSize - (seiSize - 1)), (seiSize - 1));
-        fileRead = fread(buffer + (seiSize - 1), sizeByte,
-                         bufferSize - (seiSize - 1), filePtr);
-        // Stop if timeout reached.
-        if ((time(NULL) - whileTimerStart) > timeout) {
-          fprintf(stderr, "SEI couldn't be found within %d seconds.\n",
-                  timeout);
-          return -1;
-        }
-      }
+  // A range the parser stopped early still counts as done.
+  if (result == 0 && !eof && range->end != INT64_MAX) {
+    addProgress(progress, range->end - reported);
+  }
+
+  return result;
+}
+
+static void scanRangeTask(void *arg, int index) {
+  struct scanContext *context = (struct scanContext *)arg;
+  struct OFMDrange *range = &context->ranges[index];
+  struct inputSource input;
+
+  if (openInput(&input, context->filenames[range->file], context->backend,
+                context->bufferSize, SCAN_LOOKAHEAD) == -1) {
+    range->result = -1;
+    return;
+  }
+
+  if (scanRange(&input, context, range, false) == -1) {
+    range->result = -1;
+  }
+  closeInput(&input);
+}
+
+// Works out if the input is a transport stream, without consuming any of it.
+static void probeFormat(struct inputSource *input,
+                        struct streamFormat *format) {
+  fillInput(input, TS_PROBE_SIZE);
+
+  format->type = STREAM_ANNEXB;
+  format->packetSize = 0;
+  format->firstPacket = 0;
+  format->videoPID = -1;
+  format->videoTrack = -1;
+  format->nalLengthSize = 4;
+
+  if (input->length >= 4 && memcmp(input->data, EBML_MAGIC, 4) == 0) {
+    format->type = STREAM_MKV;
+    return;
+  }
+
+  format->packetSize =
+      probeTS(input->data, input->length, &format->firstPacket);
+  if (format->packetSize > 0) {
+    format->type = STREAM_TS;
+  }
+}
+
+/*
+ * Reads the PAT and PMT at the start of a transport stream, so every range
+ * demuxes the same PID. Falls back to the Blu-ray MVC PID.
+ */
+static int probeVideoPID(struct inputSource *input,
+                         const struct streamFormat *format) {
+  struct tsDemuxer demux;
+  size_t size;
+
+  initTSDemuxer(&demux, NULL, format->packetSize);
+  while (!demux.mvcFound && input->position < PID_PROBE_SIZE &&
+         fillInput(input, 1) > 0) {
+    size = input->length < INPUT_BLOCK_SIZE ? input->length : INPUT_BLOCK_SIZE;
+    feedTSDemuxer(&demux, input->data, size, input->position);
+    skipInput(input, size);
+  }
+
+  return demux.videoPID;
+}
+
+/*
+ * Reads the Tracks at the start of an MKV, so the ranges which start in the
+ * middle of the file know which track to read.
+ */
+static int probeVideoTrack(struct inputSource *input,
+                           struct streamFormat *format) {
+  struct mkvDemuxer demux;
+  size_t size;
+
+  if (initMKVDemuxer(&demux, NULL) == -1) {
+    return -1;
+  }
+  while (!demux.clusterFound && input->position < PID_PROBE_SIZE &&
+         fillInput(input, 1) > 0) {
+    size = input->length < INPUT_BLOCK_SIZE ? input->length : INPUT_BLOCK_SIZE;
+    feedMKVDemuxer(&demux, input->data, size, input->position);
+    skipInput(input, size);
+    skipInput(input, takeMKVSkip(&demux));
+  }
+
+  format->videoTrack = demux.videoTrack;
+  format->nalLengthSize = demux.nalLengthSize;
+  freeMKVDemuxer(&demux);
+
+  return format->videoTrack;
+}
+
+/*
+ * Works out the format of the opened 'file' and adds its ranges to the end
+ * of 'context->ranges'. Returns the number of ranges added or -1.
+ */
+static int splitFile(struct scanContext *context, int file,
+                     struct inputSource *input, int numThreads,
+                     int numRanges) {
+  struct streamFormat *format = &context->formats[file];
+  struct OFMDrange *ranges;
+  int fileRanges = 1;
+
+  probeFormat(input, format);
+
+  // stdin and pipes can only be read from start to finish.
+  if (numThreads > 1 && input->fileSize > 0) {
+    fileRanges = numThreads * 4; // Smaller ranges balance better.
+    if (input->fileSize / minRangeSize < fileRanges) {
+      fileRanges = input->fileSize / minRangeSize;
+    }
+    if (fileRanges < 1) {
+      fileRanges = 1;
     }
+  }
+
+  if (fileRanges > 1 && format->type == STREAM_TS) {
+    format->videoPID = probeVideoPID(input, format);
+  }
+
+  // Without a video track every range but the first would skip everything.
+  // A resumed scan starts in the middle too.
+  if (format->type == STREAM_MKV &&
+      (fileRanges > 1 ||
+       (context->checkpoint != NULL && input->fileSize > 0)) &&
+      probeVideoTrack(input, format) == -1) {
+    fileRanges = 1;
+  }
+
+  ranges = (struct OFMDrange *)realloc(
+      context->ranges, sizeof(struct OFMDrange) * (numRanges + fileRanges));
+  if (ranges == NULL) {
+    perror("realloc()");
+    return -1;
+  }
+  context->ranges = ranges;
+  memset(context->ranges + numRanges, 0,
+         sizeof(struct OFMDrange) * fileRanges);
+
+  for (int x = 0; x < fileRanges; x++) {
+    struct OFMDrange *range = &context->ranges[numRanges + x];
+    int64_t start = input->fileSize * x / fileRanges;
 
-    if (!useStdin) {
-      progress = (float)ftello(filePtr) / (float)fileSize * 100;
-      if (progress != prevProgress) {
-        if (prettyPrint) {
-          printf("\rProgress: %d%s", progress, "%");
-          fflush(stdout);
-        } else {
-          printf("Progress: %d%s\n", progress, "%");
-          fflush(stdout);
-        }
-        prevProgress = progress;
+    // Transport stream ranges have to start on a packet.
+    if (x > 0 && format->type == STREAM_TS) {
+      start = packetStart(format, start);
+    }
+    initOFMDStore(&range->OFMDs);
+    range->file = file;
+    range->start = start;
+    range->resumeAfter = -1;
+    if (x > 0) {
+      range[-1].end = start;
+    }
+  }
+  context->ranges[numRanges + fileRanges - 1].end =
+      input->fileSize > 0 ? input->fileSize : INT64_MAX;
+  if (context->limit > 0) {
+    for (int x = 0; x < fileRanges; x++) {
+      struct OFMDrange *range = &context->ranges[numRanges + x];
+      if (range->end > context->limit) {
+        range->end = context->limit;
+      }
+      if (range->start > range->end) {
+        range->start = range->end;
       }
     }
   }
 
-  if (!useStdin) {
-    progress = (float)ftello(filePtr) / (float)fileSize * 100;
-    if (progress != prevProgress) {
-      if (prettyPrint) {
-        printf("\rProgress: %d%s", progress, "%");
-        printf("\n");
-        fflush(stdout);
-      } else {
-        printf("Progress: %d%s\n", progress, "%");
-        fflush(stdout);
-      }
-      prevProgress = progress;
+  return fileRanges;
+}
+
+/*
+ * Searches for all "valid" OFMDs within a 3D H264/MVC stream.
+ * Which will be later used to create OFS '3D-Planes' files.
+ *
+ * 'bufferSize': Size of each read when the file isn't memory-mapped.
+ * 'backend': How the file should be read. (See 'input.h')
+ * 'numThreads': Split regular files into ranges and scan them on this many
+ *               threads. The result is the same as scanning with 1 thread.
+ * 'filename': The path to the 3D H264/MVC file, or a TS/M2TS, or MKV file.
+ * 'indexPath': Where the '.ofsidx' of the input is kept or NULL.
+ *              If it's there and still matches the input, only the OFMDs
+ *              are read back from where it says. Otherwise the whole file is
+ *              scanned, and a new index is written.
+ * 'checkpoint': Saves the OFMDs to the output folder as they're found, or
+ *               NULL. (See 'checkpoint.h') Only works with 1 thread.
+ * 'OFMDs': An initialized store which gets the OFMDs in file order.
+ *          Each one is exactly as long as its SEI payload.
+ * Returns the number of OFMDs or -1.
+ */
+int getOFMDsInFile(size_t bufferSize, enum inputBackend backend,
+                   int numThreads, const char *filename, bool prettyPrint,
+                   const char *indexPath, struct checkpoint *checkpoint,
+                   struct OFMDstore *OFMDs) {
+  return getOFMDsInFiles(bufferSize, backend, numThreads, &filename, 1,
+                         prettyPrint, indexPath, checkpoint, OFMDs);
+}
+
+// 'checkpointReplay' which hands the OFMD to the callback of its file.
+static int replayOFMD(void *context, int file, const BYTE *OFMD,
+                      size_t length, int64_t offset) {
+  struct scanContext *scanContext = (struct scanContext *)context;
+  void *callbackContext = scanContext->callbackContext;
+
+  // With 1 thread every file is 1 range.
+  if (callbackContext == NULL) {
+    callbackContext = &scanContext->ranges[file];
+  }
+
+  return scanContext->callback(callbackContext, OFMD, length, offset);
+}
+
+/*
+ * Starts the checkpoint and puts back the OFMDs of the old one if there's
+ * one to resume. The ranges then start where the old scan got to.
+ */
+static void resumeScan(struct scanContext *context, int numFiles) {
+  struct checkpoint *checkpoint = context->checkpoint;
+  int64_t skipped = 0;
+  int file;
+
+  // The scan still filters the OFMDs that were put back.
+  if (startCheckpoint(checkpoint, context->filenames, numFiles, replayOFMD,
+                      context) == -1) {
+    printf("No checkpoints will be saved.\n\n");
+  }
+
+  file = checkpoint->file;
+  if (file == -1) {
+    return;
+  }
+  for (int x = 0; x < file; x++) {
+    skipped += context->ranges[x].end - context->ranges[x].start;
+    context->ranges[x].start = context->ranges[x].end;
+  }
+  if (checkpoint->resumeOffset > context->ranges[file].start) {
+    skipped += checkpoint->resumeOffset - context->ranges[file].start;
+    context->ranges[file].start = checkpoint->resumeOffset;
+  }
+  context->ranges[file].resumeAfter = checkpoint->lastOffset;
+  addProgress(&context->progress, skipped);
+}
+
+/*
+ * Opens every file, splits them into ranges, and scans those.
+ * The OFMDs stay in 'context->ranges' unless 'context->callbackContext' is
+ * set.
+ * Returns -1 if a file couldn't be opened or memory ran out.
+ */
+static int scanFiles(struct scanContext *context, int numThreads,
+                     int numFiles, bool prettyPrint) {
+  struct inputSource input;
+  bool inputOpen = false;
+  int fileRanges;
+  int result = 0;
+
+  // The checkpoint only knows how far the ranges got in order.
+  if (context->checkpoint != NULL) {
+    numThreads = 1;
+  }
+
+  context->formats =
+      (struct streamFormat *)calloc(numFiles, sizeof(struct streamFormat));
+  context->ranges = NULL;
+  context->numRanges = 0;
+  if (context->formats == NULL) {
+    perror("calloc()");
+    return -1;
+  }
+
+  context->progress.scanned = 0;
+  context->progress.total = 0;
+  context->progress.prevProgress = 0;
+  context->progress.prettyPrint = prettyPrint;
+  context->progress.callback = threadProgress;
+  context->progress.callbackContext = threadProgressContext;
+  pthread_mutex_init(&context->progress.lock, NULL);
+
+  for (int file = 0; file < numFiles; file++) {
+    if (openInput(&input, context->filenames[file], context->backend,
+                  context->bufferSize, SCAN_LOOKAHEAD) == -1) {
+      result = -1;
+      break;
+    }
+    fileRanges =
+        splitFile(context, file, &input, numThreads, context->numRanges);
+    if (fileRanges == -1) {
+      closeInput(&input);
+      result = -1;
+      break;
+    }
+    context->numRanges += fileRanges;
+
+    if (input.fileSize < 0 || context->progress.total < 0) {
+      context->progress.total = -1; // Unknown.
+    } else {
+      context->progress.total += input.fileSize;
     }
-    fflush(stderr);
+
+    // stdin can't be opened twice, so a single range uses this input.
+    if (numFiles == 1 && context->numRanges == 1 && input.position == 0) {
+      inputOpen = true;
+      break;
+    }
+    closeInput(&input);
+  }
+  if (context->quiet ||
+      (quietReports && context->progress.callback == NULL)) {
+    context->progress.total = -1;
+  }
+  if (result == 0 && context->checkpoint != NULL) {
+    resumeScan(context, numFiles);
+  }
+
+  if (result == 0 && inputOpen) {
+    if (scanRange(&input, context, &context->ranges[0], true) == -1) {
+      context->ranges[0].result = -1;
+    }
+  } else if (result == 0) {
+    parallelFor(context->numRanges, numThreads, scanRangeTask, context);
+  }
+  if (inputOpen) {
+    closeInput(&input);
   }
+  pthread_mutex_destroy(&context->progress.lock);
 
-  free(buffer);
+  if (prettyPrint && context->progress.total > 0) {
+    printf("\n");
+  }
+  fflush(stdout);
+  fflush(stderr);
 
-  if (!useStdin) {
-    fclose(filePtr);
+  for (int x = 0; x < context->numRanges; x++) {
+    if (context->ranges[x].result == -1) {
+      result = -1;
+    }
   }
+  free(context->formats);
 
-  return OFMDCounter;
+  return result;
 }
 
-// Parses the depth values from the OFMDs then stores them into the OFMDdata
-// struct.
-void getPlanesFromOFMDs(BYTE ***OFMDs, int numOFMDs,
-                        struct OFMDdata *OFMDdata) {
-  int counter;
-  int frameRate;
-  int start;
-  int end;
-  int numOfPlanes;
+// What 'addIndexedOFMD' is looking for.
+struct indexedRead {
+  const struct indexEntry *entry;
+  struct OFMDstore *OFMDs;
+  bool found;
+  int result;
+};
+
+/*
+ * 'OFMDCallback' which only takes the OFMD the index points at.
+ * Anything else in the same few KB is ignored.
+ */
+static int addIndexedOFMD(void *context, const BYTE *OFMD, size_t length,
+                          int64_t offset) {
+  struct indexedRead *read = (struct indexedRead *)context;
+
+  if (offset != read->entry->offset) {
+    return 0;
+  }
+
+  if (length != read->entry->length ||
+      (OFMD[11] & 127) != read->entry->frameCount ||
+      addOFMDToStore(read->OFMDs, OFMD, length, offset) == -1) {
+    read->result = -1;
+  } else {
+    read->found = true;
+  }
+
+  return 1;
+}
+
+// Reads until 'wanted' bytes are available. False if the file ends first.
+static bool fillWanted(struct inputSource *input, size_t wanted) {
+  size_t length = input->length;
+
+  while (length < wanted) {
+    size_t filled = fillInput(input, wanted);
+    if (filled == length) {
+      return false;
+    }
+    length = filled;
+  }
+
+  return true;
+}
+
+/*
+ * Feeds the parser from the SEI which starts at 'offset', until it reaches
+ * the start code after it. MKV SEIs are handed to 'parseNAL' whole instead.
+ *
+ * The chunk the parser stopped in isn't skipped, since the next OFMD can be
+ * in there too. Returns -1 if 'offset' is behind the input.
+ */
+static int readIndexedOFMD(struct inputSource *input,
+                           const struct streamFormat *format,
+                           struct nalParser *parser, int64_t offset) {
+  struct tsDemuxer demux;
+  int64_t start = offset;
+  size_t header;
+  size_t size;
+
+  resetNALParser(parser);
+  parser->stopOffset = offset + 1;
+
+  if (format->type == STREAM_MKV) {
+    size_t lengthSize = format->nalLengthSize;
+    uint64_t nalLength = 0;
+
+    // The NAL's length is right in front of it.
+    start = offset - lengthSize;
+    if (start < input->position) {
+      return -1;
+    }
+    skipInput(input, start - input->position);
+    if (!fillWanted(input, lengthSize)) {
+      return 0;
+    }
+    for (size_t x = 0; x < lengthSize; x++) {
+      nalLength = (nalLength << 8) | input->data[x];
+    }
+    if (nalLength <= MAX_SEI_SIZE && fillWanted(input, lengthSize + nalLength)) {
+      parseNAL(parser, input->data + lengthSize, nalLength, offset);
+      skipInput(input, lengthSize + nalLength);
+    }
+    return 0;
+  }
+
+  // Start on the packet the start code is in and take its PID as the video.
+  if (format->type == STREAM_TS) {
+    start = packetStart(format, offset);
+  }
+  if (start < input->position) {
+    return -1;
+  }
+  skipInput(input, start - input->position);
+
+  if (format->type == STREAM_TS) {
+    header = format->packetSize - TS_PACKET_SIZE;
+    if (!fillWanted(input, format->packetSize)) {
+      return 0;
+    }
+    initTSDemuxer(&demux, parser, format->packetSize);
+    setTSVideoPID(&demux, ((input->data[header + 1] & 0x1F) << 8) |
+                              input->data[header + 2]);
+  }
+
+  while (!parser->stopped) {
+    if (!fillWanted(input, format->type == STREAM_TS ? format->packetSize
+                                                     : 1)) {
+      flushNALParser(parser);
+      break;
+    }
+
+    // Whole packets only, so the next OFMD's packet is never skipped.
+    size = input->length;
+    if (format->type == STREAM_TS) {
+      size -= size % format->packetSize;
+      feedTSDemuxer(&demux, input->data, size, input->position);
+    } else {
+      feedNALParser(parser, input->data, size, input->position);
+    }
+    if (!parser->stopped) {
+      skipInput(input, size);
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Reads 'numEntries' OFMDs from the places 'entries' points at.
+ * Returns -1 if any of them isn't there anymore.
+ */
+static int readIndexedFile(const char *filename,
+                           const struct indexEntry *entries, int numEntries,
+                           struct OFMDstore *OFMDs) {
+  struct inputSource input;
+  struct streamFormat format;
+  struct nalParser parser;
+  struct indexedRead read = {NULL, OFMDs, false, 0};
+  int result = 0;
+
+  if (openInput(&input, filename, INPUT_PREAD, INDEX_BLOCK_SIZE,
+                INDEX_LOOKAHEAD) == -1) {
+    return -1;
+  }
+  probeFormat(&input, &format);
+
+  // Reading the Tracks can go past the first OFMD, so start over after it.
+  if (format.type == STREAM_MKV) {
+    result = probeVideoTrack(&input, &format);
+    closeInput(&input);
+    if (result == -1 || openInput(&input, filename, INPUT_PREAD,
+                                  INDEX_BLOCK_SIZE, INDEX_LOOKAHEAD) == -1) {
+      return -1;
+    }
+    result = 0;
+  }
+
+  if (initNALParser(&parser, addIndexedOFMD, &read) == -1) {
+    closeInput(&input);
+    return -1;
+  }
+
+  for (int x = 0; x < numEntries && result == 0; x++) {
+    read.entry = &entries[x];
+    read.found = false;
+    if (readIndexedOFMD(&input, &format, &parser, entries[x].offset) == -1 ||
+        !read.found || read.result == -1) {
+      result = -1;
+    }
+  }
+
+  freeNALParser(&parser);
+  closeInput(&input);
+  return result;
+}
+
+/*
+ * Reads the OFMDs back with the index at 'indexPath'.
+ * Returns the number of OFMDs or -1 if the files have to be scanned.
+ */
+static int readIndexedFiles(const char *indexPath, const char **filenames,
+                            int numFiles, struct OFMDstore *OFMDs) {
+  struct ofsIndex index;
+  int entry = 0;
+  int result = 0;
+
+  if (readIndex(indexPath, &index) == -1) {
+    return -1;
+  }
+  if (!indexMatches(&index, filenames, numFiles)) {
+    printf("'%s' doesn't match the input. Scanning it again.\n\n",
+           indexPath);
+    freeIndex(&index);
+    return -1;
+  }
+
+  printf("Reading %d OFMDs with '%s'.\n\n", index.numEntries, indexPath);
+  for (int file = 0; file < numFiles && result == 0; file++) {
+    result = readIndexedFile(filenames[file], index.entries + entry,
+                             index.fileEntries[file], OFMDs);
+    entry += index.fileEntries[file];
+  }
+  freeIndex(&index);
+
+  if (result == -1) {
+    printf("The OFMDs aren't where '%s' says. Scanning the input again.\n\n",
+           indexPath);
+    freeOFMDStore(OFMDs);
+    return -1;
+  }
+
+  return OFMDs->numOFMDs;
+}
+
+// Writes the index of 'OFMDs'. It's only a cache, so failing is fine.
+static void indexFiles(const char *indexPath, const char **filenames,
+                       int numFiles, const int *fileEntries,
+                       const struct OFMDstore *OFMDs) {
+  struct ofsIndex index;
+
+  index.numFiles = numFiles;
+  index.keys =
+      (struct indexKey *)malloc(numFiles * sizeof(struct indexKey));
+  index.fileEntries = (int *)malloc(numFiles * sizeof(int));
+  index.numEntries = OFMDs->numOFMDs;
+  index.entries = (struct indexEntry *)malloc(
+      (OFMDs->numOFMDs + 1) * sizeof(struct indexEntry));
+  if (index.keys == NULL || index.fileEntries == NULL ||
+      index.entries == NULL) {
+    perror("malloc()");
+    freeIndex(&index);
+    return;
+  }
+
+  for (int file = 0; file < numFiles; file++) {
+    index.fileEntries[file] = fileEntries[file];
+    if (makeIndexKey(filenames[file], &index.keys[file]) == -1) {
+      printf("'%s' can't be indexed.\n", filenames[file]);
+      freeIndex(&index);
+      return;
+    }
+  }
+  for (int x = 0; x < OFMDs->numOFMDs; x++) {
+    const struct OFMDentry *OFMD = &OFMDs->entries[x];
+
+    index.entries[x].offset = OFMD->offset;
+    index.entries[x].length = OFMD->length;
+    index.entries[x].frameCount = OFMD->OFMD[11] & 127;
+  }
+
+  if (writeIndex(indexPath, &index) == -1) {
+    printf("Failed to write '%s'.\n", indexPath);
+  }
+  freeIndex(&index);
+}
+
+/*
+ * Same as 'getOFMDsInFile', but for clips that play one after another.
+ * (Like the clips of a Blu-ray playlist.) The ranges of every file are
+ * scanned together, and the OFMDs are put back together in 'filenames' order.
+ */
+int getOFMDsInFiles(size_t bufferSize, enum inputBackend backend,
+                    int numThreads, const char **filenames, int numFiles,
+                    bool prettyPrint, const char *indexPath,
+                    struct checkpoint *checkpoint, struct OFMDstore *OFMDs) {
+  struct scanContext context;
+  int *fileEntries;
+  int result;
+
+  if (indexPath != NULL) {
+    result = readIndexedFiles(indexPath, filenames, numFiles, OFMDs);
+    if (result != -1) {
+      return result;
+    }
+  }
+
+  context.filenames = filenames;
+  context.bufferSize = bufferSize;
+  context.backend = backend;
+  context.callback = addOFMD;
+  context.callbackContext = NULL;
+  context.limit = 0;
+  context.quiet = false;
+  context.checkpoint = checkpoint;
+  result = scanFiles(&context, numThreads, numFiles, prettyPrint);
+
+  // Put the ranges back together in file order.
+  fileEntries = (int *)calloc(numFiles, sizeof(int));
+  if (fileEntries == NULL) {
+    perror("calloc()");
+    result = -1;
+  }
+  for (int x = 0; x < context.numRanges; x++) {
+    struct OFMDrange *range = &context.ranges[x];
+
+    if (fileEntries != NULL) {
+      fileEntries[range->file] += range->OFMDs.numOFMDs;
+    }
+    if (result == 0 && moveOFMDStore(OFMDs, &range->OFMDs) == -1) {
+      result = -1;
+    }
+    freeOFMDStore(&range->OFMDs);
+  }
+  free(context.ranges);
+
+  if (result == -1) {
+    free(fileEntries);
+    freeOFMDStore(OFMDs);
+    return -1;
+  }
+
+  if (indexPath != NULL) {
+    indexFiles(indexPath, filenames, numFiles, fileEntries, OFMDs);
+  }
+  free(fileEntries);
+
+  return OFMDs->numOFMDs;
+}
+
+/*
+ * Same as 'getOFMDsInFiles' followed by 'getPlanesFromOFMDs', but each OFMD
+ * is decoded into the planes as soon as it's found. The OFMDs themselves are
+ * never kept.
+ *
+ * 'OFMDdata': Gets the planes, the frame-rate, and the number of frames.
+ * Returns the number of OFMDs or -1.
+ */
+int getPlanesInFiles(size_t bufferSize, enum inputBackend backend,
+                     int numThreads, const char **filenames, int numFiles,
+                     bool prettyPrint, struct checkpoint *checkpoint,
+                     struct OFMDdata *OFMDdata) {
+  struct scanContext context;
+  struct mergeJob job;
+  int *firstFrames;
+  int numOfPlanes = 0;
   int totalFrames = 0;
+  int numOFMDs = 0;
+  int result;
 
-  // Let's hope the frame-rate, and the number of planes don't change
-  frameRate = (*OFMDs)[0][4] & 15;
-  numOfPlanes = (*OFMDs)[0][10] & 0x7F;
+  context.filenames = filenames;
+  context.bufferSize = bufferSize;
+  context.backend = backend;
+  context.callback = decodeOFMD;
+  context.callbackContext = NULL;
+  context.limit = 0;
+  context.quiet = false;
+  context.checkpoint = checkpoint;
+  result = scanFiles(&context, numThreads, numFiles, prettyPrint);
 
-  OFMDdata->numOfPlanes = numOfPlanes;
-  OFMDdata->frameRate = frameRate;
+  OFMDdata->depths = NULL;
+  if (result == -1) {
+    for (int x = 0; x < context.numRanges; x++) {
+      freePlaneArrays(&context.ranges[x].planes);
+    }
+    free(context.ranges);
+    return -1;
+  }
 
-  // Get total number of frames.
-  for (int OFMD = 0; OFMD < numOFMDs; OFMD++) {
-    totalFrames += (*OFMDs)[OFMD][11] & 127;
+  // Each range's frames follow the ones of the range before it.
+  firstFrames = (int *)malloc((context.numRanges + 1) * sizeof(int));
+  for (int x = 0; x < context.numRanges && firstFrames != NULL; x++) {
+    struct planeArrays *arrays = &context.ranges[x].planes;
+
+    if (arrays->numOFMDs > 0 && numOFMDs == 0) {
+      numOfPlanes = arrays->numOfPlanes;
+      OFMDdata->frameRate = arrays->frameRate;
+    }
+    firstFrames[x] = totalFrames;
+    totalFrames += arrays->numFrames;
+    numOFMDs += arrays->numOFMDs;
+  }
+
+  if (firstFrames == NULL ||
+      (numOFMDs > 0 &&
+       allocPlanes(OFMDdata, numOfPlanes, totalFrames) == -1)) {
+    numOFMDs = -1;
+  } else {
+    job.ranges = context.ranges;
+    job.firstFrames = firstFrames;
+    job.OFMDdata = OFMDdata;
+    OFMDdata->numOfPlanes = numOfPlanes;
+    OFMDdata->totalFrames = totalFrames;
+    if (numOFMDs > 0) {
+      parallelFor(context.numRanges, numThreads, mergeRangeTask, &job);
+    }
+  }
+
+  for (int x = 0; x < context.numRanges; x++) {
+    freePlaneArrays(&context.ranges[x].planes);
   }
+  free(context.ranges);
+  free(firstFrames);
+
+  return numOFMDs;
+}
+
+/*
+ * Points each of the planes into one block, with every plane starting on a
+ * PLANE_ALIGNMENT boundary. Returns -1 if out of memory.
+ */
+int allocPlanes(struct OFMDdata *OFMDdata, int numOfPlanes, int totalFrames) {
+  size_t stride = ((size_t)totalFrames + PLANE_ALIGNMENT - 1) &
+                  ~(size_t)(PLANE_ALIGNMENT - 1);
 
+  OFMDdata->numOfPlanes = numOfPlanes;
   OFMDdata->totalFrames = totalFrames;
+  memset(OFMDdata->planes, 0, sizeof(OFMDdata->planes));
+  OFMDdata->depths = (BYTE *)alignedAlloc(
+      PLANE_ALIGNMENT, (stride > 0 ? stride : PLANE_ALIGNMENT) * numOfPlanes);
+  if (OFMDdata->depths == NULL) {
+    perror("alignedAlloc()");
+    return -1;
+  }
 
-  // Allocate planes array like this planes[numOfPlanes][totalFrames]
-  OFMDdata->planes = (BYTE **)malloc(numOfPlanes * sizeof(BYTE *));
   for (int plane = 0; plane < numOfPlanes; plane++) {
-    OFMDdata->planes[plane] = (BYTE *)malloc(totalFrames * sizeof(BYTE));
+    OFMDdata->planes[plane] = OFMDdata->depths + (stride * plane);
   }
 
-  // Place the depth values into each plane.
-  // Not gonna lie, it's pretty ugly looking. Depths are stored like this:
-  //
-  // (14 * Plane #) to (14 * Plane #) + (framecount from OFMD).
-  counter = 0;
-  totalFrames = 0;
-  for (int OFMD = 0; OFMD < numOFMDs; OFMD++) {
-    BYTE frameCount = (*OFMDs)[OFMD][11] & 127;
-    for (int plane = 0; plane < numOfPlanes; plane++) {
-      counter = totalFrames;
-      start = 14 + (plane * frameCount);
-      end = 14 + (plane * frameCount) + frameCount;
-      for (int x = start; x < end; x++) {
-        OFMDdata->planes[plane][counter] = (*OFMDs)[OFMD][x];
-        counter++;
-      }
+  return 0;
+}
+
+void freePlanes(struct OFMDdata *OFMDdata) {
+  alignedFree(OFMDdata->depths);
+  OFMDdata->depths = NULL;
+  memset(OFMDdata->planes, 0, sizeof(OFMDdata->planes));
+}
+
+// What each task of 'getPlanesFromOFMDs' needs.
+struct transposeJob {
+  const struct OFMDentry *entries;
+  const int *firstFrames; // Of each OFMD.
+  int numOFMDs;
+  struct OFMDdata *OFMDdata;
+};
+
+/*
+ * memcpy for the few dozen depths of a GOP. Fixed size copies are done with
+ * plain loads and stores instead of a call.
+ */
+static inline void copyDepths(BYTE *dest, const BYTE *src, int count) {
+  for (; count > 16; count -= 16) {
+    memcpy(dest, src, 16);
+    dest += 16;
+    src += 16;
+  }
+  if (count >= 8) {
+    memcpy(dest, src, 8); // These two overlap.
+    memcpy(dest + count - 8, src + count - 8, 8);
+  } else {
+    for (int x = 0; x < count; x++) {
+      dest[x] = src[x];
     }
-    totalFrames += frameCount;
   }
 }
 
-// Verifies each 3D-Plane, and modifies an array containing which planes are
-// valid.
-int verifyPlanes(struct OFMDdata OFMDdata, char *inFile) {
-  int numOfPlanes = OFMDdata.numOfPlanes;
-  int totalFrames = OFMDdata.totalFrames;
-  BYTE **planes = OFMDdata.planes;
-  int planesInFile = 0;
-  const char *fileExt = getFileExt(inFile);
+// Copies the depths of TRANSPOSE_BLOCK OFMDs into the planes.
+static void transposeTask(void *context, int index) {
+  struct transposeJob *job = (struct transposeJob *)context;
+  int first = index * TRANSPOSE_BLOCK;
+  int last = first + TRANSPOSE_BLOCK;
 
-  for (int x = 0; x < numOfPlanes; x++) {
-    bool thereArePlanes = false;
-    for (int y = 0; y < totalFrames; y++) {
-      if (planes[x][y] != 0x80) {
-        thereArePlanes = true;
-        OFMDdata.validPlanes[x] = 1; // Mark a valid plane as 1.
+  if (last > job->numOFMDs) {
+    last = job->numOFMDs;
+  }
+
+  for (int OFMD = first; OFMD < last; OFMD++) {
+    const BYTE *data = job->entries[OFMD].OFMD;
+    int frameCount = data[11] & 127;
+    int planesInOFMD = data[10] & 0x7F;
+
+    for (int plane = 0; plane < job->OFMDdata->numOfPlanes; plane++) {
+      BYTE *dest = job->OFMDdata->planes[plane] + job->firstFrames[OFMD];
+
+      if (plane >= planesInOFMD) {
+        memset(dest, 0x80, frameCount);
+      } else {
+        copyDepths(dest, data + 14 + (plane * frameCount), frameCount);
       }
     }
+  }
+}
 
-    if (thereArePlanes) {
-      printf("\n");
-      printf("3D-Plane #%02d\n", x);
-      parseDepths(x, numOfPlanes, planes, totalFrames);
-    } else {
-      printf("\n");
-      printf("3D-Plane #%02d is empty.\n", x);
-      if (strncmp(fileExt, "m2ts", 4) == 0 ||
-          strncmp(fileExt, "M2TS", 4) == 0) {
-        printf("\nStopping here because input file is M2TS.\n");
-        break;
-      }
+/*
+ * Parses the depth values from the OFMDs then stores them into the OFMDdata
+ * struct. The first frame of each OFMD is worked out up front, so blocks of
+ * OFMDs can be copied on 'numThreads' threads.
+ * Returns -1 if out of memory.
+ */
+int getPlanesFromOFMDs(const struct OFMDstore *OFMDs, int numThreads,
+                       struct OFMDdata *OFMDdata) {
+  const struct OFMDentry *entries = OFMDs->entries;
+  int numOFMDs = OFMDs->numOFMDs;
+  struct transposeJob job;
+  int *firstFrames;
+  int numOfPlanes;
+  int totalFrames = 0;
+
+  // Let's hope the frame-rate, and the number of planes don't change
+  OFMDdata->frameRate = entries[0].OFMD[4] & 15;
+  numOfPlanes = entries[0].OFMD[10] & 0x7F;
+  if (numOfPlanes > MAXPLANES) {
+    numOfPlanes = MAXPLANES;
+  }
+
+  firstFrames = (int *)malloc(numOFMDs * sizeof(int));
+  if (firstFrames == NULL) {
+    perror("malloc()");
+    OFMDdata->depths = NULL;
+    return -1;
+  }
+  for (int OFMD = 0; OFMD < numOFMDs; OFMD++) {
+    firstFrames[OFMD] = totalFrames;
+    totalFrames += entries[OFMD].OFMD[11] & 127;
+  }
+
+  if (allocPlanes(OFMDdata, numOfPlanes, totalFrames) == -1) {
+    free(firstFrames);
+    return -1;
+  }
+
+  job.entries = entries;
+  job.firstFrames = firstFrames;
+  job.numOFMDs = numOFMDs;
+  job.OFMDdata = OFMDdata;
+  parallelFor((numOFMDs + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK, numThreads,
+              transposeTask, &job);
+  free(firstFrames);
+
+  return 0;
+}
+
+/*
+ * Stops the progress and the depth report of each 3D-Plane from being
+ * printed. Batch mode runs several titles at the same time and only prints
+ * a line for each.
+ */
+void setQuietReports(bool quiet) { quietReports = quiet; }
+
+/*
+ * Lets the tests split small streams into many ranges. Anything below a few
+ * MB is only slower.
+ */
+void setMinRangeSize(int64_t size) { minRangeSize = size > 0 ? size : 1; }
+
+/*
+ * Hands the progress of the scans this thread starts to 'callback' (from any
+ * of the scan's threads, but one at a time), even if reports are quiet.
+ * NULL goes back to printing it.
+ */
+void setProgressCallback(progressCallback callback, void *context) {
+  threadProgress = callback;
+  threadProgressContext = context;
+}
+
+// True if any of the depth values isn't 0x80 (undefined).
+bool hasDefinedDepth(const BYTE *depths, int numFrames) {
+  for (int x = 0; x < numFrames; x++) {
+    if (depths[x] != 0x80) {
+      return true;
     }
-    planesInFile++;
   }
 
-  return planesInFile;
+  return false;
 }
 
-void compareDepths(int planeNum, int numOfPlanes, int totalFrames,
-                   BYTE **planes) {
-  char printString[80] = "Identical Planes:";
+// Prints the planes whose bit is set in 'identical', other than 'planeNum'.
+static void printIdenticalPlanes(int planeNum, int numOfPlanes,
+                                 uint32_t identical) {
+  char printString[160] = "Identical Planes:";
   char samePlaneStr[25];
   bool samePlane = false;
 
   for (int x = 0; x < numOfPlanes; x++) {
-    if (memcmp(planes[planeNum], planes[x], totalFrames) == 0) {
+    if ((identical >> x) & 1) {
       if (x != planeNum) {
         sprintf(samePlaneStr, " #%02d", x);
         strcat(printString, samePlaneStr);
@@ -367,148 +1423,422 @@ void compareDepths(int planeNum, int numOfPlanes, int totalFrames,
   }
 }
 
-// Prints information about the 3D-Plane.
-void parseDepths(int planeNum, int numOfPlanes, BYTE **planes, int numFrames) {
-  BYTE *plane = planes[planeNum];
-  int minval = 128;
-  int maxval = -128;
-  int total = 0;
-  int undefined = 0;
-  int firstframe = -1;
-  int lastframe = -1;
-  int lastval = 0;
-  int byte;
-  int cuts = 0;
-
-  for (int i = 0; i < numFrames; i++) {
-    byte = plane[i];
-    if (byte != lastval) {
-      cuts++;
-      lastval = byte;
-    }
-    if (byte == 128) {
-      undefined += 1;
+static void printDepthStats(const struct depthStats *stats) {
+  double average = ((double)stats->total /
+                    ((double)stats->numFrames - (double)stats->undefined));
+  printf("NumFrames: %d\n", stats->numFrames);
+  printf("Minimum depth: %d\n", stats->minval);
+  printf("Maximum depth: %d\n", stats->maxval);
+  printf("Average depth: %.2f\n", average);
+  printf("Number of changes of depth value: %d\n", stats->cuts);
+  printf("First frame with a defined depth: %d\n", stats->firstframe);
+  printf("Last frame with a defined depth: %d\n", stats->lastframe);
+  printf("Number of frames with undefined depth: %d\n", stats->undefined);
+}
+
+// Prints the depth report of every 3D-Plane.
+static void printPlaneReport(const struct planeAnalytics *analytics) {
+  for (int x = 0; x < analytics->numOfPlanes; x++) {
+    const struct depthStats *stats = &analytics->stats[x];
+
+    if (!hasDefinedStats(stats)) {
+      printf("\n3D-Plane #%02d is empty.\n", x);
       continue;
-    } else {
-      lastframe = i;
-      if (firstframe == -1) {
-        firstframe = i;
-      }
     }
 
-    // If the value is bigger than 128. Negate the value.
-    if (byte > 128) {
-      byte = 128 - byte;
+    printf("\n3D-Plane #%02d\n", x);
+    printDepthStats(stats);
+    printIdenticalPlanes(x, analytics->numOfPlanes, analytics->identical[x]);
+    if (stats->minval == stats->maxval) {
+      printf("*** Warning This 3D-Plane has a fixed depth of %d! ***\n",
+             stats->minval);
     }
+  }
+}
 
-    if (byte < minval) {
-      minval = byte;
-    }
-    if (byte > maxval) {
-      maxval = byte;
+// Verifies each 3D-Plane, and modifies an array containing which planes are
+// valid.
+int verifyPlanes(struct OFMDdata OFMDdata) {
+  struct planeAnalytics analytics;
+
+  analyzePlanes(OFMDdata.planes, OFMDdata.numOfPlanes, OFMDdata.totalFrames,
+                &analytics);
+  for (int x = 0; x < OFMDdata.numOfPlanes; x++) {
+    if (hasDefinedStats(&analytics.stats[x])) {
+      OFMDdata.validPlanes[x] = 1; // Mark a valid plane as 1.
     }
-    total += byte;
   }
 
-  double average = ((double)total / ((double)numFrames - (double)undefined));
-  printf("NumFrames: %d\n", numFrames);
-  printf("Minimum depth: %d\n", minval);
-  printf("Maximum depth: %d\n", maxval);
-  printf("Average depth: %.2f\n", average);
-  printf("Number of changes of depth value: %d\n", cuts);
-  printf("First frame with a defined depth: %d\n", firstframe);
-  printf("Last frame with a defined depth: %d\n", lastframe);
-  printf("Number of frames with undefined depth: %d\n", undefined);
-  compareDepths(planeNum, numOfPlanes, numFrames, planes);
-  if (minval == maxval) {
-    printf("*** Warning This 3D-Plane has a fixed depth of %d! ***\n", minval);
-  }
-}
-
-void createOFSFiles(struct OFMDdata OFMDdata, const char *outFolder,
-                    BYTE dropFrame) {
-  FILE *ofsFile;
-  char ofsName[80];   // Store the name of the ofs file.
-  char outFile[4096]; // will become what's used with fopen.
-  BYTE *buffer;
-  int bufferOffset;
-  // Structure of the OFS file.
-  BYTE signiture[8] = {0x89, 0x4f, 0x46, 0x53, 0x0d, 0x0a, 0x1a, 0x0a};
-  BYTE version[4] = {0x30, 0x31, 0x30, 0x30};
+  if (!quietReports) {
+    printPlaneReport(&analytics);
+  }
+
+  return OFMDdata.numOfPlanes;
+}
+
+// What each task of 'createOFSFiles' needs.
+struct ofsWriteJob {
+  const struct OFMDdata *OFMDdata;
+  const char *outFolder;
   BYTE GUID[16];
   BYTE frameRate;
-  BYTE rollsAndReserved[4] = {0x01, 0x00, 0x00, 0x00};
-  BYTE timecode[4] = {0x00, 0x00, 0x00, 0x00};
-  BYTE frameArray[4] = {0x00, 0x00, 0x00, 0x00};
-  srand(time(NULL));
+  int planes[MAXPLANES]; // The valid ones.
+  int result;
+};
+
+// Writes the OFS file of one valid plane.
+static void writeOFSTask(void *context, int index) {
+  struct ofsWriteJob *job = (struct ofsWriteJob *)context;
+  int plane = job->planes[index];
+  BYTE header[OFS_HEADER_SIZE];
+  BYTE GUID[16];
+  char *path = makeOFSPath(job->outFolder, plane);
+
+  if (path == NULL) {
+    __atomic_store_n(&job->result, -1, __ATOMIC_RELAXED);
+    return;
+  }
+  memcpy(GUID, job->GUID, 16);
+  GUID[15] = (BYTE)plane; // Copy the plane number to the end of the GUID.
+  makeOFSHeader(header, GUID, job->frameRate, job->OFMDdata->totalFrames);
+  if (writeOFSFile(path, header, job->OFMDdata->planes[plane],
+                   job->OFMDdata->totalFrames) == -1) {
+    __atomic_store_n(&job->result, -1, __ATOMIC_RELAXED);
+  }
+  free(path);
+}
+
+/*
+ * Writes the OFS file of every valid plane, all of them at the same time.
+ * Each file is written straight from its plane.
+ */
+int createOFSFiles(struct OFMDdata OFMDdata, const char *outFolder,
+                   BYTE dropFrame) {
+  struct ofsWriteJob job;
+  int numFiles = 0;
 
   if (!dirExists(outFolder)) {
     printf("'%s' doesn't exist.\n", outFolder);
-    exit(1);
+    return -1;
   }
 
-  // The OFS should be 41 bytes plus the number of depth values (frames).
-  buffer = (BYTE *)malloc((41 * OFMDdata.totalFrames) * sizeof(BYTE));
-
-  // Copy the signiture, and version to buffer.
-  memcpy(buffer, signiture, 8);
-  memcpy(buffer + 8, version, 4);
+  job.OFMDdata = &OFMDdata;
+  job.outFolder = outFolder;
+  job.result = 0;
 
   // Generate the GUID. The last value will be the plane number.
-  for (int x = 0; x < 15; x++) {
-    GUID[x] = rand() % 256;
-  }
-
-  // Store the frame count in 4 bytes.
-  frameArray[3] = (OFMDdata.totalFrames) % 256;
-  frameArray[2] = (OFMDdata.totalFrames >> 8) % 256;
-  frameArray[1] = (OFMDdata.totalFrames >> 16) % 256;
-  frameArray[0] = (OFMDdata.totalFrames >> 24) % 256;
+  makeOFSGUID(job.GUID);
 
   // Calculate the framerate value.
-  frameRate = (OFMDdata.frameRate * 16) + dropFrame;
+  job.frameRate = (OFMDdata.frameRate * 16) + dropFrame;
 
   for (int plane = 0; plane < OFMDdata.numOfPlanes; plane++) {
     if (OFMDdata.validPlanes[plane] == 1) {
-      bufferOffset = 12;
-      strcpy(outFile, outFolder);
-      GUID[15] = (BYTE)plane; // Copy the plane number to the end of the GUID.
-
-      memcpy(buffer + bufferOffset, GUID, 16); // Copy guid
-      bufferOffset += 16;
-      buffer[bufferOffset] = frameRate; // Copy frame_rate value
-      bufferOffset++;
-      // Copy number_of_rolls, reserved, and marker_bits
-      memcpy(buffer + bufferOffset, rollsAndReserved, 4);
-      bufferOffset += 4;
-      // Copy start_timecode (Assume 0 for now).
-      memcpy(buffer + bufferOffset, timecode, 4);
-      bufferOffset += 4;
-      memcpy(buffer + bufferOffset, frameArray, 4); // Copy number_of_frames.
-      bufferOffset += 4;
-      // Copy the depth values.
-      for (int x = 0; x < OFMDdata.totalFrames; x++) {
-        buffer[bufferOffset] = OFMDdata.planes[plane][x];
-        bufferOffset++;
-      }
+      job.planes[numFiles++] = plane;
+    }
+  }
+  parallelFor(numFiles, numFiles, writeOFSTask, &job);
+
+  return job.result;
+}
+
+// Everything 'streamOFMD' needs between two OFMDs.
+struct streamState {
+  const char *outFolder;
+  int frameRate; // 0 to take it from the first OFMD.
+  BYTE dropFrame;
+  struct OFMDdata *OFMDdata;
+  struct ofsStream ofs;
+  bool opened;
+  int numOFMDs;
+  struct planeAnalytics analytics; // Grouped once the stream has ended.
+  struct rlePlanes *rle;           // NULL unless the runs are kept.
+  int result;
+};
+
+// 'OFMDCallback' which appends the depth values to the OFS files.
+static int streamOFMD(void *context, const BYTE *OFMD, size_t length,
+                      int64_t offset) {
+  struct streamState *state = (struct streamState *)context;
+  struct OFMDdata *OFMDdata = state->OFMDdata;
+  const BYTE *depths[MAXPLANES];
+  BYTE undefined[127];
+  int frameCount = OFMD[11] & 127;
+  int planesInOFMD = OFMD[10] & 0x7F;
+  (void)length;
+  (void)offset;
+
+  // Same as 'getPlanesFromOFMDs', the first OFMD decides.
+  if (!state->opened) {
+    OFMDdata->numOfPlanes = planesInOFMD;
+    if (OFMDdata->numOfPlanes > MAXPLANES) {
+      OFMDdata->numOfPlanes = MAXPLANES;
+    }
+    OFMDdata->frameRate =
+        state->frameRate > 0 ? state->frameRate : OFMD[4] & 15;
+
+    if (openOFSStream(&state->ofs, state->outFolder, OFMDdata->numOfPlanes,
+                      (OFMDdata->frameRate * 16) + state->dropFrame) == -1) {
+      state->result = -1;
+      return 1;
+    }
+    state->analytics.numOfPlanes = OFMDdata->numOfPlanes;
+    for (int plane = 0; plane < OFMDdata->numOfPlanes; plane++) {
+      initDepthStats(&state->analytics.stats[plane]);
+    }
+    if (state->rle != NULL) {
+      initRLEPlanes(state->rle, OFMDdata->numOfPlanes);
+    }
+    state->opened = true;
+  }
+
+  // The stats are worked out from the runs at the end.
+  if (state->rle != NULL && addRLEOFMD(state->rle, OFMD) == -1) {
+    state->result = -1;
+    return 1;
+  }
 
-      // Create name for outFile.
-      sprintf(ofsName, "3D-Plane-%02d.ofs", plane);
-#ifdef _WIN32 // Windows uses backslashes in it's path.
-      strcat(outFile, "\\");
-#else
-      strcat(outFile, "/");
-#endif
-      strcat(outFile, ofsName); // Append the file name to the output path.
-
-      ofsFile = fopen(outFile, "wb");
-      if (ofsFile == NULL) {
-        printf("Failed to open: %s\n", outFile);
+  memset(undefined, 0x80, frameCount);
+  for (int plane = 0; plane < OFMDdata->numOfPlanes; plane++) {
+    if (plane < planesInOFMD) {
+      depths[plane] = OFMD + 14 + (plane * frameCount);
+    } else {
+      depths[plane] = undefined;
+    }
+
+    if (writeOFSDepths(&state->ofs, plane, depths[plane], frameCount) == -1) {
+      state->result = -1;
+      return 1;
+    }
+    if (state->rle == NULL) {
+      addDepths(&state->analytics.stats[plane], depths[plane], frameCount);
+    }
+  }
+
+  OFMDdata->totalFrames += frameCount;
+  state->numOFMDs++;
+  return 0;
+}
+
+/*
+ * Scans the files with one thread and writes the OFS files while the OFMDs
+ * are found. Only one GOP of depth values is kept in memory, so it doesn't
+ * matter how long the title is. Prints the same report as 'verifyPlanes'.
+ *
+ * 'frameRate': Overrides the frame-rate of the stream if it's not 0.
+ * 'rle': Gets the runs of every plane if it's not NULL. (Has to be freed.)
+ * 'OFMDdata': Gets everything but the planes. 'depths' is left NULL.
+ * Returns the number of OFMDs or -1.
+ */
+int streamOFSFiles(size_t bufferSize, enum inputBackend backend,
+                   const char **filenames, int numFiles, bool prettyPrint,
+                   const char *outFolder, int frameRate, BYTE dropFrame,
+                   struct checkpoint *checkpoint, struct rlePlanes *rle,
+                   struct OFMDdata *OFMDdata) {
+  struct scanContext context;
+  struct streamState *state;
+  int result;
+
+  if (!dirExists(outFolder)) {
+    printf("'%s' doesn't exist.\n", outFolder);
+    return -1;
+  }
+
+  state = (struct streamState *)calloc(1, sizeof(struct streamState));
+  if (state == NULL) {
+    perror("calloc()");
+    return -1;
+  }
+  state->outFolder = outFolder;
+  state->frameRate = frameRate;
+  state->dropFrame = dropFrame;
+  state->OFMDdata = OFMDdata;
+  state->rle = rle;
+  if (rle != NULL) {
+    initRLEPlanes(rle, 0);
+  }
+  OFMDdata->totalFrames = 0;
+  OFMDdata->numOfPlanes = 0;
+  OFMDdata->depths = NULL;
+  memset(OFMDdata->planes, 0, sizeof(OFMDdata->planes));
+
+  // The OFS files are written in order, so the ranges have to be too.
+  context.filenames = filenames;
+  context.bufferSize = bufferSize;
+  context.backend = backend;
+  context.callback = streamOFMD;
+  context.callbackContext = state;
+  context.limit = 0;
+  context.quiet = false;
+  context.checkpoint = checkpoint;
+  result = scanFiles(&context, 1, numFiles, prettyPrint);
+  free(context.ranges);
+
+  if (state->result == -1 || result == -1) {
+    if (state->opened) {
+      closeOFSStream(&state->ofs, NULL);
+    }
+    free(state);
+    return -1;
+  }
+
+  if (state->opened) {
+    if (rle != NULL) {
+      analyzeRLEPlanes(rle, &state->analytics);
+    } else {
+      // Every plane got its depths in the same pieces, so the hashes match.
+      groupIdenticalPlanes(&state->analytics, NULL);
+    }
+    for (int x = 0; x < OFMDdata->numOfPlanes; x++) {
+      if (hasDefinedStats(&state->analytics.stats[x])) {
+        OFMDdata->validPlanes[x] = 1; // Mark a valid plane as 1.
       }
-      fwrite(buffer, 1, bufferOffset, ofsFile);
-      fclose(ofsFile);
+    }
+    if (!quietReports) {
+      printf("\nChecking 3D-Planes for valid depth values.\n");
+      printPlaneReport(&state->analytics);
+    }
+
+    if (closeOFSStream(&state->ofs, OFMDdata->validPlanes) == -1) {
+      free(state);
+      return -1;
+    }
+  }
+
+  result = state->numOFMDs;
+  free(state);
+  return result;
+}
+
+// What 'probeOFMD' fills in, and when it stops.
+struct probeContext {
+  struct probeResult *probe;
+  int maxOFMDs;
+};
+
+// 'OFMDCallback' which looks at the first 'maxOFMDs' OFMDs.
+static int probeOFMD(void *context, const BYTE *OFMD, size_t length,
+                     int64_t offset) {
+  struct probeContext *probeContext = (struct probeContext *)context;
+  struct probeResult *probe = probeContext->probe;
+  int frameCount = OFMD[11] & 127;
+  (void)length;
+
+  if (probe->numOFMDs == 0) {
+    probe->numOfPlanes = OFMD[10] & 0x7F;
+    probe->frameRate = OFMD[4] & 15;
+    probe->firstOffset = offset;
+    probe->minGOPFrames = frameCount;
+    probe->maxGOPFrames = frameCount;
+  } else {
+    // The frames up to the last OFMD's offset.
+    probe->framesBeforeLast = probe->framesRead;
+  }
+  if (frameCount < probe->minGOPFrames) {
+    probe->minGOPFrames = frameCount;
+  }
+  if (frameCount > probe->maxGOPFrames) {
+    probe->maxGOPFrames = frameCount;
+  }
+  probe->lastOffset = offset;
+  probe->framesRead += frameCount;
+  probe->numOFMDs++;
+
+  return probe->numOFMDs >= probeContext->maxOFMDs;
+}
+
+// The bytes left on stdin or -1 if it's a pipe.
+static int64_t stdinSize() {
+  struct stat info;
+  off_t position;
+
+  if (fstat(STDIN_FILENO, &info) != 0 || !S_ISREG(info.st_mode)) {
+    return -1;
+  }
+  position = lseek(STDIN_FILENO, 0, SEEK_CUR);
+
+  return info.st_size - (position > 0 ? position : 0);
+}
+
+/*
+ * Reads the first OFMDs of 'filenames[0]' (up to 'maxOFMDs' of them, or
+ * 'maxBytes') and guesses the number of frames of all the files from the
+ * frames per byte in between.
+ * Returns the number of OFMDs read or -1.
+ */
+int probeFiles(size_t bufferSize, enum inputBackend backend,
+               const char **filenames, int numFiles, int maxOFMDs,
+               int64_t maxBytes, struct probeResult *probe) {
+  struct probeContext probeContext = {probe, maxOFMDs};
+  struct scanContext context;
+  struct stat info;
+  int64_t firstSize = -1;
+  int result;
+
+  memset(probe, 0, sizeof(struct probeResult));
+  probe->estimatedFrames = -1;
+
+  // stdin only has a size if a file was redirected to it.
+  probe->totalSize = 0;
+  for (int file = 0; file < numFiles; file++) {
+    int64_t size = -1;
+
+    if (strcmp(filenames[file], "-") == 0) {
+      size = stdinSize();
+    } else if (stat(filenames[file], &info) == 0 && S_ISREG(info.st_mode)) {
+      size = info.st_size;
+    }
+    if (size == -1) {
+      probe->totalSize = -1;
+      break;
+    }
+    probe->totalSize += size;
+    if (file == 0) {
+      firstSize = size;
+    }
+  }
+
+  context.filenames = filenames;
+  context.bufferSize = bufferSize;
+  context.backend = backend;
+  context.callback = probeOFMD;
+  context.callbackContext = &probeContext;
+  context.limit = maxBytes;
+  context.quiet = true;
+  context.checkpoint = NULL;
+  result = scanFiles(&context, 1, 1, false);
+  free(context.ranges);
+  if (result == -1) {
+    return -1;
+  }
+
+  if (probe->numOFMDs >= maxOFMDs) {
+    probe->bytesScanned = probe->lastOffset;
+  } else {
+    probe->bytesScanned = context.progress.scanned;
+  }
+
+  // A small file might have been read from start to finish.
+  if (numFiles == 1 && probe->numOFMDs < maxOFMDs && firstSize != -1 &&
+      firstSize <= maxBytes) {
+    probe->estimatedFrames = probe->framesRead;
+  } else if (probe->totalSize > 0 && probe->numOFMDs > 0) {
+    double framesPerByte;
+
+    if (probe->numOFMDs > 1 && probe->lastOffset > probe->firstOffset) {
+      framesPerByte = (double)probe->framesBeforeLast /
+                      (double)(probe->lastOffset - probe->firstOffset);
+    } else {
+      framesPerByte = (double)probe->framesRead /
+                      (double)(probe->bytesScanned > 0 ? probe->bytesScanned
+                                                       : 1);
+    }
+    probe->estimatedFrames =
+        (int64_t)(framesPerByte * (double)probe->totalSize + 0.5);
+    if (probe->estimatedFrames < probe->framesRead) {
+      probe->estimatedFrames = probe->framesRead;
     }
   }
 
-  free(buffer);
+  return probe->numOFMDs;
 }
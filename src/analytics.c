@@ -0,0 +1,333 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "analytics.h"
+#include "rle.h"
+#include "util.h"
+
+#define HASH_PRIME (0x100000001b3ULL)
+
+void initDepthStats(struct depthStats *stats) {
+  stats->numFrames = 0;
+  stats->minval = 128;
+  stats->maxval = -128;
+  stats->total = 0;
+  stats->undefined = 0;
+  stats->firstframe = -1;
+  stats->lastframe = -1;
+  stats->lastval = 0;
+  stats->cuts = 0;
+  stats->hash = HASH_SEED;
+}
+
+static void addDepthsScalar(struct depthStats *stats, const BYTE *depths,
+                            int count) {
+  int byte;
+
+  for (int x = 0; x < count; x++) {
+    int i = stats->numFrames + x;
+
+    byte = depths[x];
+    if (byte != stats->lastval) {
+      stats->cuts++;
+      stats->lastval = byte;
+    }
+    if (byte == 128) {
+      stats->undefined += 1;
+      continue;
+    } else {
+      stats->lastframe = i;
+      if (stats->firstframe == -1) {
+        stats->firstframe = i;
+      }
+    }
+
+    // If the value is bigger than 128. Negate the value.
+    if (byte > 128) {
+      byte = 128 - byte;
+    }
+
+    if (byte < stats->minval) {
+      stats->minval = byte;
+    }
+    if (byte > stats->maxval) {
+      stats->maxval = byte;
+    }
+    stats->total += byte;
+  }
+  stats->hash = hashBytes(stats->hash, depths, count);
+  stats->numFrames += count;
+}
+
+#ifdef __SSE2__
+/*
+ * Does 16 depths at a time after the first one and returns how many were
+ * added. Each depth is compared with the one in front of it for the cuts, and
+ * turned into 'depth + 128' so the unsigned min, max, and sum of absolute
+ * differences work on it. Undefined depths are masked out of those.
+ */
+static int addDepthsSSE2(struct depthStats *stats, const BYTE *depths,
+                         int count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i undefinedVec = _mm_set1_epi8((char)0x80);
+  const __m128i low7 = _mm_set1_epi8(0x7F);
+  __m128i minVec = _mm_set1_epi8((char)0xFF);
+  __m128i maxVec = zero;
+  __m128i sumVec = zero;
+  BYTE lanes[16];
+  int64_t numDefined = 0;
+  uint64_t hash;
+  int minval = 255;
+  int maxval = 0;
+  int x = 1;
+
+  addDepthsScalar(stats, depths, 1);
+  hash = stats->hash;
+  for (; x + 16 <= count; x += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(depths + x));
+    __m128i prev = _mm_loadu_si128((const __m128i *)(depths + x - 1));
+    __m128i undefined = _mm_cmpeq_epi8(bytes, undefinedVec);
+    int undefinedBits = _mm_movemask_epi8(undefined);
+    int definedBits = ~undefinedBits & 0xFFFF;
+    int sameBits = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, prev));
+
+    // 0x81-0xFF are -1 to -127, so negate the low 7 bits of those.
+    __m128i negative = _mm_cmplt_epi8(bytes, zero);
+    __m128i magnitude = _mm_and_si128(bytes, low7);
+    __m128i value = _mm_sub_epi8(_mm_xor_si128(magnitude, negative), negative);
+    __m128i biased = _mm_xor_si128(value, undefinedVec);
+    __m128i defined = _mm_andnot_si128(undefined, biased);
+    uint64_t words[2];
+
+    minVec = _mm_min_epu8(minVec, _mm_or_si128(biased, undefined));
+    maxVec = _mm_max_epu8(maxVec, defined);
+    sumVec = _mm_add_epi64(sumVec, _mm_sad_epu8(defined, zero));
+
+    stats->cuts += 16 - __builtin_popcount(sameBits);
+    stats->undefined += __builtin_popcount(undefinedBits);
+    numDefined += __builtin_popcount(definedBits);
+    if (definedBits != 0) {
+      if (stats->firstframe == -1) {
+        stats->firstframe = stats->numFrames + __builtin_ctz(definedBits);
+      }
+      stats->lastframe = stats->numFrames + 31 - __builtin_clz(definedBits);
+    }
+
+    // FNV-1a, but a word at a time.
+    memcpy(words, depths + x, 16);
+    hash = (hash ^ words[0]) * HASH_PRIME;
+    hash = (hash ^ words[1]) * HASH_PRIME;
+    stats->numFrames += 16;
+  }
+  stats->hash = hash;
+
+  if (numDefined > 0) {
+    _mm_storeu_si128((__m128i *)lanes, minVec);
+    for (int lane = 0; lane < 16; lane++) {
+      minval = lanes[lane] < minval ? lanes[lane] : minval;
+    }
+    _mm_storeu_si128((__m128i *)lanes, maxVec);
+    for (int lane = 0; lane < 16; lane++) {
+      maxval = lanes[lane] > maxval ? lanes[lane] : maxval;
+    }
+    _mm_storeu_si128((__m128i *)lanes, sumVec);
+    for (int half = 0; half < 2; half++) {
+      uint64_t sum;
+
+      memcpy(&sum, lanes + half * 8, 8);
+      stats->total += (int64_t)sum;
+    }
+    stats->total -= 128 * numDefined;
+    if (minval - 128 < stats->minval) {
+      stats->minval = minval - 128;
+    }
+    if (maxval - 128 > stats->maxval) {
+      stats->maxval = maxval - 128;
+    }
+  }
+  stats->lastval = depths[x - 1];
+
+  return x;
+}
+#endif
+
+// Adds the next 'count' depth values of a plane to 'stats'.
+void addDepths(struct depthStats *stats, const BYTE *depths, int count) {
+  int done = 0;
+
+#ifdef __SSE2__
+  if (count > 16) {
+    done = addDepthsSSE2(stats, depths, count);
+  }
+#endif
+  addDepthsScalar(stats, depths + done, count - done);
+}
+
+bool hasDefinedStats(const struct depthStats *stats) {
+  return stats->undefined < stats->numFrames;
+}
+
+// True if planes 'x' and 'y' have the same depths.
+typedef bool (*planeCompare)(const void *planes, int x, int y,
+                             int numFrames);
+
+static bool sameDepths(const void *planes, int x, int y, int numFrames) {
+  BYTE *const *depths = (BYTE *const *)planes;
+
+  return memcmp(depths[x], depths[y], numFrames) == 0;
+}
+
+static bool sameRuns(const void *planes, int x, int y, int numFrames) {
+  const struct rlePlanes *rle = (const struct rlePlanes *)planes;
+  (void)numFrames;
+
+  return sameRLEPlanes(&rle->planes[x], &rle->planes[y]);
+}
+
+/*
+ * Puts the planes with the same depths in the same class. Planes are only
+ * compared if their hashes match, and with 'compare' the match is checked,
+ * so a collision can't make two planes identical. Without it (while
+ * streaming) the hashes have to do.
+ */
+static void groupPlanes(struct planeAnalytics *analytics,
+                        planeCompare compare, const void *planes) {
+  int numOfPlanes = analytics->numOfPlanes;
+
+  analytics->numDefined = 0;
+  analytics->numClasses = 0;
+  for (int x = 0; x < numOfPlanes; x++) {
+    const struct depthStats *stats = &analytics->stats[x];
+
+    analytics->classOf[x] = x;
+    analytics->identical[x] = 0;
+    if (hasDefinedStats(stats)) {
+      analytics->numDefined++;
+    }
+
+    // Only the first plane of each class has to be looked at.
+    for (int y = 0; y < x; y++) {
+      const struct depthStats *other = &analytics->stats[y];
+
+      if (analytics->classOf[y] == y && other->hash == stats->hash &&
+          other->numFrames == stats->numFrames &&
+          (compare == NULL || compare(planes, x, y, stats->numFrames))) {
+        analytics->classOf[x] = y;
+        break;
+      }
+    }
+    if (analytics->classOf[x] == x) {
+      analytics->numClasses++;
+    }
+  }
+
+  for (int x = 0; x < numOfPlanes; x++) {
+    for (int y = 0; y < numOfPlanes; y++) {
+      if (analytics->classOf[x] == analytics->classOf[y]) {
+        analytics->identical[x] |= (uint32_t)1 << y;
+      }
+    }
+  }
+}
+
+// 'planes' can be NULL if they're not in memory.
+void groupIdenticalPlanes(struct planeAnalytics *analytics,
+                          BYTE *const *planes) {
+  groupPlanes(analytics, planes != NULL ? sameDepths : NULL, planes);
+}
+
+/*
+ * Gets the depth stats of every plane in one pass over each and which of
+ * them are identical, without printing anything.
+ */
+void analyzePlanes(BYTE *const *planes, int numOfPlanes, int numFrames,
+                   struct planeAnalytics *analytics) {
+  analytics->numOfPlanes = numOfPlanes;
+  for (int x = 0; x < numOfPlanes; x++) {
+    initDepthStats(&analytics->stats[x]);
+    addDepths(&analytics->stats[x], planes[x], numFrames);
+  }
+  groupIdenticalPlanes(analytics, planes);
+}
+
+/*
+ * Same as 'analyzePlanes', but a run at a time instead of a frame at a
+ * time. The hashes are of the runs.
+ */
+void analyzeRLEPlanes(const struct rlePlanes *rle,
+                      struct planeAnalytics *analytics) {
+  analytics->numOfPlanes = rle->numOfPlanes;
+  for (int x = 0; x < rle->numOfPlanes; x++) {
+    const struct rlePlane *plane = &rle->planes[x];
+    struct depthStats *stats = &analytics->stats[x];
+    int start = 0;
+
+    initDepthStats(stats);
+    for (int run = 0; run < plane->numRuns; run++) {
+      int depth = plane->runs[run].depth;
+      int length = plane->runs[run].end - start;
+      BYTE key[5];
+
+      writeLE(key, plane->runs[run].end, 4);
+      key[4] = (BYTE)depth;
+      stats->hash = hashBytes(stats->hash, key, 5);
+
+      // Runs next to each other always have different depths.
+      if (depth != stats->lastval) {
+        stats->cuts++;
+        stats->lastval = depth;
+      }
+      if (depth == 128) {
+        stats->undefined += length;
+        start = plane->runs[run].end;
+        continue;
+      }
+      if (stats->firstframe == -1) {
+        stats->firstframe = start;
+      }
+      stats->lastframe = plane->runs[run].end - 1;
+
+      if (depth > 128) {
+        depth = 128 - depth;
+      }
+      if (depth < stats->minval) {
+        stats->minval = depth;
+      }
+      if (depth > stats->maxval) {
+        stats->maxval = depth;
+      }
+      stats->total += (int64_t)depth * length;
+      start = plane->runs[run].end;
+    }
+    stats->numFrames = rle->numFrames;
+  }
+  groupPlanes(analytics, sameRuns, rle);
+}
@@ -0,0 +1,504 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "input.h"
+#include "parallel.h"
+#include "util.h"
+
+#define MAX_MANIFEST_LINE (4096 * 3)
+#define MAX_FOLDER_DEPTH (32)
+
+static bool isSeparator(char c) { return c == '/' || c == '\\'; }
+
+static bool isAbsolutePath(const char *path) {
+  return isSeparator(path[0]) || (path[0] != '\0' && path[1] == ':');
+}
+
+static char *joinPath(const char *folder, const char *name) {
+  size_t size = strlen(folder) + strlen(name) + 2;
+  char *path = (char *)malloc(size);
+
+  if (path == NULL) {
+    perror("malloc()");
+    return NULL;
+  }
+  snprintf(path, size, "%s" PATH_SEPARATOR "%s", folder, name);
+  return path;
+}
+
+// The last part of 'path', without the extension of an input file.
+static char *titleName(const char *path) {
+  size_t length = strlen(path);
+  const char *name;
+  char *title;
+
+  while (length > 1 && isSeparator(path[length - 1])) {
+    length--;
+  }
+  name = path + length;
+  while (name > path && !isSeparator(name[-1])) {
+    name--;
+  }
+
+  title = (char *)malloc(path + length - name + 1);
+  if (title == NULL) {
+    perror("malloc()");
+    return NULL;
+  }
+  memcpy(title, name, path + length - name);
+  title[path + length - name] = '\0';
+  if (hasInputExt(title)) {
+    *strrchr(title, '.') = '\0';
+  }
+
+  return title;
+}
+
+static bool isBDMVFolder(const char *name) {
+  const char *bdmv = "BDMV";
+
+  for (int x = 0; x < 5; x++) {
+    if (toupper((unsigned char)name[x]) != bdmv[x]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Takes 'input' and 'outFolder', which are freed if the job can't be added.
+ * Either can be NULL if it couldn't be allocated. Returns -1 then.
+ */
+static int addBatchJob(struct batch *batch, char *input, char *outFolder,
+                       int playlist) {
+  struct batchJob *jobs;
+  struct batchJob *job;
+  struct stat info;
+
+  if (input == NULL || outFolder == NULL) {
+    free(input);
+    free(outFolder);
+    return -1;
+  }
+  jobs = (struct batchJob *)realloc(
+      batch->jobs, sizeof(struct batchJob) * (batch->numJobs + 1));
+  if (jobs == NULL) {
+    perror("realloc()");
+    free(input);
+    free(outFolder);
+    return -1;
+  }
+  batch->jobs = jobs;
+  job = &batch->jobs[batch->numJobs++];
+  memset(job, 0, sizeof(struct batchJob));
+  job->input = input;
+  job->outFolder = outFolder;
+  job->playlist = playlist;
+  job->numOFMDs = -1;
+  job->device = stat(input, &info) == 0 ? (int64_t)info.st_dev : -1;
+
+  return 0;
+}
+
+int readBatchManifest(const char *path, const char *outFolder,
+                      struct batch *batch) {
+  FILE *filePtr = fopen(path, "r");
+  char *line;
+  int lineNum = 0;
+  int result = 0;
+
+  memset(batch, 0, sizeof(struct batch));
+  if (filePtr == NULL) {
+    perror("fopen()");
+    printf("Failed to open '%s'\n", path);
+    return -1;
+  }
+
+  line = (char *)malloc(MAX_MANIFEST_LINE);
+  if (line == NULL) {
+    perror("malloc()");
+    fclose(filePtr);
+    return -1;
+  }
+  while (result == 0 && fgets(line, MAX_MANIFEST_LINE, filePtr) != NULL) {
+    char *fields[3] = {line, NULL, NULL};
+    size_t length = strlen(line);
+    int playlist = -1;
+    char *title;
+    char *output;
+
+    lineNum++;
+    if (length == MAX_MANIFEST_LINE - 1 && line[length - 1] != '\n') {
+      printf("%s:%d: The line is too long.\n", path, lineNum);
+      result = -1;
+      break;
+    }
+    while (length > 0 &&
+           (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      line[--length] = '\0';
+    }
+    if (length == 0 || line[0] == '#') {
+      continue;
+    }
+
+    for (int x = 1; x < 3; x++) {
+      fields[x] = strchr(fields[x - 1], '\t');
+      if (fields[x] == NULL) {
+        break;
+      }
+      *fields[x]++ = '\0';
+    }
+
+    if (strcmp(fields[0], "-") == 0) {
+      printf("%s:%d: stdin can't be used in a batch.\n", path, lineNum);
+      result = -1;
+    } else if (fields[2] != NULL) {
+      if (sscanf(fields[2], "%d", &playlist) != 1 || playlist < 0 ||
+          playlist > 99999) {
+        printf("%s:%d: '%s' is an invalid playlist.\n", path, lineNum,
+               fields[2]);
+        result = -1;
+      } else if (!dirExists(fields[0])) {
+        printf("%s:%d: A playlist only works with a BDMV folder.\n", path,
+               lineNum);
+        result = -1;
+      }
+    } else if (dirExists(fields[0])) {
+      printf("%s:%d: '%s' is a folder. Add a playlist.\n", path, lineNum,
+             fields[0]);
+      result = -1;
+    }
+    if (result == -1) {
+      break;
+    }
+
+    if (fields[1] != NULL && fields[1][0] != '\0') {
+      output = isAbsolutePath(fields[1]) ? strdup(fields[1])
+                                         : joinPath(outFolder, fields[1]);
+    } else {
+      char *withPlaylist;
+
+      title = titleName(fields[0]);
+      if (title != NULL && playlist != -1) {
+        size_t size = strlen(title) + 7;
+
+        withPlaylist = (char *)realloc(title, size);
+        if (withPlaylist == NULL) {
+          perror("realloc()");
+          free(title);
+        } else {
+          snprintf(withPlaylist + strlen(withPlaylist), 7, "-%05d", playlist);
+        }
+        title = withPlaylist;
+      }
+      output = title != NULL ? joinPath(outFolder, title) : NULL;
+      free(title);
+    }
+    result = addBatchJob(batch, strdup(fields[0]), output, playlist);
+  }
+  free(line);
+  fclose(filePtr);
+
+  if (result == -1) {
+    freeBatch(batch);
+  }
+  return result;
+}
+
+static int findInputs(const char *folder, const char *outFolder,
+                      struct batch *batch, int depth) {
+  DIR *dir;
+  struct dirent *entry;
+  int result = 0;
+
+  if (depth > MAX_FOLDER_DEPTH) {
+    return 0;
+  }
+
+  dir = opendir(folder);
+  if (dir == NULL) {
+    perror("opendir()");
+    printf("Failed to open '%s'\n", folder);
+    return -1;
+  }
+
+  while (result == 0 && (entry = readdir(dir)) != NULL) {
+    char *path;
+    char *title;
+
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    path = joinPath(folder, entry->d_name);
+    if (path == NULL) {
+      result = -1;
+    } else if (dirExists(path)) {
+      if (!isBDMVFolder(entry->d_name)) {
+        char *subFolder = joinPath(outFolder, entry->d_name);
+
+        result = subFolder != NULL
+                     ? findInputs(path, subFolder, batch, depth + 1)
+                     : -1;
+        free(subFolder);
+      }
+      free(path);
+    } else if (hasInputExt(entry->d_name)) {
+      title = titleName(entry->d_name);
+      result = addBatchJob(batch, path,
+                           title != NULL ? joinPath(outFolder, title) : NULL,
+                           -1);
+      free(title);
+    } else {
+      free(path);
+    }
+  }
+  closedir(dir);
+
+  return result;
+}
+
+static int compareJobs(const void *a, const void *b) {
+  return strcmp(((const struct batchJob *)a)->input,
+                ((const struct batchJob *)b)->input);
+}
+
+int findBatchInputs(const char *folder, const char *outFolder,
+                    struct batch *batch) {
+  memset(batch, 0, sizeof(struct batch));
+  if (findInputs(folder, outFolder, batch, 0) == -1) {
+    freeBatch(batch);
+    return -1;
+  }
+
+  // readdir() doesn't sort.
+  if (batch->numJobs > 1) {
+    qsort(batch->jobs, batch->numJobs, sizeof(struct batchJob), compareJobs);
+  }
+
+  return 0;
+}
+
+// Makes the folders 'path' is in, like 'mkdir -p' would.
+static void makeParentFolders(const char *path) {
+  char *folder = strdup(path);
+
+  if (folder == NULL) {
+    return; // Opening the output folder fails later.
+  }
+  for (size_t x = 1; folder[x] != '\0'; x++) {
+    if (!isSeparator(folder[x]) || folder[x - 1] == ':') {
+      continue;
+    }
+    folder[x] = '\0';
+    if (!dirExists(folder)) {
+      makeDirectory(folder);
+    }
+    folder[x] = path[x];
+  }
+  free(folder);
+}
+
+// Shared by every batch worker.
+struct batchRun {
+  struct batch *batch;
+  int ioLimit;
+  batchTask task;
+  void *context;
+  pthread_mutex_t lock;
+  pthread_cond_t changed; // A job started or finished.
+  bool *started;
+  int *groups;  // The device group of each job.
+  int *running; // Jobs running in each group.
+  int numStarted;
+  int numFinished;
+};
+
+// The first job that hasn't started, whose device has room. -1 if none.
+static int nextBatchJob(struct batchRun *run) {
+  for (int x = 0; x < run->batch->numJobs; x++) {
+    if (!run->started[x] && run->running[run->groups[x]] < run->ioLimit) {
+      return x;
+    }
+  }
+
+  return -1;
+}
+
+static const char *jobStatus(const struct batchJob *job) {
+  if (job->result == 0) {
+    return "Done";
+  } else if (job->numOFMDs == 0) {
+    return "No 3D-Planes";
+  }
+  return "Failed";
+}
+
+// 'parallelTask' which keeps taking jobs until they've all started.
+static void batchWorker(void *context, int index) {
+  struct batchRun *run = (struct batchRun *)context;
+  (void)index;
+
+  keepInputBuffers(true);
+  pthread_mutex_lock(&run->lock);
+  while (run->numStarted < run->batch->numJobs) {
+    int x = nextBatchJob(run);
+    struct batchJob *job;
+    double start;
+
+    if (x == -1) {
+      pthread_cond_wait(&run->changed, &run->lock);
+      continue;
+    }
+    job = &run->batch->jobs[x];
+    run->started[x] = true;
+    run->numStarted++;
+    run->running[run->groups[x]]++;
+    pthread_mutex_unlock(&run->lock);
+
+    start = currentSeconds();
+    makeParentFolders(job->outFolder);
+    job->result = run->task(run->context, job);
+    job->seconds = currentSeconds() - start;
+
+    pthread_mutex_lock(&run->lock);
+    run->running[run->groups[x]]--;
+    run->numFinished++;
+    printf("[%d/%d] %s: %s (%.1f seconds)\n", run->numFinished,
+           run->batch->numJobs, jobStatus(job), job->input, job->seconds);
+    fflush(stdout);
+    pthread_cond_broadcast(&run->changed);
+  }
+  pthread_mutex_unlock(&run->lock);
+  keepInputBuffers(false);
+}
+
+int runBatch(struct batch *batch, int numWorkers, int ioLimit,
+             batchTask task, void *context) {
+  struct batchRun run;
+  int64_t *devices;
+  int numDevices = 0;
+
+  if (batch->numJobs == 0) {
+    return 0;
+  }
+
+  memset(&run, 0, sizeof(struct batchRun));
+  run.batch = batch;
+  run.ioLimit = ioLimit;
+  run.task = task;
+  run.context = context;
+  run.started = (bool *)calloc(batch->numJobs, sizeof(bool));
+  run.groups = (int *)calloc(batch->numJobs, sizeof(int));
+  run.running = (int *)calloc(batch->numJobs, sizeof(int));
+  devices = (int64_t *)malloc(sizeof(int64_t) * batch->numJobs);
+  if (run.started == NULL || run.groups == NULL || run.running == NULL ||
+      devices == NULL) {
+    perror("malloc()");
+    free(run.started);
+    free(run.groups);
+    free(run.running);
+    free(devices);
+    return -1;
+  }
+
+  // Jobs on the same device share a group. (Unknown ones share one too.)
+  for (int x = 0; x < batch->numJobs; x++) {
+    int group = 0;
+
+    while (group < numDevices && devices[group] != batch->jobs[x].device) {
+      group++;
+    }
+    if (group == numDevices) {
+      devices[numDevices++] = batch->jobs[x].device;
+    }
+    run.groups[x] = group;
+  }
+  free(devices);
+
+  pthread_mutex_init(&run.lock, NULL);
+  pthread_cond_init(&run.changed, NULL);
+  parallelFor(numWorkers, numWorkers, batchWorker, &run);
+  pthread_cond_destroy(&run.changed);
+  pthread_mutex_destroy(&run.lock);
+
+  free(run.started);
+  free(run.groups);
+  free(run.running);
+
+  return 0;
+}
+
+int printBatchSummary(const struct batch *batch, double seconds) {
+  int numDone = 0;
+  int numEmpty = 0;
+  int numFailed = 0;
+
+  printf("\nBatch summary:\n");
+  for (int x = 0; x < batch->numJobs; x++) {
+    const struct batchJob *job = &batch->jobs[x];
+
+    if (job->result == 0) {
+      numDone++;
+      printf("  %-12s %2d/%-2d planes %8d frames %8.1fs  %s -> %s\n",
+             jobStatus(job), job->planesWritten, job->numOfPlanes,
+             job->totalFrames, job->seconds, job->input, job->outFolder);
+    } else {
+      if (job->numOFMDs == 0) {
+        numEmpty++;
+      } else {
+        numFailed++;
+      }
+      printf("  %-12s %32.1fs  %s\n", jobStatus(job), job->seconds,
+             job->input);
+    }
+  }
+  printf("\n%d title(s): %d done, %d without 3D-Planes, %d failed. "
+         "(%.1f seconds)\n",
+         batch->numJobs, numDone, numEmpty, numFailed, seconds);
+  fflush(stdout);
+
+  return numEmpty + numFailed;
+}
+
+void freeBatch(struct batch *batch) {
+  for (int x = 0; x < batch->numJobs; x++) {
+    free(batch->jobs[x].input);
+    free(batch->jobs[x].outFolder);
+  }
+  free(batch->jobs);
+  memset(batch, 0, sizeof(struct batch));
+}
@@ -0,0 +1,320 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "bdmv.h"
+#include "util.h"
+
+#define MAX_MPLS_SIZE (1024 * 1024) // Real playlists are a few KB.
+#define CLIP_NAME_SIZE (5)          // '00001' in '00001.m2ts'
+
+// The clip names of one PlayItem.
+struct playItem {
+  char clip[CLIP_NAME_SIZE + 1];
+  char dependentClip[CLIP_NAME_SIZE + 1]; // Empty if there isn't one.
+};
+
+static uint32_t readU32(const BYTE *data) {
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+         ((uint32_t)data[2] << 8) | data[3];
+}
+
+static uint16_t readU16(const BYTE *data) {
+  return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+// The names end up in paths, so they can only be the five digits.
+static bool isClipName(const BYTE *name) {
+  for (int x = 0; x < CLIP_NAME_SIZE; x++) {
+    if (!isdigit(name[x])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool fileExists(const char *path) {
+  struct stat info;
+
+  return stat(path, &info) == 0 && (info.st_mode & S_IFDIR) == 0;
+}
+
+static BYTE *readWholeFile(const char *path, size_t *length) {
+  FILE *filePtr = fopen(path, "rb");
+  BYTE *data;
+
+  if (filePtr == NULL) {
+    perror("fopen()");
+    printf("Failed to open '%s'\n", path);
+    return NULL;
+  }
+
+  data = (BYTE *)malloc(MAX_MPLS_SIZE);
+  if (data == NULL) {
+    perror("malloc()");
+    fclose(filePtr);
+    return NULL;
+  }
+  *length = fread(data, 1, MAX_MPLS_SIZE, filePtr);
+  fclose(filePtr);
+
+  return data;
+}
+
+/*
+ * Reads the SubPaths starting at 'pos' and stores the clip of each
+ * SubPlayItem from the SS video SubPath into the matching PlayItem.
+ */
+static void parseSubPaths(const BYTE *mpls, size_t length, size_t pos,
+                          int numSubPaths, struct playItem *items,
+                          int numItems) {
+  for (int subPath = 0; subPath < numSubPaths; subPath++) {
+    size_t subPathEnd;
+    size_t itemPos;
+    int numSubItems;
+
+    if (pos + 10 > length) {
+      return;
+    }
+    subPathEnd = pos + 4 + readU32(mpls + pos);
+
+    if (mpls[pos + 5] == SUBPATH_SS_VIDEO) {
+      numSubItems = mpls[pos + 9];
+      itemPos = pos + 10;
+      for (int item = 0; item < numSubItems && item < numItems; item++) {
+        if (itemPos + 2 + CLIP_NAME_SIZE > length) {
+          break;
+        }
+        if (isClipName(mpls + itemPos + 2)) {
+          memcpy(items[item].dependentClip, mpls + itemPos + 2,
+                 CLIP_NAME_SIZE);
+        }
+        itemPos += 2 + readU16(mpls + itemPos);
+      }
+    }
+
+    pos = subPathEnd;
+  }
+}
+
+/*
+ * 3D playlists keep their SS video SubPath in the 'SubPath entries
+ * extension' (ID1 2, ID2 2) of the ExtensionData.
+ */
+static void parseExtensionData(const BYTE *mpls, size_t length,
+                               struct playItem *items, int numItems) {
+  size_t start = readU32(mpls + 16);
+  size_t entryPos;
+  int numEntries;
+
+  if (start == 0 || start + 12 > length || readU32(mpls + start) == 0) {
+    return;
+  }
+
+  numEntries = mpls[start + 11];
+  entryPos = start + 12;
+  for (int entry = 0; entry < numEntries; entry++, entryPos += 12) {
+    size_t dataPos;
+
+    if (entryPos + 12 > length) {
+      return;
+    }
+    if (readU16(mpls + entryPos) != 2 || readU16(mpls + entryPos + 2) != 2) {
+      continue;
+    }
+
+    dataPos = start + readU32(mpls + entryPos + 4);
+    if (dataPos + 6 <= length) {
+      parseSubPaths(mpls, length, dataPos + 6, readU16(mpls + dataPos + 4),
+                    items, numItems);
+    }
+  }
+}
+
+/*
+ * Returns the number of PlayItems or -1 if 'mpls' isn't a playlist, or
+ * 'items' couldn't be allocated.
+ */
+static int parsePlaylist(const BYTE *mpls, size_t length,
+                         struct playItem **items) {
+  size_t pos;
+  int numItems;
+  int numSubPaths;
+
+  if (length < 20 || memcmp(mpls, "MPLS", 4) != 0) {
+    return -1;
+  }
+
+  // Skip the PlayList length and reserved bytes.
+  pos = readU32(mpls + 8) + 6;
+  if (pos + 4 > length) {
+    return -1;
+  }
+  numItems = readU16(mpls + pos);
+  numSubPaths = readU16(mpls + pos + 2);
+  pos += 4;
+  if (numItems == 0) {
+    return -1;
+  }
+
+  *items = (struct playItem *)calloc(numItems + 1, sizeof(struct playItem));
+  if (*items == NULL) {
+    perror("calloc()");
+    return -1;
+  }
+  for (int item = 0; item < numItems; item++) {
+    if (pos + 2 + CLIP_NAME_SIZE > length || !isClipName(mpls + pos + 2)) {
+      free(*items);
+      return -1;
+    }
+    memcpy((*items)[item].clip, mpls + pos + 2, CLIP_NAME_SIZE);
+    pos += 2 + readU16(mpls + pos);
+  }
+
+  parseSubPaths(mpls, length, pos, numSubPaths, *items, numItems);
+  parseExtensionData(mpls, length, *items, numItems);
+
+  return numItems;
+}
+
+// Builds '<folder>/<subFolder><name><ext>'.
+static char *joinPath(const char *folder, const char *subFolder,
+                      const char *name, const char *ext) {
+  size_t size =
+      strlen(folder) + strlen(subFolder) + strlen(name) + strlen(ext) + 2;
+  char *path = (char *)malloc(size);
+
+  if (path == NULL) {
+    perror("malloc()");
+    return NULL;
+  }
+  snprintf(path, size, "%s" PATH_SEPARATOR "%s%s%s", folder, subFolder, name,
+           ext);
+  return path;
+}
+
+int getPlaylistClips(const char *folder, int playlist, char ***clips) {
+  char *bdmv;
+  char *mplsPath;
+  char name[16];
+  BYTE *mpls;
+  size_t length;
+  struct playItem *items;
+  int numItems;
+
+  // Accept the folder above 'BDMV' too.
+  bdmv = joinPath(folder, "", "BDMV", "");
+  if (bdmv != NULL && !dirExists(bdmv)) {
+    free(bdmv);
+    bdmv = strdup(folder);
+  }
+  if (bdmv == NULL) {
+    return -1;
+  }
+
+  snprintf(name, sizeof(name), "%05d", playlist);
+  mplsPath = joinPath(bdmv, "PLAYLIST" PATH_SEPARATOR, name, ".mpls");
+  if (mplsPath == NULL) {
+    free(bdmv);
+    return -1;
+  }
+  mpls = readWholeFile(mplsPath, &length);
+  if (mpls == NULL) {
+    free(mplsPath);
+    free(bdmv);
+    return -1;
+  }
+
+  numItems = parsePlaylist(mpls, length, &items);
+  free(mpls);
+  if (numItems <= 0) {
+    printf("'%s' isn't a valid playlist.\n", mplsPath);
+    free(mplsPath);
+    free(bdmv);
+    return -1;
+  }
+  free(mplsPath);
+
+  *clips = (char **)calloc(numItems, sizeof(char *));
+  if (*clips == NULL) {
+    perror("calloc()");
+    free(items);
+    free(bdmv);
+    return -1;
+  }
+  for (int item = 0; item < numItems; item++) {
+    char *ssif = joinPath(bdmv, "STREAM" PATH_SEPARATOR "SSIF" PATH_SEPARATOR,
+                          items[item].clip, ".ssif");
+    char *dependent = joinPath(bdmv, "STREAM" PATH_SEPARATOR,
+                               items[item].dependentClip, ".m2ts");
+    char *m2ts =
+        joinPath(bdmv, "STREAM" PATH_SEPARATOR, items[item].clip, ".m2ts");
+
+    if (ssif == NULL || dependent == NULL || m2ts == NULL) {
+      free(ssif);
+      free(dependent);
+      free(m2ts);
+      free2DArray((void ***)clips, numItems);
+      free(items);
+      free(bdmv);
+      return -1;
+    }
+
+    // The SSIF and the dependent view clip both have the MVC stream.
+    if (fileExists(ssif)) {
+      (*clips)[item] = ssif;
+      ssif = NULL;
+    } else if (items[item].dependentClip[0] != '\0' && fileExists(dependent)) {
+      (*clips)[item] = dependent;
+      dependent = NULL;
+    } else if (fileExists(m2ts)) {
+      (*clips)[item] = m2ts;
+      m2ts = NULL;
+    }
+    free(ssif);
+    free(dependent);
+    free(m2ts);
+
+    if ((*clips)[item] == NULL) {
+      printf("Couldn't find the clip '%s' of PlayItem %d.\n", items[item].clip,
+             item);
+      free2DArray((void ***)clips, numItems);
+      free(items);
+      free(bdmv);
+      return -1;
+    }
+  }
+
+  free(items);
+  free(bdmv);
+  return numItems;
+}
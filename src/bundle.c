@@ -0,0 +1,258 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "3dplanes.h"
+#include "analytics.h"
+#include "bundle.h"
+#include "ofs.h"
+#include "util.h"
+
+// The real stdout, once 'bundleToStdout' moved it.
+static int stdoutBundle = -1;
+
+int bundleToStdout() {
+  stdoutBundle = takeStdout();
+
+  return stdoutBundle == -1 ? -1 : 0;
+}
+
+static int64_t tarBlocks(int64_t size) {
+  return (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE;
+}
+
+// Writes a ustar header for a regular file.
+static int writeTarHeader(FILE *out, const char *name, int64_t size,
+                          time_t mtime) {
+  BYTE header[TAR_BLOCK_SIZE];
+  unsigned int checksum = 0;
+
+  memset(header, 0, TAR_BLOCK_SIZE);
+  snprintf((char *)header, 100, "%s", name);
+  snprintf((char *)header + 100, 8, "%07o", 0644);
+  snprintf((char *)header + 108, 8, "%07o", 0);
+  snprintf((char *)header + 116, 8, "%07o", 0);
+  snprintf((char *)header + 124, 12, "%011llo", (unsigned long long)size);
+  snprintf((char *)header + 136, 12, "%011llo", (unsigned long long)mtime);
+  header[156] = '0'; // A regular file.
+  memcpy(header + 257, "ustar\0" "00", 8);
+
+  // The checksum is worked out with its own field as spaces.
+  memset(header + 148, ' ', 8);
+  for (int x = 0; x < TAR_BLOCK_SIZE; x++) {
+    checksum += header[x];
+  }
+  snprintf((char *)header + 148, 8, "%06o", checksum);
+  header[155] = ' ';
+
+  return fwrite(header, 1, TAR_BLOCK_SIZE, out) == TAR_BLOCK_SIZE ? 0 : -1;
+}
+
+// Writes a member and pads it to the next block.
+static int writeTarFile(FILE *out, const char *name, time_t mtime,
+                        const BYTE *head, size_t headSize, const BYTE *data,
+                        size_t size) {
+  BYTE padding[TAR_BLOCK_SIZE];
+  int64_t total = (int64_t)headSize + size;
+  size_t padSize = tarBlocks(total) * TAR_BLOCK_SIZE - total;
+
+  memset(padding, 0, TAR_BLOCK_SIZE);
+  if (writeTarHeader(out, name, total, mtime) == -1 ||
+      (headSize > 0 && fwrite(head, 1, headSize, out) != headSize) ||
+      fwrite(data, 1, size, out) != size ||
+      fwrite(padding, 1, padSize, out) != padSize) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Writes the index, with the OFS files starting 'dataStart' bytes into the
+ * archive. Returns its size.
+ */
+static long writeIndex(FILE *out, const struct OFMDdata *OFMDdata,
+                       const struct planeAnalytics *analytics,
+                       const BYTE *GUID, BYTE frameRate, int64_t dataStart) {
+  int64_t offset = dataStart;
+  const char *next = "";
+
+  rewind(out);
+  fprintf(out, "{\n  \"frameRate\": %d,\n", frameRate >> 4);
+  fprintf(out, "  \"dropFrame\": %s,\n", frameRate & 1 ? "true" : "false");
+  fprintf(out, "  \"totalFrames\": %d,\n", OFMDdata->totalFrames);
+  fprintf(out, "  \"numOfPlanes\": %d,\n", OFMDdata->numOfPlanes);
+  fprintf(out, "  \"planes\": [");
+  for (int plane = 0; plane < OFMDdata->numOfPlanes; plane++) {
+    const struct depthStats *stats = &analytics->stats[plane];
+    int64_t size = OFS_HEADER_SIZE + (int64_t)OFMDdata->totalFrames;
+
+    if (OFMDdata->validPlanes[plane] != 1) {
+      continue;
+    }
+
+    fprintf(out, "%s\n    {\"plane\": %d, ", next, plane);
+    fprintf(out, "\"name\": \"3D-Plane-%02d.ofs\", ", plane);
+    fprintf(out, "\"offset\": %lld, ", (long long)offset);
+    fprintf(out, "\"size\": %lld,\n     \"guid\": \"", (long long)size);
+    for (int x = 0; x < 15; x++) {
+      fprintf(out, "%02x", GUID[x]);
+    }
+    fprintf(out, "%02x\",\n", plane);
+    fprintf(out,
+            "     \"minDepth\": %d, \"maxDepth\": %d, "
+            "\"averageDepth\": %.2f,\n",
+            stats->minval, stats->maxval,
+            (double)stats->total /
+                ((double)stats->numFrames - (double)stats->undefined));
+    fprintf(out,
+            "     \"depthChanges\": %d, \"firstFrame\": %d, "
+            "\"lastFrame\": %d, \"undefinedFrames\": %d,\n",
+            stats->cuts, stats->firstframe, stats->lastframe,
+            stats->undefined);
+    fprintf(out, "     \"sameAs\": %d}", analytics->classOf[plane]);
+
+    offset += (1 + tarBlocks(size)) * TAR_BLOCK_SIZE;
+    next = ",";
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  return ftell(out);
+}
+
+/*
+ * The index is written first, but it has the offsets of the OFS files after
+ * it, which depend on its own size. It's written again until its size in
+ * blocks stops changing.
+ */
+static BYTE *makeIndex(const struct OFMDdata *OFMDdata,
+                       const struct planeAnalytics *analytics,
+                       const BYTE *GUID, BYTE frameRate, size_t *size) {
+  FILE *temp = tmpfile();
+  int64_t blocks = 1;
+  long length;
+  BYTE *index;
+
+  if (temp == NULL) {
+    perror("tmpfile()");
+    return NULL;
+  }
+
+  while (1) {
+    length = writeIndex(temp, OFMDdata, analytics, GUID, frameRate,
+                        (2 + blocks) * TAR_BLOCK_SIZE);
+    if (length < 0 || tarBlocks(length) == blocks) {
+      break;
+    }
+    blocks = tarBlocks(length);
+  }
+
+  index = length < 0 ? NULL : (BYTE *)malloc(length);
+  rewind(temp);
+  if (index != NULL && fread(index, 1, length, temp) != (size_t)length) {
+    free(index);
+    index = NULL;
+  }
+  fclose(temp);
+  if (index == NULL) {
+    perror("fread()");
+    return NULL;
+  }
+  *size = length;
+
+  return index;
+}
+
+int writeOFSBundle(struct OFMDdata OFMDdata, const char *path,
+                   BYTE dropFrame) {
+  struct planeAnalytics analytics;
+  BYTE header[OFS_HEADER_SIZE];
+  BYTE end[TAR_BLOCK_SIZE * 2];
+  BYTE GUID[16];
+  BYTE frameRate = (OFMDdata.frameRate * 16) + dropFrame;
+  time_t mtime = time(NULL);
+  BYTE *index;
+  size_t indexSize;
+  FILE *out;
+  int result = 0;
+
+  makeOFSGUID(GUID);
+  analyzePlanes(OFMDdata.planes, OFMDdata.numOfPlanes, OFMDdata.totalFrames,
+                &analytics);
+  index = makeIndex(&OFMDdata, &analytics, GUID, frameRate, &indexSize);
+  if (index == NULL) {
+    return -1;
+  }
+
+  if (strcmp(path, "-") == 0) {
+    out = fdopen(stdoutBundle, "wb");
+  } else {
+    out = fopen(path, "wb");
+  }
+  if (out == NULL) {
+    perror("fopen()");
+    printf("Failed to open: %s\n", path);
+    free(index);
+    return -1;
+  }
+
+  // The header of the index has the size of the whole index in it.
+  result = writeTarFile(out, BUNDLE_INDEX_NAME, mtime, NULL, 0, index,
+                        indexSize);
+  for (int plane = 0; plane < OFMDdata.numOfPlanes && result == 0; plane++) {
+    char name[32];
+
+    if (OFMDdata.validPlanes[plane] != 1) {
+      continue;
+    }
+    snprintf(name, sizeof(name), "3D-Plane-%02d.ofs", plane);
+    GUID[15] = (BYTE)plane; // Copy the plane number to the end of the GUID.
+    makeOFSHeader(header, GUID, frameRate, OFMDdata.totalFrames);
+    result = writeTarFile(out, name, mtime, header, OFS_HEADER_SIZE,
+                          OFMDdata.planes[plane], OFMDdata.totalFrames);
+  }
+
+  // A tar ends with two empty blocks.
+  memset(end, 0, sizeof(end));
+  if (result == 0 && fwrite(end, 1, sizeof(end), out) != sizeof(end)) {
+    result = -1;
+  }
+  if (result == -1) {
+    perror("fwrite()");
+    printf("Failed to write: %s\n", path);
+  }
+  if (fclose(out) != 0 && result == 0) {
+    perror("fclose()");
+    result = -1;
+  }
+  free(index);
+
+  return result;
+}
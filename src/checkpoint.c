@@ -0,0 +1,279 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "checkpoint.h"
+#include "ofsidx.h"
+#include "util.h"
+
+/*
+ * The checkpoint is little-endian:
+ *
+ *   magic[8], numFiles u32
+ *   numFiles * (size i64, mtime i64, hash u64)
+ *   FNV-1a u64 of the header
+ *   records: file u32, offset i64, resumeOffset i64, length u32, OFMD[length],
+ *            FNV-1a u64 of the record
+ *
+ * The header only depends on the input files, so an old checkpoint matches
+ * if its header is the same as a new one.
+ */
+#define MAGIC_SIZE (8)
+#define KEY_SIZE (24)
+#define RECORD_HEADER_SIZE (24)
+#define MAX_CHECKPOINT_SIZE (1024 * 1024 * 512)
+
+void initCheckpoint(struct checkpoint *checkpoint, const char *outFolder,
+                    int seconds, bool resume) {
+  size_t size = strlen(outFolder) + strlen(CHECKPOINT_NAME) + 2;
+
+  memset(checkpoint, 0, sizeof(struct checkpoint));
+  checkpoint->path = (char *)malloc(size);
+  if (checkpoint->path == NULL) {
+    perror("malloc()"); // 'startCheckpoint' fails, so nothing is saved.
+  } else {
+    snprintf(checkpoint->path, size, "%s" PATH_SEPARATOR "%s", outFolder,
+             CHECKPOINT_NAME);
+  }
+  checkpoint->seconds = seconds;
+  checkpoint->resume = resume;
+  checkpoint->file = -1;
+}
+
+// Returns the header for 'filenames' or NULL if one can't be checkpointed.
+static BYTE *makeHeader(const char **filenames, int numFiles, size_t *size) {
+  struct indexKey key;
+  BYTE *header;
+  BYTE *pos;
+
+  *size = MAGIC_SIZE + 4 + (size_t)numFiles * KEY_SIZE + 8;
+  header = (BYTE *)malloc(*size);
+  if (header == NULL) {
+    perror("malloc()");
+    return NULL;
+  }
+  memcpy(header, CHECKPOINT_MAGIC, MAGIC_SIZE);
+  writeLE(header + MAGIC_SIZE, numFiles, 4);
+
+  pos = header + MAGIC_SIZE + 4;
+  for (int file = 0; file < numFiles; file++, pos += KEY_SIZE) {
+    if (makeIndexKey(filenames[file], &key) == -1) {
+      printf("'%s' can't be checkpointed.\n", filenames[file]);
+      free(header);
+      return NULL;
+    }
+    writeLE(pos, key.size, 8);
+    writeLE(pos + 8, key.mtime, 8);
+    writeLE(pos + 16, key.hash, 8);
+  }
+  writeLE(pos, hashBytes(HASH_SEED, header, *size - 8), 8);
+
+  return header;
+}
+
+static BYTE *readWholeCheckpoint(const char *path, size_t *size) {
+  FILE *filePtr = fopen(path, "rb");
+  BYTE *data;
+  int64_t length;
+
+  if (filePtr == NULL) {
+    return NULL;
+  }
+  if (fseeko(filePtr, 0, SEEK_END) != 0 || (length = ftello(filePtr)) < 0 ||
+      length > MAX_CHECKPOINT_SIZE || fseeko(filePtr, 0, SEEK_SET) != 0) {
+    fclose(filePtr);
+    return NULL;
+  }
+
+  data = (BYTE *)malloc(length > 0 ? length : 1);
+  if (data == NULL || fread(data, 1, length, filePtr) != (size_t)length) {
+    free(data);
+    fclose(filePtr);
+    return NULL;
+  }
+  fclose(filePtr);
+
+  *size = length;
+  return data;
+}
+
+/*
+ * Hands the whole records after the header to 'replay'.
+ * Returns the length of the part of 'data' that's worth keeping.
+ */
+static size_t replayRecords(struct checkpoint *checkpoint, const BYTE *data,
+                            size_t size, size_t headerSize, int numFiles,
+                            checkpointReplay replay, void *context) {
+  size_t pos = headerSize;
+
+  while (size - pos >= RECORD_HEADER_SIZE + 8) {
+    const BYTE *record = data + pos;
+    int file = readLE(record, 4);
+    int64_t offset = readLE(record + 4, 8);
+    int64_t resumeOffset = readLE(record + 12, 8);
+    size_t length = readLE(record + 20, 4);
+    size_t recordSize = RECORD_HEADER_SIZE + length;
+
+    if (length > size - pos - RECORD_HEADER_SIZE - 8 || file < 0 ||
+        file >= numFiles || file < checkpoint->file ||
+        readLE(record + recordSize, 8) !=
+            hashBytes(HASH_SEED, record, recordSize)) {
+      break; // Cut off when the last scan was killed.
+    }
+
+    if (replay(context, file, record + RECORD_HEADER_SIZE, length, offset) !=
+        0) {
+      break;
+    }
+    checkpoint->file = file;
+    checkpoint->resumeOffset = resumeOffset;
+    checkpoint->lastOffset = offset;
+    checkpoint->numOFMDs++;
+    pos += recordSize + 8;
+  }
+
+  return pos;
+}
+
+// Replaces the checkpoint with 'data', and opens it for appending.
+static int rewriteCheckpoint(struct checkpoint *checkpoint, const BYTE *data,
+                             size_t size) {
+  if (replaceFile(checkpoint->path, data, size) == -1) {
+    return -1;
+  }
+
+  checkpoint->filePtr = fopen(checkpoint->path, "ab");
+  if (checkpoint->filePtr == NULL) {
+    perror("fopen()");
+    return -1;
+  }
+
+  return 0;
+}
+
+int startCheckpoint(struct checkpoint *checkpoint, const char **filenames,
+                    int numFiles, checkpointReplay replay, void *context) {
+  size_t headerSize;
+  BYTE *header;
+  BYTE *data = NULL;
+  size_t size = 0;
+  int result;
+
+  if (checkpoint->path == NULL) {
+    return -1;
+  }
+  header = makeHeader(filenames, numFiles, &headerSize);
+  if (header == NULL) {
+    return -1;
+  }
+
+  if (checkpoint->resume) {
+    data = readWholeCheckpoint(checkpoint->path, &size);
+    if (data == NULL) {
+      printf("There's no checkpoint in '%s'. Starting from the beginning.\n\n",
+             checkpoint->path);
+    } else if (size < headerSize || memcmp(data, header, headerSize) != 0) {
+      printf("'%s' doesn't match the input. Starting from the beginning.\n\n",
+             checkpoint->path);
+      free(data);
+      data = NULL;
+    } else {
+      size = replayRecords(checkpoint, data, size, headerSize, numFiles,
+                           replay, context);
+      printf("Resuming after %d OFMDs from '%s'.\n\n", checkpoint->numOFMDs,
+             checkpoint->path);
+    }
+  }
+
+  // The part that was cut off is dropped here too.
+  if (data != NULL) {
+    result = rewriteCheckpoint(checkpoint, data, size);
+  } else {
+    result = rewriteCheckpoint(checkpoint, header, headerSize);
+  }
+  free(data);
+  free(header);
+
+  checkpoint->lastFlush = time(NULL);
+  return result;
+}
+
+int addCheckpointOFMD(struct checkpoint *checkpoint, int file,
+                      const BYTE *OFMD, size_t length, int64_t offset,
+                      int64_t resumeOffset) {
+  BYTE header[RECORD_HEADER_SIZE];
+  BYTE hash[8];
+
+  if (checkpoint->filePtr == NULL) {
+    return -1;
+  }
+
+  writeLE(header, file, 4);
+  writeLE(header + 4, offset, 8);
+  writeLE(header + 12, resumeOffset, 8);
+  writeLE(header + 20, length, 4);
+  writeLE(hash,
+          hashBytes(hashBytes(HASH_SEED, header, RECORD_HEADER_SIZE), OFMD,
+                    length),
+          8);
+  if (fwrite(header, 1, RECORD_HEADER_SIZE, checkpoint->filePtr) !=
+          RECORD_HEADER_SIZE ||
+      fwrite(OFMD, 1, length, checkpoint->filePtr) != length ||
+      fwrite(hash, 1, 8, checkpoint->filePtr) != 8) {
+    perror("fwrite()");
+    printf("Failed to write '%s'. No more checkpoints will be saved.\n",
+           checkpoint->path);
+    fclose(checkpoint->filePtr);
+    checkpoint->filePtr = NULL;
+    return -1;
+  }
+
+  checkpoint->pending++;
+  if (checkpoint->pending >= CHECKPOINT_OFMDS ||
+      time(NULL) - checkpoint->lastFlush >= checkpoint->seconds) {
+    fflush(checkpoint->filePtr);
+    checkpoint->pending = 0;
+    checkpoint->lastFlush = time(NULL);
+  }
+
+  return 0;
+}
+
+void finishCheckpoint(struct checkpoint *checkpoint, bool keep) {
+  if (checkpoint->filePtr != NULL) {
+    fclose(checkpoint->filePtr);
+    checkpoint->filePtr = NULL;
+  }
+  if (!keep && checkpoint->path != NULL) {
+    remove(checkpoint->path);
+  }
+  free(checkpoint->path);
+  checkpoint->path = NULL;
+}
@@ -0,0 +1,638 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE // tee() and splice()
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "input.h"
+#include "uring.h"
+#include "util.h"
+
+// The buffer of the last input closed on this thread. Only kept after
+// 'keepInputBuffers(true)', so threads that don't ask for it can't leak one.
+static _Thread_local bool keepBuffer;
+static _Thread_local BYTE *spareBuffer;
+static _Thread_local size_t spareSize;
+
+// Where stdin is copied to. -1 unless 'teeStdin' was called.
+static int stdinTee = -1;
+
+static size_t roundUp(size_t value, size_t multiple) {
+  return ((value + multiple - 1) / multiple) * multiple;
+}
+
+// Takes the spare buffer if it's the right size or allocates a new one.
+static BYTE *takeBuffer(size_t size) {
+  BYTE *buffer = spareBuffer;
+
+  if (buffer != NULL && spareSize == size) {
+    spareBuffer = NULL;
+    return buffer;
+  }
+
+  return (BYTE *)alignedAlloc(INPUT_ALIGNMENT, size);
+}
+
+static void giveBackBuffer(BYTE *buffer, size_t size) {
+  if (buffer == NULL) {
+    return;
+  }
+
+  if (keepBuffer) {
+    alignedFree(spareBuffer);
+    spareBuffer = buffer;
+    spareSize = size;
+  } else {
+    alignedFree(buffer);
+  }
+}
+
+#ifndef _WIN32
+// Maps the whole file. Returns -1 so the caller can fall back to pread.
+static int openMappedInput(struct inputSource *input, const char *filename) {
+  input->fd = open(filename, O_RDONLY);
+  if (input->fd == -1) {
+    perror("open()");
+    printf("Failed to open '%s'\n", filename);
+    return -1;
+  }
+
+  input->backend = INPUT_MMAP;
+  input->eof = true; // Everything is 'read' once it's mapped.
+
+  // mmap() refuses zero length mappings.
+  if (input->fileSize == 0) {
+    return 0;
+  }
+
+  // A 32bit build can't map a 40GB remux.
+  if ((uint64_t)input->fileSize > (uint64_t)SIZE_MAX) {
+    close(input->fd);
+    input->fd = -1;
+    return -1;
+  }
+
+  input->map = (BYTE *)mmap(NULL, input->fileSize, PROT_READ, MAP_PRIVATE,
+                            input->fd, 0);
+  if (input->map == MAP_FAILED) {
+    perror("mmap()");
+    input->map = NULL;
+    close(input->fd);
+    input->fd = -1;
+    return -1;
+  }
+
+#ifdef MADV_SEQUENTIAL
+  madvise(input->map, input->fileSize, MADV_SEQUENTIAL);
+#endif
+
+  input->data = input->map;
+  input->length = input->fileSize;
+  return 0;
+}
+#endif
+
+#ifndef _WIN32
+// Returns -1 so the caller can fall back to pread.
+static int openUringInput(struct inputSource *input, const char *filename) {
+  input->fd = open(filename, O_RDONLY);
+  if (input->fd == -1) {
+    perror("open()");
+    printf("Failed to open '%s'\n", filename);
+    return -1;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(input->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  input->uring = openUringReader(input->fd, input->fileSize, input->headroom,
+                                 input->blockSize, URING_QUEUE_DEPTH);
+  if (input->uring == NULL) {
+    close(input->fd);
+    input->fd = -1;
+    return -1;
+  }
+
+  return 0;
+}
+#endif
+
+static int openBufferedInput(struct inputSource *input, const char *filename) {
+#ifndef _WIN32
+  if (input->backend == INPUT_PREAD) {
+    input->fd = open(filename, O_RDONLY);
+    if (input->fd == -1) {
+      perror("open()");
+      printf("Failed to open '%s'\n", filename);
+      return -1;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(input->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  }
+#endif
+
+  if (input->backend == INPUT_STDIO && input->tee) {
+    // Read straight from the descriptor, so nothing is buffered that the
+    // tee hasn't seen.
+    input->fd = STDIN_FILENO;
+#ifdef _WIN32
+    _setmode(STDIN_FILENO, _O_BINARY);
+#elif defined(__linux__)
+    struct stat info;
+
+    if (fstat(STDIN_FILENO, &info) == 0 && S_ISFIFO(info.st_mode) &&
+        fstat(stdinTee, &info) == 0 && S_ISFIFO(info.st_mode)) {
+      input->teePipes = true;
+#ifdef F_SETPIPE_SZ
+      // Bigger pipes mean fewer trips through tee(). It's fine if it fails.
+      fcntl(STDIN_FILENO, F_SETPIPE_SZ, TEE_PIPE_SIZE);
+      fcntl(stdinTee, F_SETPIPE_SZ, TEE_PIPE_SIZE);
+#endif
+    }
+#endif
+  } else if (input->backend == INPUT_STDIO) {
+    if (input->useStdin) {
+      // Set stdin to binary mode.
+#ifdef _WIN32
+      // Windows doesn't except 'NULL' as parameter for freopen.
+      int result = _setmode(_fileno(stdin), _O_BINARY);
+
+      if (result == -1) {
+        perror("_setmode()");
+        return -1;
+      }
+      input->filePtr = stdin;
+#else
+      input->filePtr = freopen(NULL, "rb", stdin);
+
+      if (input->filePtr == NULL) {
+        perror("freopen()");
+        return -1;
+      }
+#endif
+    } else {
+      input->filePtr = fopen(filename, "rb");
+      if (input->filePtr == NULL) {
+        perror("fopen()");
+        printf("Failed to open '%s'\n", filename);
+        return -1;
+      }
+    }
+  }
+
+  input->buffer = takeBuffer(input->headroom + input->blockSize);
+  if (input->buffer == NULL) {
+    perror("alignedAlloc()");
+    return -1;
+  }
+  input->data = input->buffer + input->headroom;
+
+  return 0;
+}
+
+/*
+ * Opens 'filename' (or stdin if it's '-') for scanning.
+ *
+ * 'backend': Which reader to use. Anything that can't be mapped or pread
+ *            (stdin, pipes, Windows) quietly falls back to stdio.
+ * 'blockSize': Size of each read for the pread, stdio, and uring backends.
+ * 'lookahead': The most bytes the caller will ever ask 'fillInput' for.
+ */
+int openInput(struct inputSource *input, const char *filename,
+              enum inputBackend backend, size_t blockSize, size_t lookahead) {
+  struct stat info;
+
+  memset(input, 0, sizeof(struct inputSource));
+  input->fd = -1;
+  input->fileSize = -1;
+
+  if ((strlen(filename) == 1) && (strncmp(filename, "-", 1) == 0)) {
+    input->useStdin = true;
+    input->tee = stdinTee != -1;
+    backend = INPUT_STDIO;
+  } else if (stat(filename, &info) == 0) {
+    if (S_ISREG(info.st_mode)) {
+      input->fileSize = info.st_size;
+    } else {
+      backend = INPUT_STDIO; // Pipes and character devices.
+    }
+  } else {
+    perror("stat()");
+    printf("Failed to open '%s'\n", filename);
+    return -1;
+  }
+
+#ifdef _WIN32
+  backend = INPUT_STDIO;
+#else
+  if (backend == INPUT_AUTO) {
+    backend = INPUT_MMAP;
+  }
+
+  if (backend == INPUT_MMAP) {
+    if (openMappedInput(input, filename) == 0) {
+      return 0;
+    }
+    backend = INPUT_PREAD;
+  }
+
+  if (backend == INPUT_URING && input->fileSize == -1) {
+    backend = INPUT_STDIO;
+  }
+#endif
+
+  if (blockSize == 0) {
+    blockSize = INPUT_BLOCK_SIZE;
+  }
+
+  input->backend = backend;
+  input->headroom = roundUp(lookahead, INPUT_ALIGNMENT);
+  input->blockSize = roundUp(blockSize, INPUT_ALIGNMENT);
+  if (input->blockSize < input->headroom) {
+    input->blockSize = input->headroom;
+  }
+
+#ifndef _WIN32
+  if (backend == INPUT_URING) {
+    if (openUringInput(input, filename) == 0) {
+      return 0;
+    }
+    input->backend = INPUT_PREAD;
+  }
+#endif
+
+  if (openBufferedInput(input, filename) == -1) {
+    closeInput(input);
+    return -1;
+  }
+
+  return 0;
+}
+
+// Writes all of 'data' to 'fd'. Returns -1 if it can't.
+static int writeAll(int fd, const BYTE *data, size_t size) {
+  while (size > 0) {
+    ssize_t result = write(fd, data, size);
+
+    if (result == -1 && errno == EINTR) {
+      continue;
+    } else if (result <= 0) {
+      perror("write()");
+      return -1;
+    }
+    data += result;
+    size -= result;
+  }
+
+  return 0;
+}
+
+/*
+ * Reads up to 'size' bytes of stdin into 'dest' and copies them to the tee.
+ * Between two pipes the copy is made with tee() before the same bytes are
+ * read, so they're never copied through the buffer.
+ * Returns the number of bytes, 0 at the end, or -1.
+ */
+static ssize_t readTee(struct inputSource *input, BYTE *dest, size_t size) {
+  ssize_t result;
+
+#ifdef __linux__
+  while (input->teePipes) {
+    result = tee(STDIN_FILENO, stdinTee, size, 0);
+    if (result == -1 && errno == EINTR) {
+      continue;
+    } else if (result == -1) {
+      input->teePipes = false; // Use read() and write() instead.
+      break;
+    } else if (result == 0) {
+      return 0;
+    }
+
+    // tee() didn't take them out of stdin, so they're already there.
+    size = result;
+    for (size_t done = 0; done < size; done += result) {
+      result = read(STDIN_FILENO, dest + done, size - done);
+      if (result == -1 && errno == EINTR) {
+        result = 0;
+      } else if (result <= 0) {
+        perror("read()");
+        return -1;
+      }
+    }
+    return size;
+  }
+#endif
+
+  do {
+    result = read(STDIN_FILENO, dest, size);
+  } while (result == -1 && errno == EINTR);
+  if (result == -1) {
+    perror("read()");
+  } else if (result > 0 && writeAll(stdinTee, dest, result) == -1) {
+    return -1;
+  }
+
+  return result;
+}
+
+// Copies what wasn't read of stdin to the tee, since it has to get all of it.
+static void drainTee(struct inputSource *input) {
+  size_t size = input->headroom + input->blockSize;
+  ssize_t result;
+
+  if (input->eof) {
+    return;
+  }
+
+#ifdef __linux__
+  // splice() moves it across without a copy if either end is a pipe.
+  do {
+    result = splice(STDIN_FILENO, NULL, stdinTee, NULL, size, SPLICE_F_MOVE);
+  } while (result > 0 || (result == -1 && errno == EINTR));
+  if (result == 0) {
+    return;
+  }
+#endif
+
+  do {
+    result = readTee(input, input->buffer, size);
+  } while (result > 0);
+  input->eof = true;
+}
+
+// Reads up to 'size' bytes at 'readOffset'. Short reads only happen at EOF.
+static size_t readBlock(struct inputSource *input, BYTE *dest, size_t size) {
+  size_t total = 0;
+
+  while (total < size) {
+    if (input->tee) {
+      ssize_t result = readTee(input, dest + total, size - total);
+      if (result <= 0) {
+        break;
+      }
+      total += result;
+      continue;
+    }
+#ifndef _WIN32
+    if (input->backend == INPUT_PREAD) {
+      ssize_t result = pread(input->fd, dest + total, size - total,
+                             input->readOffset + total);
+      if (result == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        perror("pread()");
+        break;
+      }
+      if (result == 0) {
+        break;
+      }
+      total += result;
+      continue;
+    }
+#endif
+    size_t result = fread(dest + total, 1, size - total, input->filePtr);
+    if (result == 0) {
+      if (ferror(input->filePtr)) {
+        perror("fread()");
+      }
+      break;
+    }
+    total += result;
+  }
+
+  input->readOffset += total;
+  if (total < size) {
+    input->eof = true;
+  }
+
+  return total;
+}
+
+/*
+ * Makes sure at least 'wanted' bytes are available at 'input->data', unless
+ * the end of the file has been reached. 'wanted' is capped by the 'lookahead'
+ * given to 'openInput'. Returns the number of bytes available.
+ */
+size_t fillInput(struct inputSource *input, size_t wanted) {
+  size_t result;
+
+  if (input->eof || input->length >= wanted) {
+    return input->length;
+  }
+
+  if (input->backend == INPUT_URING) {
+    BYTE *block =
+        nextUringBlock(input->uring, input->data, input->length, &result);
+    if (block == NULL) {
+      input->eof = true;
+      return input->length;
+    }
+    input->data = block - input->length;
+    input->readOffset += result;
+    if (result < input->blockSize) {
+      input->eof = true;
+    }
+  } else {
+    // Carry the unconsumed tail in front of the next block.
+    if (input->length > 0) {
+      memmove(input->buffer + input->headroom - input->length, input->data,
+              input->length);
+    }
+    input->data = input->buffer + input->headroom - input->length;
+
+    result =
+        readBlock(input, input->buffer + input->headroom, input->blockSize);
+  }
+
+  // Drop what's in front of 'position' after an aligned seek.
+  if (input->skipHead > 0) {
+    size_t drop = input->skipHead < result ? input->skipHead : result;
+    input->data += drop;
+    result -= drop;
+    input->skipHead = 0;
+  }
+
+  input->length += result;
+  return input->length;
+}
+
+// Moves 'input->data' forward by 'count' bytes. Can jump past the buffer.
+void skipInput(struct inputSource *input, int64_t count) {
+  if (count <= 0) {
+    return;
+  }
+
+  if ((uint64_t)count <= input->length) {
+    input->data += count;
+    input->length -= count;
+    input->position += count;
+    return;
+  }
+
+  if (input->backend == INPUT_MMAP) {
+    input->data += input->length;
+    input->position += input->length;
+    input->length = 0;
+    return;
+  }
+
+  count -= input->length;
+  input->position += input->length;
+  input->length = 0;
+
+  if (input->fileSize != -1 && input->position + count > input->fileSize) {
+    count = input->fileSize - input->position;
+  }
+  input->position += count;
+
+  if (input->backend == INPUT_PREAD) {
+    // Keep reads aligned and throw away the head of the next block.
+    input->readOffset = input->position & ~((int64_t)INPUT_ALIGNMENT - 1);
+    input->skipHead = input->position - input->readOffset;
+    return;
+  }
+
+  if (input->backend == INPUT_URING) {
+    // Blocks which are already in flight are kept if 'position' is in one.
+    input->readOffset = seekUringReader(
+        input->uring, input->position & ~((int64_t)INPUT_ALIGNMENT - 1));
+    input->skipHead = input->position - input->readOffset;
+    return;
+  }
+
+  input->data = input->buffer + input->headroom;
+
+  if (!input->useStdin &&
+      fseeko(input->filePtr, input->position, SEEK_SET) == 0) {
+    input->readOffset = input->position;
+    return;
+  }
+
+  // Can't seek a pipe, so read and discard.
+  while (count > 0 && !input->eof) {
+    size_t size = input->blockSize;
+    if ((uint64_t)count < size) {
+      size = count;
+    }
+    count -= readBlock(input, input->data, size);
+  }
+}
+
+void closeInput(struct inputSource *input) {
+  closeUringReader(input->uring);
+  input->uring = NULL;
+
+  if (input->tee && input->buffer != NULL) {
+    drainTee(input);
+  }
+  if (input->tee) {
+    input->fd = -1; // stdin stays open.
+  }
+
+#ifndef _WIN32
+  if (input->map != NULL) {
+    munmap(input->map, input->fileSize);
+    input->map = NULL;
+  }
+
+  if (input->fd != -1) {
+    close(input->fd);
+    input->fd = -1;
+  }
+#endif
+
+  if (input->filePtr != NULL && !input->useStdin) {
+    fclose(input->filePtr);
+  }
+  input->filePtr = NULL;
+
+  giveBackBuffer(input->buffer, input->headroom + input->blockSize);
+  input->buffer = NULL;
+}
+
+/*
+ * With 'keep' set, the buffer of an input closed on this thread is kept for
+ * the next one opened on it, as long as that uses the same block size.
+ * Batch workers open one file after another and don't have to allocate a
+ * new buffer for each. 'false' frees the kept buffer.
+ */
+void keepInputBuffers(bool keep) {
+  keepBuffer = keep;
+  if (!keep) {
+    alignedFree(spareBuffer);
+    spareBuffer = NULL;
+  }
+}
+
+int teeStdin() {
+  stdinTee = takeStdout();
+
+  return stdinTee == -1 ? -1 : 0;
+}
+
+const char *inputBackendName(enum inputBackend backend) {
+  switch (backend) {
+  case INPUT_MMAP:
+    return "mmap";
+  case INPUT_PREAD:
+    return "pread";
+  case INPUT_STDIO:
+    return "stdio";
+  case INPUT_URING:
+    return "uring";
+  default:
+    return "auto";
+  }
+}
+
+// Returns -1 if 'name' isn't 'auto', 'mmap', 'pread', 'stdio', or 'uring'.
+int parseInputBackend(const char *name, enum inputBackend *backend) {
+  enum inputBackend backends[5] = {INPUT_AUTO, INPUT_MMAP, INPUT_PREAD,
+                                   INPUT_STDIO, INPUT_URING};
+
+  for (int x = 0; x < 5; x++) {
+    if (strcmp(name, inputBackendName(backends[x])) == 0) {
+      *backend = backends[x];
+      return 0;
+    }
+  }
+
+  return -1;
+}
@@ -23,14 +23,33 @@
  */
 #define _FILE_OFFSET_BITS 64
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 #include "3dplanes.h"
+#include "batch.h"
+#include "bundle.h"
+#include "bdmv.h"
+#include "checkpoint.h"
 #include "commitdate.h" // Generated via meson
+#include "input.h"
+#include "ofmd.h"
+#include "ofs.h"
+#include "ofsidx.h"
+#include "parallel.h"
+#include "serve.h"
+#include "uring.h"
 #include "util.h"
 #include "version.h" // from 'git describe --tags --dirty=+'
 
@@ -44,96 +63,886 @@
 #define ARCH "32bit "
 #endif
 
-void parseOptions(int argc, char *argv[], BYTE *newFrameRate, BYTE *dropFrame,
-                  char **outFolder);
+struct options {
+  BYTE newFrameRate;
+  BYTE dropFrame;
+  char *outFolder;
+  enum inputBackend backend;
+  size_t blockSize;
+  int threads;
+  int playlist; // -1 unless the input is a BDMV folder.
+  bool stream;
+  bool probe;
+  bool index; // Keep an '.ofsidx' in the output folder.
+  int checkpointSeconds; // 0 unless checkpoints are saved.
+  bool resume;
+  bool batch; // The input is a manifest or a folder of titles.
+  int jobs;   // Titles extracted at the same time in batch mode.
+  int ioLimit;
+  bool quiet; // Only print a line for each title.
+  char *serve;  // The socket '-serve' listens on.
+  char *client; // The socket of the server '-client' sends the job to.
+  bool tee;     // Pass stdin through to stdout.
+  char *tar;    // The bundle '-tar' writes instead of the OFS files.
+  bool rle;     // Write the runs of the planes to RLE_NAME as well.
+  int probeOFMDs; // '-probe' stops after this many OFMDs,
+  int probeSize;  // or this many MB.
+};
+
+void parseOptions(int argc, char *argv[], struct options *options);
 void printLicense();
 void usage(char *argv[]);
 void printIntro();
+bool hasOption(int argc, char *argv[], const char *option);
+const char *findOptionValue(int argc, char *argv[], const char *option);
+int probeTitle(const struct options *options, const char *input, FILE *out,
+               const char *before, bool oneLine);
+void writeProbe(FILE *out, const char *input, int numInputs,
+                const struct probeResult *probe, bool oneLine);
+int extractTitle(const struct options *options, struct batchJob *job);
+int runBatchMode(struct options *options, const char *input);
+int runServeMode(struct options *options);
+int runClientMode(const struct options *options, const char *input);
+int checkOptions(const struct options *options, const char *input,
+                 char *error, size_t errorSize);
+bool isFrameRate(int frameRate);
+int getPlanesWithIndex(const struct options *options, const char *outFolder,
+                       const char **inputs, int numInputs,
+                       struct checkpoint *checkpoint,
+                       struct OFMDdata *OFMDdata);
+int writeRLESidecar(const struct options *options, const char *outFolder,
+                    const struct OFMDdata *OFMDdata, struct rlePlanes *rle);
 char *printFpsValue(int frameRate);
 int sumOfIntArray(int *array, size_t sizeOfArray);
 
-static char *outFolder;
+// The jobs Ctrl-C has to clean up after.
+static struct batchJob *runningJobs[MAXTHREADS];
+static pthread_mutex_t runningLock = PTHREAD_MUTEX_INITIALIZER;
 
+// 'intHandler' writes the signal here, and 'interruptThread' cleans up.
+static int interruptPipe[2] = {-1, -1};
+static pthread_once_t interruptOnce = PTHREAD_ONCE_INIT;
+
+// Only async-signal-safe calls can be made in here.
 void intHandler(int SIG_TYPE) {
+  BYTE signalType = (BYTE)SIG_TYPE;
+  int savedErrno = errno;
+
+  if (write(interruptPipe[1], &signalType, 1) == -1) {
+    _exit(1);
+  }
+  errno = savedErrno;
+}
+
+static void *interruptThread(void *arg) {
+  BYTE signalType;
+  (void)arg;
+
+  while (read(interruptPipe[0], &signalType, 1) != 1) {
+    if (errno != EINTR) {
+      return NULL;
+    }
+  }
+
   printf("\nOUCH!, CTRL-C was hit.\n");
-  printf("Deleting directory '%s' if it exists.\n", outFolder);
-  if (dirExists(outFolder)) {
-    delDirectory(outFolder);
+  stopServer();
+
+  // The lock is never given back, so no job can come or go after this.
+  pthread_mutex_lock(&runningLock);
+  for (int x = 0; x < MAXTHREADS; x++) {
+    struct batchJob *job = runningJobs[x];
+
+    if (job == NULL) {
+      continue;
+    } else if (job->keepOutFolder) {
+      printf("Keeping directory '%s'. Use '-resume' to carry on.\n",
+             job->outFolder);
+    } else {
+      printf("Deleting directory '%s' if it exists.\n", job->outFolder);
+      if (dirExists(job->outFolder)) {
+        delDirectory(job->outFolder);
+      }
+    }
   }
 
   printf("Exiting.\n");
-  signal(SIG_TYPE, SIG_DFL);
   exit(0);
 }
 
+static void startInterruptThread() {
+  pthread_t thread;
+
+#ifdef _WIN32
+  if (_pipe(interruptPipe, 16, _O_BINARY) == -1) {
+#else
+  if (pipe(interruptPipe) == -1) {
+#endif
+    perror("pipe()");
+    return;
+  }
+  if (pthread_create(&thread, NULL, interruptThread, NULL) != 0) {
+    printf("Failed to start the Ctrl-C thread.\n");
+    close(interruptPipe[0]);
+    close(interruptPipe[1]);
+    interruptPipe[1] = -1;
+    return;
+  }
+  pthread_detach(thread);
+}
+
+// 'signal' for 'intHandler'. The thread that cleans up is started once.
+static void catchInterrupt(int SIG_TYPE) {
+  pthread_once(&interruptOnce, startInterruptThread);
+  if (interruptPipe[1] != -1) {
+    signal(SIG_TYPE, intHandler);
+  }
+}
+
+// Returns the slot 'job' has in 'runningJobs' or -1 if they're all taken.
+static int addRunningJob(struct batchJob *job) {
+  int slot = 0;
+
+  pthread_mutex_lock(&runningLock);
+  while (slot < MAXTHREADS && runningJobs[slot] != NULL) {
+    slot++;
+  }
+  if (slot < MAXTHREADS) {
+    runningJobs[slot] = job;
+  } else {
+    slot = -1;
+  }
+  pthread_mutex_unlock(&runningLock);
+
+  return slot;
+}
+
+static void removeRunningJob(int slot) {
+  if (slot == -1) {
+    return;
+  }
+  pthread_mutex_lock(&runningLock);
+  runningJobs[slot] = NULL;
+  pthread_mutex_unlock(&runningLock);
+}
+
 int main(int argc, char *argv[]) {
-  BYTE **OFMDs;
-  BYTE newFrameRate = 0;
-  BYTE dropFrame = 0;
+  struct options options = {0, 0, ".", INPUT_AUTO, INPUT_BLOCK_SIZE, 1, -1,
+                            false, false, false, 0, false, false, 0,
+                            BATCH_IO_LIMIT, false, NULL, NULL, false, NULL,
+                            false, PROBE_OFMDS, PROBE_SIZE};
+  const char *tarPath = findOptionValue(argc, argv, "-tar");
+  struct batchJob job;
+
+  // With '-tee' stdout has the stream, so everything else goes to stderr.
+  if (hasOption(argc, argv, "-tee") && teeStdin() == -1) {
+    return 1;
+  }
+
+  // So does '-tar -' with the bundle.
+  if (tarPath != NULL && strcmp(tarPath, "-") == 0 &&
+      bundleToStdout() == -1) {
+    return 1;
+  }
+
+  // '-probe' and '-client' only print JSON.
+  if (!hasOption(argc, argv, "-probe") && !hasOption(argc, argv, "-client")) {
+    printIntro();
+  }
+  parseOptions(argc, argv, &options);
+
+  if (options.serve != NULL) {
+    return runServeMode(&options);
+  } else if (options.client != NULL) {
+    return runClientMode(&options, argv[1]);
+  }
+
+  if (options.batch) {
+    return runBatchMode(&options, argv[1]);
+  }
+
+  if (options.probe) {
+    return probeTitle(&options, argv[1], stdout, "", false);
+  }
+
+  memset(&job, 0, sizeof(struct batchJob));
+  job.input = argv[1];
+  job.outFolder = options.outFolder;
+  job.playlist = options.playlist;
+
+  return extractTitle(&options, &job);
+}
+
+// Deletes the output folder of a job that failed, unless it can be resumed.
+static void removeOutFolder(const struct options *options,
+                            const struct batchJob *job) {
+  if (job->keepOutFolder && job->numOFMDs == -1) {
+    if (!options->quiet) {
+      printf("Keeping directory '%s'. Use '-resume' to carry on.\n",
+             job->outFolder);
+    }
+    return;
+  }
+
+  if (!options->quiet) {
+    printf("Deleting directory '%s' if it exists.\n", job->outFolder);
+  }
+  if (dirExists(job->outFolder)) {
+    delDirectory(job->outFolder);
+  }
+}
+
+// Deletes the OFS files and sidecar a title wrote before it failed.
+static void removeOutFiles(const struct batchJob *job,
+                           const int *validPlanes) {
+  size_t size = strlen(job->outFolder) + strlen(RLE_NAME) + 2;
+  char *path;
+
+  for (int plane = 0; plane < MAXPLANES; plane++) {
+    if (validPlanes[plane] == 1 &&
+        (path = makeOFSPath(job->outFolder, plane)) != NULL) {
+      remove(path);
+      free(path);
+    }
+  }
+
+  path = (char *)malloc(size);
+  if (path != NULL) {
+    snprintf(path, size, "%s" PATH_SEPARATOR "%s", job->outFolder, RLE_NAME);
+    remove(path);
+    free(path);
+  }
+}
+
+/*
+ * Extracts the 3D-Planes of one title into 'job->outFolder' and fills in
+ * the rest of 'job'. Returns the exit code.
+ */
+int extractTitle(const struct options *options, struct batchJob *job) {
   struct OFMDdata OFMDdata;
   int planesInFile;
   int numOFMDs;
+  char **clips = NULL;
+  int numClips = 0;
+  const char **inputs;
+  int numInputs;
+  struct checkpoint checkpointData;
+  struct checkpoint *checkpoint = NULL;
+  struct rlePlanes rle;
+  int slot;
 
-  OFMDdata.validPlanes = (int *)malloc(sizeof(int) * MAXPLANES);
+  if (job->playlist != -1) {
+    numClips = getPlaylistClips(job->input, job->playlist, &clips);
+    if (numClips == -1) {
+      return 1;
+    }
+  }
 
-  // Prevent creating false ofs files.
-  for (int x = 0; x < MAXPLANES; x++) {
-    OFMDdata.validPlanes[x] = 0;
+  // A single input file is read like a playlist with one clip.
+  if (job->playlist == -1) {
+    inputs = (const char **)&job->input;
+    numInputs = 1;
+  } else {
+    inputs = (const char **)clips;
+    numInputs = numClips;
   }
 
-  printIntro();
-  parseOptions(argc, argv, &newFrameRate, &dropFrame, &outFolder);
+  // A checkpoint is worth keeping after Ctrl-C.
+  if (options->checkpointSeconds > 0 || options->resume) {
+    job->keepOutFolder = true;
+  }
 
-  if (newFrameRate > 0) {
-    OFMDdata.frameRate = newFrameRate;
+  // Ctrl-C can only clean up after the jobs it knows about.
+  slot = addRunningJob(job);
+  if (slot == -1) {
+    printf("Too many jobs are running at once.\n");
+    free2DArray((void ***)&clips, numClips);
+    return 1;
   }
+  catchInterrupt(SIGINT);
 
   // Create OFS file directory.
-  if (makeDirectory(outFolder) == -1) {
-    exit(1);
+  if (makeDirectory(job->outFolder) == -1) {
+    removeRunningJob(slot);
+    free2DArray((void ***)&clips, numClips);
+    return 1;
   }
 
-  printf("Searching file for 3D-Planes.\n\n");
+  if (job->playlist != -1 && !options->quiet) {
+    printf("Playlist %05d has %d clip(s):\n", job->playlist, numClips);
+    for (int x = 0; x < numClips; x++) {
+      printf("  %s\n", clips[x]);
+    }
+    printf("\n");
+  }
 
-  OFMDs = (BYTE **)malloc(sizeof(BYTE *));
-  signal(SIGINT, intHandler);
-  numOFMDs = getOFMDsInFile(OFMD_SIZE, BUFFER_SIZE, argv[1], false, &OFMDs);
+  if (!options->quiet) {
+    printf("Searching file for 3D-Planes.\n\n");
+  }
 
-  // if 'getOFMDsInFile' returns -1 it failed to open input file.
-  if (numOFMDs == -1) {
-    printf("Deleting directory '%s' if it exists.\n", outFolder);
-    if (dirExists(outFolder)) {
-      delDirectory(outFolder);
-    }
-    exit(1);
+  if (options->checkpointSeconds > 0 || options->resume) {
+    initCheckpoint(&checkpointData, job->outFolder,
+                   options->checkpointSeconds > 0 ? options->checkpointSeconds
+                                                  : CHECKPOINT_SECONDS,
+                   options->resume);
+    checkpoint = &checkpointData;
   }
 
-  if (numOFMDs == 0) {
-    printf("This file doesn't have any 3D-Planes.\n");
-    printf("Deleting directory '%s' if it exists.\n", outFolder);
-    if (dirExists(outFolder)) {
-      delDirectory(outFolder);
+  // Prevent creating false ofs files.
+  OFMDdata.validPlanes = (int *)calloc(MAXPLANES, sizeof(int));
+  initRLEPlanes(&rle, 0);
+
+  if (options->stream) {
+    numOFMDs = streamOFSFiles(options->blockSize, options->backend, inputs,
+                              numInputs, false, job->outFolder,
+                              options->newFrameRate, options->dropFrame,
+                              checkpoint, options->rle ? &rle : NULL,
+                              &OFMDdata);
+  } else if (options->index) {
+    numOFMDs = getPlanesWithIndex(options, job->outFolder, inputs, numInputs,
+                                  checkpoint, &OFMDdata);
+  } else {
+    numOFMDs = getPlanesInFiles(options->blockSize, options->backend,
+                                options->threads, inputs, numInputs, false,
+                                checkpoint, &OFMDdata);
+  }
+  free2DArray((void ***)&clips, numClips);
+  job->numOFMDs = numOFMDs;
+
+  // Only a failed scan is worth resuming.
+  if (checkpoint != NULL) {
+    finishCheckpoint(checkpoint, numOFMDs == -1);
+  }
+
+  // if 'getPlanesInFiles' returns -1 it failed to open input file.
+  if (numOFMDs <= 0) {
+    if (numOFMDs == 0 && !options->quiet) {
+      printf("This file doesn't have any 3D-Planes.\n");
     }
-    exit(1);
+    removeOutFolder(options, job);
+    removeRunningJob(slot);
+    freeRLEPlanes(&rle);
+    free(OFMDdata.validPlanes);
+    return 1;
   }
 
-  getPlanesFromOFMDs(&OFMDs, numOFMDs, &OFMDdata);
+  if (options->stream) {
+    // The OFS files have already been written.
+    planesInFile = OFMDdata.numOfPlanes;
+  } else {
+    if (options->newFrameRate > 0) {
+      OFMDdata.frameRate = options->newFrameRate;
+    }
+
+    if (!options->quiet) {
+      printf("\nChecking 3D-Planes for valid depth values.\n");
+    }
+
+    planesInFile = verifyPlanes(OFMDdata);
+    if ((options->tar != NULL
+             ? writeOFSBundle(OFMDdata, options->tar, options->dropFrame)
+             : createOFSFiles(OFMDdata, job->outFolder,
+                              options->dropFrame)) == -1) {
+      if (options->tar == NULL) {
+        removeOutFiles(job, OFMDdata.validPlanes);
+      }
+      removeOutFolder(options, job);
+      removeRunningJob(slot);
+      freePlanes(&OFMDdata);
+      free(OFMDdata.validPlanes);
+      return 1;
+    }
+  }
 
-  printf("\nChecking 3D-Planes for valid depth values.\n");
+  if (options->rle &&
+      writeRLESidecar(options, job->outFolder, &OFMDdata, &rle) == -1) {
+    removeOutFiles(job, OFMDdata.validPlanes);
+    removeOutFolder(options, job);
+    removeRunningJob(slot);
+    freePlanes(&OFMDdata);
+    freeRLEPlanes(&rle);
+    free(OFMDdata.validPlanes);
+    return 1;
+  }
 
-  planesInFile = verifyPlanes(OFMDdata, argv[1]);
-  createOFSFiles(OFMDdata, outFolder, dropFrame);
+  // The bundle is elsewhere. The folder stays only if '-index' used it.
+  if (options->tar != NULL && !options->rle) {
+    delDirectory(job->outFolder);
+  }
+  removeRunningJob(slot);
 
-  printf("\nNumber of 3D-Planes in MVC stream: %d\n", planesInFile);
-  printf("Number of 3D-Planes written: %d\n",
-         sumOfIntArray(OFMDdata.validPlanes, MAXPLANES));
-  printf("Number of frames: %d\n", OFMDdata.totalFrames);
-  printf("Framerate: %s\n\n", printFpsValue(OFMDdata.frameRate));
+  job->numOfPlanes = planesInFile;
+  job->planesWritten = sumOfIntArray(OFMDdata.validPlanes, MAXPLANES);
+  job->totalFrames = OFMDdata.totalFrames;
+  job->frameRate = OFMDdata.frameRate;
+  if (!options->quiet) {
+    printf("\nNumber of 3D-Planes in MVC stream: %d\n", job->numOfPlanes);
+    printf("Number of 3D-Planes written: %d\n", job->planesWritten);
+    printf("Number of frames: %d\n", job->totalFrames);
+    printf("Framerate: %s\n\n", printFpsValue(job->frameRate));
+  }
 
   // Don't leak memory!
-  free2DArray((void ***)&OFMDdata.planes, OFMDdata.numOfPlanes);
-  free2DArray((void ***)&OFMDs, numOFMDs);
+  freePlanes(&OFMDdata);
+  freeRLEPlanes(&rle);
   free(OFMDdata.validPlanes);
+
+  return 0;
+}
+
+// 'batchTask' for 'runBatch'.
+static int extractBatchTitle(void *context, struct batchJob *job) {
+  return extractTitle((const struct options *)context, job);
+}
+
+/*
+ * Runs an extraction for every title in the manifest or folder 'input' on
+ * a pool of workers. Returns the exit code.
+ */
+int runBatchMode(struct options *options, const char *input) {
+  struct batch batch;
+  double start = currentSeconds();
+  int numFailed;
+
+  if (dirExists(input)) {
+    if (findBatchInputs(input, options->outFolder, &batch) == -1) {
+      return 1;
+    }
+  } else if (readBatchManifest(input, options->outFolder, &batch) == -1) {
+    return 1;
+  }
+
+  if (batch.numJobs == 0) {
+    printf("There's nothing to extract in '%s'.\n", input);
+    return 1;
+  }
+
+  printf("Extracting %d title(s) with %d worker(s) and up to %d per "
+         "device.\n\n",
+         batch.numJobs, options->jobs, options->ioLimit);
+  setQuietReports(true);
+  if (runBatch(&batch, options->jobs, options->ioLimit, extractBatchTitle,
+               options) == -1) {
+    freeBatch(&batch);
+    return 1;
+  }
+  numFailed = printBatchSummary(&batch, currentSeconds() - start);
+  freeBatch(&batch);
+
+  return numFailed > 0 ? 1 : 0;
+}
+
+// Checks what a '-serve' request wants to read and write.
+static void checkJobInput(const struct options *options, const char *input,
+                          const char *output, char *error, size_t errorSize) {
+  if (input == NULL || (output == NULL && !options->probe)) {
+    snprintf(error, errorSize, "'input' and 'output' are needed.");
+  } else if (strcmp(input, "-") == 0) {
+    snprintf(error, errorSize, "The server can't read its stdin.");
+  } else if (!dirExists(input) &&
+             (!hasInputExt(input) || !testOpenReadFile(input))) {
+    snprintf(error, errorSize, "'%s' can't be read or isn't supported.",
+             input);
+  } else {
+    checkOptions(options, input, error, errorSize);
+  }
+}
+
+// 'serveHandler' for '-serve'. The fields are named after the options.
+static void serveJob(void *context, struct serveRequest *request) {
+  struct options options = *(const struct options *)context;
+  const char *input = NULL;
+  const char *output = NULL;
+  char error[1024] = "";
+  struct batchJob job;
+  double start = currentSeconds();
+  bool flag;
+  int value = 0;
+
+  options.quiet = true;
+  for (int x = 0; x < request->numFields && error[0] == '\0'; x++) {
+    const struct serveField *field = &request->fields[x];
+    bool valid = true;
+
+    if (strcmp(field->name, "input") == 0) {
+      input = field->value;
+      valid = field->isString;
+    } else if (strcmp(field->name, "output") == 0) {
+      output = field->value;
+      valid = field->isString;
+    } else if (strcmp(field->name, "probe") == 0) {
+      valid = fieldBool(field, &options.probe);
+    } else if (strcmp(field->name, "fps") == 0) {
+      valid = fieldInt(field, &value) && isFrameRate(value);
+      options.newFrameRate = valid ? value : 0;
+    } else if (strcmp(field->name, "dropframe") == 0) {
+      valid = fieldBool(field, &flag);
+      options.dropFrame = valid ? (flag ? 1 : 0) : options.dropFrame;
+    } else if (strcmp(field->name, "reader") == 0) {
+      valid = field->isString &&
+              parseInputBackend(field->value, &options.backend) != -1;
+    } else if (strcmp(field->name, "blocksize") == 0) {
+      valid = fieldInt(field, &value) && value >= 64;
+      options.blockSize = valid ? (size_t)value * 1024 : options.blockSize;
+    } else if (strcmp(field->name, "threads") == 0) {
+      valid = fieldInt(field, &value) && value >= 0 && value <= MAXTHREADS;
+      if (valid) {
+        options.threads = value == 0 ? cpuCount() : value;
+      }
+    } else if (strcmp(field->name, "playlist") == 0) {
+      valid = fieldInt(field, &value) && value >= 0 && value <= 99999;
+      options.playlist = valid ? value : options.playlist;
+    } else if (strcmp(field->name, "stream") == 0) {
+      valid = fieldBool(field, &options.stream);
+    } else if (strcmp(field->name, "index") == 0) {
+      valid = fieldBool(field, &options.index);
+    } else if (strcmp(field->name, "rle") == 0) {
+      valid = fieldBool(field, &options.rle);
+    } else if (strcmp(field->name, "probeofmds") == 0) {
+      valid = fieldInt(field, &value) && value >= 1;
+      options.probeOFMDs = valid ? value : options.probeOFMDs;
+    } else if (strcmp(field->name, "probesize") == 0) {
+      valid = fieldInt(field, &value) && value >= 1;
+      options.probeSize = valid ? value : options.probeSize;
+    } else if (strcmp(field->name, "checkpoint") == 0) {
+      valid = fieldInt(field, &value) && value >= 1;
+      options.checkpointSeconds = valid ? value : options.checkpointSeconds;
+    } else if (strcmp(field->name, "resume") == 0) {
+      valid = fieldBool(field, &options.resume);
+    } else {
+      snprintf(error, sizeof(error), "'%s' isn't an option.", field->name);
+    }
+
+    if (!valid) {
+      snprintf(error, sizeof(error), "'%s' is invalid.", field->name);
+    }
+  }
+
+  if (error[0] == '\0') {
+    checkJobInput(&options, input, output, error, sizeof(error));
+  }
+
+  if (error[0] != '\0') {
+    printf("Job %d: %s\n", request->job, error);
+    sendServeError(request, error);
+    return;
+  }
+
+  if (options.probe) {
+    char before[80];
+
+    snprintf(before, sizeof(before),
+             "{\"event\": \"result\", \"job\": %d, \"ok\": true, "
+             "\"probe\": ",
+             request->job);
+    printf("Job %d: Probing '%s'.\n", request->job, input);
+    if (probeTitle(&options, input, request->reply, before, true) == 0) {
+      fprintf(request->reply, "}\n");
+      printf("Job %d: Done\n", request->job);
+    } else {
+      printf("Job %d: Failed\n", request->job);
+      sendServeError(request, "The probe failed. See the server's output.");
+    }
+    return;
+  }
+
+  memset(&job, 0, sizeof(struct batchJob));
+  job.input = (char *)input;
+  job.outFolder = (char *)output;
+  job.playlist = options.playlist;
+  printf("Job %d: Extracting '%s' to '%s'.\n", request->job, input, output);
+  fflush(stdout);
+
+  setProgressCallback(sendServeProgress, request);
+  job.result = extractTitle(&options, &job);
+  setProgressCallback(NULL, NULL);
+  job.seconds = currentSeconds() - start;
+
+  printf("Job %d: %s (%.2f seconds)\n", request->job,
+         job.result == 0 ? "Done" : "Failed", job.seconds);
+  fflush(stdout);
+  if (job.result == 0) {
+    fprintf(request->reply,
+            "{\"event\": \"result\", \"job\": %d, \"ok\": true, "
+            "\"numOfPlanes\": %d, \"planesWritten\": %d, "
+            "\"totalFrames\": %d, \"frameRate\": %d, \"fps\": \"%s\", "
+            "\"seconds\": %.2f}\n",
+            request->job, job.numOfPlanes, job.planesWritten, job.totalFrames,
+            job.frameRate, printFpsValue(job.frameRate), job.seconds);
+  } else if (job.numOFMDs == 0) {
+    sendServeError(request, "This file doesn't have any 3D-Planes.");
+  } else {
+    sendServeError(request, "The extraction failed. See the server's output.");
+  }
+}
+
+// Runs the jobs that come in on the socket until the server is stopped.
+int runServeMode(struct options *options) {
+  setQuietReports(true);
+  catchInterrupt(SIGINT);
+  catchInterrupt(SIGTERM);
+
+  return runServer(options->serve, options->jobs, serveJob, options);
+}
+
+static void addRequestField(struct serveRequest *request, const char *name,
+                            const char *value, bool isString) {
+  struct serveField *field = &request->fields[request->numFields++];
+
+  field->name = name;
+  field->value = value;
+  field->isString = isString;
+}
+
+/*
+ * Sends the job to the server at 'options->client'. Only the options that
+ * were set are sent, so the rest are the server's. With '-' as the input,
+ * the request is read from stdin instead. Returns the exit code.
+ */
+int runClientMode(const struct options *options, const char *input) {
+  struct serveRequest request;
+  char numbers[7][16];
+  char *text = NULL;
+  char *inputPath = NULL;
+  char *outputPath = NULL;
+  size_t length;
+  int result = 1;
+
+  request.numFields = 0;
+  if (strcmp(input, "-") == 0) {
+    text = (char *)malloc(SERVE_MAX_REQUEST);
+    if (text == NULL) {
+      perror("malloc()");
+      return 1;
+    }
+    length = fread(text, 1, SERVE_MAX_REQUEST - 1, stdin);
+    text[length] = '\0';
+    if (parseRequest(text, &request) == -1) {
+      printf("stdin doesn't have a JSON object without nested values.\n");
+      free(text);
+      return 1;
+    }
+  } else {
+    inputPath = absolutePath(input);
+    outputPath = absolutePath(options->outFolder);
+    if (inputPath == NULL || outputPath == NULL) {
+      free(inputPath);
+      free(outputPath);
+      return 1;
+    }
+
+    // The server has its own working folder.
+    addRequestField(&request, "input", inputPath, true);
+    if (options->probe) {
+      addRequestField(&request, "probe", "true", false);
+      if (options->probeOFMDs != PROBE_OFMDS) {
+        snprintf(numbers[5], sizeof(numbers[5]), "%d", options->probeOFMDs);
+        addRequestField(&request, "probeofmds", numbers[5], false);
+      }
+      if (options->probeSize != PROBE_SIZE) {
+        snprintf(numbers[6], sizeof(numbers[6]), "%d", options->probeSize);
+        addRequestField(&request, "probesize", numbers[6], false);
+      }
+    } else {
+      addRequestField(&request, "output", outputPath, true);
+    }
+    if (options->playlist != -1) {
+      snprintf(numbers[0], sizeof(numbers[0]), "%d", options->playlist);
+      addRequestField(&request, "playlist", numbers[0], false);
+    }
+    if (options->newFrameRate > 0) {
+      snprintf(numbers[1], sizeof(numbers[1]), "%d", options->newFrameRate);
+      addRequestField(&request, "fps", numbers[1], false);
+    }
+    if (options->dropFrame) {
+      addRequestField(&request, "dropframe", "true", false);
+    }
+    if (options->backend != INPUT_AUTO) {
+      addRequestField(&request, "reader", inputBackendName(options->backend),
+                      true);
+    }
+    if (options->blockSize != INPUT_BLOCK_SIZE) {
+      snprintf(numbers[2], sizeof(numbers[2]), "%d",
+               (int)(options->blockSize / 1024));
+      addRequestField(&request, "blocksize", numbers[2], false);
+    }
+    if (options->threads != 1) {
+      snprintf(numbers[3], sizeof(numbers[3]), "%d", options->threads);
+      addRequestField(&request, "threads", numbers[3], false);
+    }
+    if (options->stream) {
+      addRequestField(&request, "stream", "true", false);
+    }
+    if (options->index) {
+      addRequestField(&request, "index", "true", false);
+    }
+    if (options->rle) {
+      addRequestField(&request, "rle", "true", false);
+    }
+    if (options->checkpointSeconds > 0) {
+      snprintf(numbers[4], sizeof(numbers[4]), "%d",
+               options->checkpointSeconds);
+      addRequestField(&request, "checkpoint", numbers[4], false);
+    }
+    if (options->resume) {
+      addRequestField(&request, "resume", "true", false);
+    }
+  }
+
+  result = runClient(options->client, &request);
+  free(text);
+  free(inputPath);
+  free(outputPath);
+
+  return result;
+}
+
+/*
+ * Gets the OFMDs with the index in the output folder (which is written if
+ * it isn't there yet) and decodes their planes.
+ * Returns the number of OFMDs or -1.
+ */
+int getPlanesWithIndex(const struct options *options, const char *outFolder,
+                       const char **inputs, int numInputs,
+                       struct checkpoint *checkpoint,
+                       struct OFMDdata *OFMDdata) {
+  size_t size = strlen(outFolder) + strlen(OFSIDX_NAME) + 2;
+  char *indexPath = (char *)malloc(size);
+  struct OFMDstore OFMDs;
+  int numOFMDs;
+
+  if (indexPath == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+  snprintf(indexPath, size, "%s" PATH_SEPARATOR "%s", outFolder, OFSIDX_NAME);
+
+  initOFMDStore(&OFMDs);
+  numOFMDs = getOFMDsInFiles(options->blockSize, options->backend,
+                             options->threads, inputs, numInputs, false,
+                             indexPath, checkpoint, &OFMDs);
+  if (numOFMDs > 0 &&
+      getPlanesFromOFMDs(&OFMDs, options->threads, OFMDdata) == -1) {
+    numOFMDs = -1;
+  }
+  freeOFMDStore(&OFMDs);
+  free(indexPath);
+
+  return numOFMDs;
+}
+
+/*
+ * Writes the runs of the valid planes to RLE_NAME in 'outFolder'. A title
+ * that was streamed already has its runs, the others get them from the
+ * planes.
+ */
+int writeRLESidecar(const struct options *options, const char *outFolder,
+                    const struct OFMDdata *OFMDdata, struct rlePlanes *rle) {
+  BYTE frameRate = (OFMDdata->frameRate * 16) + options->dropFrame;
+
+  if (!options->stream &&
+      encodeRLEPlanes(OFMDdata->planes, OFMDdata->numOfPlanes,
+                      OFMDdata->totalFrames, rle) == -1) {
+    return -1;
+  }
+
+  return writeRLEFile(outFolder, rle, frameRate, OFMDdata->validPlanes);
+}
+
+// True if 'option' is one of the arguments.
+bool hasOption(int argc, char *argv[], const char *option) {
+  for (int x = 1; x < argc; x++) {
+    if (strcmp(argv[x], option) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// The argument after 'option' or NULL if there's no such option.
+const char *findOptionValue(int argc, char *argv[], const char *option) {
+  for (int x = 1; x + 1 < argc; x++) {
+    if (strcmp(argv[x], option) == 0) {
+      return argv[x + 1];
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Probes 'input' or the clips of its playlist and writes what was found as
+ * JSON after 'before'. Nothing is written if it fails. Returns the exit code.
+ */
+int probeTitle(const struct options *options, const char *input, FILE *out,
+               const char *before, bool oneLine) {
+  struct probeResult probe;
+  const char **inputs = &input;
+  int numInputs = 1;
+  char **clips = NULL;
+  int numClips = 0;
+  int result = 1;
+
+  // The clips of a playlist are probed as one input.
+  if (options->playlist != -1) {
+    numClips = getPlaylistClips(input, options->playlist, &clips);
+    if (numClips == -1) {
+      return 1;
+    }
+    inputs = (const char **)clips;
+    numInputs = numClips;
+  }
+
+  if (probeFiles(options->blockSize, options->backend, inputs, numInputs,
+                 options->probeOFMDs, (int64_t)options->probeSize * 1024 * 1024,
+                 &probe) != -1) {
+    fputs(before, out);
+    writeProbe(out, inputs[0], numInputs, &probe, oneLine);
+    fflush(out);
+    result = 0;
+  }
+  free2DArray((void ***)&clips, numClips);
+
+  return result;
+}
+
+// Writes what '-probe' found as JSON, on a single line if 'oneLine'.
+void writeProbe(FILE *out, const char *input, int numInputs,
+                const struct probeResult *probe, bool oneLine) {
+  const char *first = oneLine ? "{" : "{\n  ";
+  const char *next = oneLine ? ", " : ",\n  ";
+
+  fprintf(out, "%s\"input\": ", first);
+  writeJSONString(out, input);
+  fprintf(out, "%s\"files\": %d", next, numInputs);
+  fprintf(out, "%s\"has3DPlanes\": %s", next,
+          probe->numOFMDs > 0 ? "true" : "false");
+  if (probe->numOFMDs > 0) {
+    fprintf(out, "%s\"numOfPlanes\": %d", next, probe->numOfPlanes);
+    fprintf(out, "%s\"frameRate\": %d", next, probe->frameRate);
+    fprintf(out, "%s\"fps\": \"%s\"", next, printFpsValue(probe->frameRate));
+    fprintf(out,
+            "%s\"framesPerGOP\": {\"min\": %d, \"max\": %d, "
+            "\"average\": %.2f}",
+            next, probe->minGOPFrames, probe->maxGOPFrames,
+            (double)probe->framesRead / probe->numOFMDs);
+  }
+  fprintf(out, "%s\"OFMDsRead\": %d", next, probe->numOFMDs);
+  fprintf(out, "%s\"framesRead\": %d", next, probe->framesRead);
+  fprintf(out, "%s\"bytesScanned\": %lld", next,
+          (long long)probe->bytesScanned);
+  if (probe->totalSize != -1) {
+    fprintf(out, "%s\"totalSize\": %lld", next, (long long)probe->totalSize);
+  } else {
+    fprintf(out, "%s\"totalSize\": null", next);
+  }
+  if (probe->estimatedFrames != -1) {
+    fprintf(out, "%s\"estimatedFrames\": %lld", next,
+            (long long)probe->estimatedFrames);
+  } else {
+    fprintf(out, "%s\"estimatedFrames\": null", next);
+  }
+  fputs(oneLine ? "}" : "\n}\n", out);
 }
 
 char *printFpsValue(int frameRate) {
@@ -165,49 +974,44 @@ char *printFpsValue(int frameRate) {
   return fpsString;
 }
 
-// Exits program if frame-rate value is invalid.
-void isValidFps(int frameRate) {
+// True if 'frameRate' is in the FPS Conversion Table.
+bool isFrameRate(int frameRate) {
   BYTE frameRateOption[6] = {1, 2, 3, 4, 6, 7};
-  bool validFps = false;
+
   for (int x = 0; x < 6; x++) {
     if (frameRate == frameRateOption[x]) {
-      printf("OFS Framerate will now be: %s\n\n", printFpsValue(frameRate));
-      validFps = true;
-      break;
+      return true;
     }
   }
-  if (!validFps) {
+
+  return false;
+}
+
+// Exits program if frame-rate value is invalid.
+void isValidFps(int frameRate) {
+  if (!isFrameRate(frameRate)) {
     printf("'-fps %d' is invalid. Value must be ", frameRate);
     printf("between 1 and 4, 6, or 7.\n");
     exit(1);
   }
+  printf("OFS Framerate will now be: %s\n\n", printFpsValue(frameRate));
 }
 
-// Helper function for 'parseOptions'
-bool checkFileExt(const char **validExts, size_t validExtsSize,
-                  const char *inExt) {
-  char lowerExt[5] = "\0"; // Will increase this if need be.
-  size_t x;
-
-  // Make inExt lowercase.
-  for (x = 0; x < strlen(inExt); x++) {
-    lowerExt[x] = tolower(inExt[x]);
-  }
-
-  // compare with validExt
-  for (x = 0; x < validExtsSize; x++) {
-    if (strcmp(validExts[x], lowerExt) == 0) {
-      return true;
-    }
+// Reads the value that follows 'argv[*argIndex]' and exits if it's missing.
+char *optionValue(int argc, char *argv[], int *argIndex) {
+  if (*argIndex + 1 >= argc) {
+    printf("'%s' requires a value.\n", argv[*argIndex]);
+    exit(1);
   }
 
-  return false;
+  *argIndex += 1;
+  return argv[*argIndex];
 }
 
-void parseOptions(int argc, char *argv[], BYTE *newFrameRate, BYTE *dropFrame,
-                  char **outFolder) {
-  char *supportedExt[4] = {"mvc", "h264", "264", "m2ts"};
-  const char *fileExt;
+void parseOptions(int argc, char *argv[], struct options *options) {
+  char error[1024];
+  int argIndex = 2;
+  int value;
 
   if (argc >= 2) {
     if (strncmp(argv[1], "-license", 8) == 0) {
@@ -217,12 +1021,13 @@ void parseOptions(int argc, char *argv[], BYTE *newFrameRate, BYTE *dropFrame,
   }
 
   if (argc >= 2) {
-    if ((strlen(argv[1]) != 1) && (strncmp(argv[1], "-", 1) != 0)) {
+    if ((strlen(argv[1]) != 1) && (strncmp(argv[1], "-", 1) != 0) &&
+        !dirExists(argv[1])) {
       if (testOpenReadFile(argv[1])) {
-        // Check if file extention is supported.
-        fileExt = getFileExt(argv[1]);
-        if (!checkFileExt((const char **)supportedExt, 4, fileExt)) {
-          printf("'%s': Is not a supported file extention.\n", fileExt);
+        // Check if file extention is supported. (A manifest can be anything.)
+        if (!hasInputExt(argv[1]) && !hasOption(argc, argv, "-batch")) {
+          printf("'%s': Is not a supported file extention.\n",
+                 getFileExt(argv[1]));
           exit(1);
         }
       } else {
@@ -234,74 +1039,242 @@ void parseOptions(int argc, char *argv[], BYTE *newFrameRate, BYTE *dropFrame,
 
   if (argc == 1) {
     usage(argv);
-  } else if (argc == 2) {
-    *outFolder = "."; // Output to current if option not set.
-  } else if (argc == 3) {
-    if (strncmp(argv[2], "-fps", 4) == 0) {
-      printf("'-fps' requires a value.\n");
-      exit(1);
-    } else {
-      *outFolder = argv[2]; // Set output Folder.
-    }
-  } else if (argc == 4) {
-    if (strncmp(argv[3], "-fps", 4) == 0) {
-      printf("'-fps' requires a value.\n");
-      exit(1);
-    } else if (strncmp(argv[2], "-fps", 4) == 0) {
-      sscanf(argv[3], "%d", (int *)&(*newFrameRate));
-      isValidFps(*newFrameRate);
-      *outFolder = ".";
-    } else {
-      printf("Invalid input!\n");
-      exit(1);
-    }
-  } else if (argc == 5) {
-    if (strncmp(argv[2], "-fps", 4) == 0) {
-      sscanf(argv[3], "%d", (int *)&(*newFrameRate)); // Convert to int
-      isValidFps(*newFrameRate);
-      if (strncmp(argv[4], "-dropframe", 10) == 0) {
-        if (*newFrameRate == 4) {
-          *dropFrame = 1;
-          printf("'drop_frame_flag' will be set in OFS.\n\n");
-        } else {
-          printf("'-dropframe' is only compatible with '-fps 4'.\n");
-          exit(1);
-        }
-        *outFolder = ".";
-      } else {
-        printf("Invalid input!\n");
+  }
+
+  options->outFolder = "."; // Output to current if option not set.
+  if (strcmp(argv[1], "-serve") == 0) {
+    // The socket takes the place of the input and output folder.
+    argIndex = 1;
+    options->serve = optionValue(argc, argv, &argIndex);
+    argIndex++;
+  } else if (argc >= 3 && strncmp(argv[2], "-", 1) != 0) {
+    options->outFolder = argv[2]; // Set output Folder.
+    argIndex = 3;
+  }
+
+  for (; argIndex < argc; argIndex++) {
+    if (strcmp(argv[argIndex], "-fps") == 0) {
+      value = 0;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      isValidFps(value);
+      options->newFrameRate = value;
+    } else if (strcmp(argv[argIndex], "-dropframe") == 0) {
+      options->dropFrame = 1;
+    } else if (strcmp(argv[argIndex], "-reader") == 0) {
+      if (parseInputBackend(optionValue(argc, argv, &argIndex),
+                            &options->backend) == -1) {
+        printf("'-reader %s' is invalid. ", argv[argIndex]);
+        printf("Value must be auto, mmap, pread, stdio, or uring.\n");
         exit(1);
       }
-    } else if (strncmp(argv[3], "-fps", 4) == 0) {
-      sscanf(argv[4], "%d", (int *)&(*newFrameRate)); // Convert to int
-      isValidFps(*newFrameRate);
-      *outFolder = argv[2];
-    } else {
-      printf("Invalid input!\n");
-      exit(1);
-    }
-  } else if (argc == 6) {
-    if (strncmp(argv[3], "-fps", 4) == 0) {
-      sscanf(argv[4], "%d", (int *)&(*newFrameRate));
-      isValidFps(*newFrameRate);
-      if (strncmp(argv[5], "-dropframe", 10) == 0) {
-        if (*newFrameRate == 4) {
-          *dropFrame = 1;
-          printf("'drop_frame_flag' will be set in OFS.\n\n");
-        } else {
-          printf("'-dropframe' is only compatible with '-fps 4'.\n");
-          exit(1);
-        }
-      } else {
-        printf("Invalid input!\n");
+    } else if (strcmp(argv[argIndex], "-blocksize") == 0) {
+      value = 0;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      if (value < 64) {
+        printf("'-blocksize %s' is invalid. ", argv[argIndex]);
+        printf("Value must be at least 64 (KB).\n");
         exit(1);
       }
-      *outFolder = argv[2];
+      options->blockSize = (size_t)value * 1024;
+    } else if (strcmp(argv[argIndex], "-threads") == 0) {
+      value = -1;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      if (value < 0 || value > MAXTHREADS) {
+        printf("'-threads %s' is invalid. ", argv[argIndex]);
+        printf("Value must be between 0 and %d.\n", MAXTHREADS);
+        exit(1);
+      }
+      options->threads = value == 0 ? cpuCount() : value;
+    } else if (strcmp(argv[argIndex], "-stream") == 0) {
+      options->stream = true;
+    } else if (strcmp(argv[argIndex], "-probe") == 0) {
+      options->probe = true;
+    } else if (strcmp(argv[argIndex], "-probeofmds") == 0) {
+      value = 0;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      if (value < 1) {
+        printf("'-probeofmds %s' is invalid. ", argv[argIndex]);
+        printf("Value must be at least 1.\n");
+        exit(1);
+      }
+      options->probeOFMDs = value;
+    } else if (strcmp(argv[argIndex], "-probesize") == 0) {
+      value = 0;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      if (value < 1) {
+        printf("'-probesize %s' is invalid. ", argv[argIndex]);
+        printf("Value must be at least 1 (MB).\n");
+        exit(1);
+      }
+      options->probeSize = value;
+    } else if (strcmp(argv[argIndex], "-index") == 0) {
+      options->index = true;
+    } else if (strcmp(argv[argIndex], "-checkpoint") == 0) {
+      value = 0;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      if (value < 1) {
+        printf("'-checkpoint %s' is invalid. ", argv[argIndex]);
+        printf("Value must be at least 1 (seconds).\n");
+        exit(1);
+      }
+      options->checkpointSeconds = value;
+    } else if (strcmp(argv[argIndex], "-resume") == 0) {
+      options->resume = true;
+    } else if (strcmp(argv[argIndex], "-batch") == 0) {
+      options->batch = true;
+      options->quiet = true;
+    } else if (strcmp(argv[argIndex], "-jobs") == 0) {
+      value = -1;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      if (value < 0 || value > MAXTHREADS) {
+        printf("'-jobs %s' is invalid. ", argv[argIndex]);
+        printf("Value must be between 0 and %d.\n", MAXTHREADS);
+        exit(1);
+      }
+      options->jobs = value;
+    } else if (strcmp(argv[argIndex], "-iolimit") == 0) {
+      value = 0;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      if (value < 1) {
+        printf("'-iolimit %s' is invalid. ", argv[argIndex]);
+        printf("Value must be at least 1.\n");
+        exit(1);
+      }
+      options->ioLimit = value;
+    } else if (strcmp(argv[argIndex], "-playlist") == 0) {
+      value = -1;
+      sscanf(optionValue(argc, argv, &argIndex), "%d", &value);
+      if (value < 0 || value > 99999) {
+        printf("'-playlist %s' is invalid. ", argv[argIndex]);
+        printf("Value must be between 0 and 99999.\n");
+        exit(1);
+      }
+      options->playlist = value;
+    } else if (strcmp(argv[argIndex], "-client") == 0) {
+      options->client = optionValue(argc, argv, &argIndex);
+    } else if (strcmp(argv[argIndex], "-tee") == 0) {
+      options->tee = true;
+    } else if (strcmp(argv[argIndex], "-tar") == 0) {
+      options->tar = optionValue(argc, argv, &argIndex);
+    } else if (strcmp(argv[argIndex], "-rle") == 0) {
+      options->rle = true;
     } else {
       printf("Invalid input!\n");
       exit(1);
     }
   }
+
+  // Each job brings its own input. The server's options are the defaults.
+  if (options->serve != NULL) {
+    if (options->batch || options->client != NULL || options->probe ||
+        options->tee || options->tar != NULL || options->playlist != -1 ||
+        options->ioLimit != BATCH_IO_LIMIT) {
+      printf("'-batch', '-client', '-probe', '-tee', '-tar', '-playlist', "
+             "and '-iolimit' can't be used with '-serve'.\n");
+      exit(1);
+    }
+    if (options->jobs == 0) {
+      options->jobs = cpuCount();
+    }
+    return;
+  }
+
+  // A batch brings its own inputs and playlists.
+  if (options->batch) {
+    if (strcmp(argv[1], "-") == 0) {
+      printf("'-batch' needs a manifest or a folder. Not stdin.\n");
+      exit(1);
+    } else if (options->probe || options->playlist != -1 ||
+               options->client != NULL || options->tar != NULL) {
+      printf("'-probe', '-playlist', '-client', and '-tar' can't be used "
+             "with '-batch'.\n");
+      exit(1);
+    }
+    if (options->jobs == 0) {
+      options->jobs = cpuCount();
+    }
+  } else if (options->jobs != 0 || options->ioLimit != BATCH_IO_LIMIT) {
+    printf("'-jobs' only works with '-batch' or '-serve', and '-iolimit' "
+           "with '-batch'.\n");
+    exit(1);
+  }
+
+  if (!options->probe && (options->probeOFMDs != PROBE_OFMDS ||
+                          options->probeSize != PROBE_SIZE)) {
+    printf("'-probeofmds' and '-probesize' only work with '-probe'.\n");
+    exit(1);
+  }
+
+  // Only this process reads its stdin, and it's read once.
+  if (options->tee && (strcmp(argv[1], "-") != 0 || options->batch ||
+                       options->client != NULL)) {
+    printf("'-tee' needs stdin ('-') as the input and can't be used with "
+           "'-batch' or '-client'.\n");
+    exit(1);
+  }
+
+  // The bundle is written here, and stdout can only take one stream.
+  if (options->tar != NULL &&
+      (options->client != NULL ||
+       (options->tee && strcmp(options->tar, "-") == 0))) {
+    printf("'-tar' can't be used with '-client', and '-tar -' can't be used "
+           "with '-tee'.\n");
+    exit(1);
+  }
+
+  if (checkOptions(options, argv[1], error, sizeof(error)) == -1) {
+    printf("%s\n", error);
+    exit(1);
+  }
+  if (options->dropFrame) {
+    printf("'drop_frame_flag' will be set in OFS.\n\n");
+  }
+}
+
+/*
+ * Checks the options that depend on each other or on the input.
+ * Returns -1 with what's wrong in 'error'.
+ */
+int checkOptions(const struct options *options, const char *input,
+                 char *error, size_t errorSize) {
+  // A BDMV folder is read through one of its playlists.
+  if (dirExists(input) && options->playlist == -1 && !options->batch) {
+    snprintf(error, errorSize,
+             "'%s' is a folder. Use '-playlist #' to pick a playlist.", input);
+    return -1;
+  } else if (!dirExists(input) && options->playlist != -1) {
+    snprintf(error, errorSize, "'-playlist' only works with a BDMV folder.");
+    return -1;
+  }
+
+  // A checkpoint only knows how far the scan got in file order.
+  if ((options->checkpointSeconds > 0 || options->resume) &&
+      options->threads > 1) {
+    snprintf(error, errorSize,
+             "'-checkpoint' and '-resume' only work with 1 thread.");
+    return -1;
+  }
+
+  // The bundle's index comes first, so every plane has to be done by then.
+  if (options->tar != NULL && (options->stream || options->probe)) {
+    snprintf(error, errorSize,
+             "'-tar' can't be used with '-stream' or '-probe'.");
+    return -1;
+  }
+
+  // The index needs the offsets of the OFMDs, which streaming doesn't keep.
+  if (options->index && options->stream) {
+    snprintf(error, errorSize, "'-index' can't be used with '-stream'.");
+    return -1;
+  }
+
+  if (options->dropFrame && options->newFrameRate != 4) {
+    snprintf(error, errorSize,
+             "'-dropframe' is only compatible with '-fps 4'.");
+    return -1;
+  }
+
+  return 0;
 }
 
 int sumOfIntArray(int *array, size_t sizeOfArray) {
@@ -329,13 +1302,29 @@ void usage(char *argv[]) {
   char *program = basename(argv[0]);
 
   printf("Usage: %s [-license] <input file> <output folder> [-fps # "
-         "-dropframe] \n\n",
+         "-dropframe] [-reader <type> -blocksize # -threads #] "
+         "[-playlist #] [-stream] [-probe [-probeofmds # -probesize #]] "
+         "[-index] [-checkpoint # -resume] [-rle]\n",
+         program);
+  printf("       %s <manifest|folder> <output folder> -batch [-jobs # "
+         "-iolimit #] [options]\n",
+         program);
+  printf("       %s -serve <socket> [-jobs #] [-reader <type> -blocksize # "
+         "-threads #]\n",
+         program);
+  printf("       %s <input file|-> [<output folder>] -client <socket> "
+         "[options]\n",
+         program);
+  printf("       %s - <output folder> -tee [options] > <copy of stdin>\n",
          program);
+  printf("       %s <input file> -tar <file|-> [options]\n\n", program);
   printf("  -license : Print license (MIT).\n\n");
   printf("  <input file> : Can be a raw MVC stream, ");
   printf("a H264+MVC combined stream (like those from MakeMKV),\n");
-  printf("                 or a M2TS file. (M2TS is not fully supported.)\n");
-  printf("                 Using '-' will read from stdin.\n\n");
+  printf("                 a M2TS/TS file or a MKV file. (Only the MVC PID "
+         "or track is read.)\n");
+  printf("                 Using '-' will read from stdin.\n");
+  printf("                 Can also be a BDMV folder. (See '-playlist')\n\n");
   printf("  <output folder> : The output folder which will contain the ofs "
          "files.\n");
   printf("                    If undefined the current directory will be "
@@ -354,6 +1343,86 @@ void usage(char *argv[]) {
   printf(
       "  -dropframe : Set drop_frame_flag within the resulting OFS files.\n");
   printf("               Can only be used with FPS value 4.\n\n");
+  printf("  -reader <auto|mmap|pread|stdio|uring> : How the input file is "
+         "read.\n");
+  printf("           'auto' memory-maps regular files. stdin and pipes are "
+         "always read with stdio.\n");
+  printf("           'uring' keeps %d reads in flight with io_uring (Linux "
+         "only),\n",
+         URING_QUEUE_DEPTH);
+  printf("           and uses pread if io_uring isn't available.\n\n");
+  printf("  -blocksize # : Size of each read in KB for the pread, stdio, and "
+         "uring readers. (Default: %d)\n\n",
+         INPUT_BLOCK_SIZE / 1024);
+  printf("  -threads # : Scan regular files with this many threads. "
+         "0 uses every CPU. (Default: 1)\n");
+  printf("               Only helps if the storage is faster than one "
+         "thread can scan.\n\n");
+  printf("  -playlist # : Read the clips of 'BDMV/PLAYLIST/#####.mpls' in "
+         "order.\n");
+  printf("                The input has to be a BDMV folder. For each clip the "
+         "SSIF,\n");
+  printf("                or the MVC dependent view M2TS is used if there's "
+         "one.\n\n");
+  printf("  -probeofmds # : '-probe' stops after this many OFMDs. "
+         "(Default: %d)\n\n",
+         PROBE_OFMDS);
+  printf("  -probesize # : '-probe' stops after this many MB. "
+         "(Default: %d)\n\n",
+         PROBE_SIZE);
+  printf("  -index : Keep '%s' in the output folder. The next run with the "
+         "same input\n",
+         OFSIDX_NAME);
+  printf("           only reads the OFMDs back from where it says, instead of "
+         "scanning everything.\n\n");
+  printf("  -checkpoint # : Save the OFMDs found so far to '%s' in the "
+         "output folder\n",
+         CHECKPOINT_NAME);
+  printf("                  every # seconds or %d GOPs. The folder is kept "
+         "if the scan is stopped.\n\n",
+         CHECKPOINT_OFMDS);
+  printf("  -resume : Carry on from the checkpoint in the output folder if it "
+         "matches the input.\n");
+  printf("            Checkpoints are saved every %d seconds unless "
+         "'-checkpoint' says otherwise.\n\n",
+         CHECKPOINT_SECONDS);
+  printf("  -batch : Extract many titles in one go. The input is a folder, "
+         "where every input file\n");
+  printf("           gets a folder of the same name (and sub-folder) in the "
+         "output folder,\n");
+  printf("           or a manifest with one '<input>[<TAB><output "
+         "folder>[<TAB><playlist>]]' per line.\n");
+  printf("           A line for each title and a summary are printed "
+         "instead of the depth reports.\n\n");
+  printf("  -jobs # : Titles extracted at the same time with '-batch' or "
+         "'-serve'. 0 uses every CPU. (Default: 0)\n\n");
+  printf("  -iolimit # : Most titles read from the same device at the same "
+         "time with '-batch'. (Default: %d)\n\n",
+         BATCH_IO_LIMIT);
+  printf("  -serve <socket> : Extract the jobs sent to this Unix domain socket "
+         "with '-jobs' workers.\n");
+  printf("                    A job is a JSON object on one line, with fields "
+         "named after the options\n");
+  printf("                    ('input', 'output', 'probe', 'fps', ...). The "
+         "progress and result come back\n");
+  printf("                    as lines of JSON. The other options are the "
+         "defaults for every job.\n\n");
+  printf("  -tee : Copy stdin to stdout unchanged while it's scanned, so the "
+         "planes come out of a remux\n");
+  printf("         pipeline without reading the stream twice. Everything else "
+         "is printed to stderr.\n\n");
+  printf("  -tar <file|-> : Pack the OFS files into one tar archive, with an "
+         "index ('%s') first,\n",
+         BUNDLE_INDEX_NAME);
+  printf("                  instead of writing them to the output folder. "
+         "'-' writes it to stdout.\n\n");
+  printf("  -rle : Also write the depth values as runs to '%s' in the output "
+         "folder.\n\n",
+         RLE_NAME);
+  printf("  -client <socket> : Send the input and options to a '-serve' "
+         "server and print what it sends back.\n");
+  printf("                     With '-' as the input the JSON request is read "
+         "from stdin.\n\n");
   exit(0);
 }
 
@@ -0,0 +1,481 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mkv.h"
+#include "nal.h"
+#include "scanner.h"
+#include "util.h"
+
+// The number of bytes in an EBML variable size integer or 0 if invalid.
+static int vintLength(BYTE first) {
+  for (int x = 0; x < 8; x++) {
+    if (first & (0x80 >> x)) {
+      return x + 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Reads the variable size integer at 'data'. Element IDs keep their marker
+ * bit. Returns its length or 0 if it doesn't fit in 'length'.
+ */
+static int readVint(const BYTE *data, size_t length, bool keepMarker,
+                    uint64_t *value) {
+  int size;
+
+  if (length < 1 || (size = vintLength(data[0])) == 0 ||
+      (size_t)size > length) {
+    return 0;
+  }
+
+  *value = keepMarker ? data[0] : data[0] & (0xFF >> size);
+  for (int x = 1; x < size; x++) {
+    *value = (*value << 8) | data[x];
+  }
+
+  return size;
+}
+
+static uint64_t readUInt(const BYTE *data, size_t length) {
+  uint64_t value = 0;
+
+  for (size_t x = 0; x < length && x < 8; x++) {
+    value = (value << 8) | data[x];
+  }
+
+  return value;
+}
+
+int initMKVDemuxer(struct mkvDemuxer *demux, struct nalParser *parser) {
+  memset(demux, 0, sizeof(struct mkvDemuxer));
+  demux->parser = parser;
+  demux->state = MKV_ELEMENT;
+  demux->videoTrack = -1;
+  demux->nalLengthSize = 4;
+  demux->clusterOffset = -1;
+
+  demux->buffer = (BYTE *)malloc(MAX_SEI_SIZE > MKV_MAX_TRACK_ENTRY
+                                     ? MAX_SEI_SIZE
+                                     : MKV_MAX_TRACK_ENTRY);
+  if (demux->buffer == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+
+  return 0;
+}
+
+void freeMKVDemuxer(struct mkvDemuxer *demux) {
+  free(demux->buffer);
+  demux->buffer = NULL;
+}
+
+void setMKVTrack(struct mkvDemuxer *demux, int track, int nalLengthSize) {
+  demux->videoTrack = track;
+  demux->nalLengthSize = nalLengthSize;
+  demux->fixedTrack = true;
+}
+
+int64_t takeMKVSkip(struct mkvDemuxer *demux) {
+  int64_t skip = demux->skip;
+
+  demux->skip = 0;
+  return skip;
+}
+
+/*
+ * Picks the first MVC track or the first AVC track if there isn't one.
+ * (MakeMKV puts both views in one 'V_MPEG4/ISO/AVC' track.)
+ */
+static void parseTrackEntry(struct mkvDemuxer *demux, const BYTE *data,
+                            size_t length) {
+  uint64_t number = 0;
+  uint64_t type = 0;
+  char codec[64] = "";
+  const BYTE *codecPrivate = NULL;
+  size_t privateLength = 0;
+  size_t pos = 0;
+  bool isMVC;
+  bool isAVC;
+
+  while (pos < length) {
+    uint64_t id;
+    uint64_t size;
+    int idLength = readVint(data + pos, length - pos, true, &id);
+    int sizeLength =
+        idLength == 0 ? 0
+                      : readVint(data + pos + idLength,
+                                 length - pos - idLength, false, &size);
+
+    if (sizeLength == 0) {
+      break;
+    }
+    pos += idLength + sizeLength;
+    if (size > length - pos) {
+      break;
+    }
+
+    switch (id) {
+    case MKV_ID_TRACK_NUMBER:
+      number = readUInt(data + pos, size);
+      break;
+    case MKV_ID_TRACK_TYPE:
+      type = readUInt(data + pos, size);
+      break;
+    case MKV_ID_CODEC_ID:
+      memcpy(codec, data + pos, size < sizeof(codec) ? size : sizeof(codec) - 1);
+      break;
+    case MKV_ID_CODEC_PRIVATE:
+      codecPrivate = data + pos;
+      privateLength = size;
+      break;
+    }
+    pos += size;
+  }
+
+  isMVC = memcmp(codec, "V_MPEG4/", 8) == 0 && strstr(codec, "MVC") != NULL;
+  isAVC = strcmp(codec, "V_MPEG4/ISO/AVC") == 0;
+
+  if (demux->fixedTrack || type != 1 || (!isMVC && !isAVC)) {
+    return; // Not a video track we can read.
+  }
+  if (demux->videoTrack != -1 && (demux->mvcTrack || !isMVC)) {
+    return;
+  }
+
+  demux->videoTrack = (int)number;
+  demux->mvcTrack = isMVC;
+  // lengthSizeMinusOne from the avcC. (Or mvcC, which starts the same way.)
+  demux->nalLengthSize =
+      privateLength >= 5 ? (codecPrivate[4] & 3) + 1 : 4;
+}
+
+// Copies bytes into 'demux->header' until it's 'needed' bytes long.
+static size_t gatherHeader(struct mkvDemuxer *demux, const BYTE *data,
+                           size_t length, size_t needed) {
+  size_t copySize =
+      needed > demux->headerLength ? needed - demux->headerLength : 0;
+
+  if (copySize > length) {
+    copySize = length;
+  }
+  memcpy(demux->header + demux->headerLength, data, copySize);
+  demux->headerLength += copySize;
+
+  return copySize;
+}
+
+/*
+ * Skips 'demux->remaining' bytes, then moves on to 'next'. Whatever isn't in
+ * this chunk is left for the caller to skip. (See 'takeMKVSkip')
+ */
+static size_t skipBytes(struct mkvDemuxer *demux, size_t length,
+                        enum mkvState next) {
+  size_t used = length;
+
+  if (demux->remaining <= length) {
+    used = demux->remaining;
+  } else {
+    demux->skip += demux->remaining - length;
+  }
+  demux->remaining = 0;
+  demux->state = next;
+
+  return used;
+}
+
+static void startElement(struct mkvDemuxer *demux, uint64_t id, uint64_t size,
+                         bool unknownSize) {
+  switch (id) {
+  case MKV_ID_CLUSTER:
+    // Clusters from 'stopOffset' on belong to someone else.
+    if (demux->parser != NULL &&
+        demux->headerOffset >= demux->parser->stopOffset) {
+      demux->parser->stopped = true;
+      return;
+    }
+    demux->clusterFound = true;
+    demux->clusterOffset = demux->headerOffset;
+    return;
+  case MKV_ID_SEGMENT:
+  case MKV_ID_TRACKS:
+  case MKV_ID_BLOCK_GROUP:
+    return; // Look inside.
+  case MKV_ID_TRACK_ENTRY:
+    if (!unknownSize && size <= MKV_MAX_TRACK_ENTRY) {
+      demux->state = MKV_TRACK_ENTRY;
+      demux->remaining = size;
+      demux->bufferLength = 0;
+      return;
+    }
+    break;
+  case MKV_ID_SIMPLE_BLOCK:
+  case MKV_ID_BLOCK:
+    if (!unknownSize) {
+      demux->state = MKV_BLOCK_HEADER;
+      demux->blockRemaining = size;
+      demux->numBlocks++;
+      return;
+    }
+    break;
+  }
+
+  // An element without a size can't be skipped, so look inside instead.
+  if (!unknownSize) {
+    demux->state = MKV_SKIP;
+    demux->remaining = size;
+  }
+}
+
+static size_t readElement(struct mkvDemuxer *demux, const BYTE *data,
+                          size_t length, int64_t offset) {
+  size_t used;
+  int idLength;
+  int sizeLength;
+  uint64_t id;
+  uint64_t size;
+
+  if (demux->headerLength == 0) {
+    demux->headerOffset = offset;
+  }
+
+  // An invalid ID or size is always caught in the call that read it,
+  // so 'used' is never 0 when the header is thrown away.
+  used = gatherHeader(demux, data, length, 1);
+  if (demux->headerLength < 1) {
+    return used;
+  }
+  idLength = vintLength(demux->header[0]);
+  if (idLength == 0 || idLength > 4) {
+    demux->headerLength = 0; // Not an element. Try the next byte.
+    return used;
+  }
+
+  used += gatherHeader(demux, data + used, length - used, idLength + 1);
+  if (demux->headerLength < (size_t)idLength + 1) {
+    return used;
+  }
+  sizeLength = vintLength(demux->header[idLength]);
+  if (sizeLength == 0) {
+    demux->headerLength = 0;
+    return used;
+  }
+
+  used += gatherHeader(demux, data + used, length - used,
+                       idLength + sizeLength);
+  if (demux->headerLength < (size_t)(idLength + sizeLength)) {
+    return used;
+  }
+
+  readVint(demux->header, idLength, true, &id);
+  readVint(demux->header + idLength, sizeLength, false, &size);
+  demux->headerLength = 0;
+
+  startElement(demux, id, size,
+               size == ((uint64_t)1 << (7 * sizeLength)) - 1);
+  return used;
+}
+
+// The block's track number, timestamp, and flags.
+static size_t readBlockHeader(struct mkvDemuxer *demux, const BYTE *data,
+                              size_t length) {
+  size_t limit = length < demux->blockRemaining ? length : demux->blockRemaining;
+  size_t used = gatherHeader(demux, data, limit, 1);
+  int trackLength = 0;
+  uint64_t track = 0;
+  bool keep;
+
+  if (demux->headerLength > 0) {
+    trackLength = vintLength(demux->header[0]);
+  }
+  if (trackLength > 0) {
+    used += gatherHeader(demux, data + used, limit - used, trackLength + 3);
+  }
+  demux->blockRemaining -= used;
+
+  if (trackLength > 0 && demux->headerLength < (size_t)trackLength + 3) {
+    if (demux->blockRemaining > 0) {
+      return used; // The rest is in the next chunk.
+    }
+    trackLength = 0; // The block is too short.
+  }
+
+  keep = false;
+  if (trackLength > 0) {
+    readVint(demux->header, trackLength, false, &track);
+    // Skip laced blocks. Video is never laced anyway.
+    keep = demux->parser != NULL && (int64_t)track == demux->videoTrack &&
+           (demux->header[trackLength + 2] & 0x06) == 0;
+  }
+  demux->headerLength = 0;
+
+  if (keep) {
+    demux->state = MKV_NAL_LENGTH;
+  } else {
+    demux->state = MKV_SKIP;
+    demux->remaining = demux->blockRemaining;
+    demux->blockRemaining = 0;
+  }
+
+  return used;
+}
+
+static size_t readNALLength(struct mkvDemuxer *demux, const BYTE *data,
+                            size_t length, int64_t offset) {
+  size_t limit = length < demux->blockRemaining ? length : demux->blockRemaining;
+  size_t needed = demux->nalLengthSize;
+  size_t used;
+  uint64_t nalLength;
+
+  if (demux->blockRemaining == 0) {
+    demux->state = MKV_ELEMENT;
+    return 0;
+  }
+
+  used = gatherHeader(demux, data, limit, needed);
+  demux->blockRemaining -= used;
+  if (demux->headerLength < needed) {
+    if (demux->blockRemaining == 0) {
+      demux->headerLength = 0;
+      demux->state = MKV_ELEMENT;
+    }
+    return used;
+  }
+
+  nalLength = readUInt(demux->header, needed);
+  demux->headerLength = 0;
+
+  if (nalLength > demux->blockRemaining) {
+    // Broken block, skip the rest of it.
+    demux->state = MKV_SKIP;
+    demux->remaining = demux->blockRemaining;
+    demux->blockRemaining = 0;
+    return used;
+  }
+
+  demux->state = nalLength > 0 ? MKV_NAL : MKV_NAL_LENGTH;
+  demux->remaining = nalLength;
+  demux->blockRemaining -= nalLength;
+  demux->nalOffset = offset + used;
+
+  return used;
+}
+
+/*
+ * Feeds the next 'length' bytes of the file to the demuxer.
+ * 'offset' is the file offset of 'data[0]'.
+ * Returns non-zero once the NAL parser has stopped.
+ */
+int feedMKVDemuxer(struct mkvDemuxer *demux, const BYTE *data, size_t length,
+                   int64_t offset) {
+  size_t x = 0;
+  size_t copySize;
+
+  while (x < length &&
+         (demux->parser == NULL || !demux->parser->stopped)) {
+    switch (demux->state) {
+    case MKV_ELEMENT:
+      x += readElement(demux, data + x, length - x, offset + x);
+      break;
+    case MKV_SKIP:
+      x += skipBytes(demux, length - x, MKV_ELEMENT);
+      break;
+    case MKV_BLOCK_HEADER:
+      x += readBlockHeader(demux, data + x, length - x);
+      break;
+    case MKV_NAL_LENGTH:
+      x += readNALLength(demux, data + x, length - x, offset + x);
+      break;
+    case MKV_NAL:
+      if ((data[x] & NAL_HEADER_MASK) == NAL_HEADER_SEI &&
+          demux->remaining <= MAX_SEI_SIZE) {
+        demux->state = MKV_SEI;
+        demux->bufferLength = 0;
+      } else {
+        demux->state = MKV_SKIP_NAL;
+      }
+      break;
+    case MKV_SKIP_NAL:
+      x += skipBytes(demux, length - x, MKV_NAL_LENGTH);
+      break;
+    case MKV_TRACK_ENTRY:
+    case MKV_SEI:
+      copySize = length - x < demux->remaining ? length - x : demux->remaining;
+      memcpy(demux->buffer + demux->bufferLength, data + x, copySize);
+      demux->bufferLength += copySize;
+      demux->remaining -= copySize;
+      x += copySize;
+
+      if (demux->remaining > 0) {
+        break;
+      }
+      if (demux->state == MKV_SEI) {
+        parseNAL(demux->parser, demux->buffer, demux->bufferLength,
+                 demux->nalOffset);
+        demux->state = MKV_NAL_LENGTH;
+      } else {
+        parseTrackEntry(demux, demux->buffer, demux->bufferLength);
+        demux->state = MKV_ELEMENT;
+      }
+      break;
+    }
+  }
+
+  return demux->parser != NULL && demux->parser->stopped;
+}
+
+const BYTE *findMKVCluster(const BYTE *data, size_t length) {
+  const BYTE clusterID[4] = {0x1F, 0x43, 0xB6, 0x75};
+  size_t pos = 0;
+  size_t last;
+  const BYTE *match;
+  int sizeLength;
+
+  if (length < MKV_CLUSTER_HEADER_SIZE) {
+    return NULL;
+  }
+  last = length - MKV_CLUSTER_HEADER_SIZE; // Last position with room to check.
+
+  while (pos <= last) {
+    match = (const BYTE *)searchNative(data + pos, last - pos + 4, clusterID, 4);
+    if (match == NULL) {
+      return NULL;
+    }
+
+    sizeLength = vintLength(match[4]);
+    if (sizeLength > 0 && match[4 + sizeLength] == MKV_ID_TIMESTAMP) {
+      return match;
+    }
+    pos = match - data + 1;
+  }
+
+  return NULL;
+}
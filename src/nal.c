@@ -0,0 +1,406 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nal.h"
+#include "scanner.h"
+#include "util.h"
+
+// Just enough of an Exp-Golomb bit reader for the MVC nesting SEI header.
+struct bitReader {
+  const BYTE *data;
+  size_t length;
+  size_t bit;
+};
+
+static unsigned int readBits(struct bitReader *reader, int count) {
+  unsigned int value = 0;
+
+  for (int x = 0; x < count; x++) {
+    value <<= 1;
+    if (reader->bit < reader->length * 8) {
+      value |= (reader->data[reader->bit / 8] >> (7 - reader->bit % 8)) & 1;
+    }
+    reader->bit++;
+  }
+
+  return value;
+}
+
+// Returns false if the prefix is too long to fit in 32 bits.
+static bool readExpGolomb(struct bitReader *reader, unsigned int *value) {
+  int leadingZeros = 0;
+
+  while (readBits(reader, 1) == 0) {
+    if (++leadingZeros > 31) {
+      return false;
+    }
+  }
+
+  *value = (1u << leadingZeros) - 1 + readBits(reader, leadingZeros);
+  return true;
+}
+
+// Checks the frame-rate and that every depth value is actually there.
+bool isValidOFMD(const BYTE *OFMD, size_t length) {
+  int frameRate;
+  int numOfPlanes;
+  int frameCount;
+
+  if (length < OFMD_HEADER_SIZE || memcmp(OFMD, "OFMD", 4) != 0) {
+    return false;
+  }
+
+  frameRate = OFMD[4] & 15;
+  numOfPlanes = OFMD[10] & 0x7F;
+  frameCount = OFMD[11] & 0x7F;
+
+  if (frameRate < 1 || frameRate > 7 || frameRate == 5) {
+    return false;
+  }
+
+  return length >= (size_t)(OFMD_HEADER_SIZE + numOfPlanes * frameCount);
+}
+
+/*
+ * Walks the sei_message()s in 'data'. An MVC scalable nesting SEI has its
+ * own sei_message()s after a short header, so this calls itself for those.
+ * Returns 1 once an OFMD has been handed to the callback.
+ */
+static int parseSEIMessages(struct nalParser *parser, const BYTE *data,
+                            size_t length, int64_t offset, bool nested) {
+  size_t pos = 0;
+
+  // Anything left after the last message is rbsp_trailing_bits.
+  while (pos + 2 <= length && !(data[pos] == 0x80 && pos + 1 == length)) {
+    size_t payloadType = 0;
+    size_t payloadSize = 0;
+
+    while (pos < length && data[pos] == 0xFF) {
+      payloadType += 255;
+      pos++;
+    }
+    if (pos >= length) {
+      break;
+    }
+    payloadType += data[pos++];
+
+    while (pos < length && data[pos] == 0xFF) {
+      payloadSize += 255;
+      pos++;
+    }
+    if (pos >= length) {
+      break;
+    }
+    payloadSize += data[pos++];
+
+    if (payloadSize > length - pos) {
+      break; // Truncated or not an SEI after all.
+    }
+
+    if (payloadType == SEI_MVC_NESTING && !nested) {
+      struct bitReader reader = {data + pos, payloadSize, 0};
+      unsigned int numViewsMinus1 = 0;
+      size_t headerSize;
+      bool valid = true;
+
+      if (readBits(&reader, 1) == 0) { // operation_point_flag
+        if (readBits(&reader, 1) == 0) { // all_view_components_in_au_flag
+          valid = readExpGolomb(&reader, &numViewsMinus1);
+          reader.bit += 10 * ((size_t)numViewsMinus1 + 1); // sei_view_id
+        }
+      } else {
+        valid = readExpGolomb(&reader, &numViewsMinus1);
+        reader.bit += 10 * ((size_t)numViewsMinus1 + 1); // sei_op_view_id
+        reader.bit += 3;                                 // sei_op_temporal_id
+      }
+
+      headerSize = (reader.bit + 7) / 8; // sei_nesting_zero_bit
+      if (valid && headerSize < payloadSize &&
+          parseSEIMessages(parser, data + pos + headerSize,
+                           payloadSize - headerSize, offset, true) == 1) {
+        return 1;
+      }
+    } else if (payloadType == SEI_USER_DATA_UNREGISTERED && payloadSize > 16) {
+      // Skip uuid_iso_iec_11578.
+      const BYTE *OFMD = data + pos + 16;
+      size_t OFMDLength = payloadSize - 16;
+
+      if (isValidOFMD(OFMD, OFMDLength)) {
+        parser->numOFMDs++;
+        if (parser->callback(parser->context, OFMD, OFMDLength, offset) != 0) {
+          parser->stopped = true;
+        }
+        return 1; // Only one OFMD per SEI.
+      }
+    }
+
+    pos += payloadSize;
+  }
+
+  return 0;
+}
+
+/*
+ * Parses a whole NAL (without its start code). Anything that isn't an SEI
+ * is ignored. 'offset' is passed on to the callback.
+ * Returns non-zero if the callback asked to stop.
+ */
+int parseNAL(struct nalParser *parser, const BYTE *nal, size_t length,
+             int64_t offset) {
+  size_t rbspLength = 0;
+  int zeros = 0;
+
+  if (length < 2 || (nal[0] & NAL_HEADER_MASK) != NAL_HEADER_SEI ||
+      length > MAX_SEI_SIZE) {
+    return parser->stopped;
+  }
+  parser->numSEIs++;
+
+  // Remove the emulation prevention bytes. ('00 00 03' -> '00 00')
+  for (size_t x = 1; x < length; x++) {
+    if (zeros >= 2 && nal[x] == 0x03) {
+      zeros = 0;
+      continue;
+    }
+    zeros = nal[x] == 0 ? zeros + 1 : 0;
+    parser->rbsp[rbspLength++] = nal[x];
+  }
+
+  parseSEIMessages(parser, parser->rbsp, rbspLength, offset, false);
+
+  return parser->stopped;
+}
+
+int initNALParser(struct nalParser *parser, OFMDCallback callback,
+                  void *context) {
+  memset(parser, 0, sizeof(struct nalParser));
+  parser->callback = callback;
+  parser->context = context;
+  parser->state = NAL_SCAN;
+  parser->stopOffset = INT64_MAX;
+
+  parser->nal = (BYTE *)malloc(MAX_SEI_SIZE);
+  parser->rbsp = (BYTE *)malloc(MAX_SEI_SIZE);
+  if (parser->nal == NULL || parser->rbsp == NULL) {
+    perror("malloc()");
+    freeNALParser(parser);
+    return -1;
+  }
+
+  return 0;
+}
+
+void freeNALParser(struct nalParser *parser) {
+  free(parser->nal);
+  free(parser->rbsp);
+  parser->nal = NULL;
+  parser->rbsp = NULL;
+}
+
+// True if the parser isn't in the middle of a NAL or a start code.
+bool nalParserIdle(struct nalParser *parser) {
+  return parser->state == NAL_SCAN && parser->zeroRun == 0;
+}
+
+/*
+ * Forgets the NAL or start code that was cut off, so the next chunk can be
+ * from anywhere in the file. The counters and 'stopOffset' are kept.
+ */
+void resetNALParser(struct nalParser *parser) {
+  parser->state = NAL_SCAN;
+  parser->zeroRun = 0;
+  parser->stopped = false;
+  parser->overflow = false;
+  parser->nalLength = 0;
+}
+
+static void appendNAL(struct nalParser *parser, const BYTE *data,
+                      size_t length) {
+  if (parser->overflow || length > MAX_SEI_SIZE - parser->nalLength) {
+    parser->overflow = true;
+    return;
+  }
+
+  memcpy(parser->nal + parser->nalLength, data, length);
+  parser->nalLength += length;
+}
+
+// The SEI ended. Its trailing zero bytes belong to the next start code.
+static void finishSEI(struct nalParser *parser) {
+  while (parser->nalLength > 0 && parser->nal[parser->nalLength - 1] == 0) {
+    parser->nalLength--;
+  }
+
+  if (!parser->overflow) {
+    parseNAL(parser, parser->nal, parser->nalLength, parser->startCodeOffset);
+  }
+
+  parser->nalLength = 0;
+  parser->overflow = false;
+  parser->state = NAL_SCAN;
+}
+
+// A start code was found at 'offset'. Returns true if the parser should stop.
+static bool startCode(struct nalParser *parser, int64_t offset) {
+  if (parser->state == NAL_SEI) {
+    finishSEI(parser);
+  }
+
+  if (parser->stopped || offset >= parser->stopOffset) {
+    parser->stopped = true;
+    return true;
+  }
+
+  parser->startCodeOffset = offset;
+  parser->state = NAL_HEADER;
+  return false;
+}
+
+/*
+ * Feeds the next 'length' bytes of the stream to the parser.
+ * 'offset' is the file offset of 'data[0]', which doesn't have to follow on
+ * from the previous chunk. (e.g. the payloads of transport stream packets)
+ * Returns non-zero once the parser has stopped.
+ */
+int feedNALParser(struct nalParser *parser, const BYTE *data, size_t length,
+                  int64_t offset) {
+  const BYTE *match;
+  size_t segment = 0; // Start of the SEI bytes that haven't been copied yet.
+  size_t searchFrom = 0;
+  size_t x = 0;
+
+  if (parser->stopped) {
+    return 1;
+  }
+
+  // Start codes which started in the previous chunk.
+  if (parser->state != NAL_HEADER && length > 0) {
+    if (parser->zeroRun >= 2 && data[0] == 1) {
+      if (startCode(parser, parser->zeroOffsets[0])) {
+        return 1;
+      }
+      x = 1;
+    } else if (parser->zeroRun >= 1 && length >= 2 && data[0] == 0 &&
+               data[1] == 1) {
+      if (startCode(parser, parser->zeroOffsets[1])) {
+        return 1;
+      }
+      x = 2;
+    }
+  }
+
+  while (x < length) {
+    if (parser->state == NAL_HEADER) {
+      if ((data[x] & NAL_HEADER_MASK) == NAL_HEADER_SEI) {
+        parser->state = NAL_SEI;
+        parser->nalLength = 0;
+        parser->overflow = false;
+        segment = x;
+      } else {
+        parser->state = NAL_SCAN;
+      }
+      x++;
+      continue;
+    }
+
+    searchFrom = x;
+    if (parser->state == NAL_SCAN) {
+      // Skip everything that isn't an SEI.
+      match = findStartCode(data + x, length - x, NAL_HEADER_SEI,
+                            NAL_HEADER_MASK, 0, 0);
+    } else {
+      // The SEI ends at the next start code, whatever it is.
+      match = findStartCode(data + x, length - x, 0, 0, 0, 0);
+    }
+
+    if (match == NULL) {
+      break;
+    }
+
+    if (parser->state == NAL_SEI) {
+      appendNAL(parser, data + segment, match - (data + segment));
+    }
+    if (startCode(parser, offset + (match - data))) {
+      return 1;
+    }
+    x = match - data + 3;
+  }
+
+  if (x >= length) {
+    searchFrom = length;
+  }
+
+  if (parser->state == NAL_SEI) {
+    appendNAL(parser, data + segment, length - segment);
+  }
+
+  // A start code right at the end, with its NAL header in the next chunk.
+  if (parser->state != NAL_HEADER && length >= 3 && length - 3 >= searchFrom &&
+      data[length - 3] == 0 && data[length - 2] == 0 &&
+      data[length - 1] == 1) {
+    if (parser->state == NAL_SEI) {
+      parser->nalLength -= parser->nalLength >= 3 ? 3 : parser->nalLength;
+    }
+    if (startCode(parser, offset + length - 3)) {
+      return 1;
+    }
+    parser->zeroRun = 0;
+    return 0;
+  }
+
+  // Remember where the trailing zeros are.
+  if (length > 2) {
+    parser->zeroRun = 0;
+  }
+  for (size_t y = length > 2 ? length - 2 : 0; y < length; y++) {
+    if (data[y] == 0) {
+      parser->zeroOffsets[0] = parser->zeroOffsets[1];
+      parser->zeroOffsets[1] = offset + y;
+      parser->zeroRun = parser->zeroRun < 2 ? parser->zeroRun + 1 : 2;
+    } else {
+      parser->zeroRun = 0;
+    }
+  }
+  if (parser->state == NAL_HEADER) {
+    parser->zeroRun = 0;
+  }
+
+  return parser->stopped;
+}
+
+// End of the stream. Finishes the last SEI if there's one.
+int flushNALParser(struct nalParser *parser) {
+  if (parser->state == NAL_SEI && !parser->stopped) {
+    finishSEI(parser);
+  }
+  parser->state = NAL_SCAN;
+  parser->zeroRun = 0;
+
+  return parser->stopped;
+}
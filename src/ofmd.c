@@ -0,0 +1,132 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ofmd.h"
+#include "util.h"
+
+void initOFMDStore(struct OFMDstore *store) {
+  store->chunks = NULL;
+  store->entries = NULL;
+  store->numOFMDs = 0;
+  store->capacity = 0;
+}
+
+static int growEntries(struct OFMDstore *store, int needed) {
+  struct OFMDentry *entries;
+  int capacity = store->capacity > 0 ? store->capacity : 256;
+
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+  if (capacity == store->capacity) {
+    return 0;
+  }
+
+  entries = (struct OFMDentry *)realloc(store->entries,
+                                        sizeof(struct OFMDentry) * capacity);
+  if (entries == NULL) {
+    perror("realloc()");
+    return -1;
+  }
+  store->entries = entries;
+  store->capacity = capacity;
+
+  return 0;
+}
+
+int addOFMDToStore(struct OFMDstore *store, const BYTE *OFMD, size_t length,
+                   int64_t offset) {
+  struct OFMDchunk *chunk = store->chunks;
+  struct OFMDentry *entry;
+
+  if (growEntries(store, store->numOFMDs + 1) == -1) {
+    return -1;
+  }
+
+  if (chunk == NULL || chunk->size - chunk->used < length) {
+    size_t size = length > OFMD_CHUNK_SIZE ? length : OFMD_CHUNK_SIZE;
+
+    chunk = (struct OFMDchunk *)malloc(sizeof(struct OFMDchunk) + size);
+    if (chunk == NULL) {
+      perror("malloc()");
+      return -1;
+    }
+    chunk->next = store->chunks;
+    chunk->used = 0;
+    chunk->size = size;
+    store->chunks = chunk;
+  }
+
+  memcpy(chunk->data + chunk->used, OFMD, length);
+  entry = &store->entries[store->numOFMDs++];
+  entry->OFMD = chunk->data + chunk->used;
+  entry->length = (uint32_t)length;
+  entry->offset = offset;
+  chunk->used += length;
+
+  return 0;
+}
+
+int moveOFMDStore(struct OFMDstore *dest, struct OFMDstore *src) {
+  struct OFMDchunk *last = src->chunks;
+
+  if (src->numOFMDs == 0) {
+    freeOFMDStore(src);
+    return 0;
+  }
+  if (growEntries(dest, dest->numOFMDs + src->numOFMDs) == -1) {
+    return -1;
+  }
+
+  memcpy(dest->entries + dest->numOFMDs, src->entries,
+         sizeof(struct OFMDentry) * src->numOFMDs);
+  dest->numOFMDs += src->numOFMDs;
+
+  // Put the chunks of 'src' in front, since they're newer.
+  while (last->next != NULL) {
+    last = last->next;
+  }
+  last->next = dest->chunks;
+  dest->chunks = src->chunks;
+
+  free(src->entries);
+  initOFMDStore(src);
+
+  return 0;
+}
+
+void freeOFMDStore(struct OFMDstore *store) {
+  struct OFMDchunk *chunk = store->chunks;
+
+  while (chunk != NULL) {
+    struct OFMDchunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(store->entries);
+  initOFMDStore(store);
+}
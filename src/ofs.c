@@ -0,0 +1,350 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE // fallocate()
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "3dplanes.h"
+#include "ofs.h"
+#include "util.h"
+
+#define COPY_BUFFER_SIZE (1024 * 64)
+
+void makeOFSHeader(BYTE *header, const BYTE *GUID, BYTE frameRate,
+                   int totalFrames) {
+  BYTE signiture[8] = {0x89, 0x4f, 0x46, 0x53, 0x0d, 0x0a, 0x1a, 0x0a};
+  BYTE version[4] = {0x30, 0x31, 0x30, 0x30};
+  // number_of_rolls, reserved, and marker_bits
+  BYTE rollsAndReserved[4] = {0x01, 0x00, 0x00, 0x00};
+  BYTE timecode[4] = {0x00, 0x00, 0x00, 0x00}; // Assume 0 for now.
+
+  memcpy(header, signiture, 8);
+  memcpy(header + 8, version, 4);
+  memcpy(header + 12, GUID, 16);
+  header[28] = frameRate;
+  memcpy(header + 29, rollsAndReserved, 4);
+  memcpy(header + 33, timecode, 4);
+
+  header[OFS_FRAMES_OFFSET] = (totalFrames >> 24) % 256;
+  header[OFS_FRAMES_OFFSET + 1] = (totalFrames >> 16) % 256;
+  header[OFS_FRAMES_OFFSET + 2] = (totalFrames >> 8) % 256;
+  header[OFS_FRAMES_OFFSET + 3] = totalFrames % 256;
+}
+
+/*
+ * Fills the first 15 bytes of 'GUID' with random bytes. (The last one is the
+ * plane number.) Without /dev/urandom the time and a counter are hashed, so
+ * titles extracted in the same second still get different GUIDs.
+ */
+void makeOFSGUID(BYTE *GUID) {
+  static uint64_t counter;
+  FILE *random = fopen("/dev/urandom", "rb");
+  BYTE seed[8];
+  uint64_t hash = HASH_SEED;
+
+  if (random != NULL) {
+    size_t length = fread(GUID, 1, 15, random);
+
+    fclose(random);
+    if (length == 15) {
+      return;
+    }
+  }
+
+  writeLE(seed, (uint64_t)time(NULL), 8);
+  hash = hashBytes(hash, seed, 8);
+  writeLE(seed, (uint64_t)clock(), 8);
+  hash = hashBytes(hash, seed, 8);
+  writeLE(seed, __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED), 8);
+  hash = hashBytes(hash, seed, 8);
+  writeLE(seed, (uint64_t)(uintptr_t)GUID, 8);
+  for (int x = 0; x < 15; x++) {
+    hash = hashBytes(hash, seed, 8);
+    GUID[x] = (BYTE)(hash >> 56);
+  }
+}
+
+char *makeOFSPath(const char *outFolder, int plane) {
+  size_t size = strlen(outFolder) + 32;
+  char *path = (char *)malloc(size);
+
+  if (path == NULL) {
+    perror("malloc()");
+    return NULL;
+  }
+  snprintf(path, size, "%s" PATH_SEPARATOR "3D-Plane-%02d.ofs", outFolder,
+           plane);
+  return path;
+}
+
+#ifndef _WIN32
+// Writes every byte of 'iov' to 'fd', however many calls it takes.
+static int writevAll(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t result = writev(fd, iov, count);
+
+    if (result == -1 && errno == EINTR) {
+      continue;
+    } else if (result <= 0) {
+      return -1;
+    }
+
+    // Skip what's been written.
+    while (count > 0 && (size_t)result >= iov->iov_len) {
+      result -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (BYTE *)iov->iov_base + result;
+      iov->iov_len -= result;
+    }
+  }
+
+  return 0;
+}
+#endif
+
+/*
+ * Writes the header and the depth values of a plane to 'path' in one go,
+ * without copying them into a buffer first. The file is allocated up front
+ * where the file system can do that.
+ */
+int writeOFSFile(const char *path, const BYTE *header, const BYTE *depths,
+                 size_t count) {
+#ifdef _WIN32
+  FILE *file = fopen(path, "wb");
+
+  if (file == NULL) {
+    perror("fopen()");
+    printf("Failed to open: %s\n", path);
+    return -1;
+  }
+  if (fwrite(header, 1, OFS_HEADER_SIZE, file) != OFS_HEADER_SIZE ||
+      fwrite(depths, 1, count, file) != count) {
+    perror("fwrite()");
+    fclose(file);
+    return -1;
+  }
+  if (fclose(file) != 0) {
+    perror("fclose()");
+    return -1;
+  }
+
+  return 0;
+#else
+  struct iovec iov[2];
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+  if (fd == -1) {
+    perror("open()");
+    printf("Failed to open: %s\n", path);
+    return -1;
+  }
+
+#ifdef __linux__
+  // Not every file system has it, and a FIFO never does.
+  fallocate(fd, 0, 0, OFS_HEADER_SIZE + count);
+#endif
+
+  iov[0].iov_base = (void *)header;
+  iov[0].iov_len = OFS_HEADER_SIZE;
+  iov[1].iov_base = (void *)depths;
+  iov[1].iov_len = count;
+  if (writevAll(fd, iov, 2) == -1) {
+    perror("writev()");
+    close(fd);
+    return -1;
+  }
+  if (close(fd) != 0) {
+    perror("close()");
+    return -1;
+  }
+
+  return 0;
+#endif
+}
+
+int openOFSStream(struct ofsStream *stream, const char *outFolder,
+                  int numOfPlanes, BYTE frameRate) {
+  BYTE header[OFS_HEADER_SIZE];
+
+  memset(stream, 0, sizeof(struct ofsStream));
+  stream->numOfPlanes = numOfPlanes;
+  stream->frameRate = frameRate;
+
+  makeOFSGUID(stream->GUID);
+
+  for (int plane = 0; plane < numOfPlanes; plane++) {
+    stream->paths[plane] = makeOFSPath(outFolder, plane);
+    if (stream->paths[plane] == NULL) {
+      closeOFSStream(stream, NULL);
+      return -1;
+    }
+    stream->files[plane] = fopen(stream->paths[plane], "wb");
+    if (stream->files[plane] == NULL) {
+      perror("fopen()");
+      printf("Failed to open: %s\n", stream->paths[plane]);
+      closeOFSStream(stream, NULL);
+      return -1;
+    }
+
+    // Keep the depth values aside until the frame count is known.
+    stream->canSeek[plane] = fseeko(stream->files[plane], 0, SEEK_SET) == 0;
+    if (!stream->canSeek[plane]) {
+      stream->temps[plane] = tmpfile();
+      if (stream->temps[plane] == NULL) {
+        perror("tmpfile()");
+        closeOFSStream(stream, NULL);
+        return -1;
+      }
+      continue;
+    }
+
+    stream->GUID[15] = (BYTE)plane;
+    makeOFSHeader(header, stream->GUID, frameRate, 0);
+    if (fwrite(header, 1, OFS_HEADER_SIZE, stream->files[plane]) !=
+        OFS_HEADER_SIZE) {
+      perror("fwrite()");
+      closeOFSStream(stream, NULL);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int writeOFSDepths(struct ofsStream *stream, int plane, const BYTE *depths,
+                   size_t count) {
+  FILE *file = stream->temps[plane] != NULL ? stream->temps[plane]
+                                            : stream->files[plane];
+
+  if (fwrite(depths, 1, count, file) != count) {
+    perror("fwrite()");
+    printf("Failed to write: %s\n", stream->paths[plane]);
+    return -1;
+  }
+  stream->numFrames[plane] += count;
+
+  return 0;
+}
+
+// Writes the header and copies the depth values from the temp file.
+static int finishFromTemp(struct ofsStream *stream, int plane) {
+  BYTE header[OFS_HEADER_SIZE];
+  BYTE *buffer;
+  size_t size;
+  int result = 0;
+
+  stream->GUID[15] = (BYTE)plane;
+  makeOFSHeader(header, stream->GUID, stream->frameRate,
+                stream->numFrames[plane]);
+  if (fwrite(header, 1, OFS_HEADER_SIZE, stream->files[plane]) !=
+      OFS_HEADER_SIZE) {
+    return -1;
+  }
+
+  buffer = (BYTE *)malloc(COPY_BUFFER_SIZE);
+  if (buffer == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+  rewind(stream->temps[plane]);
+  while ((size = fread(buffer, 1, COPY_BUFFER_SIZE, stream->temps[plane])) >
+         0) {
+    if (fwrite(buffer, 1, size, stream->files[plane]) != size) {
+      result = -1;
+      break;
+    }
+  }
+  free(buffer);
+
+  return result;
+}
+
+// Patches 'number_of_frames' in the header that was written first.
+static int finishInPlace(struct ofsStream *stream, int plane) {
+  BYTE header[OFS_HEADER_SIZE];
+
+  stream->GUID[15] = (BYTE)plane;
+  makeOFSHeader(header, stream->GUID, stream->frameRate,
+                stream->numFrames[plane]);
+  if (fseeko(stream->files[plane], OFS_FRAMES_OFFSET, SEEK_SET) != 0 ||
+      fwrite(header + OFS_FRAMES_OFFSET, 1, 4, stream->files[plane]) != 4) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int closeOFSStream(struct ofsStream *stream, const int *validPlanes) {
+  int result = 0;
+
+  for (int plane = 0; plane < stream->numOfPlanes; plane++) {
+    bool valid = validPlanes != NULL && validPlanes[plane] == 1;
+
+    if (stream->files[plane] != NULL && valid) {
+      int finished = stream->temps[plane] != NULL
+                         ? finishFromTemp(stream, plane)
+                         : finishInPlace(stream, plane);
+      if (finished == -1) {
+        perror("fwrite()");
+        printf("Failed to write: %s\n", stream->paths[plane]);
+        result = -1;
+      }
+    }
+
+    if (stream->files[plane] != NULL && fclose(stream->files[plane]) != 0) {
+      perror("fclose()");
+      result = -1;
+    }
+    if (stream->temps[plane] != NULL) {
+      fclose(stream->temps[plane]);
+    }
+
+    // Empty planes don't get a file. (A FIFO is left alone.)
+    if (stream->paths[plane] != NULL && !valid && stream->canSeek[plane]) {
+      remove(stream->paths[plane]);
+    }
+    free(stream->paths[plane]);
+
+    stream->files[plane] = NULL;
+    stream->temps[plane] = NULL;
+    stream->paths[plane] = NULL;
+  }
+
+  return result;
+}
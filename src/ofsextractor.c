@@ -0,0 +1,345 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "3dplanes.h"
+#include "mkv.h"
+#include "nal.h"
+#include "ofmd.h"
+#include "ofs.h"
+#include "ofsextractor.h"
+#include "ts.h"
+#include "util.h"
+
+#if OFS_MAX_PLANES != MAXPLANES
+#error "OFS_MAX_PLANES has to match MAXPLANES"
+#endif
+
+struct ofsExtractor {
+  struct ofsConfig config;
+  enum ofsFormat format; // OFS_FORMAT_AUTO until 'startStream'.
+  bool started;
+  bool finished;
+  int result;
+
+  // The start of the stream, kept until the format is known.
+  BYTE probe[TS_PROBE_SIZE];
+  size_t probeLength;
+
+  struct nalParser parser;
+  struct tsDemuxer ts;
+  struct mkvDemuxer mkv;
+  bool mkvReady;
+  int64_t offset; // Of the next byte fed to the demuxer.
+  int64_t skip;   // Bytes to drop before the next byte is fed.
+
+  struct OFMDstore OFMDs; // Only with 'keepPlanes'.
+  int numOFMDs;
+  int numOfPlanes;
+  int frameRate;
+  int totalFrames;
+};
+
+// 'OFMDCallback' which hands the OFMD to the user's callbacks.
+static int extractOFMD(void *context, const BYTE *OFMD, size_t length,
+                       int64_t offset) {
+  struct ofsExtractor *ofs = (struct ofsExtractor *)context;
+  const struct ofsConfig *config = &ofs->config;
+  int frameCount = OFMD[11] & 127;
+  int planesInOFMD = OFMD[10] & 0x7F;
+  bool stop = false;
+
+  // The first OFMD decides, like in 'getPlanesFromOFMDs'.
+  if (ofs->numOFMDs == 0) {
+    ofs->numOfPlanes = planesInOFMD > MAXPLANES ? MAXPLANES : planesInOFMD;
+    ofs->frameRate = OFMD[4] & 15;
+  }
+
+  if (config->keepPlanes &&
+      addOFMDToStore(&ofs->OFMDs, OFMD, length, offset) == -1) {
+    ofs->result = -1;
+    return 1;
+  }
+
+  if (config->onOFMD != NULL &&
+      config->onOFMD(config->user, OFMD, length, offset) != 0) {
+    stop = true;
+  }
+
+  if (config->onDepths != NULL && !stop) {
+    const BYTE *depths[MAXPLANES];
+    BYTE undefined[127];
+
+    memset(undefined, 0x80, frameCount);
+    for (int plane = 0; plane < ofs->numOfPlanes; plane++) {
+      depths[plane] = plane < planesInOFMD ? OFMD + 14 + (plane * frameCount)
+                                           : undefined;
+    }
+    if (config->onDepths(config->user, depths, ofs->numOfPlanes, frameCount,
+                         ofs->totalFrames) != 0) {
+      stop = true;
+    }
+  }
+
+  ofs->totalFrames += frameCount;
+  ofs->numOFMDs++;
+  if (stop) {
+    ofs->result = 1;
+    return 1;
+  }
+
+  return 0;
+}
+
+struct ofsExtractor *ofsCreate(const struct ofsConfig *config) {
+  struct ofsExtractor *ofs;
+
+  if (config == NULL) {
+    return NULL;
+  }
+  ofs = (struct ofsExtractor *)calloc(1, sizeof(struct ofsExtractor));
+  if (ofs == NULL) {
+    return NULL;
+  }
+
+  ofs->config = *config;
+  ofs->format = config->format;
+  initOFMDStore(&ofs->OFMDs);
+  if (initNALParser(&ofs->parser, extractOFMD, ofs) == -1) {
+    free(ofs);
+    return NULL;
+  }
+
+  return ofs;
+}
+
+// Sends 'data' through the demuxer, minus anything it asked to skip.
+static void feedStream(struct ofsExtractor *ofs, const BYTE *data,
+                       size_t length) {
+  if ((int64_t)length <= ofs->skip) {
+    ofs->skip -= length;
+    ofs->offset += length;
+    return;
+  }
+  data += ofs->skip;
+  length -= ofs->skip;
+  ofs->offset += ofs->skip;
+  ofs->skip = 0;
+
+  if (ofs->format == OFS_FORMAT_TS) {
+    feedTSDemuxer(&ofs->ts, data, length, ofs->offset);
+  } else if (ofs->format == OFS_FORMAT_MKV) {
+    feedMKVDemuxer(&ofs->mkv, data, length, ofs->offset);
+    ofs->skip = takeMKVSkip(&ofs->mkv);
+  } else {
+    feedNALParser(&ofs->parser, data, length, ofs->offset);
+  }
+  ofs->offset += length;
+}
+
+// Works out the format from the probe and feeds it through.
+static int startStream(struct ofsExtractor *ofs) {
+  size_t firstPacket = 0;
+  int packetSize = 0;
+
+  ofs->started = true;
+  if (ofs->format == OFS_FORMAT_AUTO || ofs->format == OFS_FORMAT_TS) {
+    packetSize = probeTS(ofs->probe, ofs->probeLength, &firstPacket);
+  }
+
+  if (ofs->format == OFS_FORMAT_AUTO) {
+    if (ofs->probeLength >= 4 && memcmp(ofs->probe, EBML_MAGIC, 4) == 0) {
+      ofs->format = OFS_FORMAT_MKV;
+    } else if (packetSize > 0) {
+      ofs->format = OFS_FORMAT_TS;
+    } else {
+      ofs->format = OFS_FORMAT_ANNEXB;
+    }
+  }
+
+  if (ofs->format == OFS_FORMAT_TS) {
+    initTSDemuxer(&ofs->ts, &ofs->parser,
+                  packetSize > 0 ? packetSize : TS_PACKET_SIZE);
+    ofs->skip = firstPacket;
+  } else if (ofs->format == OFS_FORMAT_MKV) {
+    if (initMKVDemuxer(&ofs->mkv, &ofs->parser) == -1) {
+      ofs->result = -1;
+      return -1;
+    }
+    ofs->mkvReady = true;
+  }
+
+  feedStream(ofs, ofs->probe, ofs->probeLength);
+  return ofs->result;
+}
+
+int ofsFeed(struct ofsExtractor *ofs, const void *data, size_t length) {
+  const BYTE *bytes = (const BYTE *)data;
+
+  if (ofs->result != 0 || ofs->finished) {
+    return ofs->result;
+  }
+
+  // Annex B and MKV don't need a probe to start.
+  if (!ofs->started && (ofs->format == OFS_FORMAT_ANNEXB ||
+                        ofs->format == OFS_FORMAT_MKV)) {
+    startStream(ofs);
+  }
+
+  if (!ofs->started) {
+    size_t copySize = TS_PROBE_SIZE - ofs->probeLength;
+
+    if (copySize > length) {
+      copySize = length;
+    }
+    memcpy(ofs->probe + ofs->probeLength, bytes, copySize);
+    ofs->probeLength += copySize;
+    bytes += copySize;
+    length -= copySize;
+    if (ofs->probeLength < TS_PROBE_SIZE || startStream(ofs) != 0) {
+      return ofs->result;
+    }
+  }
+
+  if (length > 0) {
+    feedStream(ofs, bytes, length);
+  }
+
+  return ofs->result;
+}
+
+int ofsFinish(struct ofsExtractor *ofs) {
+  if (ofs->finished) {
+    return ofs->result;
+  }
+
+  if (!ofs->started && ofs->result == 0) {
+    startStream(ofs);
+  }
+  if (ofs->result == 0) {
+    flushNALParser(&ofs->parser);
+  }
+  ofs->finished = true;
+
+  return ofs->result;
+}
+
+void ofsGetInfo(const struct ofsExtractor *ofs, struct ofsInfo *info) {
+  info->format = ofs->started ? ofs->format : OFS_FORMAT_AUTO;
+  info->numOFMDs = ofs->numOFMDs;
+  info->numOfPlanes = ofs->numOfPlanes;
+  info->frameRate = ofs->frameRate;
+  info->totalFrames = ofs->totalFrames;
+  info->bytesFed = ofs->offset + (ofs->started ? 0 : ofs->probeLength);
+}
+
+int ofsMakeFiles(const struct ofsExtractor *ofs, int frameRate,
+                 bool dropFrame, const uint8_t *GUID,
+                 struct ofsFile **files) {
+  struct OFMDdata OFMDdata;
+  BYTE fileGUID[16];
+  BYTE frameRateValue;
+  int numFiles = 0;
+  bool failed = false;
+
+  *files = NULL;
+  if (!ofs->config.keepPlanes) {
+    return -1;
+  }
+  if (ofs->OFMDs.numOFMDs == 0) {
+    return 0;
+  }
+
+  if (getPlanesFromOFMDs(&ofs->OFMDs, 1, &OFMDdata) == -1) {
+    return -1;
+  }
+  if (OFMDdata.numOfPlanes == 0) {
+    freePlanes(&OFMDdata);
+    return 0;
+  }
+  frameRateValue = ((frameRate > 0 ? frameRate : OFMDdata.frameRate) * 16) +
+                   (dropFrame ? 1 : 0);
+  if (GUID != NULL) {
+    memcpy(fileGUID, GUID, 15);
+  } else {
+    makeOFSGUID(fileGUID);
+  }
+
+  *files = (struct ofsFile *)calloc(OFMDdata.numOfPlanes,
+                                    sizeof(struct ofsFile));
+  failed = *files == NULL;
+  for (int plane = 0; plane < OFMDdata.numOfPlanes && !failed; plane++) {
+    struct ofsFile *file = &(*files)[numFiles];
+
+    if (!hasDefinedDepth(OFMDdata.planes[plane], OFMDdata.totalFrames)) {
+      continue;
+    }
+
+    file->plane = plane;
+    file->size = OFS_HEADER_SIZE + OFMDdata.totalFrames;
+    file->data = (uint8_t *)malloc(file->size);
+    if (file->data == NULL) {
+      ofsFreeFiles(*files, numFiles);
+      *files = NULL;
+      failed = true;
+      break;
+    }
+    fileGUID[15] = (BYTE)plane;
+    makeOFSHeader(file->data, fileGUID, frameRateValue, OFMDdata.totalFrames);
+    memcpy(file->data + OFS_HEADER_SIZE, OFMDdata.planes[plane],
+           OFMDdata.totalFrames);
+    numFiles++;
+  }
+  freePlanes(&OFMDdata);
+
+  return failed ? -1 : numFiles;
+}
+
+void ofsFreeFiles(struct ofsFile *files, int numFiles) {
+  if (files == NULL) {
+    return;
+  }
+
+  for (int x = 0; x < numFiles; x++) {
+    free(files[x].data);
+  }
+  free(files);
+}
+
+void ofsDestroy(struct ofsExtractor *ofs) {
+  if (ofs == NULL) {
+    return;
+  }
+
+  freeNALParser(&ofs->parser);
+  if (ofs->mkvReady) {
+    freeMKVDemuxer(&ofs->mkv);
+  }
+  freeOFMDStore(&ofs->OFMDs);
+  free(ofs);
+}
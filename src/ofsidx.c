@@ -0,0 +1,228 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "ofsidx.h"
+#include "util.h"
+
+/*
+ * The index is little-endian:
+ *
+ *   magic[8], numFiles u32, numEntries u32
+ *   numFiles * (size i64, mtime i64, hash u64, entries u32)
+ *   numEntries * (offset i64, length u32, frameCount u8)
+ *   FNV-1a u64 of everything before it
+ */
+#define MAGIC_SIZE (8)
+#define HEADER_SIZE (MAGIC_SIZE + 8)
+#define KEY_SIZE (28)
+#define ENTRY_SIZE (13)
+#define MAX_INDEX_SIZE (1024 * 1024 * 256) // Way more GOPs than any title.
+
+int makeIndexKey(const char *filename, struct indexKey *key) {
+  BYTE sample[OFSIDX_SAMPLE_SIZE];
+  BYTE size[8];
+  struct stat info;
+  FILE *filePtr;
+  int64_t last;
+
+  if (strcmp(filename, "-") == 0 || stat(filename, &info) != 0 ||
+      (info.st_mode & S_IFMT) != S_IFREG) {
+    return -1;
+  }
+  key->size = info.st_size;
+  key->mtime = info.st_mtime;
+
+  filePtr = fopen(filename, "rb");
+  if (filePtr == NULL) {
+    return -1;
+  }
+
+  // The first and last block are always in there.
+  writeLE(size, key->size, 8);
+  key->hash = hashBytes(HASH_SEED, size, 8);
+  last = key->size > OFSIDX_SAMPLE_SIZE ? key->size - OFSIDX_SAMPLE_SIZE : 0;
+  for (int x = 0; x < OFSIDX_SAMPLES; x++) {
+    int64_t offset = last * x / (OFSIDX_SAMPLES - 1);
+    size_t length;
+
+    if (fseeko(filePtr, offset, SEEK_SET) != 0) {
+      fclose(filePtr);
+      return -1;
+    }
+    length = fread(sample, 1, OFSIDX_SAMPLE_SIZE, filePtr);
+    key->hash = hashBytes(key->hash, sample, length);
+  }
+  fclose(filePtr);
+
+  return 0;
+}
+
+int readIndex(const char *path, struct ofsIndex *index) {
+  FILE *filePtr = fopen(path, "rb");
+  BYTE *data;
+  const BYTE *pos;
+  int64_t size;
+  int64_t total = 0;
+
+  memset(index, 0, sizeof(struct ofsIndex));
+  if (filePtr == NULL) {
+    return -1;
+  }
+  if (fseeko(filePtr, 0, SEEK_END) != 0 || (size = ftello(filePtr)) < 0 ||
+      size < HEADER_SIZE + 8 || size > MAX_INDEX_SIZE ||
+      fseeko(filePtr, 0, SEEK_SET) != 0) {
+    fclose(filePtr);
+    return -1;
+  }
+
+  data = (BYTE *)malloc(size);
+  if (data == NULL || fread(data, 1, size, filePtr) != (size_t)size) {
+    free(data);
+    fclose(filePtr);
+    return -1;
+  }
+  fclose(filePtr);
+
+  index->numFiles = readLE(data + MAGIC_SIZE, 4);
+  index->numEntries = readLE(data + MAGIC_SIZE + 4, 4);
+  if (memcmp(data, OFSIDX_MAGIC, MAGIC_SIZE) != 0 || index->numFiles <= 0 ||
+      index->numEntries < 0 ||
+      size != HEADER_SIZE + (int64_t)index->numFiles * KEY_SIZE +
+                  (int64_t)index->numEntries * ENTRY_SIZE + 8 ||
+      readLE(data + size - 8, 8) != hashBytes(HASH_SEED, data, size - 8)) {
+    free(data);
+    memset(index, 0, sizeof(struct ofsIndex));
+    return -1;
+  }
+
+  index->keys =
+      (struct indexKey *)malloc(index->numFiles * sizeof(struct indexKey));
+  index->fileEntries = (int *)malloc(index->numFiles * sizeof(int));
+  index->entries = (struct indexEntry *)malloc(
+      (index->numEntries + 1) * sizeof(struct indexEntry));
+  if (index->keys == NULL || index->fileEntries == NULL ||
+      index->entries == NULL) {
+    perror("malloc()");
+    free(data);
+    freeIndex(index);
+    return -1;
+  }
+
+  pos = data + HEADER_SIZE;
+  for (int file = 0; file < index->numFiles; file++, pos += KEY_SIZE) {
+    index->keys[file].size = readLE(pos, 8);
+    index->keys[file].mtime = readLE(pos + 8, 8);
+    index->keys[file].hash = readLE(pos + 16, 8);
+    index->fileEntries[file] = readLE(pos + 24, 4);
+    if (index->fileEntries[file] < 0) {
+      free(data);
+      freeIndex(index);
+      return -1;
+    }
+    total += index->fileEntries[file];
+  }
+  for (int entry = 0; entry < index->numEntries; entry++, pos += ENTRY_SIZE) {
+    index->entries[entry].offset = readLE(pos, 8);
+    index->entries[entry].length = readLE(pos + 8, 4);
+    index->entries[entry].frameCount = pos[12];
+  }
+  free(data);
+
+  if (total != index->numEntries) {
+    freeIndex(index);
+    return -1;
+  }
+
+  return 0;
+}
+
+int writeIndex(const char *path, const struct ofsIndex *index) {
+  size_t size = HEADER_SIZE + (size_t)index->numFiles * KEY_SIZE +
+                (size_t)index->numEntries * ENTRY_SIZE + 8;
+  BYTE *data;
+  BYTE *pos;
+  int result;
+
+  data = (BYTE *)malloc(size);
+  if (data == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+
+  memcpy(data, OFSIDX_MAGIC, MAGIC_SIZE);
+  writeLE(data + MAGIC_SIZE, index->numFiles, 4);
+  writeLE(data + MAGIC_SIZE + 4, index->numEntries, 4);
+  pos = data + HEADER_SIZE;
+  for (int file = 0; file < index->numFiles; file++, pos += KEY_SIZE) {
+    writeLE(pos, index->keys[file].size, 8);
+    writeLE(pos + 8, index->keys[file].mtime, 8);
+    writeLE(pos + 16, index->keys[file].hash, 8);
+    writeLE(pos + 24, index->fileEntries[file], 4);
+  }
+  for (int entry = 0; entry < index->numEntries; entry++, pos += ENTRY_SIZE) {
+    writeLE(pos, index->entries[entry].offset, 8);
+    writeLE(pos + 8, index->entries[entry].length, 4);
+    pos[12] = (BYTE)index->entries[entry].frameCount;
+  }
+  writeLE(pos, hashBytes(HASH_SEED, data, size - 8), 8);
+
+  result = replaceFile(path, data, size);
+  free(data);
+
+  return result;
+}
+
+bool indexMatches(const struct ofsIndex *index, const char **filenames,
+                  int numFiles) {
+  struct indexKey key;
+
+  if (index->numFiles != numFiles) {
+    return false;
+  }
+
+  for (int file = 0; file < numFiles; file++) {
+    if (makeIndexKey(filenames[file], &key) == -1 ||
+        key.size != index->keys[file].size ||
+        key.mtime != index->keys[file].mtime ||
+        key.hash != index->keys[file].hash) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void freeIndex(struct ofsIndex *index) {
+  free(index->keys);
+  free(index->fileEntries);
+  free(index->entries);
+  memset(index, 0, sizeof(struct ofsIndex));
+}
@@ -0,0 +1,117 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "parallel.h"
+
+struct parallelJob {
+  pthread_mutex_t lock;
+  int next;
+  int count;
+  parallelTask task;
+  void *context;
+};
+
+// Each thread keeps taking the next index until there are none left.
+static void *parallelWorker(void *arg) {
+  struct parallelJob *job = (struct parallelJob *)arg;
+  int index;
+
+  while (1) {
+    pthread_mutex_lock(&job->lock);
+    index = job->next++;
+    pthread_mutex_unlock(&job->lock);
+
+    if (index >= job->count) {
+      break;
+    }
+    job->task(job->context, index);
+  }
+
+  return NULL;
+}
+
+/*
+ * Runs 'task' for every index in 'count' on up to 'numThreads' threads, and
+ * waits for all of them to finish. The calling thread does work too.
+ * Returns -1 if no thread could be started. (The tasks still run.)
+ */
+int parallelFor(int count, int numThreads, parallelTask task, void *context) {
+  pthread_t threads[MAXTHREADS];
+  struct parallelJob job;
+  int started = 0;
+  int result = 0;
+
+  if (numThreads > count) {
+    numThreads = count;
+  }
+  if (numThreads > MAXTHREADS) {
+    numThreads = MAXTHREADS;
+  }
+
+  job.next = 0;
+  job.count = count;
+  job.task = task;
+  job.context = context;
+  pthread_mutex_init(&job.lock, NULL);
+
+  for (int x = 1; x < numThreads; x++) {
+    if (pthread_create(&threads[started], NULL, parallelWorker, &job) != 0) {
+      perror("pthread_create()");
+      result = -1;
+      break;
+    }
+    started++;
+  }
+
+  parallelWorker(&job);
+
+  for (int x = 0; x < started; x++) {
+    pthread_join(threads[x], NULL);
+  }
+  pthread_mutex_destroy(&job.lock);
+
+  return result;
+}
+
+// Number of online CPUs or 1 if that can't be found.
+int cpuCount() {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return count > 0 ? (int)count : 1;
+#endif
+}
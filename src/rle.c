@@ -0,0 +1,391 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rle.h"
+#include "util.h"
+
+/*
+ * The RLE file is little-endian:
+ *
+ *   magic[8], frameRate u8, numOfPlanes u8, numFrames u32
+ *   numOfPlanes * (plane u8, numRuns u32, numRuns * (length u32, depth u8))
+ *   FNV-1a u64 of everything before it
+ *
+ * 'frameRate' is the same as in the OFS header, with the drop_frame_flag.
+ * Only the valid planes are in it.
+ */
+#define MAGIC_SIZE (8)
+#define HEADER_SIZE (MAGIC_SIZE + 6)
+#define PLANE_HEADER_SIZE (5)
+#define RUN_SIZE (5)
+#define MAX_RLE_SIZE (1024 * 1024 * 256) // Way more runs than any title.
+
+void initRLEPlanes(struct rlePlanes *rle, int numOfPlanes) {
+  memset(rle, 0, sizeof(struct rlePlanes));
+  rle->numOfPlanes = numOfPlanes;
+}
+
+void freeRLEPlanes(struct rlePlanes *rle) {
+  for (int plane = 0; plane < MAXPLANES; plane++) {
+    free(rle->planes[plane].runs);
+  }
+  memset(rle, 0, sizeof(struct rlePlanes));
+}
+
+// Starts a new run. Returns -1 if out of memory.
+static int addRun(struct rlePlane *plane, int end, BYTE depth) {
+  if (plane->numRuns == plane->capacity) {
+    int capacity = plane->capacity > 0 ? plane->capacity * 2 : 64;
+    struct depthRun *runs = (struct depthRun *)realloc(
+        plane->runs, capacity * sizeof(struct depthRun));
+
+    if (runs == NULL) {
+      perror("realloc()");
+      return -1;
+    }
+    plane->runs = runs;
+    plane->capacity = capacity;
+  }
+
+  plane->runs[plane->numRuns].end = end;
+  plane->runs[plane->numRuns].depth = depth;
+  plane->numRuns++;
+
+  return 0;
+}
+
+/*
+ * Appends 'count' depth values to the runs, the first one being frame
+ * 'first'. Returns -1 if out of memory.
+ */
+int addRLEDepths(struct rlePlane *plane, int first, const BYTE *depths,
+                 int count) {
+  struct depthRun *last =
+      plane->numRuns > 0 ? &plane->runs[plane->numRuns - 1] : NULL;
+
+  for (int x = 0; x < count; x++) {
+    if (last != NULL && last->depth == depths[x]) {
+      last->end = first + x + 1;
+      continue;
+    }
+    if (addRun(plane, first + x + 1, depths[x]) == -1) {
+      return -1;
+    }
+    last = &plane->runs[plane->numRuns - 1];
+  }
+
+  return 0;
+}
+
+/*
+ * Appends the depth values of an OFMD, without them ever being put in a
+ * plane. Planes the OFMD doesn't have get undefined depths.
+ * Returns -1 if out of memory.
+ */
+int addRLEOFMD(struct rlePlanes *rle, const BYTE *OFMD) {
+  BYTE undefined[127];
+  int frameCount = OFMD[11] & 127;
+  int planesInOFMD = OFMD[10] & 0x7F;
+
+  memset(undefined, 0x80, frameCount);
+  for (int plane = 0; plane < rle->numOfPlanes; plane++) {
+    const BYTE *depths = plane < planesInOFMD
+                             ? OFMD + 14 + (plane * frameCount)
+                             : undefined;
+
+    if (addRLEDepths(&rle->planes[plane], rle->numFrames, depths,
+                     frameCount) == -1) {
+      return -1;
+    }
+  }
+  rle->numFrames += frameCount;
+
+  return 0;
+}
+
+// Builds the runs of planes that are already in memory.
+int encodeRLEPlanes(BYTE *const *planes, int numOfPlanes, int numFrames,
+                    struct rlePlanes *rle) {
+  initRLEPlanes(rle, numOfPlanes);
+  rle->numFrames = numFrames;
+  for (int plane = 0; plane < numOfPlanes; plane++) {
+    if (addRLEDepths(&rle->planes[plane], 0, planes[plane], numFrames) ==
+        -1) {
+      freeRLEPlanes(rle);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Returns the run 'frame' is in or 'numRuns' if it's past the end.
+int findRun(const struct rlePlane *plane, int frame) {
+  int low = 0;
+  int high = plane->numRuns;
+
+  while (low < high) {
+    int middle = low + ((high - low) / 2);
+
+    if (plane->runs[middle].end <= frame) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+/*
+ * Gets the depth values of frames 'first' to 'first + count - 1' back.
+ * Frames past the end are undefined.
+ */
+void getRLEDepths(const struct rlePlane *plane, int first, int count,
+                  BYTE *depths) {
+  int run = findRun(plane, first);
+  int frame = first;
+
+  while (frame < first + count) {
+    int end = first + count;
+    BYTE depth = 0x80;
+
+    if (run < plane->numRuns) {
+      depth = plane->runs[run].depth;
+      if (plane->runs[run].end < end) {
+        end = plane->runs[run].end;
+      }
+      run++;
+    }
+    memset(depths + (frame - first), depth, end - frame);
+    frame = end;
+  }
+}
+
+bool sameRLEPlanes(const struct rlePlane *a, const struct rlePlane *b) {
+  if (a->numRuns != b->numRuns) {
+    return false;
+  }
+
+  for (int run = 0; run < a->numRuns; run++) {
+    if (a->runs[run].end != b->runs[run].end ||
+        a->runs[run].depth != b->runs[run].depth) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Writes the planes marked in 'validPlanes' to RLE_NAME in 'outFolder'.
+ * 'frameRate': Same as the OFS header's.
+ */
+int writeRLEFile(const char *outFolder, const struct rlePlanes *rle,
+                 BYTE frameRate, const int *validPlanes) {
+  size_t size = HEADER_SIZE + 8;
+  size_t pathSize = strlen(outFolder) + strlen(RLE_NAME) + 2;
+  int numValid = 0;
+  char *path;
+  BYTE *data;
+  BYTE *pos;
+  FILE *filePtr;
+  int result = 0;
+
+  for (int plane = 0; plane < rle->numOfPlanes; plane++) {
+    if (validPlanes[plane] == 1) {
+      size += PLANE_HEADER_SIZE + (size_t)rle->planes[plane].numRuns * RUN_SIZE;
+      numValid++;
+    }
+  }
+
+  data = (BYTE *)malloc(size);
+  if (data == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+
+  memcpy(data, RLE_MAGIC, MAGIC_SIZE);
+  data[MAGIC_SIZE] = frameRate;
+  data[MAGIC_SIZE + 1] = (BYTE)numValid;
+  writeLE(data + MAGIC_SIZE + 2, rle->numFrames, 4);
+  pos = data + HEADER_SIZE;
+  for (int plane = 0; plane < rle->numOfPlanes; plane++) {
+    const struct rlePlane *runs = &rle->planes[plane];
+    int start = 0;
+
+    if (validPlanes[plane] != 1) {
+      continue;
+    }
+    pos[0] = (BYTE)plane;
+    writeLE(pos + 1, runs->numRuns, 4);
+    pos += PLANE_HEADER_SIZE;
+    for (int run = 0; run < runs->numRuns; run++, pos += RUN_SIZE) {
+      writeLE(pos, runs->runs[run].end - start, 4);
+      pos[4] = runs->runs[run].depth;
+      start = runs->runs[run].end;
+    }
+  }
+  writeLE(pos, hashBytes(HASH_SEED, data, size - 8), 8);
+
+  path = (char *)malloc(pathSize);
+  if (path == NULL) {
+    perror("malloc()");
+    free(data);
+    return -1;
+  }
+  snprintf(path, pathSize, "%s" PATH_SEPARATOR "%s", outFolder, RLE_NAME);
+  filePtr = fopen(path, "wb");
+  if (filePtr == NULL) {
+    perror("fopen()");
+    printf("Failed to open: %s\n", path);
+    result = -1;
+  } else {
+    if (fwrite(data, 1, size, filePtr) != size) {
+      perror("fwrite()");
+      result = -1;
+    }
+    if (fclose(filePtr) != 0) {
+      result = -1;
+    }
+  }
+  free(path);
+  free(data);
+
+  return result;
+}
+
+// Parses the planes after the header. Returns -1 if they don't add up.
+static int parseRLEPlanes(const BYTE *data, size_t size,
+                          struct rlePlanes *rle, int *validPlanes) {
+  int numValid = data[MAGIC_SIZE + 1];
+  const BYTE *pos = data + HEADER_SIZE;
+  const BYTE *end = data + size - 8;
+
+  for (int x = 0; x < numValid; x++) {
+    struct rlePlane *runs;
+    int plane;
+    int64_t numRuns;
+    int start = 0;
+
+    if (end - pos < PLANE_HEADER_SIZE) {
+      return -1;
+    }
+    plane = pos[0];
+    numRuns = (int64_t)readLE(pos + 1, 4);
+    pos += PLANE_HEADER_SIZE;
+
+    // The planes are in order, and every run has a depth of its own.
+    if (plane >= MAXPLANES || plane < rle->numOfPlanes ||
+        (end - pos) / RUN_SIZE < numRuns) {
+      return -1;
+    }
+    runs = &rle->planes[plane];
+    for (int64_t run = 0; run < numRuns; run++, pos += RUN_SIZE) {
+      int64_t length = (int64_t)readLE(pos, 4);
+
+      if (length == 0 || length > rle->numFrames - start ||
+          (runs->numRuns > 0 &&
+           runs->runs[runs->numRuns - 1].depth == pos[4]) ||
+          addRun(runs, start + (int)length, pos[4]) == -1) {
+        return -1;
+      }
+      start += (int)length;
+    }
+    if (start != rle->numFrames) {
+      return -1;
+    }
+    validPlanes[plane] = 1;
+    rle->numOfPlanes = plane + 1;
+  }
+
+  return pos == end ? 0 : -1;
+}
+
+/*
+ * Reads RLE_NAME in 'outFolder' back. The planes that aren't in it have no
+ * runs and are 0 in 'validPlanes'. Returns -1 if it can't be read or
+ * doesn't check out.
+ */
+int readRLEFile(const char *outFolder, struct rlePlanes *rle, BYTE *frameRate,
+                int *validPlanes) {
+  size_t pathSize = strlen(outFolder) + strlen(RLE_NAME) + 2;
+  char *path = (char *)malloc(pathSize);
+  FILE *filePtr;
+  BYTE *data;
+  int64_t size;
+
+  initRLEPlanes(rle, 0);
+  memset(validPlanes, 0, MAXPLANES * sizeof(int));
+  if (path == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+  snprintf(path, pathSize, "%s" PATH_SEPARATOR "%s", outFolder, RLE_NAME);
+  filePtr = fopen(path, "rb");
+  free(path);
+  if (filePtr == NULL) {
+    return -1;
+  }
+  if (fseeko(filePtr, 0, SEEK_END) != 0 || (size = ftello(filePtr)) < 0 ||
+      size < HEADER_SIZE + 8 || size > MAX_RLE_SIZE ||
+      fseeko(filePtr, 0, SEEK_SET) != 0) {
+    fclose(filePtr);
+    return -1;
+  }
+
+  data = (BYTE *)malloc(size);
+  if (data == NULL || fread(data, 1, size, filePtr) != (size_t)size) {
+    free(data);
+    fclose(filePtr);
+    return -1;
+  }
+  fclose(filePtr);
+
+  if (memcmp(data, RLE_MAGIC, MAGIC_SIZE) != 0 ||
+      readLE(data + MAGIC_SIZE + 2, 4) > INT_MAX ||
+      readLE(data + size - 8, 8) != hashBytes(HASH_SEED, data, size - 8)) {
+    free(data);
+    return -1;
+  }
+  *frameRate = data[MAGIC_SIZE];
+  rle->numFrames = (int)readLE(data + MAGIC_SIZE + 2, 4);
+
+  if (parseRLEPlanes(data, size, rle, validPlanes) == -1) {
+    free(data);
+    freeRLEPlanes(rle);
+    memset(validPlanes, 0, MAXPLANES * sizeof(int));
+    return -1;
+  }
+  free(data);
+
+  return 0;
+}
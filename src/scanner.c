@@ -0,0 +1,236 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "scanner.h"
+#include "util.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Checks the byte 2 positions ahead first. If it's bigger than 1 there can't
+ * be a start code at any of the next 3 positions, so skip all of them.
+ */
+static const BYTE *findStartCodeScalar(const BYTE *data, size_t length,
+                                       BYTE header, BYTE headerMask,
+                                       BYTE payload, BYTE payloadMask) {
+  size_t needed = payloadMask ? 5 : 4;
+  size_t last;
+  size_t i = 0;
+
+  if (length < needed) {
+    return NULL;
+  }
+  last = length - needed;
+
+  while (i <= last) {
+    BYTE byte = data[i + 2];
+
+    if (byte > 1) {
+      i += 3;
+      continue;
+    }
+
+    if (byte == 1 && data[i + 1] == 0 && data[i] == 0 &&
+        (data[i + 3] & headerMask) == (header & headerMask) &&
+        (payloadMask == 0 ||
+         (data[i + 4] & payloadMask) == (payload & payloadMask))) {
+      return data + i;
+    }
+    i++;
+  }
+
+  return NULL;
+}
+
+#ifdef SCANNER_X86
+/*
+ * Compares 16 positions at a time. Each lane checks the whole
+ * '00 00 01 <header> <payload>' pattern with 5 overlapping loads,
+ * so a candidate never has to be verified with memcmp.
+ */
+__attribute__((target("sse2"))) static const BYTE *
+findStartCodeSSE2(const BYTE *data, size_t length, BYTE header,
+                  BYTE headerMask, BYTE payload, BYTE payloadMask) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i headerMaskVec = _mm_set1_epi8((char)headerMask);
+  const __m128i headerVec = _mm_set1_epi8((char)(header & headerMask));
+  const __m128i payloadMaskVec = _mm_set1_epi8((char)payloadMask);
+  const __m128i payloadVec = _mm_set1_epi8((char)(payload & payloadMask));
+  const BYTE *match;
+  size_t i = 0;
+
+  // The last lane reads 4 bytes past itself.
+  if (length >= 16 + 4) {
+    size_t last = length - (16 + 4);
+
+    for (; i <= last; i += 16) {
+      __m128i byte1 = _mm_loadu_si128((const __m128i *)(data + i + 1));
+      __m128i byte2 = _mm_loadu_si128((const __m128i *)(data + i + 2));
+      __m128i mask = _mm_and_si128(_mm_cmpeq_epi8(byte1, zero),
+                                   _mm_cmpeq_epi8(byte2, one));
+
+      // Most blocks don't even have a '00 01'.
+      if (_mm_movemask_epi8(mask) == 0) {
+        continue;
+      }
+
+      __m128i byte0 = _mm_loadu_si128((const __m128i *)(data + i));
+      __m128i byte3 = _mm_loadu_si128((const __m128i *)(data + i + 3));
+      __m128i byte4 = _mm_loadu_si128((const __m128i *)(data + i + 4));
+      mask = _mm_and_si128(mask, _mm_cmpeq_epi8(byte0, zero));
+      mask = _mm_and_si128(
+          mask, _mm_cmpeq_epi8(_mm_and_si128(byte3, headerMaskVec), headerVec));
+      mask = _mm_and_si128(mask,
+                           _mm_cmpeq_epi8(_mm_and_si128(byte4, payloadMaskVec),
+                                          payloadVec));
+
+      int bits = _mm_movemask_epi8(mask);
+      if (bits != 0) {
+        return data + i + __builtin_ctz(bits);
+      }
+    }
+  }
+
+  match = findStartCodeScalar(data + i, length - i, header, headerMask,
+                              payload, payloadMask);
+  return match;
+}
+
+// Same as 'findStartCodeSSE2', but 32 positions at a time.
+__attribute__((target("avx2"))) static const BYTE *
+findStartCodeAVX2(const BYTE *data, size_t length, BYTE header,
+                  BYTE headerMask, BYTE payload, BYTE payloadMask) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i headerMaskVec = _mm256_set1_epi8((char)headerMask);
+  const __m256i headerVec = _mm256_set1_epi8((char)(header & headerMask));
+  const __m256i payloadMaskVec = _mm256_set1_epi8((char)payloadMask);
+  const __m256i payloadVec = _mm256_set1_epi8((char)(payload & payloadMask));
+  const BYTE *match;
+  size_t i = 0;
+
+  if (length >= 32 + 4) {
+    size_t last = length - (32 + 4);
+
+    for (; i <= last; i += 32) {
+      __m256i byte1 = _mm256_loadu_si256((const __m256i *)(data + i + 1));
+      __m256i byte2 = _mm256_loadu_si256((const __m256i *)(data + i + 2));
+      __m256i mask = _mm256_and_si256(_mm256_cmpeq_epi8(byte1, zero),
+                                      _mm256_cmpeq_epi8(byte2, one));
+
+      if (_mm256_movemask_epi8(mask) == 0) {
+        continue;
+      }
+
+      __m256i byte0 = _mm256_loadu_si256((const __m256i *)(data + i));
+      __m256i byte3 = _mm256_loadu_si256((const __m256i *)(data + i + 3));
+      __m256i byte4 = _mm256_loadu_si256((const __m256i *)(data + i + 4));
+      mask = _mm256_and_si256(mask, _mm256_cmpeq_epi8(byte0, zero));
+      mask = _mm256_and_si256(
+          mask, _mm256_cmpeq_epi8(_mm256_and_si256(byte3, headerMaskVec),
+                                  headerVec));
+      mask = _mm256_and_si256(
+          mask, _mm256_cmpeq_epi8(_mm256_and_si256(byte4, payloadMaskVec),
+                                  payloadVec));
+
+      unsigned int bits = (unsigned int)_mm256_movemask_epi8(mask);
+      if (bits != 0) {
+        return data + i + __builtin_ctz(bits);
+      }
+    }
+  }
+
+  match = findStartCodeScalar(data + i, length - i, header, headerMask,
+                              payload, payloadMask);
+  return match;
+}
+#endif
+
+enum scannerLevel scannerLevel() {
+#ifdef SCANNER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SCANNER_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SCANNER_SSE2;
+  }
+#endif
+  return SCANNER_SCALAR;
+}
+
+const char *scannerLevelName(enum scannerLevel level) {
+  switch (level) {
+  case SCANNER_AVX2:
+    return "AVX2";
+  case SCANNER_SSE2:
+    return "SSE2";
+  default:
+    return "scalar";
+  }
+}
+
+const BYTE *findStartCodeWith(enum scannerLevel level, const BYTE *data,
+                              size_t length, BYTE header, BYTE headerMask,
+                              BYTE payload, BYTE payloadMask) {
+  if (data == NULL) {
+    return NULL;
+  }
+
+#ifdef SCANNER_X86
+  if (level == SCANNER_AVX2) {
+    return findStartCodeAVX2(data, length, header, headerMask, payload,
+                             payloadMask);
+  }
+  if (level == SCANNER_SSE2) {
+    return findStartCodeSSE2(data, length, header, headerMask, payload,
+                             payloadMask);
+  }
+#else
+  (void)level;
+#endif
+
+  return findStartCodeScalar(data, length, header, headerMask, payload,
+                             payloadMask);
+}
+
+static pthread_once_t bestLevelOnce = PTHREAD_ONCE_INIT;
+static enum scannerLevel bestLevel;
+
+static void findBestLevel() { bestLevel = scannerLevel(); }
+
+const BYTE *findStartCode(const BYTE *data, size_t length, BYTE header,
+                          BYTE headerMask, BYTE payload, BYTE payloadMask) {
+  pthread_once(&bestLevelOnce, findBestLevel);
+
+  return findStartCodeWith(bestLevel, data, length, header, headerMask,
+                           payload, payloadMask);
+}
@@ -0,0 +1,584 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "input.h"
+#include "serve.h"
+#include "util.h"
+
+static char *skipSpace(char *text) {
+  while (*text == ' ' || *text == '\t' || *text == '\n' || *text == '\r') {
+    text++;
+  }
+
+  return text;
+}
+
+static int hexValue(const char *text) {
+  int value = 0;
+
+  for (int x = 0; x < 4; x++) {
+    int c = text[x];
+
+    if (c >= '0' && c <= '9') {
+      value = value * 16 + c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      value = value * 16 + c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      value = value * 16 + c - 'A' + 10;
+    } else {
+      return -1;
+    }
+  }
+
+  return value;
+}
+
+/*
+ * Unescapes the JSON string which starts after the quote at 'text' in place.
+ * Returns what follows the closing quote or NULL.
+ */
+static char *parseString(char *text, const char **value) {
+  char *read = text + 1;
+  char *write = text + 1;
+
+  *value = write;
+  while (*read != '"') {
+    int code;
+
+    if (*read == '\0' || (unsigned char)*read < 0x20) {
+      return NULL;
+    } else if (*read != '\\') {
+      *write++ = *read++;
+      continue;
+    }
+
+    read++;
+    switch (*read) {
+    case '"':
+    case '\\':
+    case '/':
+      *write++ = *read;
+      break;
+    case 'b':
+      *write++ = '\b';
+      break;
+    case 'f':
+      *write++ = '\f';
+      break;
+    case 'n':
+      *write++ = '\n';
+      break;
+    case 'r':
+      *write++ = '\r';
+      break;
+    case 't':
+      *write++ = '\t';
+      break;
+    case 'u':
+      code = hexValue(read + 1);
+      read += 4;
+      if (code >= 0xD800 && code <= 0xDBFF && read[1] == '\\' &&
+          read[2] == 'u') {
+        int low = hexValue(read + 3);
+
+        if (low < 0xDC00 || low > 0xDFFF) {
+          return NULL;
+        }
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        read += 6;
+      } else if (code >= 0xD800 && code <= 0xDFFF) {
+        return NULL;
+      }
+
+      // A C string can't hold a null.
+      if (code <= 0) {
+        return NULL;
+      } else if (code < 0x80) {
+        *write++ = (char)code;
+      } else if (code < 0x800) {
+        *write++ = (char)(0xC0 | (code >> 6));
+        *write++ = (char)(0x80 | (code & 0x3F));
+      } else if (code < 0x10000) {
+        *write++ = (char)(0xE0 | (code >> 12));
+        *write++ = (char)(0x80 | ((code >> 6) & 0x3F));
+        *write++ = (char)(0x80 | (code & 0x3F));
+      } else {
+        *write++ = (char)(0xF0 | (code >> 18));
+        *write++ = (char)(0x80 | ((code >> 12) & 0x3F));
+        *write++ = (char)(0x80 | ((code >> 6) & 0x3F));
+        *write++ = (char)(0x80 | (code & 0x3F));
+      }
+      break;
+    default:
+      return NULL;
+    }
+    read++;
+  }
+  *write = '\0';
+
+  return read + 1;
+}
+
+int parseRequest(char *text, struct serveRequest *request) {
+  request->numFields = 0;
+
+  text = skipSpace(text);
+  if (*text != '{') {
+    return -1;
+  }
+  text = skipSpace(text + 1);
+  if (*text == '}') {
+    return *skipSpace(text + 1) == '\0' ? 0 : -1;
+  }
+
+  while (1) {
+    struct serveField *field = &request->fields[request->numFields];
+    char *end;
+    char next;
+
+    if (request->numFields == SERVE_MAX_FIELDS || *text != '"') {
+      return -1;
+    }
+    text = parseString(text, &field->name);
+    if (text == NULL) {
+      return -1;
+    }
+    text = skipSpace(text);
+    if (*text != ':') {
+      return -1;
+    }
+    text = skipSpace(text + 1);
+
+    if (*text == '"') {
+      field->isString = true;
+      end = parseString(text, &field->value);
+      if (end == NULL) {
+        return -1;
+      }
+    } else {
+      field->isString = false;
+      field->value = text;
+      end = text;
+      while (*end != '\0' && strchr("+-.0123456789Eaeflnrstu", *end)) {
+        end++;
+      }
+      if (end == text) {
+        return -1; // Objects and arrays aren't supported.
+      }
+    }
+
+    // The value is ended in place, so remember what came after it.
+    text = skipSpace(end);
+    next = *text;
+    if (!field->isString) {
+      *end = '\0';
+      if (strcmp(field->value, "null") == 0) {
+        field->value = NULL;
+      }
+    }
+    request->numFields++;
+
+    if (next == '}') {
+      return *skipSpace(text + 1) == '\0' ? 0 : -1;
+    } else if (next != ',') {
+      return -1;
+    }
+    text = skipSpace(text + 1);
+  }
+}
+
+// The value of 'field' if it's a whole number.
+bool fieldInt(const struct serveField *field, int *value) {
+  char *end;
+  long number;
+
+  if (field->isString || field->value == NULL) {
+    return false;
+  }
+
+  errno = 0;
+  number = strtol(field->value, &end, 10);
+  if (*end != '\0' || errno != 0 || number < INT_MIN || number > INT_MAX) {
+    return false;
+  }
+  *value = (int)number;
+
+  return true;
+}
+
+bool fieldBool(const struct serveField *field, bool *value) {
+  if (field->isString || field->value == NULL) {
+    return false;
+  } else if (strcmp(field->value, "true") == 0) {
+    *value = true;
+  } else if (strcmp(field->value, "false") == 0) {
+    *value = false;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+void sendServeError(struct serveRequest *request, const char *error) {
+  fprintf(request->reply,
+          "{\"event\": \"result\", \"job\": %d, \"ok\": false, "
+          "\"error\": ",
+          request->job);
+  writeJSONString(request->reply, error);
+  fprintf(request->reply, "}\n");
+  fflush(request->reply);
+}
+
+void sendServeProgress(void *request, int percent) {
+  struct serveRequest *serveRequest = (struct serveRequest *)request;
+
+  fprintf(serveRequest->reply,
+          "{\"event\": \"progress\", \"job\": %d, \"percent\": %d}\n",
+          serveRequest->job, percent);
+  fflush(serveRequest->reply);
+}
+
+#ifdef _WIN32
+int runServer(const char *path, int numWorkers, serveHandler handler,
+              void *context) {
+  (void)path;
+  (void)numWorkers;
+  (void)handler;
+  (void)context;
+  printf("'-serve' needs Unix domain sockets, which this build doesn't "
+         "have.\n");
+  return 1;
+}
+
+void stopServer() {}
+
+int runClient(const char *path, const struct serveRequest *request) {
+  (void)path;
+  (void)request;
+  printf("'-client' needs Unix domain sockets, which this build doesn't "
+         "have.\n");
+  return 1;
+}
+#else
+struct server {
+  int socket;
+  serveHandler handler;
+  void *context;
+  atomic_int nextJob;
+
+  // Accepted connections waiting for a worker.
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  int queue[SERVE_QUEUE];
+  int first;
+  int numQueued;
+};
+
+// Set while the socket exists, so 'stopServer' can remove it.
+static char serverPath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+// Fills in 'address' and returns -1 if 'path' is too long for it.
+static int socketAddress(const char *path, struct sockaddr_un *address) {
+  memset(address, 0, sizeof(struct sockaddr_un));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) {
+    printf("'%s' is too long for a socket path.\n", path);
+    return -1;
+  }
+  strcpy(address->sun_path, path);
+
+  return 0;
+}
+
+// Reads the request line. Returns its length or -1.
+static int readRequest(int connection, char *buffer) {
+  int length = 0;
+
+  while (length < SERVE_MAX_REQUEST - 1) {
+    ssize_t bytesRead =
+        read(connection, buffer + length, SERVE_MAX_REQUEST - 1 - length);
+    char *newline;
+
+    if (bytesRead == -1 && errno == EINTR) {
+      continue;
+    } else if (bytesRead <= 0) {
+      break;
+    }
+    buffer[length + bytesRead] = '\0';
+    newline = strchr(buffer + length, '\n');
+    length += bytesRead;
+    if (newline != NULL) {
+      *newline = '\0';
+      return newline - buffer;
+    }
+  }
+  buffer[length] = '\0';
+
+  // The client can end the request by closing its side instead.
+  return length > 0 && length < SERVE_MAX_REQUEST - 1 ? length : -1;
+}
+
+// Reads one request from 'connection' and runs it.
+static void serveConnection(struct server *server, int connection,
+                            char *buffer) {
+  struct serveRequest request;
+  struct timeval timeout = {SERVE_TIMEOUT, 0};
+  int length;
+
+  setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  length = readRequest(connection, buffer);
+  request.job = atomic_fetch_add(&server->nextJob, 1) + 1;
+  request.reply = fdopen(connection, "w");
+  if (request.reply == NULL) {
+    close(connection);
+    return;
+  }
+
+  if (length == -1 || parseRequest(buffer, &request) == -1) {
+    printf("Job %d: The request isn't a JSON object on one line.\n",
+           request.job);
+    sendServeError(&request, "The request isn't a JSON object on one line.");
+  } else {
+    fprintf(request.reply, "{\"event\": \"accepted\", \"job\": %d}\n",
+            request.job);
+    fflush(request.reply);
+    server->handler(server->context, &request);
+  }
+  fclose(request.reply);
+}
+
+// Each worker runs the connections in the queue for as long as there is one.
+static void *serveWorker(void *arg) {
+  struct server *server = (struct server *)arg;
+  char *buffer = (char *)malloc(SERVE_MAX_REQUEST);
+
+  if (buffer == NULL) {
+    printf("Failed to allocate a request buffer.\n");
+    return NULL;
+  }
+
+  keepInputBuffers(true);
+  while (1) {
+    int connection;
+
+    pthread_mutex_lock(&server->lock);
+    while (server->numQueued == 0) {
+      pthread_cond_wait(&server->changed, &server->lock);
+    }
+    connection = server->queue[server->first];
+    server->first = (server->first + 1) % SERVE_QUEUE;
+    server->numQueued--;
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->lock);
+
+    serveConnection(server, connection, buffer);
+  }
+
+  return NULL;
+}
+
+/*
+ * Binds 'path', but only replaces a socket nobody is listening on.
+ * Returns the socket or -1.
+ */
+static int bindSocket(const char *path) {
+  struct sockaddr_un address;
+  struct stat info;
+  int serverSocket;
+
+  if (socketAddress(path, &address) == -1) {
+    return -1;
+  }
+
+  if (lstat(path, &info) == 0) {
+    int probe;
+    bool inUse;
+
+    if (!S_ISSOCK(info.st_mode)) {
+      printf("'%s' already exists and isn't a socket.\n", path);
+      return -1;
+    }
+    probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    inUse = probe != -1 && connect(probe, (struct sockaddr *)&address,
+                                   sizeof(address)) == 0;
+    if (probe != -1) {
+      close(probe);
+    }
+    if (inUse) {
+      printf("Another server is already listening on '%s'.\n", path);
+      return -1;
+    }
+    unlink(path);
+  }
+
+  serverSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (serverSocket == -1) {
+    perror("socket()");
+    return -1;
+  }
+  if (bind(serverSocket, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+      listen(serverSocket, SERVE_QUEUE) == -1) {
+    perror("bind()");
+    printf("Failed to listen on '%s'.\n", path);
+    close(serverSocket);
+    return -1;
+  }
+
+  return serverSocket;
+}
+
+int runServer(const char *path, int numWorkers, serveHandler handler,
+              void *context) {
+  struct server server;
+
+  server.socket = bindSocket(path);
+  if (server.socket == -1) {
+    return 1;
+  }
+  strcpy(serverPath, path);
+  server.handler = handler;
+  server.context = context;
+  atomic_init(&server.nextJob, 0);
+  pthread_mutex_init(&server.lock, NULL);
+  pthread_cond_init(&server.changed, NULL);
+  server.first = 0;
+  server.numQueued = 0;
+
+  // Clients that hang up early shouldn't take the server with them.
+  signal(SIGPIPE, SIG_IGN);
+
+  for (int x = 0; x < numWorkers; x++) {
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, serveWorker, &server) != 0) {
+      printf("Failed to start worker %d.\n", x + 1);
+      stopServer();
+      return 1;
+    }
+    pthread_detach(thread);
+  }
+
+  printf("Listening on '%s' with %d worker(s).\n\n", path, numWorkers);
+  fflush(stdout);
+
+  while (1) {
+    int connection = accept(server.socket, NULL, NULL);
+
+    if (connection == -1) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        perror("accept()");
+      }
+      continue;
+    }
+
+    pthread_mutex_lock(&server.lock);
+    while (server.numQueued == SERVE_QUEUE) {
+      pthread_cond_wait(&server.changed, &server.lock);
+    }
+    server.queue[(server.first + server.numQueued) % SERVE_QUEUE] = connection;
+    server.numQueued++;
+    pthread_cond_broadcast(&server.changed);
+    pthread_mutex_unlock(&server.lock);
+  }
+}
+
+void stopServer() {
+  if (serverPath[0] != '\0') {
+    unlink(serverPath);
+  }
+}
+
+int runClient(const char *path, const struct serveRequest *request) {
+  struct sockaddr_un address;
+  FILE *server;
+  char *line = NULL;
+  size_t lineSize = 0;
+  int clientSocket;
+  int result = 1;
+
+  if (socketAddress(path, &address) == -1) {
+    return 1;
+  }
+  clientSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (clientSocket == -1 || connect(clientSocket, (struct sockaddr *)&address,
+                                    sizeof(address)) == -1) {
+    perror("connect()");
+    printf("Failed to connect to '%s'.\n", path);
+    if (clientSocket != -1) {
+      close(clientSocket);
+    }
+    return 1;
+  }
+  server = fdopen(clientSocket, "r+");
+
+  fputc('{', server);
+  for (int x = 0; x < request->numFields; x++) {
+    const struct serveField *field = &request->fields[x];
+
+    fputs(x == 0 ? "" : ", ", server);
+    writeJSONString(server, field->name);
+    fprintf(server, ": ");
+    if (field->value == NULL) {
+      fprintf(server, "null");
+    } else if (field->isString) {
+      writeJSONString(server, field->value);
+    } else {
+      fprintf(server, "%s", field->value);
+    }
+  }
+  fprintf(server, "}\n");
+  fflush(server);
+  shutdown(clientSocket, SHUT_WR);
+
+  while (getline(&line, &lineSize, server) != -1) {
+    if (strstr(line, "\"event\": \"result\"") != NULL) {
+      result = strstr(line, "\"ok\": true") != NULL ? 0 : 1;
+    }
+    fputs(line, stdout);
+    fflush(stdout);
+  }
+  free(line);
+  fclose(server);
+
+  return result;
+}
+#endif
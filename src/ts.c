@@ -0,0 +1,304 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nal.h"
+#include "ts.h"
+#include "util.h"
+
+int probeTS(const BYTE *data, size_t length, size_t *firstPacket) {
+  const int packetSizes[2] = {M2TS_PACKET_SIZE, TS_PACKET_SIZE};
+
+  for (int x = 0; x < 2; x++) {
+    int packetSize = packetSizes[x];
+    size_t header = packetSize - TS_PACKET_SIZE;
+
+    if (length < header + (size_t)packetSize * TS_PROBE_PACKETS) {
+      continue;
+    }
+
+    for (size_t start = 0; start < (size_t)packetSize; start++) {
+      size_t end = start + header + (size_t)packetSize * (TS_PROBE_PACKETS - 1);
+      size_t pos;
+
+      if (end >= length) {
+        break;
+      }
+      for (pos = start + header; pos <= end; pos += packetSize) {
+        if (data[pos] != TS_SYNC_BYTE) {
+          break;
+        }
+      }
+      if (pos > end) {
+        *firstPacket = start;
+        return packetSize;
+      }
+    }
+  }
+
+  return 0;
+}
+
+void initTSDemuxer(struct tsDemuxer *demux, struct nalParser *parser,
+                   int packetSize) {
+  memset(demux, 0, sizeof(struct tsDemuxer));
+  demux->parser = parser;
+  demux->packetSize = packetSize;
+  demux->pmtPID = -1;
+  demux->videoPID = TS_PID_MVC;
+}
+
+void setTSVideoPID(struct tsDemuxer *demux, int pid) {
+  demux->videoPID = pid;
+  demux->fixedPID = true;
+}
+
+/*
+ * Returns the PSI section at the start of 'payload' or NULL.
+ * 'length' is set to the section's length without its CRC.
+ */
+static const BYTE *findSection(const BYTE *payload, size_t payloadLength,
+                               size_t *length) {
+  const BYTE *section;
+  size_t available;
+  size_t sectionLength;
+
+  // Skip the pointer_field.
+  if (payloadLength < 1 || (size_t)payload[0] + 1 + 3 > payloadLength) {
+    return NULL;
+  }
+  section = payload + 1 + payload[0];
+  available = payloadLength - 1 - payload[0];
+
+  sectionLength = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+  if (sectionLength > available) {
+    sectionLength = available; // The rest is in the next packet. Good enough.
+  }
+  if (sectionLength < 4) {
+    return NULL;
+  }
+
+  *length = sectionLength - 4;
+  return section;
+}
+
+// Takes the PMT PID of the first program.
+static void parsePAT(struct tsDemuxer *demux, const BYTE *payload,
+                     size_t payloadLength) {
+  size_t length;
+  const BYTE *section = findSection(payload, payloadLength, &length);
+
+  if (section == NULL || section[0] != 0x00) {
+    return;
+  }
+
+  for (size_t x = 8; x + 4 <= length; x += 4) {
+    int programNumber = (section[x] << 8) | section[x + 1];
+    if (programNumber != 0) { // 0 is the network PID.
+      demux->pmtPID = ((section[x + 2] & 0x1F) << 8) | section[x + 3];
+      return;
+    }
+  }
+}
+
+// Takes the MVC stream's PID or the AVC stream's if there's no MVC stream.
+static void parsePMT(struct tsDemuxer *demux, const BYTE *payload,
+                     size_t payloadLength) {
+  size_t length;
+  const BYTE *section = findSection(payload, payloadLength, &length);
+  int avcPID = -1;
+  int mvcPID = -1;
+  size_t x;
+
+  if (section == NULL || section[0] != 0x02 || length < 12) {
+    return;
+  }
+
+  // Skip the program_info descriptors.
+  x = 12 + (((section[10] & 0x0F) << 8) | section[11]);
+  for (; x + 5 <= length; x += 5 + (((section[x + 3] & 0x0F) << 8) |
+                                    section[x + 4])) {
+    int streamType = section[x];
+    int pid = ((section[x + 1] & 0x1F) << 8) | section[x + 2];
+
+    if (streamType == TS_STREAM_TYPE_MVC && mvcPID == -1) {
+      mvcPID = pid;
+    } else if (streamType == TS_STREAM_TYPE_AVC && avcPID == -1) {
+      avcPID = pid;
+    }
+  }
+
+  demux->pmtFound = true;
+  if (mvcPID != -1) {
+    demux->mvcFound = true;
+  }
+  if (!demux->fixedPID) {
+    if (mvcPID != -1) {
+      demux->videoPID = mvcPID;
+    } else if (avcPID != -1 && !demux->mvcFound) {
+      demux->videoPID = avcPID;
+    }
+  }
+}
+
+// Passes the video payload on to the NAL parser, without the PES header.
+static void demuxVideo(struct tsDemuxer *demux, const BYTE *payload,
+                       size_t length, int64_t offset, bool unitStart) {
+  size_t headerSize;
+
+  demux->numVideoPackets++;
+
+  if (unitStart) {
+    demux->pesSkip = 0;
+    if (length < 9 || payload[0] != 0 || payload[1] != 0 || payload[2] != 1) {
+      return; // Not a PES packet.
+    }
+    headerSize = 9 + (size_t)payload[8];
+    if (headerSize > length) {
+      demux->pesSkip = headerSize - length;
+      return;
+    }
+    payload += headerSize;
+    length -= headerSize;
+    offset += headerSize;
+  } else if (demux->pesSkip > 0) {
+    size_t skip = demux->pesSkip < length ? demux->pesSkip : length;
+    demux->pesSkip -= skip;
+    payload += skip;
+    length -= skip;
+    offset += skip;
+  }
+
+  if (demux->parser != NULL && length > 0) {
+    feedNALParser(demux->parser, payload, length, offset);
+  }
+}
+
+// 'packet' starts at the sync byte. 'offset' is its file offset.
+static void demuxPacket(struct tsDemuxer *demux, const BYTE *packet,
+                        int64_t offset) {
+  int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+  bool unitStart = (packet[1] & 0x40) != 0;
+  int adaptationControl = (packet[3] >> 4) & 3;
+  size_t start = 4;
+
+  demux->numPackets++;
+
+  // Skip packets with errors or without a payload.
+  if ((packet[1] & 0x80) != 0 || (adaptationControl & 1) == 0) {
+    return;
+  }
+  if (pid != demux->videoPID && pid != TS_PID_PAT && pid != demux->pmtPID) {
+    return;
+  }
+
+  if (adaptationControl & 2) {
+    start += 1 + packet[4];
+    if (start >= TS_PACKET_SIZE) {
+      return;
+    }
+  }
+
+  if (pid == demux->videoPID) {
+    demuxVideo(demux, packet + start, TS_PACKET_SIZE - start, offset + start,
+               unitStart);
+  } else if (unitStart && pid == TS_PID_PAT) {
+    parsePAT(demux, packet + start, TS_PACKET_SIZE - start);
+  } else if (unitStart) {
+    parsePMT(demux, packet + start, TS_PACKET_SIZE - start);
+  }
+}
+
+static bool demuxStopped(struct tsDemuxer *demux) {
+  return demux->parser != NULL && demux->parser->stopped;
+}
+
+/*
+ * Feeds the next 'length' bytes of the transport stream to the demuxer.
+ * 'offset' is the file offset of 'data[0]'.
+ * Returns non-zero once the NAL parser has stopped.
+ */
+int feedTSDemuxer(struct tsDemuxer *demux, const BYTE *data, size_t length,
+                  int64_t offset) {
+  const size_t packetSize = demux->packetSize;
+  const size_t header = packetSize - TS_PACKET_SIZE;
+  size_t x = 0;
+
+  // Finish the packet which was split between chunks.
+  if (demux->packetLength > 0) {
+    size_t copySize = packetSize - demux->packetLength;
+    if (copySize > length) {
+      copySize = length;
+    }
+    memcpy(demux->packet + demux->packetLength, data, copySize);
+    demux->packetLength += copySize;
+    x = copySize;
+
+    if (demux->packetLength < packetSize) {
+      return demuxStopped(demux);
+    }
+    demux->packetLength = 0;
+    if (demux->packet[header] == TS_SYNC_BYTE) {
+      demuxPacket(demux, demux->packet + header,
+                  demux->packetOffset + header);
+    }
+  }
+
+  while (x < length && !demuxStopped(demux)) {
+    if (length - x < packetSize) {
+      memcpy(demux->packet, data + x, length - x);
+      demux->packetLength = length - x;
+      demux->packetOffset = offset + x;
+      break;
+    }
+
+    // Lost sync. Look for the next packet one byte at a time.
+    if (data[x + header] != TS_SYNC_BYTE) {
+      x++;
+      continue;
+    }
+
+    demuxPacket(demux, data + x + header, offset + x + header);
+    x += packetSize;
+  }
+
+  return demuxStopped(demux);
+}
+
+/*
+ * True if the NAL parser is idle, and there's no packet waiting to be
+ * finished which the parser would still need.
+ */
+bool tsDemuxerIdle(struct tsDemuxer *demux) {
+  if (demux->parser == NULL) {
+    return demux->packetLength == 0;
+  }
+
+  return nalParserIdle(demux->parser) &&
+         (demux->packetLength == 0 ||
+          demux->packetOffset >= demux->parser->stopOffset);
+}
@@ -0,0 +1,542 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _FILE_OFFSET_BITS 64
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_IO_URING
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "uring.h"
+#include "util.h"
+
+#ifdef HAVE_IO_URING
+
+struct uringSlot {
+  BYTE *block;    // After the slot's headroom.
+  BYTE *spare;    // Replaces the slot's buffer once the ring is abandoned.
+  int64_t offset; // File offset of the block.
+  size_t wanted;  // Less than 'blockSize' for the last block of the file.
+  size_t length;  // Bytes read, once 'done'.
+  bool queued;
+  bool done;
+};
+
+struct uringReader {
+  int ringFd;
+  int fd;
+  int64_t fileSize;
+  size_t headroom;
+  size_t blockSize;
+  int depth;
+  bool fixedBuffers; // The slots are registered with the kernel.
+  bool started;
+  bool failed; // io_uring_enter failed. Everything is read with pread now.
+  bool abandoned; // Reads can't be reaped, so the kernel may own 'buffers'.
+
+  // Submission queue.
+  void *sqRing;
+  size_t sqRingSize;
+  unsigned *sqHead;
+  unsigned *sqTail;
+  unsigned sqMask;
+  unsigned *sqArray;
+  struct io_uring_sqe *sqes;
+  size_t sqesSize;
+  unsigned toSubmit;
+
+  // Completion queue. Can share the mapping with the submission queue.
+  void *cqRing;
+  size_t cqRingSize;
+  unsigned *cqHead;
+  unsigned *cqTail;
+  unsigned cqMask;
+  struct io_uring_cqe *cqes;
+
+  BYTE *buffers;
+  struct uringSlot slots[URING_MAX_DEPTH];
+  int next;    // Slot with the next block in file order.
+  int current; // Slot returned by the last 'nextUringBlock' or -1.
+  int inFlight; // Submitted to the kernel, and not reaped yet.
+  int64_t nextOffset; // File offset of the next read to queue.
+};
+
+static int uringSetup(unsigned entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int ringFd, unsigned toSubmit, unsigned minComplete,
+                      unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete,
+                      flags, NULL, 0);
+}
+
+static int uringRegister(int ringFd, unsigned opcode, const void *arg,
+                         unsigned numArgs) {
+  return (int)syscall(__NR_io_uring_register, ringFd, opcode, arg, numArgs);
+}
+
+static int mapRings(struct uringReader *reader,
+                    const struct io_uring_params *params) {
+  BYTE *sq;
+  BYTE *cq;
+
+  reader->sqRingSize =
+      params->sq_off.array + params->sq_entries * sizeof(unsigned);
+  reader->cqRingSize =
+      params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+  if (params->features & IORING_FEAT_SINGLE_MMAP) {
+    if (reader->cqRingSize > reader->sqRingSize) {
+      reader->sqRingSize = reader->cqRingSize;
+    }
+    reader->cqRingSize = reader->sqRingSize;
+  }
+
+  reader->sqRing = mmap(NULL, reader->sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, reader->ringFd,
+                        IORING_OFF_SQ_RING);
+  if (reader->sqRing == MAP_FAILED) {
+    reader->sqRing = NULL;
+    return -1;
+  }
+
+  if (params->features & IORING_FEAT_SINGLE_MMAP) {
+    reader->cqRing = reader->sqRing;
+  } else {
+    reader->cqRing = mmap(NULL, reader->cqRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, reader->ringFd,
+                          IORING_OFF_CQ_RING);
+    if (reader->cqRing == MAP_FAILED) {
+      reader->cqRing = NULL;
+      return -1;
+    }
+  }
+
+  reader->sqesSize = params->sq_entries * sizeof(struct io_uring_sqe);
+  reader->sqes = (struct io_uring_sqe *)mmap(
+      NULL, reader->sqesSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, reader->ringFd, IORING_OFF_SQES);
+  if (reader->sqes == MAP_FAILED) {
+    reader->sqes = NULL;
+    return -1;
+  }
+
+  sq = (BYTE *)reader->sqRing;
+  reader->sqHead = (unsigned *)(sq + params->sq_off.head);
+  reader->sqTail = (unsigned *)(sq + params->sq_off.tail);
+  reader->sqMask = *(unsigned *)(sq + params->sq_off.ring_mask);
+  reader->sqArray = (unsigned *)(sq + params->sq_off.array);
+
+  cq = (BYTE *)reader->cqRing;
+  reader->cqHead = (unsigned *)(cq + params->cq_off.head);
+  reader->cqTail = (unsigned *)(cq + params->cq_off.tail);
+  reader->cqMask = *(unsigned *)(cq + params->cq_off.ring_mask);
+  reader->cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+
+  return 0;
+}
+
+// Pinned memory counts against RLIMIT_MEMLOCK, so this is allowed to fail.
+static void registerBuffers(struct uringReader *reader) {
+  struct iovec iovecs[URING_MAX_DEPTH];
+  size_t slotSize = reader->headroom + reader->blockSize;
+
+  for (int x = 0; x < reader->depth; x++) {
+    iovecs[x].iov_base = reader->buffers + slotSize * x;
+    iovecs[x].iov_len = slotSize;
+  }
+
+  reader->fixedBuffers = uringRegister(reader->ringFd, IORING_REGISTER_BUFFERS,
+                                       iovecs, reader->depth) == 0;
+}
+
+static void finishSlot(struct uringReader *reader, struct uringSlot *slot,
+                       int result);
+
+static void queueRead(struct uringReader *reader, int index) {
+  struct uringSlot *slot = &reader->slots[index];
+  unsigned tail = *reader->sqTail;
+  struct io_uring_sqe *sqe = &reader->sqes[tail & reader->sqMask];
+
+  slot->done = false;
+  slot->length = 0;
+  slot->queued = reader->nextOffset < reader->fileSize;
+  if (!slot->queued) {
+    return;
+  }
+
+  slot->offset = reader->nextOffset;
+  slot->wanted = reader->blockSize;
+  if ((uint64_t)(reader->fileSize - slot->offset) < slot->wanted) {
+    slot->wanted = reader->fileSize - slot->offset;
+  }
+  reader->nextOffset += slot->wanted;
+
+  if (reader->failed) {
+    finishSlot(reader, slot, -1);
+    return;
+  }
+
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = reader->fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->fd = reader->fd;
+  sqe->off = slot->offset;
+  sqe->addr = (uint64_t)(uintptr_t)slot->block;
+  sqe->len = (uint32_t)slot->wanted;
+  if (reader->fixedBuffers) {
+    sqe->buf_index = (uint16_t)index;
+  }
+  sqe->user_data = index;
+
+  reader->sqArray[tail & reader->sqMask] = tail & reader->sqMask;
+  __atomic_store_n(reader->sqTail, tail + 1, __ATOMIC_RELEASE);
+  reader->toSubmit++;
+}
+
+/*
+ * io_uring may return short reads, and older kernels don't know
+ * IORING_OP_READ. Both are finished with a plain pread.
+ */
+static void finishSlot(struct uringReader *reader, struct uringSlot *slot,
+                       int result) {
+  size_t total = result > 0 ? (size_t)result : 0;
+
+  while (total < slot->wanted) {
+    ssize_t count = pread(reader->fd, slot->block + total,
+                          slot->wanted - total, slot->offset + total);
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("pread()");
+      break;
+    }
+    if (count == 0) {
+      break;
+    }
+    total += count;
+  }
+
+  slot->length = total;
+  slot->done = true;
+}
+
+/*
+ * Takes back the reads the kernel hasn't seen, and reads them with pread.
+ * The submitted ones still belong to the kernel until they are reaped.
+ */
+static void failReader(struct uringReader *reader) {
+  unsigned tail = *reader->sqTail - reader->toSubmit;
+
+  __atomic_store_n(reader->sqTail, tail, __ATOMIC_RELEASE);
+  for (unsigned x = 0; x < reader->toSubmit; x++) {
+    struct io_uring_sqe *sqe = &reader->sqes[(tail + x) & reader->sqMask];
+    finishSlot(reader, &reader->slots[sqe->user_data], -1);
+  }
+  reader->toSubmit = 0;
+  reader->failed = true;
+}
+
+/*
+ * The submitted reads can't be reaped, so the kernel may write into their
+ * slots at any time. They are read again into spare buffers, and 'buffers'
+ * is leaked by closeUringReader.
+ */
+static void abandonReader(struct uringReader *reader) {
+  size_t slotSize = reader->headroom + reader->blockSize;
+
+  for (int x = 0; x < reader->depth; x++) {
+    struct uringSlot *slot = &reader->slots[x];
+
+    if (!slot->queued || slot->done) {
+      continue;
+    }
+    slot->spare = (BYTE *)alignedAlloc(4096, slotSize);
+    if (slot->spare == NULL) {
+      perror("malloc()");
+      slot->length = 0;
+      slot->done = true;
+      continue;
+    }
+    slot->block = slot->spare + reader->headroom;
+    finishSlot(reader, slot, -1);
+  }
+  reader->inFlight = 0;
+  reader->abandoned = true;
+}
+
+// Submits the queued reads and waits for at least 'minComplete' of them.
+static void submitAndWait(struct uringReader *reader, unsigned minComplete) {
+  unsigned head;
+
+  if (reader->abandoned) {
+    return;
+  }
+
+  while (reader->toSubmit > 0 || minComplete > 0) {
+    int result = uringEnter(reader->ringFd, reader->toSubmit, minComplete,
+                            minComplete > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EBUSY) {
+        break; // Reap the completions first.
+      }
+      perror("io_uring_enter()");
+      if (reader->failed) {
+        abandonReader(reader);
+        return;
+      }
+      // Only wait for what the kernel already has.
+      failReader(reader);
+      if (reader->inFlight == 0) {
+        break;
+      }
+      continue;
+    }
+    if ((unsigned)result > reader->toSubmit) {
+      result = (int)reader->toSubmit;
+    }
+    reader->toSubmit -= result;
+    reader->inFlight += result;
+    if (minComplete > 0) {
+      break;
+    }
+  }
+
+  head = *reader->cqHead;
+  while (head != __atomic_load_n(reader->cqTail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe = &reader->cqes[head & reader->cqMask];
+    finishSlot(reader, &reader->slots[cqe->user_data], cqe->res);
+    reader->inFlight--;
+    head++;
+  }
+  __atomic_store_n(reader->cqHead, head, __ATOMIC_RELEASE);
+}
+
+static void waitForSlot(struct uringReader *reader, int index) {
+  while (!reader->slots[index].done) {
+    submitAndWait(reader, 1);
+  }
+}
+
+// Reaps every submitted read, so that no slot is still owned by the kernel.
+static void drainReader(struct uringReader *reader) {
+  submitAndWait(reader, 0);
+  while (reader->inFlight > 0) {
+    submitAndWait(reader, 1);
+  }
+}
+
+// Throws away every queued read and queues the ring again from 'offset'.
+static void restartReader(struct uringReader *reader, int64_t offset) {
+  drainReader(reader);
+
+  reader->nextOffset = offset;
+  reader->next = 0;
+  reader->current = -1;
+  reader->started = true;
+  for (int x = 0; x < reader->depth; x++) {
+    queueRead(reader, x);
+  }
+  submitAndWait(reader, 0);
+}
+
+struct uringReader *openUringReader(int fd, int64_t fileSize, size_t headroom,
+                                    size_t blockSize, int depth) {
+  struct io_uring_params params;
+  struct uringReader *reader;
+  size_t slotSize = headroom + blockSize;
+
+  if (fileSize < 0 || blockSize > UINT32_MAX) {
+    return NULL;
+  }
+  if (depth > URING_MAX_DEPTH) {
+    depth = URING_MAX_DEPTH;
+  }
+
+  reader = (struct uringReader *)calloc(1, sizeof(struct uringReader));
+  if (reader == NULL) {
+    return NULL;
+  }
+  reader->fd = fd;
+  reader->fileSize = fileSize;
+  reader->headroom = headroom;
+  reader->blockSize = blockSize;
+  reader->depth = depth;
+  reader->current = -1;
+
+  memset(&params, 0, sizeof(params));
+  reader->ringFd = uringSetup(depth, &params);
+  if (reader->ringFd == -1) {
+    // ENOSYS on old kernels, EPERM when it's disabled or in a sandbox.
+    free(reader);
+    return NULL;
+  }
+
+  reader->buffers = (BYTE *)alignedAlloc(4096, slotSize * depth);
+  if (reader->buffers == NULL || mapRings(reader, &params) == -1) {
+    closeUringReader(reader);
+    return NULL;
+  }
+  for (int x = 0; x < depth; x++) {
+    reader->slots[x].block = reader->buffers + slotSize * x + headroom;
+  }
+  registerBuffers(reader);
+
+  return reader;
+}
+
+BYTE *nextUringBlock(struct uringReader *reader, const BYTE *carry,
+                     size_t carryLength, size_t *length) {
+  struct uringSlot *slot;
+
+  if (!reader->started) {
+    restartReader(reader, reader->nextOffset);
+  }
+
+  slot = &reader->slots[reader->next];
+  if (!slot->queued) {
+    *length = 0;
+    return NULL;
+  }
+  waitForSlot(reader, reader->next);
+
+  if (carryLength > 0) {
+    memcpy(slot->block - carryLength, carry, carryLength);
+  }
+
+  // 'carry' was the last thing needed from the previous block.
+  if (reader->current != -1) {
+    queueRead(reader, reader->current);
+    submitAndWait(reader, 0);
+  }
+  reader->current = reader->next;
+  reader->next = (reader->next + 1) % reader->depth;
+
+  *length = slot->length;
+  return slot->block;
+}
+
+int64_t seekUringReader(struct uringReader *reader, int64_t offset) {
+  if (!reader->started || offset >= reader->nextOffset) {
+    restartReader(reader, offset);
+    return offset;
+  }
+
+  // The caller is done with the current block.
+  if (reader->current != -1) {
+    queueRead(reader, reader->current);
+    reader->current = -1;
+  }
+
+  // Recycle the queued blocks which are completely behind 'offset'.
+  while (reader->slots[reader->next].queued) {
+    struct uringSlot *slot = &reader->slots[reader->next];
+
+    if (offset < slot->offset) {
+      break;
+    }
+    if (offset < slot->offset + (int64_t)slot->wanted) {
+      submitAndWait(reader, 0);
+      return slot->offset;
+    }
+    waitForSlot(reader, reader->next);
+    queueRead(reader, reader->next);
+    reader->next = (reader->next + 1) % reader->depth;
+  }
+
+  restartReader(reader, offset);
+  return offset;
+}
+
+void closeUringReader(struct uringReader *reader) {
+  if (reader == NULL) {
+    return;
+  }
+
+  // The kernel may still be writing into the buffers.
+  if (reader->sqes != NULL) {
+    drainReader(reader);
+  }
+  for (int x = 0; x < reader->depth; x++) {
+    alignedFree(reader->slots[x].spare);
+  }
+
+  if (reader->sqes != NULL) {
+    munmap(reader->sqes, reader->sqesSize);
+  }
+  if (reader->cqRing != NULL && reader->cqRing != reader->sqRing) {
+    munmap(reader->cqRing, reader->cqRingSize);
+  }
+  if (reader->sqRing != NULL) {
+    munmap(reader->sqRing, reader->sqRingSize);
+  }
+  close(reader->ringFd);
+
+  if (!reader->abandoned) {
+    alignedFree(reader->buffers);
+  }
+  free(reader);
+}
+
+#else
+
+struct uringReader *openUringReader(int fd, int64_t fileSize, size_t headroom,
+                                    size_t blockSize, int depth) {
+  (void)fd;
+  (void)fileSize;
+  (void)headroom;
+  (void)blockSize;
+  (void)depth;
+  return NULL;
+}
+
+BYTE *nextUringBlock(struct uringReader *reader, const BYTE *carry,
+                     size_t carryLength, size_t *length) {
+  (void)reader;
+  (void)carry;
+  (void)carryLength;
+  *length = 0;
+  return NULL;
+}
+
+int64_t seekUringReader(struct uringReader *reader, int64_t offset) {
+  (void)reader;
+  return offset;
+}
+
+void closeUringReader(struct uringReader *reader) { (void)reader; }
+
+#endif
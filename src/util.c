@@ -22,16 +22,22 @@
  * SOFTWARE.
  */
 #define _FILE_OFFSET_BITS 64
+#include <ctype.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef _WIN32
 #include <direct.h> // _mkdir
+#include <fcntl.h>  // _O_BINARY
+#include <io.h>     // _setmode
+#include <malloc.h> // _aligned_malloc
 #endif
 
 #include "util.h"
@@ -51,6 +57,89 @@ const char *getFileExt(const char *fileName) {
   return fileName + index + 1;
 }
 
+// True if 'fileName' has one of the extensions an input file can have.
+bool hasInputExt(const char *fileName) {
+  const char *inputExts[8] = {"mvc", "h264", "264", "m2ts",
+                              "mts", "ts",   "mkv", "ssif"};
+  const char *fileExt = getFileExt(fileName);
+
+  if (fileExt == fileName) {
+    return false; // There's no '.' at all.
+  }
+  for (int x = 0; x < 8; x++) {
+    size_t y = 0;
+
+    while (fileExt[y] != '\0' && tolower(fileExt[y]) == inputExts[x][y]) {
+      y++;
+    }
+    if (fileExt[y] == '\0' && inputExts[x][y] == '\0') {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Wall clock time, for measuring how long something took.
+double currentSeconds() {
+  struct timespec now;
+
+  timespec_get(&now, TIME_UTC);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Writes 'text' as a JSON string.
+void writeJSONString(FILE *out, const char *text) {
+  fputc('"', out);
+  for (; *text != '\0'; text++) {
+    unsigned char c = (unsigned char)*text;
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/*
+ * 'path' from the root, so it still works for a process that's in another
+ * folder. '-' (stdin) is kept as it is. Returns a string that has to be freed
+ * or NULL.
+ */
+char *absolutePath(const char *path) {
+#ifdef _WIN32
+  if (strcmp(path, "-") == 0) {
+    return strdup(path);
+  }
+  return _fullpath(NULL, path, 0);
+#else
+  char *folder;
+  char *fullPath;
+  size_t size;
+
+  if (path[0] == '/' || strcmp(path, "-") == 0) {
+    return strdup(path);
+  }
+
+  folder = getcwd(NULL, 0);
+  if (folder == NULL) {
+    perror("getcwd()");
+    return NULL;
+  }
+  size = strlen(folder) + strlen(path) + 2;
+  fullPath = (char *)malloc(size);
+  if (fullPath != NULL) {
+    snprintf(fullPath, size, "%s/%s", folder, path);
+  }
+  free(folder);
+
+  return fullPath;
+#endif
+}
+
 void free2DArray(void ***array, int array2DSize) {
   for (int x = 0; x < array2DSize; x++) {
     free((*array)[x]);
@@ -58,6 +147,100 @@ void free2DArray(void ***array, int array2DSize) {
   free(*array);
 }
 
+// Allocates 'size' bytes aligned to 'alignment' (a power of two).
+// Must be freed with 'alignedFree'.
+void *alignedAlloc(size_t alignment, size_t size) {
+#ifdef _WIN32
+  return _aligned_malloc(size, alignment);
+#else
+  void *memory = NULL;
+
+  if (posix_memalign(&memory, alignment, size) != 0) {
+    return NULL;
+  }
+
+  return memory;
+#endif
+}
+
+void alignedFree(void *memory) {
+#ifdef _WIN32
+  _aligned_free(memory);
+#else
+  free(memory);
+#endif
+}
+
+// 64 bit FNV-1a. Start with HASH_SEED.
+uint64_t hashBytes(uint64_t hash, const BYTE *data, size_t length) {
+  for (size_t x = 0; x < length; x++) {
+    hash = (hash ^ data[x]) * 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+// Stores the low 'size' bytes of 'value' little-endian.
+void writeLE(BYTE *data, uint64_t value, int size) {
+  for (int x = 0; x < size; x++) {
+    data[x] = (BYTE)(value >> (x * 8));
+  }
+}
+
+uint64_t readLE(const BYTE *data, int size) {
+  uint64_t value = 0;
+
+  for (int x = 0; x < size; x++) {
+    value |= (uint64_t)data[x] << (x * 8);
+  }
+
+  return value;
+}
+
+/*
+ * Writes 'data' to '<path>.tmp' and renames that over 'path', so a run that
+ * dies half way through leaves the old file alone.
+ */
+int replaceFile(const char *path, const BYTE *data, size_t size) {
+  size_t tempSize = strlen(path) + 5;
+  char *tempPath = (char *)malloc(tempSize);
+  FILE *filePtr;
+  int result = 0;
+
+  if (tempPath == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+  snprintf(tempPath, tempSize, "%s.tmp", path);
+  filePtr = fopen(tempPath, "wb");
+  if (filePtr == NULL) {
+    perror("fopen()");
+    printf("Failed to open: %s\n", tempPath);
+    free(tempPath);
+    return -1;
+  }
+  if (fwrite(data, 1, size, filePtr) != size) {
+    perror("fwrite()");
+    result = -1;
+  }
+  if (fclose(filePtr) != 0) {
+    result = -1;
+  }
+  if (result == 0) {
+    remove(path); // Windows won't rename over it.
+    if (rename(tempPath, path) != 0) {
+      perror("rename()");
+      result = -1;
+    }
+  }
+  if (result == -1) {
+    remove(tempPath);
+  }
+  free(tempPath);
+
+  return result;
+}
+
 /*
  * This is slightly modified version of the 'searchNative' function
  * made by Stephan Brumme, and is under the ZLib license.
@@ -204,3 +387,25 @@ char *basename(char *path) {
   return path;
 }
 #endif
+
+/*
+ * Moves the real stdout to a new descriptor and returns it. The 'stdout'
+ * everything else prints to becomes stderr, so only what's written to the
+ * new descriptor ends up in the output. Returns -1 if it can't be moved.
+ */
+int takeStdout() {
+  int fd;
+
+  fflush(stdout);
+  fd = dup(STDOUT_FILENO);
+  if (fd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+    perror("dup()");
+    return -1;
+  }
+#ifdef _WIN32
+  _setmode(fd, _O_BINARY);
+#endif
+  setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+  return fd;
+}
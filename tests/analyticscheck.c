@@ -0,0 +1,359 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks the depth stats against what the old report worked out a frame at a
+ * time, with the planes added whole (SSE2 when there is more than 16 depths)
+ * and in pieces of at most 16 (always scalar). Also checks that planes added
+ * a GOP at a time, like while streaming, are grouped by hash the same way as
+ * comparing their bytes.
+ *
+ * Usage: analyticscheck [seed]
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analytics.h"
+#include "util.h"
+
+#define NUM_KINDS 10
+#define NUM_TEST_PLANES 12
+#define MAX_GOP_SIZE 200
+
+// What 'parseDepths' printed, worked out the same way.
+struct reference {
+  int minval;
+  int maxval;
+  int64_t total;
+  int undefined;
+  int firstframe;
+  int lastframe;
+  int lastval;
+  int cuts;
+};
+
+// Adds the depths whole, in pieces of 1-16, or in pieces up to a GOP.
+enum addMode { ADD_WHOLE, ADD_SMALL, ADD_GOPS };
+
+static const char *modeNames[3] = {"whole", "in small pieces",
+                                   "a GOP at a time"};
+
+static uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+static void referenceDepths(const BYTE *plane, int numFrames,
+                            struct reference *ref) {
+  int byte;
+
+  ref->minval = 128;
+  ref->maxval = -128;
+  ref->total = 0;
+  ref->undefined = 0;
+  ref->firstframe = -1;
+  ref->lastframe = -1;
+  ref->lastval = 0;
+  ref->cuts = 0;
+  for (int i = 0; i < numFrames; i++) {
+    byte = plane[i];
+    if (byte != ref->lastval) {
+      ref->cuts++;
+      ref->lastval = byte;
+    }
+    if (byte == 128) {
+      ref->undefined += 1;
+      continue;
+    } else {
+      ref->lastframe = i;
+      if (ref->firstframe == -1) {
+        ref->firstframe = i;
+      }
+    }
+
+    if (byte > 128) {
+      byte = 128 - byte;
+    }
+
+    if (byte < ref->minval) {
+      ref->minval = byte;
+    }
+    if (byte > ref->maxval) {
+      ref->maxval = byte;
+    }
+    ref->total += byte;
+  }
+}
+
+/*
+ * Random depths, runs of them, every depth undefined, +127, -127, both of
+ * them, only the first or last depth defined, 0, and a mix of the extremes.
+ */
+static void fillPlane(int kind, BYTE *plane, int numFrames, uint32_t *seed) {
+  const BYTE extremes[5] = {0x00, 0x7F, 0x80, 0x81, 0xFF};
+
+  for (int x = 0; x < numFrames;) {
+    int run = kind == 1 ? 1 + nextRandom(seed) % 40 : 1;
+    BYTE depth;
+
+    switch (kind) {
+    case 0:
+    case 1:
+      depth = nextRandom(seed) % 4 == 0 ? 0x80 : (BYTE)nextRandom(seed);
+      break;
+    case 3:
+      depth = 0x7F;
+      break;
+    case 4:
+      depth = 0x81;
+      break;
+    case 5:
+      depth = nextRandom(seed) % 2 == 0 ? 0x7F : 0x81;
+      break;
+    case 6:
+      depth = x == 0 ? 0x81 : 0x80;
+      break;
+    case 7:
+      depth = x == numFrames - 1 ? 0x7F : 0x80;
+      break;
+    case 8:
+      depth = 0x00;
+      break;
+    case 9:
+      depth = extremes[nextRandom(seed) % 5];
+      break;
+    default:
+      depth = 0x80;
+      break;
+    }
+    for (; run > 0 && x < numFrames; run--, x++) {
+      plane[x] = depth;
+    }
+  }
+}
+
+// The GOP sizes come from 'gopSeed', so every plane gets the same pieces.
+static void addPlane(struct depthStats *stats, const BYTE *plane,
+                     int numFrames, enum addMode mode, uint32_t gopSeed) {
+  int done = 0;
+
+  initDepthStats(stats);
+  while (done < numFrames) {
+    int count = numFrames - done;
+
+    if (mode == ADD_SMALL) {
+      count = 1 + nextRandom(&gopSeed) % 16;
+    } else if (mode == ADD_GOPS) {
+      count = 1 + nextRandom(&gopSeed) % MAX_GOP_SIZE;
+    }
+    if (count > numFrames - done) {
+      count = numFrames - done;
+    }
+    addDepths(stats, plane + done, count);
+    done += count;
+  }
+}
+
+static bool sameStats(const struct depthStats *stats,
+                      const struct reference *ref, int numFrames) {
+  return stats->numFrames == numFrames && stats->minval == ref->minval &&
+         stats->maxval == ref->maxval && stats->total == ref->total &&
+         stats->undefined == ref->undefined &&
+         stats->firstframe == ref->firstframe &&
+         stats->lastframe == ref->lastframe &&
+         stats->lastval == ref->lastval && stats->cuts == ref->cuts &&
+         hasDefinedStats(stats) == (ref->undefined < numFrames);
+}
+
+static bool checkStats(int kind, int numFrames, uint32_t *seed) {
+  BYTE *plane = (BYTE *)malloc(numFrames);
+  struct reference ref;
+  bool same = true;
+
+  if (plane == NULL) {
+    perror("malloc()");
+    return false;
+  }
+  fillPlane(kind, plane, numFrames, seed);
+  referenceDepths(plane, numFrames, &ref);
+
+  for (int mode = ADD_WHOLE; mode <= ADD_GOPS; mode++) {
+    struct depthStats stats;
+
+    addPlane(&stats, plane, numFrames, (enum addMode)mode, nextRandom(seed));
+    if (!sameStats(&stats, &ref, numFrames)) {
+      printf("Kind %d, %d frames, added %s: min %d/%d max %d/%d "
+             "total %lld/%lld undefined %d/%d first %d/%d last %d/%d "
+             "cuts %d/%d\n",
+             kind, numFrames, modeNames[mode], stats.minval, ref.minval,
+             stats.maxval, ref.maxval, (long long)stats.total,
+             (long long)ref.total, stats.undefined, ref.undefined,
+             stats.firstframe, ref.firstframe, stats.lastframe,
+             ref.lastframe, stats.cuts, ref.cuts);
+      same = false;
+    }
+  }
+  free(plane);
+
+  return same;
+}
+
+/*
+ * Copies of planes, and copies with one depth changed at the start, the
+ * end, and just after the first 16.
+ */
+static void fillTestPlanes(BYTE **planes, int numFrames, uint32_t *seed) {
+  const int kinds[4] = {0, 1, 2, 9};
+  const int changed[3] = {0, numFrames - 1, 17 % numFrames};
+
+  for (int x = 0; x < 4; x++) {
+    fillPlane(kinds[x], planes[x], numFrames, seed);
+  }
+  memcpy(planes[4], planes[1], numFrames);
+  memcpy(planes[5], planes[0], numFrames);
+  memcpy(planes[6], planes[2], numFrames);
+  memcpy(planes[7], planes[1], numFrames);
+  for (int x = 0; x < 3; x++) {
+    memcpy(planes[8 + x], planes[1], numFrames);
+    planes[8 + x][changed[x]] ^= 0x01;
+  }
+  fillPlane(3, planes[11], numFrames, seed);
+}
+
+// Plane x is in the class of the first plane with the same bytes.
+static bool checkGroups(const struct planeAnalytics *analytics,
+                        BYTE *const *planes, int numFrames,
+                        const char *name) {
+  int numDefined = 0;
+  int numClasses = 0;
+  bool same = true;
+
+  for (int x = 0; x < NUM_TEST_PLANES; x++) {
+    uint32_t identical = 0;
+    int classOf = -1;
+
+    for (int y = 0; y < NUM_TEST_PLANES; y++) {
+      if (memcmp(planes[x], planes[y], numFrames) == 0) {
+        identical |= (uint32_t)1 << y;
+        classOf = classOf == -1 ? y : classOf;
+      }
+    }
+    numClasses += classOf == x;
+    for (int y = 0; y < numFrames; y++) {
+      if (planes[x][y] != 0x80) {
+        numDefined++;
+        break;
+      }
+    }
+
+    if (analytics->classOf[x] != classOf ||
+        analytics->identical[x] != identical) {
+      printf("%d frames, %s: 3D-Plane #%02d is in class %d with 0x%08x, "
+             "not %d with 0x%08x.\n",
+             numFrames, name, x, analytics->classOf[x],
+             analytics->identical[x], classOf, identical);
+      same = false;
+    }
+  }
+  if (analytics->numClasses != numClasses ||
+      analytics->numDefined != numDefined) {
+    printf("%d frames, %s: %d classes and %d defined, not %d and %d.\n",
+           numFrames, name, analytics->numClasses, analytics->numDefined,
+           numClasses, numDefined);
+    same = false;
+  }
+
+  return same;
+}
+
+static bool checkGrouping(int numFrames, uint32_t *seed) {
+  BYTE *planes[NUM_TEST_PLANES];
+  struct planeAnalytics analytics;
+  uint32_t gopSeed = nextRandom(seed);
+  bool same = true;
+
+  for (int x = 0; x < NUM_TEST_PLANES; x++) {
+    planes[x] = (BYTE *)malloc(numFrames);
+    if (planes[x] == NULL) {
+      perror("malloc()");
+      while (x-- > 0) {
+        free(planes[x]);
+      }
+      return false;
+    }
+  }
+  fillTestPlanes(planes, numFrames, seed);
+
+  analyzePlanes(planes, NUM_TEST_PLANES, numFrames, &analytics);
+  same = checkGroups(&analytics, planes, numFrames, "compared") && same;
+
+  // The hashes are all there is while streaming.
+  analytics.numOfPlanes = NUM_TEST_PLANES;
+  for (int x = 0; x < NUM_TEST_PLANES; x++) {
+    addPlane(&analytics.stats[x], planes[x], numFrames, ADD_GOPS, gopSeed);
+  }
+  groupIdenticalPlanes(&analytics, NULL);
+  same = checkGroups(&analytics, planes, numFrames, "hashed") && same;
+
+  for (int x = 0; x < NUM_TEST_PLANES; x++) {
+    free(planes[x]);
+  }
+
+  return same;
+}
+
+int main(int argc, char *argv[]) {
+  const int frameCounts[] = {1, 2, 15, 16, 17, 18, 31, 32,
+                             33, 47, 64, 65, 1000, 4099};
+  uint32_t seed = argc >= 2 ? (uint32_t)atol(argv[1]) : 0x3D3D3D3D;
+  int numChecked = 0;
+  bool same = true;
+
+  if (seed == 0) {
+    seed = 1;
+  }
+
+  for (size_t x = 0; x < sizeof(frameCounts) / sizeof(frameCounts[0]); x++) {
+    for (int kind = 0; kind < NUM_KINDS; kind++) {
+      for (int repeat = 0; repeat < 4; repeat++) {
+        same = checkStats(kind, frameCounts[x], &seed) && same;
+        numChecked++;
+      }
+    }
+    same = checkGrouping(frameCounts[x], &seed) && same;
+  }
+
+  if (same) {
+    printf("%d 3D-Planes have the same stats added whole, in small pieces, "
+           "and a GOP at a time.\n",
+           numChecked);
+  }
+
+  return same ? 0 : 1;
+}
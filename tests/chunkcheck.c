@@ -0,0 +1,203 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks that the push parser finds the same OFMDs, at the same offsets, no
+ * matter how the stream is split up. Start codes, SEIs, and emulation
+ * prevention bytes end up split between 'ofsFeed' calls, which a stream fed
+ * in one go never has.
+ *
+ * Usage: chunkcheck <stream> [seed]
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ofsextractor.h"
+
+#define MAX_CHUNK_SIZE (4096)
+
+// Every OFMD's offset, length, and bytes, one after another.
+struct OFMDlog {
+  uint8_t *data;
+  size_t length;
+  size_t capacity;
+  bool failed;
+};
+
+static void logBytes(struct OFMDlog *log, const void *data, size_t length) {
+  if (log->length + length > log->capacity) {
+    size_t capacity = log->capacity > 0 ? log->capacity * 2 : 65536;
+    uint8_t *grown;
+
+    while (capacity < log->length + length) {
+      capacity *= 2;
+    }
+    grown = (uint8_t *)realloc(log->data, capacity);
+    if (grown == NULL) {
+      log->failed = true;
+      return;
+    }
+    log->data = grown;
+    log->capacity = capacity;
+  }
+  memcpy(log->data + log->length, data, length);
+  log->length += length;
+}
+
+static int logOFMD(void *user, const uint8_t *OFMD, size_t length,
+                   int64_t offset) {
+  struct OFMDlog *log = (struct OFMDlog *)user;
+
+  logBytes(log, &offset, sizeof(offset));
+  logBytes(log, &length, sizeof(length));
+  logBytes(log, OFMD, length);
+
+  return 0;
+}
+
+// xorshift, so every run splits the stream the same way.
+static uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/*
+ * Feeds 'stream' in chunks of 'chunkSize' bytes or random sizes up to
+ * MAX_CHUNK_SIZE if it's 0. Returns -1 if the extractor failed.
+ */
+static int extract(const uint8_t *stream, size_t size, size_t chunkSize,
+                   uint32_t seed, struct OFMDlog *log) {
+  struct ofsConfig config = {OFS_FORMAT_AUTO, false, logOFMD, NULL, log};
+  struct ofsExtractor *ofs = ofsCreate(&config);
+  size_t pos = 0;
+  int result = 0;
+
+  memset(log, 0, sizeof(struct OFMDlog));
+  if (ofs == NULL) {
+    return -1;
+  }
+  while (pos < size && result == 0) {
+    size_t length = chunkSize > 0 ? chunkSize
+                                  : 1 + nextRandom(&seed) % MAX_CHUNK_SIZE;
+
+    if (length > size - pos) {
+      length = size - pos;
+    }
+    result = ofsFeed(ofs, stream + pos, length);
+    pos += length;
+  }
+  if (result == 0) {
+    result = ofsFinish(ofs);
+  }
+  ofsDestroy(ofs);
+
+  return result == 0 && !log->failed ? 0 : -1;
+}
+
+static uint8_t *readStream(const char *filename, size_t *size) {
+  FILE *filePtr = fopen(filename, "rb");
+  uint8_t *stream = NULL;
+  size_t capacity = 0;
+
+  *size = 0;
+  if (filePtr == NULL) {
+    perror("fopen()");
+    printf("Failed to open '%s'\n", filename);
+    return NULL;
+  }
+  while (!feof(filePtr) && !ferror(filePtr)) {
+    if (*size == capacity) {
+      uint8_t *grown;
+
+      capacity = capacity > 0 ? capacity * 2 : 1024 * 1024;
+      grown = (uint8_t *)realloc(stream, capacity);
+      if (grown == NULL) {
+        perror("realloc()");
+        break;
+      }
+      stream = grown;
+    }
+    *size += fread(stream + *size, 1, capacity - *size, filePtr);
+  }
+  if (ferror(filePtr) || !feof(filePtr)) {
+    free(stream);
+    stream = NULL;
+  }
+  fclose(filePtr);
+
+  return stream;
+}
+
+int main(int argc, char *argv[]) {
+  struct OFMDlog whole;
+  struct OFMDlog chunked;
+  uint32_t seed = argc >= 3 ? (uint32_t)atol(argv[2]) : 0x3D3D3D3D;
+  const size_t chunkSizes[] = {1, 0};
+  uint8_t *stream;
+  size_t size;
+  bool same = true;
+
+  if (argc < 2) {
+    printf("Usage: %s <stream> [seed]\n", argv[0]);
+    return 1;
+  }
+  stream = readStream(argv[1], &size);
+  if (stream == NULL) {
+    return 1;
+  }
+
+  if (extract(stream, size, size, seed, &whole) == -1 || whole.length == 0) {
+    printf("No OFMDs were found in '%s'\n", argv[1]);
+    free(whole.data);
+    free(stream);
+    return 1;
+  }
+
+  for (size_t x = 0; x < sizeof(chunkSizes) / sizeof(chunkSizes[0]); x++) {
+    const char *name = chunkSizes[x] == 1 ? "1 byte" : "random size";
+
+    if (extract(stream, size, chunkSizes[x], seed == 0 ? 1 : seed,
+                &chunked) == -1) {
+      printf("The extractor failed with %s chunks.\n", name);
+      same = false;
+    } else if (chunked.length != whole.length ||
+               memcmp(chunked.data, whole.data, whole.length) != 0) {
+      printf("The OFMDs are different with %s chunks.\n", name);
+      same = false;
+    } else {
+      printf("Same OFMDs with %s chunks.\n", name);
+    }
+    free(chunked.data);
+  }
+
+  free(whole.data);
+  free(stream);
+
+  return same ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks that the runs of a stream's 3D-Planes give back the planes: slices
+ * of them, their stats, the runs built while streaming, and the sidecar
+ * after it's been written and read back. The planes are compared with the
+ * dense ones.
+ *
+ * Usage: rlecheck <stream> <folder for the OFS files and sidecar> [seed]
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "3dplanes.h"
+#include "analytics.h"
+#include "ofs.h"
+#include "rle.h"
+#include "util.h"
+
+#define NUM_SLICES (1000)
+#define MAX_SLICE_SIZE (300)
+
+static uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// Slices that start anywhere, some of them running past the last frame.
+static bool checkSlices(const struct OFMDdata *dense,
+                        const struct rlePlanes *rle, uint32_t seed) {
+  BYTE slice[MAX_SLICE_SIZE];
+  int numFrames = dense->totalFrames;
+
+  for (int plane = 0; plane < dense->numOfPlanes; plane++) {
+    BYTE *whole = (BYTE *)malloc(numFrames);
+
+    if (whole == NULL) {
+      perror("malloc()");
+      return false;
+    }
+    getRLEDepths(&rle->planes[plane], 0, numFrames, whole);
+    if (memcmp(whole, dense->planes[plane], numFrames) != 0) {
+      printf("The runs of 3D-Plane #%02d don't give it back.\n", plane);
+      free(whole);
+      return false;
+    }
+    free(whole);
+
+    for (int x = 0; x < NUM_SLICES; x++) {
+      int first = nextRandom(&seed) % (numFrames + MAX_SLICE_SIZE / 2);
+      int count = 1 + nextRandom(&seed) % MAX_SLICE_SIZE;
+
+      getRLEDepths(&rle->planes[plane], first, count, slice);
+      for (int y = 0; y < count; y++) {
+        BYTE depth = first + y < numFrames ? dense->planes[plane][first + y]
+                                           : 0x80;
+
+        if (slice[y] != depth) {
+          printf("3D-Plane #%02d: frame %d of the slice at %d is wrong.\n",
+                 plane, first + y, first);
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+// The hashes are of different things, so they're left out.
+static bool checkAnalytics(const struct OFMDdata *dense,
+                           const struct rlePlanes *rle) {
+  struct planeAnalytics planes;
+  struct planeAnalytics runs;
+  bool same = true;
+
+  analyzePlanes((BYTE *const *)dense->planes, dense->numOfPlanes,
+                dense->totalFrames, &planes);
+  analyzeRLEPlanes(rle, &runs);
+  for (int x = 0; x < planes.numOfPlanes; x++) {
+    const struct depthStats *a = &planes.stats[x];
+    const struct depthStats *b = &runs.stats[x];
+
+    if (a->numFrames != b->numFrames || a->minval != b->minval ||
+        a->maxval != b->maxval || a->total != b->total ||
+        a->undefined != b->undefined || a->firstframe != b->firstframe ||
+        a->lastframe != b->lastframe || a->lastval != b->lastval ||
+        a->cuts != b->cuts || planes.classOf[x] != runs.classOf[x] ||
+        planes.identical[x] != runs.identical[x]) {
+      printf("3D-Plane #%02d has different stats from its runs.\n", x);
+      same = false;
+    }
+  }
+  if (runs.numOfPlanes != planes.numOfPlanes ||
+      runs.numDefined != planes.numDefined ||
+      runs.numClasses != planes.numClasses) {
+    printf("The runs have %d 3D-Planes, %d defined, in %d classes, not "
+           "%d, %d, and %d.\n",
+           runs.numOfPlanes, runs.numDefined, runs.numClasses,
+           planes.numOfPlanes, planes.numDefined, planes.numClasses);
+    same = false;
+  }
+
+  return same;
+}
+
+static bool sameRuns(const struct rlePlanes *a, const struct rlePlanes *b,
+                     const int *validPlanes) {
+  if (a->numFrames != b->numFrames) {
+    return false;
+  }
+  for (int plane = 0; plane < a->numOfPlanes; plane++) {
+    if ((validPlanes == NULL || validPlanes[plane] == 1) &&
+        !sameRLEPlanes(&a->planes[plane], &b->planes[plane])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool checkStreamed(const char *filename, const char *folder,
+                          const struct rlePlanes *rle) {
+  struct OFMDdata OFMDdata;
+  struct rlePlanes streamed;
+  bool same = true;
+
+  memset(&OFMDdata, 0, sizeof(struct OFMDdata));
+  OFMDdata.validPlanes = (int *)calloc(MAXPLANES, sizeof(int));
+  if (OFMDdata.validPlanes == NULL) {
+    perror("calloc()");
+    return false;
+  }
+  if (streamOFSFiles(INPUT_BLOCK_SIZE, INPUT_AUTO, &filename, 1, false,
+                     folder, 0, 0, NULL, &streamed, &OFMDdata) <= 0) {
+    printf("Streaming '%s' failed.\n", filename);
+    same = false;
+  } else if (streamed.numOfPlanes != rle->numOfPlanes ||
+             !sameRuns(&streamed, rle, NULL)) {
+    printf("The runs built while streaming are different.\n");
+    same = false;
+  }
+  freeRLEPlanes(&streamed);
+  free(OFMDdata.validPlanes);
+
+  return same;
+}
+
+// Flips a byte in the middle of the sidecar.
+static int damageSidecar(const char *folder) {
+  size_t size = strlen(folder) + strlen(RLE_NAME) + 2;
+  char *path = (char *)malloc(size);
+  FILE *filePtr;
+  long middle;
+  int byte;
+
+  if (path == NULL) {
+    perror("malloc()");
+    return -1;
+  }
+  snprintf(path, size, "%s" PATH_SEPARATOR "%s", folder, RLE_NAME);
+  filePtr = fopen(path, "r+b");
+  free(path);
+  if (filePtr == NULL) {
+    return -1;
+  }
+  if (fseek(filePtr, 0, SEEK_END) != 0 ||
+      (middle = ftell(filePtr) / 2) <= 0 ||
+      fseek(filePtr, middle, SEEK_SET) != 0 ||
+      (byte = fgetc(filePtr)) == EOF ||
+      fseek(filePtr, middle, SEEK_SET) != 0 ||
+      fputc(byte ^ 0x01, filePtr) == EOF) {
+    fclose(filePtr);
+    return -1;
+  }
+
+  return fclose(filePtr) == 0 ? 0 : -1;
+}
+
+static bool checkSidecar(const char *folder, const struct rlePlanes *rle,
+                         const int *validPlanes) {
+  struct rlePlanes read;
+  int readPlanes[MAXPLANES];
+  BYTE frameRate = 0;
+  bool same = true;
+
+  if (writeRLEFile(folder, rle, 0x21, validPlanes) == -1) {
+    printf("The sidecar couldn't be written.\n");
+    return false;
+  }
+  if (readRLEFile(folder, &read, &frameRate, readPlanes) == -1) {
+    printf("The sidecar couldn't be read back.\n");
+    return false;
+  }
+  if (frameRate != 0x21 ||
+      memcmp(readPlanes, validPlanes, MAXPLANES * sizeof(int)) != 0 ||
+      !sameRuns(&read, rle, validPlanes)) {
+    printf("The sidecar has different runs.\n");
+    same = false;
+  }
+  freeRLEPlanes(&read);
+
+  if (damageSidecar(folder) == -1 ||
+      readRLEFile(folder, &read, &frameRate, readPlanes) != -1) {
+    printf("A damaged sidecar was read.\n");
+    same = false;
+  }
+
+  return same;
+}
+
+// Only what this test wrote.
+static void removeOutput(const char *folder) {
+  size_t size = strlen(folder) + strlen(RLE_NAME) + 2;
+  char *path = (char *)malloc(size);
+
+  if (path != NULL) {
+    snprintf(path, size, "%s" PATH_SEPARATOR "%s", folder, RLE_NAME);
+    remove(path);
+    free(path);
+  }
+  for (int plane = 0; plane < MAXPLANES; plane++) {
+    if ((path = makeOFSPath(folder, plane)) != NULL) {
+      remove(path);
+      free(path);
+    }
+  }
+  delDirectory(folder);
+}
+
+int main(int argc, char *argv[]) {
+  struct OFMDdata dense;
+  struct rlePlanes rle;
+  uint32_t seed = argc >= 4 ? (uint32_t)atol(argv[3]) : 0x3D3D3D3D;
+  bool same = true;
+
+  if (argc < 3) {
+    printf("Usage: %s <stream> <folder> [seed]\n", argv[0]);
+    return 1;
+  }
+  if (makeDirectory(argv[2]) == -1) {
+    return 1;
+  }
+  setQuietReports(true);
+
+  memset(&dense, 0, sizeof(struct OFMDdata));
+  dense.validPlanes = (int *)calloc(MAXPLANES, sizeof(int));
+  if (dense.validPlanes == NULL) {
+    perror("calloc()");
+    return 1;
+  }
+  if (getPlanesInFiles(INPUT_BLOCK_SIZE, INPUT_AUTO, 1,
+                       (const char **)&argv[1], 1, false, NULL, &dense) <= 0) {
+    printf("No OFMDs were found in '%s'\n", argv[1]);
+    free(dense.validPlanes);
+    return 1;
+  }
+  verifyPlanes(dense);
+  if (encodeRLEPlanes(dense.planes, dense.numOfPlanes, dense.totalFrames,
+                      &rle) == -1) {
+    freePlanes(&dense);
+    free(dense.validPlanes);
+    return 1;
+  }
+
+  same = checkSlices(&dense, &rle, seed == 0 ? 1 : seed) && same;
+  same = checkAnalytics(&dense, &rle) && same;
+  same = checkStreamed(argv[1], argv[2], &rle) && same;
+  same = checkSidecar(argv[2], &rle, dense.validPlanes) && same;
+  if (same) {
+    printf("%d 3D-Planes, %d frames. The runs give back the same planes.\n",
+           dense.numOfPlanes, dense.totalFrames);
+  }
+  removeOutput(argv[2]);
+
+  freeRLEPlanes(&rle);
+  freePlanes(&dense);
+  free(dense.validPlanes);
+
+  return same ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 James McClain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks that a scan split into ranges on several threads gets the same
+ * planes as a scan on one thread, byte for byte.
+ *
+ * Usage: threadcheck <stream> <threads> [smallest range in bytes]
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "3dplanes.h"
+#include "input.h"
+#include "util.h"
+
+// Small enough for a stream of a few MB to get a range for every thread.
+#define TEST_RANGE_SIZE (1024 * 64)
+
+static int getPlanes(const char *filename, int numThreads,
+                     struct OFMDdata *OFMDdata) {
+  memset(OFMDdata, 0, sizeof(struct OFMDdata));
+  return getPlanesInFiles(INPUT_BLOCK_SIZE, INPUT_AUTO, numThreads,
+                          &filename, 1, false, NULL, OFMDdata);
+}
+
+int main(int argc, char *argv[]) {
+  struct OFMDdata serial;
+  struct OFMDdata threaded;
+  int serialOFMDs;
+  int threadedOFMDs;
+  int numThreads;
+  bool same = true;
+
+  if (argc < 3 || (numThreads = atoi(argv[2])) < 2) {
+    printf("Usage: %s <stream> <threads> [smallest range in bytes]\n",
+           argv[0]);
+    return 1;
+  }
+  setQuietReports(true);
+  setMinRangeSize(argc >= 4 ? atoll(argv[3]) : TEST_RANGE_SIZE);
+
+  serialOFMDs = getPlanes(argv[1], 1, &serial);
+  threadedOFMDs = getPlanes(argv[1], numThreads, &threaded);
+  if (serialOFMDs <= 0) {
+    printf("No OFMDs were found in '%s'\n", argv[1]);
+    same = false;
+  } else if (threadedOFMDs != serialOFMDs ||
+             threaded.numOfPlanes != serial.numOfPlanes ||
+             threaded.totalFrames != serial.totalFrames ||
+             threaded.frameRate != serial.frameRate) {
+    printf("1 thread: %d OFMDs, %d 3D-Planes, %d frames, frame rate %d\n",
+           serialOFMDs, serial.numOfPlanes, serial.totalFrames,
+           serial.frameRate);
+    printf("%d threads: %d OFMDs, %d 3D-Planes, %d frames, frame rate %d\n",
+           numThreads, threadedOFMDs, threaded.numOfPlanes,
+           threaded.totalFrames, threaded.frameRate);
+    same = false;
+  }
+
+  for (int plane = 0; same && plane < serial.numOfPlanes; plane++) {
+    if (memcmp(serial.planes[plane], threaded.planes[plane],
+               serial.totalFrames) != 0) {
+      printf("3D-Plane #%02d is different with %d threads.\n", plane,
+             numThreads);
+      same = false;
+    }
+  }
+  if (same) {
+    printf("%d OFMDs, %d 3D-Planes, %d frames. Same with %d threads.\n",
+           serialOFMDs, serial.numOfPlanes, serial.totalFrames, numThreads);
+  }
+
+  freePlanes(&serial);
+  freePlanes(&threaded);
+
+  return same ? 0 : 1;
+}